@@ -29,6 +29,7 @@ friend class Buffer;
 friend class __detail::TextureBase;
 friend class Texture1D;
 friend class Texture2D;
+friend class Texture2DArray;
 
 public:
 
@@ -106,19 +107,72 @@ public:
             addressModeW(VK_SAMPLER_ADDRESS_MODE_REPEAT), borderColor(color)
         { }
 
+        //! equality test on sampler specifications
+        bool operator== (SamplerInfo const &other) const
+        {
+            return (this->magFilter == other.magFilter)
+                && (this->minFilter == other.minFilter)
+                && (this->mipmapMode == other.mipmapMode)
+                && (this->addressModeU == other.addressModeU)
+                && (this->addressModeV == other.addressModeV)
+                && (this->addressModeW == other.addressModeW)
+                && (this->borderColor == other.borderColor);
+        }
+
+        //! hashing sampler specifications
+        struct Hash {
+            std::size_t operator() (SamplerInfo const &info) const
+            {
+                std::size_t h = static_cast<std::size_t>(info.magFilter);
+                h = 31 * h + static_cast<std::size_t>(info.minFilter);
+                h = 31 * h + static_cast<std::size_t>(info.mipmapMode);
+                h = 31 * h + static_cast<std::size_t>(info.addressModeU);
+                h = 31 * h + static_cast<std::size_t>(info.addressModeV);
+                h = 31 * h + static_cast<std::size_t>(info.addressModeW);
+                h = 31 * h + static_cast<std::size_t>(info.borderColor);
+                return h;
+            }
+        };
+
     };
 
-    //! \brief Create a texture sampler as specified
+    //! \brief Create a texture sampler as specified.  The caller owns the sampler
+    //!        and must destroy it; use `acquireSampler` to get a shared sampler.
     //! \param info  a simplified sampler specification
     //! \return the created sampler
     VkSampler createSampler (SamplerInfo const &info);
 
+    //! \brief Get a texture sampler from the application's sampler cache.  All of the
+    //!        requests with the same specification share one sampler, which is
+    //!        reference counted, so each call must be matched by a call to
+    //!        `releaseSampler`.  This function is thread safe.
+    //! \param info  a simplified sampler specification
+    //! \return the shared sampler
+    VkSampler acquireSampler (SamplerInfo const &info);
+
+    //! \brief release a reference to a sampler that was returned by `acquireSampler`.
+    //!        The sampler is destroyed when its last reference is released, so the
+    //!        caller must make sure that the GPU is no longer using it.
+    //! \param sampler  the sampler to release
+    void releaseSampler (VkSampler sampler);
+
+    //! the number of distinct samplers in the sampler cache
+    size_t numCachedSamplers () const
+    {
+        std::lock_guard<std::mutex> lck(this->_samplerMu);
+        return this->_samplerTbl.size();
+    }
+
     //! \brief get the logical device
     VkDevice device () const { return this->_device; }
 
     //! \brief access function for the physical device limits
     const VkPhysicalDeviceLimits *limits () const { return &this->_props()->limits; }
 
+    //! \brief does the device support the BC (aka DXT) block-compressed texture
+    //!        formats?
+    bool hasBCTextures () const { return this->_bcTextures; }
+
     //! \brief access function for the properties of an image format
     VkFormatProperties formatProps (VkFormat fmt) const
     {
@@ -193,6 +247,12 @@ public:
     //! \param cmdBuf the command buffer to submit
     void submitCommands (VkCommandBuffer cmdBuf);
 
+    //! \brief submit the buffer to the graphics queue without waiting for the commands
+    //!        to complete.
+    //! \param cmdBuf the command buffer to submit
+    //! \param fence  the fence that is signaled when the commands have completed
+    void submitCommands (VkCommandBuffer cmdBuf, VkFence fence);
+
     //! \brief free the command buffer
     //! \param cmdBuf the command buffer to free
     void freeCommandBuf (VkCommandBuffer & cmdBuf)
@@ -226,6 +286,19 @@ protected:
     Queues<uint32_t> _qIdxs;    //!< the queue family indices
     Queues<VkQueue> _queues;    //!< the device queues that we are using
     VkCommandPool _cmdPool;     //!< pool for allocating command buffers
+    bool _bcTextures;           //!< set if BC texture compression has been enabled
+
+    //! a shared sampler in the sampler cache
+    struct _CachedSampler {
+        SamplerInfo info;       //!< the specification of the sampler
+        uint32_t refCount;      //!< the number of unreleased `acquireSampler` results
+    };
+
+    mutable std::mutex _samplerMu; //!< protects the sampler cache
+    std::unordered_map<SamplerInfo,VkSampler,SamplerInfo::Hash> _samplerTbl;
+                                //!< the cached samplers indexed by specification
+    std::unordered_map<VkSampler,_CachedSampler> _samplerRefs;
+                                //!< the reference counts of the cached samplers
 
     //! \brief A helper function to create and initialize the Vulkan instance
     //! used by the application.
@@ -305,6 +378,7 @@ protected:
     //! \param tiling   the tiling method for the pixels (device optimal vs linear)
     //! \param usage    flags specifying the usage of the image
     //! \param mipLvls  number of mipmap levels for the image (default = 1)
+    //! \param nLayers  number of array layers for the image (default = 1)
     //! \return the created image
     VkImage _createImage (
         uint32_t wid,
@@ -312,7 +386,8 @@ protected:
         VkFormat format,
         VkImageTiling tiling,
         VkImageUsageFlags usage,
-        uint32_t mipLvls);
+        uint32_t mipLvls,
+        uint32_t nLayers = 1);
 
     //! \brief A helper function for allocating and binding device memory for an image
     //! \param img    the image to allocate memory for
@@ -324,6 +399,17 @@ protected:
     VkImageView _createImageView (
         VkImage image, VkFormat format, VkImageAspectFlags aspectFlags);
 
+    //! \brief A helper function for creating a Vulkan image view object for all of
+    //!        the mipmap levels and array layers of an array image
+    //! \param image        the image
+    //! \param format       the pixel format of the image
+    //! \param aspectFlags  the aspects of the image that the view covers
+    //! \param mipLvls      the number of mipmap levels in the image
+    //! \param nLayers      the number of array layers in the image
+    VkImageView _createArrayImageView (
+        VkImage image, VkFormat format, VkImageAspectFlags aspectFlags,
+        uint32_t mipLvls, uint32_t nLayers);
+
     //! \brief A helper function for changing the layout of an image
     void _transitionImageLayout (
         VkImage image,
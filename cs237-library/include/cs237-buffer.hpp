@@ -56,6 +56,15 @@ protected:
     //! Note that this operation only works for buffers that are "host visible".
     void _copyDataToBuffer (const void *src, size_t offset, size_t sz);
 
+    //! \brief map the buffer's memory object into the host address space.
+    //! \return the address of the mapped memory
+    //!
+    //! Note that this operation only works for buffers that are "host visible".
+    void *_map ();
+
+    //! unmap the buffer's memory object
+    void _unmap ();
+
     //! \brief copy data from the buffer using a staging buffer.
     //! \param dst    the destination for the data
     //! \param offset the source offset in the buffer
@@ -196,6 +205,27 @@ public:
 
 };
 
+//! Buffer class for host-visible staging memory that stays mapped for the lifetime of
+//! the buffer.  Clients write data directly into the mapped memory and then record
+//! commands that copy it to device-local buffers or images.
+class StagingBuffer : public Buffer {
+public:
+
+    //! StagingBuffer constuctor
+    //! \param app  the application pointer
+    //! \param sz   the size (in bytes) of the buffer
+    StagingBuffer (Application *app, size_t sz);
+
+    ~StagingBuffer ();
+
+    //! the address of the mapped memory of the buffer
+    uint8_t *data () const { return this->_data; }
+
+private:
+    uint8_t *_data;             //!< the mapped memory
+
+};
+
 } // namespace cs237
 
 #endif // !_CS237_BUFFER_HPP_
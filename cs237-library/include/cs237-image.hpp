@@ -155,7 +155,14 @@ class Image2D : public __detail::ImageBase {
   //! \param inS the input stream
   //! \param flip set to true if the image should be flipped vertically to match OpenGL
   //!        texture coordinates (default true)
-    Image2D (std::ifstream &inS, bool flip = true);
+    Image2D (std::istream &inS, bool flip = true);
+
+  //! create and initialize an image from PNG data in memory
+  //! \param data the address of the PNG data
+  //! \param nBytes the size of the PNG data in bytes
+  //! \param flip set to true if the image should be flipped vertically to match OpenGL
+  //!        texture coordinates (default true)
+    Image2D (const void *data, size_t nBytes, bool flip = true);
 
   //! return the width of the image
     size_t width () const { return this->_wid; }
@@ -181,7 +188,7 @@ class Image2D : public __detail::ImageBase {
   //!
   //! Note that the type of the image must be either GL_UNSIGNED_BYTE,
   //! or GL_UNSIGNED_SHORT to write it to an output stream.
-    bool write (std::ofstream &outS, bool flip = true);
+    bool write (std::ostream &outS, bool flip = true);
 
   //! copy the contents of another image into this image
   //! \param src the image to blt into this image
@@ -225,12 +232,78 @@ class DataImage2D : public Image2D {
   //! \param inS the input stream
   //! \param flip set to true if the image should be flipped vertically to match OpenGL
   //!        texture coordinates (default true)
-    DataImage2D (std::ifstream &inS, bool flip = true)
+    DataImage2D (std::istream &inS, bool flip = true)
       : Image2D (inS, flip)
     {
         this->_sRGB = false;
     }
 
+  //! create and initialize an image from PNG data in memory
+  //! \param data the address of the PNG data
+  //! \param nBytes the size of the PNG data in bytes
+  //! \param flip set to true if the image should be flipped vertically to match OpenGL
+  //!        texture coordinates (default true)
+    DataImage2D (const void *data, size_t nBytes, bool flip = true)
+      : Image2D (data, nBytes, flip)
+    {
+        this->_sRGB = false;
+    }
+
+};
+
+//! A 2D image in a GPU block-compressed format (BC1, BC3, or BC5) with a complete
+//! chain of mipmap levels.  The data for the levels is stored contiguously, starting
+//! with the base level, and each level is a row-major array of 4x4 blocks.  Such
+//! images can be uploaded to a texture without any conversion (see `Texture2D`).
+class CompressedImage2D {
+  public:
+  //! create and allocate space for an uninitialized image
+  //! \param fmt the block-compressed format (one of the BC1, BC3, or BC5 formats)
+  //! \param wid the width of the base level
+  //! \param ht the height of the base level
+  //! \param nLevels the number of mipmap levels (including the base level)
+    CompressedImage2D (VkFormat fmt, uint32_t wid, uint32_t ht, uint32_t nLevels);
+
+  //! the format of the image
+    VkFormat format () const { return this->_fmt; }
+  //! return the width of the base level
+    uint32_t width () const { return this->_wid; }
+  //! return the height of the base level
+    uint32_t height () const { return this->_ht; }
+  //! return the number of mipmap levels
+    uint32_t nLevels () const { return static_cast<uint32_t>(this->_offsets.size() - 1); }
+  //! return the width of a mipmap level
+    uint32_t levelWidth (uint32_t lvl) const { return std::max(1u, this->_wid >> lvl); }
+  //! return the height of a mipmap level
+    uint32_t levelHeight (uint32_t lvl) const { return std::max(1u, this->_ht >> lvl); }
+  //! return the offset of a mipmap level's data from the start of the image data
+    size_t levelOffset (uint32_t lvl) const { return this->_offsets[lvl]; }
+  //! return the size of a mipmap level's data in bytes
+    size_t levelSize (uint32_t lvl) const { return this->_offsets[lvl+1] - this->_offsets[lvl]; }
+
+  //! the image data
+    uint8_t *data () { return this->_data.data(); }
+    const uint8_t *data () const { return this->_data.data(); }
+  //! the total number of bytes of image data (all levels)
+    size_t nBytes () const { return this->_data.size(); }
+
+  //! is the format one of the block-compressed formats that we support?
+    static bool isCompressedFormat (VkFormat fmt);
+  //! the number of bytes in a 4x4 block for a block-compressed format
+    static size_t blockBytes (VkFormat fmt);
+  //! the number of bytes in a level of the given size
+    static size_t levelBytes (VkFormat fmt, uint32_t wid, uint32_t ht)
+    {
+        return size_t((wid + 3) / 4) * size_t((ht + 3) / 4) * blockBytes(fmt);
+    }
+
+  private:
+    VkFormat _fmt;                      //!< the block-compressed format
+    uint32_t _wid;                      //!< the width of the base level in pixels
+    uint32_t _ht;                       //!< the height of the base level in pixels
+    std::vector<size_t> _offsets;       //!< the offsets of the levels plus the total size
+    std::vector<uint8_t> _data;         //!< the image data
+
 };
 
 } /* namespace cs237 */
@@ -31,12 +31,22 @@ protected:
     uint32_t _wid;              //!< texture width
     uint32_t _ht;               //!< teture height (1 for 1D textures)
     uint32_t _nMipLevels;       //!< number of mipmap levels
+    uint32_t _nLayers;          //!< number of array layers (1 for non-array textures)
     VkFormat _fmt;              //!< the texel format
 
     TextureBase (
         Application *app,
         uint32_t wid, uint32_t ht, uint32_t mipLvls,
         cs237::__detail::ImageBase const *img);
+    TextureBase (
+        Application *app,
+        uint32_t wid, uint32_t ht, uint32_t mipLvls,
+        VkFormat fmt);
+    //! create an array image with a 2D-array view of all of its levels and layers
+    TextureBase (
+        Application *app,
+        uint32_t wid, uint32_t ht, uint32_t mipLvls, uint32_t nLayers,
+        VkFormat fmt);
     ~TextureBase ();
 
     //! \brief create a VkBuffer object
@@ -62,6 +72,23 @@ protected:
     //! \param img  the source of the data
     void _init (cs237::__detail::ImageBase const *img);
 
+    //! \brief record the commands to copy data from a buffer into a layer of the
+    //!        texture and to put the layer into the shader-read-only layout
+    //! \param cmdBuf      the command buffer to record the commands in
+    //! \param layer       the layer to update (0 for non-array textures)
+    //! \param buf         the buffer holding the data
+    //! \param regions     the copy regions
+    //! \param genMipMaps  if true, the other mipmap levels of the layer are generated
+    //!                    from level 0
+    //! \param oldLayout   the current layout of the layer
+    void _recordUpload (
+        VkCommandBuffer cmdBuf,
+        uint32_t layer,
+        VkBuffer buf,
+        std::vector<VkBufferImageCopy> const &regions,
+        bool genMipMaps,
+        VkImageLayout oldLayout);
+
 };
 
 } // namespace __detail
@@ -87,10 +114,134 @@ public:
     //! \param mipmap  if true, generate mipmap levels for the texture.
     Texture2D (Application *app, Image2D const *img, bool mipmap = false);
 
+    //! \brief Construct a 2D texture from a block-compressed image.  The texture
+    //!        has the image's format and all of its mipmap levels.
+    //! \param app  the owning application; it must support BC textures (see
+    //!             `Application::hasBCTextures`)
+    //! \param img  the source image for the texture
+    Texture2D (Application *app, CompressedImage2D const *img);
+
+    //! \brief Construct a 2D texture whose contents are filled in later by commands
+    //!        recorded with `recordUpdate`.  The texture must not be sampled until those
+    //!        commands have completed.
+    //! \param app      the owning application
+    //! \param wid      the width of the texture
+    //! \param ht       the height of the texture
+    //! \param fmt      the texel format of the texture
+    //! \param mipLvls  the number of mipmap levels
+    Texture2D (Application *app, uint32_t wid, uint32_t ht, VkFormat fmt, uint32_t mipLvls = 1);
+
+    //! \brief record the commands to copy an image from a buffer into the texture.
+    //!        If the texture has more than one mipmap level, the other levels are
+    //!        generated from the image.  This function should only be used once on
+    //!        a texture that was created without any data.
+    //! \param cmdBuf  the command buffer to record the commands in
+    //! \param buf     the buffer holding the image data
+    //! \param offset  the offset of the image data in `buf`
+    //! \param img     the image, which must match the size and format of the texture
+    void recordUpdate (
+        VkCommandBuffer cmdBuf,
+        VkBuffer buf, VkDeviceSize offset,
+        Image2D const *img);
+
+    //! \brief record the commands to copy a block-compressed image from a buffer into
+    //!        the texture.  This function should only be used once on a texture that
+    //!        was created without any data.
+    //! \param cmdBuf  the command buffer to record the commands in
+    //! \param buf     the buffer holding the image data (including its mipmap levels)
+    //! \param offset  the offset of the image data in `buf`
+    //! \param img     the image, which must match the size, format, and number of
+    //!                mipmap levels of the texture
+    void recordUpdate (
+        VkCommandBuffer cmdBuf,
+        VkBuffer buf, VkDeviceSize offset,
+        CompressedImage2D const *img);
+
 private:
     //! helper function for generating the mipmap levels
     void _generateMipMaps (cs237::Image2D const *img);
 
+    //! helper function for copying the levels of a compressed image into the texture
+    void _initCompressed (cs237::CompressedImage2D const *img);
+
+};
+
+// 2D Array Textures
+class Texture2DArray : public __detail::TextureBase {
+public:
+
+    //! \brief Construct a 2D array texture whose layers are filled in later (using
+    //!        `update`).  The contents of a layer are undefined until it is updated.
+    //! \param app      the owning application
+    //! \param wid      the width of the layers
+    //! \param ht       the height of the layers
+    //! \param nLayers  the number of layers (at most `limits()->maxImageArrayLayers`)
+    //! \param fmt      the texel format of the layers
+    //! \param mipLvls  the number of mipmap levels per layer
+    Texture2DArray (
+        Application *app,
+        uint32_t wid, uint32_t ht, uint32_t nLayers,
+        VkFormat fmt, uint32_t mipLvls = 1);
+
+    //! the number of layers in the texture
+    uint32_t nLayers () const { return this->_nLayers; }
+
+    //! the number of mipmap levels per layer
+    uint32_t nMipLevels () const { return this->_nMipLevels; }
+
+    //! the texel format of the texture
+    VkFormat format () const { return this->_fmt; }
+
+    //! \brief copy an image into a layer of the texture.  If the texture has more
+    //!        than one mipmap level, the other levels of the layer are generated from
+    //!        the image.
+    //! \param layer  the layer to update
+    //! \param img    the source image, which must match the size and format of the
+    //!               texture
+    void update (uint32_t layer, Image2D const *img);
+
+    //! \brief copy a block-compressed image into a layer of the texture
+    //! \param layer  the layer to update
+    //! \param img    the source image, which must match the size and format of the
+    //!               texture and have the same number of mipmap levels
+    void update (uint32_t layer, CompressedImage2D const *img);
+
+    //! \brief record the commands to copy an image from a buffer into a layer of the
+    //!        texture; the commands are like those of `update`, but the caller is
+    //!        responsible for submitting them.
+    //! \param cmdBuf  the command buffer to record the commands in
+    //! \param layer   the layer to update
+    //! \param buf     the buffer holding the image data
+    //! \param offset  the offset of the image data in `buf`
+    //! \param img     the image, which must match the size and format of the texture
+    void recordUpdate (
+        VkCommandBuffer cmdBuf,
+        uint32_t layer,
+        VkBuffer buf, VkDeviceSize offset,
+        Image2D const *img);
+
+    //! \brief record the commands to copy a block-compressed image from a buffer into
+    //!        a layer of the texture
+    //! \param cmdBuf  the command buffer to record the commands in
+    //! \param layer   the layer to update
+    //! \param buf     the buffer holding the image data (including its mipmap levels)
+    //! \param offset  the offset of the image data in `buf`
+    //! \param img     the image, which must match the size, format, and number of
+    //!                mipmap levels of the texture
+    void recordUpdate (
+        VkCommandBuffer cmdBuf,
+        uint32_t layer,
+        VkBuffer buf, VkDeviceSize offset,
+        CompressedImage2D const *img);
+
+private:
+    //! helper function for copying data into a layer using a single command buffer
+    void _upload (
+        uint32_t layer,
+        const void *data, size_t nBytes,
+        std::vector<VkBufferImageCopy> const &regions,
+        bool genMipMaps);
+
 };
 
 } // namespace cs237
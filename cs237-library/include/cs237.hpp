@@ -22,7 +22,9 @@
 #include <cassert>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <unordered_map>
 #include <vector>
 #include <algorithm>
 
@@ -47,6 +47,11 @@ namespace json {
   // parse a JSON file; this returns nullptr if there is a parsing error
     Value *parseFile (std::string filename);
 
+  // parse JSON text that is already in memory (e.g., a member of an archive); the
+  // name is only used in error messages.  This returns nullptr if there is a parsing
+  // error
+    Value *parseString (std::string const &text, std::string name = "<string>");
+
   // virtual base class of JSON values
     class Value {
       public:
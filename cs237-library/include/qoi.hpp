@@ -0,0 +1,63 @@
+/*! \file qoi.hpp
+ *
+ * Support for the "Quite OK Image" (QOI) format, which is a simple lossless image
+ * codec that decodes much faster than PNG.  See https://qoiformat.org for the
+ * specification.  We only support RGBA images with 8-bit channels.
+ *
+ * \author John Reppy
+ */
+
+/*
+ * COPYRIGHT (c) 2022 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#ifndef _QOI_HPP_
+#define _QOI_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace qoi {
+
+  //! the information in the header of a QOI image
+    struct Header {
+        uint32_t width;         //!< the width of the image in pixels
+        uint32_t height;        //!< the height of the image in pixels
+        uint8_t channels;       //!< the number of channels (3 or 4)
+        uint8_t colorspace;     //!< 0 for sRGB with linear alpha, 1 for all linear
+    };
+
+  //! \brief read the header of a QOI image
+  //! \param data    the encoded image
+  //! \param nBytes  the size of the encoded image in bytes
+  //! \param[out] hdr the header information
+  //! \return true if the data starts with a valid QOI header
+    bool readHeader (const void *data, size_t nBytes, Header &hdr);
+
+  //! \brief decode a QOI image into an RGBA8 buffer
+  //! \param data    the encoded image
+  //! \param nBytes  the size of the encoded image in bytes
+  //! \param wid     the expected width of the image
+  //! \param ht      the expected height of the image
+  //! \param[out] rgba the output buffer, which must hold wid * ht * 4 bytes
+  //! \param flip    if true, the rows are written bottom to top (to match OpenGL
+  //!                texture coordinates)
+  //! \return true on success; false if the data is not a valid QOI image of the
+  //!         expected size
+    bool decode (
+        const void *data, size_t nBytes, uint32_t wid, uint32_t ht,
+        uint8_t *rgba, bool flip);
+
+  //! \brief encode an RGBA8 image as a four-channel QOI image
+  //! \param rgba    the pixels in row-major order (top row first)
+  //! \param wid     the width of the image
+  //! \param ht      the height of the image
+  //! \param sRGB    is the color data sRGB encoded?  This only affects the header.
+  //! \return the encoded image
+    std::vector<uint8_t> encode (const uint8_t *rgba, uint32_t wid, uint32_t ht, bool sRGB);
+
+} // namespace qoi
+
+#endif // !_QOI_HPP_
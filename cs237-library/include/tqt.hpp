@@ -14,12 +14,63 @@
 #define _TQT_HPP_
 
 #include "cs237.hpp"
+#include <functional>
+#include <mutex>
 #include <vector>
 
 namespace tqt {
 
+  /* A TQT file starts with a header, which is followed by a table of contents that
+   * holds the file offset (as a uint64_t) of each node's tile in breadth-first order,
+   * which is followed by the tiles.  There are two versions of the file format:
+   *
+   *   - in version 1 files, each tile is a PNG image.
+   *
+   *   - in version 2 files, the header is extended with the tile format and the
+   *     number of mipmap levels per tile.  For the BC formats, each tile is a
+   *     complete mipmap chain (from tileSize x tileSize down to 1x1) in a GPU
+   *     block-compressed format, with the levels stored back to back.  The rows of
+   *     blocks are stored top to bottom, which is the same orientation as the PNG
+   *     images of version 1.  For the QOI format, each tile is a single-level
+   *     RGBA image in the lossless QOI format (see qoi.hpp).
+   */
+
+  //! the magic number of TQT files ("TQT\0" in little-endian order)
+    constexpr uint32_t kMagic = 0x00545154;
+  //! the version number of TQT files with PNG tiles
+    constexpr uint32_t kVersionPNG = 1;
+  //! the version number of TQT files whose header records the format of the tiles;
+  //! it is used for block-compressed and QOI tiles
+    constexpr uint32_t kVersionBC = 2;
+
+  //! the format of the tiles in a TQT file
+    enum class Format : uint32_t {
+        PNG = 0,        //!< PNG images (version 1)
+        BC1 = 1,        //!< BC1 for opaque color images (version 2)
+        BC3 = 3,        //!< BC3 for color images with alpha (version 2)
+        BC5 = 5,        //!< BC5 for normal maps; only X and Y are stored (version 2)
+        QOI = 16        //!< lossless QOI images, which decode faster than PNG (version 2)
+    };
+
+  //! the header of a TQT file
+    struct FileHdr {
+        uint32_t magic;         //!< magic number (kMagic)
+        uint32_t version;       //!< file format version
+        uint32_t depth;         //!< tree depth
+        uint32_t tileSize;      //!< width of tiles; must be a power of 2
+    };
+
+  //! the extended header of a version 2 TQT file
+    struct FileHdrV2 {
+        FileHdr hdr;            //!< the common part of the header
+        uint32_t format;        //!< the tile format
+        uint32_t nLevels;       //!< the number of mipmap levels in a tile
+    };
+
   //! Manages a disk-based texture-image quadtree and supports loading individual
-  //! texture images at different levels and locations in the tree.
+  //! texture images at different levels and locations in the tree.  The tiles are
+  //! read with positional reads (`pread`) on a file descriptor that is not otherwise
+  //! modified, so `loadImage` can be called from multiple threads at once.
     class TextureQTree {
       public:
 
@@ -28,41 +79,203 @@ namespace tqt {
         //! \param flip should the image be flipped to match OpenGL conventions
         //! \param sRGB are the textures in sRGB format?
         TextureQTree (std::string const &filename, bool flip, bool sRGB);
+
+        //! \brief constructor for a texture quad tree that is embedded in a larger
+        //!        file (e.g., a map pack).  The file descriptor can be shared with
+        //!        other readers.
+        //! \param fd    an open file descriptor; the caller retains ownership of it
+        //! \param base  the offset of the start of the TQT data in the file
+        //! \param size  the size of the TQT data in bytes
+        //! \param flip should the image be flipped to match OpenGL conventions
+        //! \param sRGB are the textures in sRGB format?
+        TextureQTree (int fd, uint64_t base, uint64_t size, bool flip, bool sRGB);
+
+        //! a function that computes the RGBA8 pixels of a tile (with the top row first)
+        //! for a given level, row, and column; it returns false on error.  The function
+        //! may be called from multiple threads at once.
+        using TileFn = std::function<bool(int level, int row, int col, uint8_t *rgba)>;
+
+        //! \brief constructor for a texture quad tree whose tiles are computed on
+        //!        demand instead of being read from a file (e.g., normal maps that
+        //!        are computed from a height field).  The tiles are reported as being
+        //!        in the PNG format, since they are uncompressed.
+        //! \param depth    the depth of the tree
+        //! \param tileSize the width of the tiles; must be a power of 2
+        //! \param tileFn   the function that computes the tiles
+        //! \param flip should the image be flipped to match OpenGL conventions
+        //! \param sRGB are the textures in sRGB format?
+        TextureQTree (int depth, int tileSize, TileFn tileFn, bool flip, bool sRGB);
+
         ~TextureQTree();
 
       //! is this a valid TQT?
-        bool isValid () const { return this->_source != nullptr; }
+        bool isValid () const { return (this->_fd >= 0) || this->isProcedural(); }
+      //! are the tiles computed on demand?
+        bool isProcedural () const { return static_cast<bool>(this->_tileFn); }
+      //! a unique identifier for the tree; unlike the tree's address, identifiers are
+      //! never reused, so they can be used as cache keys that outlive the tree
+        uint64_t id () const { return this->_id; }
       //! the depth of the TQT
         int depth() const { return this->_depth; }
       //! the size of a texture tile measured in pixels (tiles are always square)
         int tileSize() const { return this->_tileSize; }
+      //! are the tile images flipped in the Y dimension (i.e., is row 0 the south edge)?
+        bool isFlipped () const { return this->_flip; }
+      //! the version of the file's header (kVersionPNG or kVersionBC); procedural trees
+      //! report kVersionPNG.  Use `format` to get the format of the tiles.
+        uint32_t version () const { return this->_version; }
+      //! the format of the tiles
+        Format format () const { return this->_format; }
+      //! are the tiles GPU block compressed?
+        bool isCompressed () const
+        {
+            return (this->_format != Format::PNG) && (this->_format != Format::QOI);
+        }
+      //! the number of mipmap levels stored with each tile (1 for PNG and QOI tiles)
+        uint32_t nMipLevels () const { return this->_nLevels; }
 
-      //! \brief return the image tile at the specified quadtree node.
+      //! \brief return the image tile at the specified quadtree node.  This function
+      //!        is thread safe.
       //! \param[in] level the level of the node in the tree (root = 0)
       //! \param[in] row the row of the node on its level (north == 0)
       //! \param[in] col the column of the node on its level (west == 0)
       //! \return a pointer to the image; nullptr is returned if there is
       //!         an error.  It is the caller's responsibility to manage the
       //!         image's storage.
-        cs237::Image2D *loadImage (int level, int row, int col);
+        cs237::Image2D *loadImage (int level, int row, int col) const;
+
+      //! \brief return the block-compressed image tile, with all of its mipmap
+      //!        levels, at the specified quadtree node.  This function is thread safe.
+      //! \param[in] level the level of the node in the tree (root = 0)
+      //! \param[in] row the row of the node on its level (north == 0)
+      //! \param[in] col the column of the node on its level (west == 0)
+      //! \return a pointer to the image; nullptr is returned if there is an error or
+      //!         if the TQT does not have compressed tiles.  It is the caller's
+      //!         responsibility to manage the image's storage.
+        cs237::CompressedImage2D *loadCompressed (int level, int row, int col) const;
 
       //! are the images sRGB?
         bool sRGB () const { return this->_sRGB; }
 
-      //! return true if the file looks like a TQT file of the right version
+      //! return true if the file looks like a TQT file of a supported version
         static bool isTQTFile (std::string const &filename);
 
       private:
-        std::vector<std::streamoff> _toc;       //!< stream offsets for images
+        uint64_t _id;                           //!< the unique ID of the tree
+        std::vector<uint64_t> _toc;             //!< offsets of the images relative to _base
+        std::vector<uint32_t> _tileBytes;       //!< the sizes of the images in bytes
         int _depth;                             //!< the depth of the TQT
         int _tileSize;                          //!< the size of a texture tile in pixels
+        uint32_t _version;                      //!< the version of the file header
+        Format _format;                         //!< the format of the tiles
+        uint32_t _nLevels;                      //!< the number of mipmap levels per tile
         bool _flip;                             //!< true if we are flipping the Y dimension
                                                 //!  of the loaded images
         bool _sRGB;                             //!< true if we are loading sRGB images
-        std::ifstream *_source;                 //!< the source file for the textures
+        int _fd;                                //!< the file descriptor for the source of
+                                                //!  the textures (-1 if invalid)
+        bool _ownsFd;                           //!< true if we should close _fd
+        uint64_t _base;                         //!< the file offset of the TQT data
+        TileFn _tileFn;                         //!< computes the tiles of a procedural
+                                                //!  tree (empty otherwise)
+
+      //! read the header and TOC; exits on error
+        void _init (int fd, uint64_t base, uint64_t size, std::string const &name);
+
+      //! the Vulkan format of compressed tiles
+        VkFormat _vkFormat () const;
+
+      //! read the raw data of a tile into a buffer of _tileBytes[index] bytes;
+      //! returns false on error
+        bool _readTile (uint32_t index, void *buf) const;
+
+    // TQTs are not copyable
+        TextureQTree (TextureQTree const &) = delete;
+        TextureQTree &operator= (TextureQTree const &) = delete;
 
     };  // class TextureQTree
 
+  //! Writes a texture quadtree file.  The tiles can be added in any order and from
+  //! multiple threads at once; the encoding of a tile is done by the calling thread
+  //! and only the allocation of file space is serialized.  The file is written to a
+  //! temporary file, which is renamed when `finish` is called, so a partially
+  //! written tree is never visible under the final name.
+    class Writer {
+      public:
+
+        //! \brief create a writer for a texture quadtree
+        //! \param filename  the name of the output file
+        //! \param depth     the depth of the tree (> 0)
+        //! \param tileSize  the width of the tiles; must be a power of 2
+        //! \param format    the tile format; PNG trees are written as version 1 files
+        //!                  and all other formats as version 2 files
+        //! \param sRGB      are the tiles sRGB color data? (recorded in QOI tiles)
+        Writer (
+            std::string const &filename,
+            uint32_t depth, uint32_t tileSize,
+            Format format = Format::PNG,
+            bool sRGB = true);
+
+        //! the destructor removes the temporary file if `finish` was not called
+        ~Writer ();
+
+      //! is the writer ready to accept tiles?
+        bool isValid () const { return (this->_fd >= 0); }
+      //! the depth of the tree
+        uint32_t depth () const { return this->_depth; }
+      //! the size of a tile in pixels
+        uint32_t tileSize () const { return this->_tileSize; }
+      //! the format of the tiles
+        Format format () const { return this->_format; }
+      //! the number of mipmap levels per tile (a complete chain for the BC formats)
+        uint32_t nMipLevels () const { return this->_nLevels; }
+
+      //! \brief encode an image as a PNG or QOI tile and add it to the tree.  This
+      //!        function is thread safe.
+      //! \param level the level of the node in the tree (root = 0)
+      //! \param row   the row of the node on its level (north == 0)
+      //! \param col   the column of the node on its level (west == 0)
+      //! \param rgba  the tile's RGBA8 pixels, with the top row first
+      //! \return true if successful; false on error or if the tree's tiles are
+      //!         block compressed.
+        bool addImage (int level, int row, int col, const uint8_t *rgba);
+
+      //! \brief add an already encoded tile to the tree (e.g., a block-compressed
+      //!        mipmap chain).  This function is thread safe.
+      //! \param level  the level of the node in the tree (root = 0)
+      //! \param row    the row of the node on its level (north == 0)
+      //! \param col    the column of the node on its level (west == 0)
+      //! \param data   the encoded tile
+      //! \param nBytes the size of the encoded tile
+      //! \return true if successful, false otherwise
+        bool addTile (int level, int row, int col, const void *data, size_t nBytes);
+
+      //! \brief write the table of contents and move the file to its final name.
+      //!        All of the tiles must have been added.
+      //! \return true if successful, false otherwise
+        bool finish ();
+
+      private:
+        std::string _file;                      //!< the name of the output file
+        std::string _tmpFile;                   //!< the name of the temporary file
+        int _fd;                                //!< the temporary file (-1 if invalid)
+        uint32_t _depth;                        //!< the depth of the tree
+        uint32_t _tileSize;                     //!< the size of the tiles in pixels
+        Format _format;                         //!< the format of the tiles
+        uint32_t _nLevels;                      //!< the number of mipmap levels per tile
+        bool _sRGB;                             //!< true for sRGB color data
+        size_t _hdrSize;                        //!< the size of the header and TOC
+        std::mutex _mu;                         //!< protects _offset and _toc
+        uint64_t _offset;                       //!< the offset of the next tile
+        std::vector<uint64_t> _toc;             //!< the offsets of the tiles (0 if
+                                                //!  the tile has not been added)
+
+    // writers are not copyable
+        Writer (Writer const &) = delete;
+        Writer &operator= (Writer const &) = delete;
+
+    };  // class Writer
+
 } // namespace tqt
 
 #endif // !_TQT_HPP_
@@ -40,7 +40,8 @@ Application::Application (std::vector<const char *> &args, std::string const &na
     _messages(VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT),
     _debug(false),
     _gpu(VK_NULL_HANDLE),
-    _propsCache(nullptr)
+    _propsCache(nullptr),
+    _bcTextures(false)
 {
     // process the command-line arguments
     for (auto it = args.cbegin();  it != args.cend();  ++it) {
@@ -78,6 +79,11 @@ Application::~Application ()
         delete this->_propsCache;
     }
 
+    // destroy any cached samplers that were not released
+    for (auto it : this->_samplerTbl) {
+        vkDestroySampler(this->_device, it.second, nullptr);
+    }
+
     // delete the command pool
     vkDestroyCommandPool(this->_device, this->_cmdPool, nullptr);
 
@@ -361,10 +367,15 @@ void Application::_createLogicalDevice ()
     createInfo.enabledExtensionCount = static_cast<uint32_t>(kDeviceExts.size());
     createInfo.ppEnabledExtensionNames = kDeviceExts.data();
 
-    // for now, we are only enabling a couple of extra features
+    // for now, we are only enabling a couple of extra features, plus BC texture
+    // compression when the device supports it
+    VkPhysicalDeviceFeatures availFeatures;
+    vkGetPhysicalDeviceFeatures (this->_gpu, &availFeatures);
     VkPhysicalDeviceFeatures deviceFeatures{};
     deviceFeatures.fillModeNonSolid = VK_TRUE;
     deviceFeatures.samplerAnisotropy = VK_TRUE;
+    deviceFeatures.textureCompressionBC = availFeatures.textureCompressionBC;
+    this->_bcTextures = (availFeatures.textureCompressionBC == VK_TRUE);
     createInfo.pEnabledFeatures = &deviceFeatures;
 
     // create the logical device
@@ -384,7 +395,8 @@ VkImage Application::_createImage (
     uint32_t ht, VkFormat format,
     VkImageTiling tiling,
     VkImageUsageFlags usage,
-    uint32_t mipLvls)
+    uint32_t mipLvls,
+    uint32_t nLayers)
 {
     VkImageCreateInfo imageInfo{};
     imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -393,7 +405,7 @@ VkImage Application::_createImage (
     imageInfo.extent.height = ht;
     imageInfo.extent.depth = 1;
     imageInfo.mipLevels = mipLvls;
-    imageInfo.arrayLayers = 1;
+    imageInfo.arrayLayers = nLayers;
     imageInfo.format = format;
     imageInfo.tiling = tiling;
     imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
@@ -458,6 +470,36 @@ VkImageView Application::_createImageView (
 
 }
 
+VkImageView Application::_createArrayImageView (
+    VkImage img,
+    VkFormat fmt,
+    VkImageAspectFlags aspectFlags,
+    uint32_t mipLvls,
+    uint32_t nLayers)
+{
+    assert (img != VK_NULL_HANDLE);
+
+    VkImageViewCreateInfo viewInfo{};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+    viewInfo.image = img;
+    viewInfo.format = fmt;
+    viewInfo.subresourceRange.aspectMask = aspectFlags;
+    viewInfo.subresourceRange.baseMipLevel = 0;
+    viewInfo.subresourceRange.levelCount = mipLvls;
+    viewInfo.subresourceRange.baseArrayLayer = 0;
+    viewInfo.subresourceRange.layerCount = nLayers;
+
+    VkImageView imageView;
+    auto sts = vkCreateImageView(this->_device, &viewInfo, nullptr, &imageView);
+    if (sts != VK_SUCCESS) {
+        ERROR("unable to create array image view!");
+    }
+
+    return imageView;
+
+}
+
 VkBuffer Application::_createBuffer (size_t size, VkBufferUsageFlags usage)
 {
     VkBufferCreateInfo bufferInfo{};
@@ -664,6 +706,19 @@ void Application::submitCommands (VkCommandBuffer cmdBuf)
 
 }
 
+void Application::submitCommands (VkCommandBuffer cmdBuf, VkFence fence)
+{
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &cmdBuf;
+
+    if (vkQueueSubmit(this->_queues.graphics, 1, &submitInfo, fence) != VK_SUCCESS) {
+        ERROR("unable to submit command buffer!");
+    }
+
+}
+
 VkSampler Application::createSampler (Application::SamplerInfo const &info)
 {
     VkSamplerCreateInfo samplerInfo{};
@@ -690,6 +745,40 @@ VkSampler Application::createSampler (Application::SamplerInfo const &info)
     return sampler;
 }
 
+VkSampler Application::acquireSampler (Application::SamplerInfo const &info)
+{
+    std::lock_guard<std::mutex> lck(this->_samplerMu);
+
+    auto got = this->_samplerTbl.find(info);
+    if (got != this->_samplerTbl.end()) {
+        this->_samplerRefs[got->second].refCount++;
+        return got->second;
+    }
+
+    VkSampler sampler = this->createSampler (info);
+    this->_samplerTbl.insert (std::make_pair(info, sampler));
+    this->_samplerRefs.insert (std::make_pair(sampler, _CachedSampler{info, 1}));
+
+    return sampler;
+}
+
+void Application::releaseSampler (VkSampler sampler)
+{
+    std::lock_guard<std::mutex> lck(this->_samplerMu);
+
+    auto got = this->_samplerRefs.find(sampler);
+    if (got == this->_samplerRefs.end()) {
+        ERROR("releaseSampler: sampler was not acquired from the cache");
+    }
+    assert (got->second.refCount > 0);
+    if (--got->second.refCount == 0) {
+        this->_samplerTbl.erase (got->second.info);
+        this->_samplerRefs.erase (got);
+        vkDestroySampler(this->_device, sampler, nullptr);
+    }
+
+}
+
 // Get the list of supported instance extensions
 //
 std::vector<VkExtensionProperties> Application::supportedInstanceExtensions ()
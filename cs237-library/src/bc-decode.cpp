@@ -0,0 +1,221 @@
+/*! \file bc-decode.cpp
+ *
+ * CPU decoding and vertical flipping of BC1, BC3, and BC5 block-compressed images.
+ *
+ * \author John Reppy
+ */
+
+/*
+ * COPYRIGHT (c) 2022 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#include "bc-decode.hpp"
+#include <cstring>
+
+/* A BC1 block is 8 bytes: two RGB565 endpoint colors followed by 16 2-bit indices,
+ * one byte per row of the block (the low bits are the leftmost pixel).  If the first
+ * endpoint is greater than the second, the palette has four colors; otherwise it has
+ * three colors plus transparent black.
+ *
+ * A BC4 block is 8 bytes: two 8-bit endpoints followed by 16 3-bit indices packed
+ * into a 48-bit little-endian integer, so each row of the block is 12 bits.
+ *
+ * A BC3 block is a BC4 block for alpha followed by a BC1 block for color (which is
+ * always decoded in four-color mode), and a BC5 block is a BC4 block for red followed
+ * by a BC4 block for green.
+ */
+
+namespace bc {
+
+// expand 5 and 6-bit color components to 8 bits
+inline uint8_t expand5 (uint32_t v) { return static_cast<uint8_t>((v << 3) | (v >> 2)); }
+inline uint8_t expand6 (uint32_t v) { return static_cast<uint8_t>((v << 2) | (v >> 4)); }
+
+// the weighted average (wa*a + wb*b) / (wa + wb), rounded to nearest
+inline uint8_t lerp (uint32_t a, uint32_t b, uint32_t wa, uint32_t wb)
+{
+    uint32_t w = wa + wb;
+    return static_cast<uint8_t>((wa * a + wb * b + w / 2) / w);
+}
+
+// decode a BC1 color block into 16 RGBA pixels
+static void decodeBC1 (const uint8_t *blk, bool fourColor, uint8_t rgba[16][4])
+{
+    uint32_t c0 = blk[0] | (blk[1] << 8);
+    uint32_t c1 = blk[2] | (blk[3] << 8);
+    uint8_t pal[4][4];
+    pal[0][0] = expand5(c0 >> 11);  pal[0][1] = expand6((c0 >> 5) & 0x3f);
+    pal[0][2] = expand5(c0 & 0x1f); pal[0][3] = 255;
+    pal[1][0] = expand5(c1 >> 11);  pal[1][1] = expand6((c1 >> 5) & 0x3f);
+    pal[1][2] = expand5(c1 & 0x1f); pal[1][3] = 255;
+    if (fourColor || (c0 > c1)) {
+        for (int i = 0;  i < 3;  i++) {
+            pal[2][i] = lerp(pal[0][i], pal[1][i], 2, 1);
+            pal[3][i] = lerp(pal[0][i], pal[1][i], 1, 2);
+        }
+        pal[2][3] = pal[3][3] = 255;
+    } else {
+        for (int i = 0;  i < 3;  i++) {
+            pal[2][i] = lerp(pal[0][i], pal[1][i], 1, 1);
+            pal[3][i] = 0;
+        }
+        pal[2][3] = 255;
+        pal[3][3] = 0;
+    }
+
+    for (int r = 0;  r < 4;  r++) {
+        uint32_t bits = blk[4 + r];
+        for (int c = 0;  c < 4;  c++) {
+            std::memcpy (rgba[4*r + c], pal[(bits >> (2*c)) & 3], 4);
+        }
+    }
+}
+
+// decode a BC4 block into 16 single-channel values
+static void decodeBC4 (const uint8_t *blk, uint8_t vals[16])
+{
+    uint32_t e0 = blk[0], e1 = blk[1];
+    uint8_t pal[8];
+    pal[0] = e0;
+    pal[1] = e1;
+    if (e0 > e1) {
+        for (uint32_t i = 1;  i < 7;  i++) {
+            pal[i+1] = lerp(e0, e1, 7 - i, i);
+        }
+    } else {
+        for (uint32_t i = 1;  i < 5;  i++) {
+            pal[i+1] = lerp(e0, e1, 5 - i, i);
+        }
+        pal[6] = 0;
+        pal[7] = 255;
+    }
+
+    uint64_t bits = 0;
+    for (int i = 5;  i >= 0;  i--) {
+        bits = (bits << 8) | blk[2 + i];
+    }
+    for (int i = 0;  i < 16;  i++) {
+        vals[i] = pal[(bits >> (3*i)) & 7];
+    }
+}
+
+// decode a single block into 16 RGBA pixels
+static void decodeBlock (VkFormat fmt, const uint8_t *blk, uint8_t rgba[16][4])
+{
+    switch (fmt) {
+    case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+    case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+    case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+    case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+        decodeBC1 (blk, false, rgba);
+        break;
+    case VK_FORMAT_BC3_UNORM_BLOCK:
+    case VK_FORMAT_BC3_SRGB_BLOCK: {
+            uint8_t alpha[16];
+            decodeBC4 (blk, alpha);
+            decodeBC1 (blk + 8, true, rgba);
+            for (int i = 0;  i < 16;  i++) {
+                rgba[i][3] = alpha[i];
+            }
+        } break;
+    case VK_FORMAT_BC5_UNORM_BLOCK: {
+            uint8_t red[16], green[16];
+            decodeBC4 (blk, red);
+            decodeBC4 (blk + 8, green);
+            for (int i = 0;  i < 16;  i++) {
+                float x = float(red[i]) * (2.0f / 255.0f) - 1.0f;
+                float y = float(green[i]) * (2.0f / 255.0f) - 1.0f;
+                float z = std::sqrt(std::max(0.0f, 1.0f - x*x - y*y));
+                rgba[i][0] = red[i];
+                rgba[i][1] = green[i];
+                rgba[i][2] = static_cast<uint8_t>(std::lround((z + 1.0f) * 127.5f));
+                rgba[i][3] = 255;
+            }
+        } break;
+    default:
+        std::cerr << "bc::decode: unsupported format " << static_cast<int>(fmt) << "\n";
+        exit (1);
+    }
+}
+
+void decode (VkFormat fmt, uint32_t wid, uint32_t ht, const uint8_t *blocks, uint8_t *rgba)
+{
+    size_t blkBytes = cs237::CompressedImage2D::blockBytes(fmt);
+    uint8_t pixels[16][4];
+    for (uint32_t by = 0;  by < ht;  by += 4) {
+        for (uint32_t bx = 0;  bx < wid;  bx += 4) {
+            decodeBlock (fmt, blocks, pixels);
+            blocks += blkBytes;
+          // copy the part of the block that is inside the image
+            uint32_t nr = std::min(4u, ht - by);
+            uint32_t nc = std::min(4u, wid - bx);
+            for (uint32_t r = 0;  r < nr;  r++) {
+                std::memcpy (rgba + 4 * (size_t(by + r) * wid + bx), pixels[4*r], 4 * nc);
+            }
+        }
+    }
+}
+
+// reverse the first n rows of a BC1 index block
+static void flipBC1Rows (uint8_t *blk, uint32_t n)
+{
+    for (uint32_t r = 0;  r < n / 2;  r++) {
+        std::swap (blk[4 + r], blk[4 + n - 1 - r]);
+    }
+}
+
+// reverse the first n rows of a BC4 index block
+static void flipBC4Rows (uint8_t *blk, uint32_t n)
+{
+    uint64_t bits = 0;
+    for (int i = 5;  i >= 0;  i--) {
+        bits = (bits << 8) | blk[2 + i];
+    }
+    uint64_t flipped = bits;
+    for (uint32_t r = 0;  r < n;  r++) {
+        uint64_t row = (bits >> (12 * (n - 1 - r))) & 0xfff;
+        flipped = (flipped & ~(uint64_t(0xfff) << (12 * r))) | (row << (12 * r));
+    }
+    for (int i = 0;  i < 6;  i++) {
+        blk[2 + i] = static_cast<uint8_t>(flipped >> (8 * i));
+    }
+}
+
+void flip (VkFormat fmt, uint32_t wid, uint32_t ht, uint8_t *blocks)
+{
+    size_t blkBytes = cs237::CompressedImage2D::blockBytes(fmt);
+    uint32_t nbw = (wid + 3) / 4;
+    uint32_t nbh = (ht + 3) / 4;
+    size_t rowBytes = nbw * blkBytes;
+
+  // reverse the order of the rows of blocks
+    for (uint32_t r = 0;  r < nbh / 2;  r++) {
+        std::swap_ranges (
+            blocks + r * rowBytes, blocks + (r + 1) * rowBytes,
+            blocks + (nbh - 1 - r) * rowBytes);
+    }
+
+  // reverse the rows of pixels inside each block; when the image is less than four
+  // pixels high, only the first `ht` rows of the block are used
+    uint32_t n = std::min(4u, ht);
+    for (size_t i = 0;  i < size_t(nbw) * nbh;  i++) {
+        uint8_t *blk = blocks + i * blkBytes;
+        switch (fmt) {
+        case VK_FORMAT_BC3_UNORM_BLOCK:
+        case VK_FORMAT_BC3_SRGB_BLOCK:
+            flipBC4Rows (blk, n);
+            flipBC1Rows (blk + 8, n);
+            break;
+        case VK_FORMAT_BC5_UNORM_BLOCK:
+            flipBC4Rows (blk, n);
+            flipBC4Rows (blk + 8, n);
+            break;
+        default:
+            flipBC1Rows (blk, n);
+            break;
+        }
+    }
+}
+
+} // namespace bc
@@ -0,0 +1,44 @@
+/*! \file bc-decode.hpp
+ *
+ * CPU decoding and vertical flipping of BC1, BC3, and BC5 block-compressed images.
+ * This code is internal to the library; it is used by the texture quadtree code to
+ * support version 2 TQT files.
+ *
+ * \author John Reppy
+ */
+
+/*
+ * COPYRIGHT (c) 2022 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#ifndef _BC_DECODE_HPP_
+#define _BC_DECODE_HPP_
+
+#include "cs237.hpp"
+
+namespace bc {
+
+  //! \brief decode a block-compressed image to RGBA8.
+  //! \param fmt     the format of the blocks (a BC1, BC3, or BC5 format)
+  //! \param wid     the width of the image in pixels
+  //! \param ht      the height of the image in pixels
+  //! \param blocks  the row-major array of 4x4 blocks
+  //! \param[out] rgba the output pixels (wid * ht * 4 bytes) in row-major order.
+  //!
+  //! BC5 images only store the X and Y components of a unit-length normal vector
+  //! in the red and green channels; we reconstruct the Z component in the blue
+  //! channel and set alpha to 255, so the result matches an uncompressed normal map.
+    void decode (VkFormat fmt, uint32_t wid, uint32_t ht, const uint8_t *blocks, uint8_t *rgba);
+
+  //! \brief flip a block-compressed image vertically in place.  This operation is
+  //!        exact, since it only reorders the blocks and the index rows inside them.
+  //! \param fmt     the format of the blocks (a BC1, BC3, or BC5 format)
+  //! \param wid     the width of the image in pixels
+  //! \param ht      the height of the image in pixels
+  //! \param blocks  the row-major array of 4x4 blocks
+    void flip (VkFormat fmt, uint32_t wid, uint32_t ht, uint8_t *blocks);
+
+} // namespace bc
+
+#endif // !_BC_DECODE_HPP_
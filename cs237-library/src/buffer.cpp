@@ -67,6 +67,21 @@ void Buffer::_copyDataToBuffer (const void *src, size_t offset, size_t sz)
     vkUnmapMemory (this->_app->_device, this->_mem);
 }
 
+void *Buffer::_map ()
+{
+    void *data;
+    auto sts = vkMapMemory(this->_app->_device, this->_mem, 0, this->_sz, 0, &data);
+    if (sts != VK_SUCCESS) {
+        ERROR ("unable to map memory object");
+    }
+    return data;
+}
+
+void Buffer::_unmap ()
+{
+    vkUnmapMemory (this->_app->_device, this->_mem);
+}
+
 void Buffer::_stageDataToBuffer (const void *src, size_t offset, size_t sz)
 {
     assert (offset + sz <= this->_sz);
@@ -182,4 +197,21 @@ StorageBuffer::StorageBuffer (Application *app, size_t sz, const void *data)
     }
 }
 
+/******************** class StagingBuffer methods ********************/
+
+StagingBuffer::StagingBuffer (Application *app, size_t sz)
+  : Buffer (
+        app,
+        VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        sz)
+{
+    this->_data = static_cast<uint8_t *>(this->_map());
+}
+
+StagingBuffer::~StagingBuffer ()
+{
+    this->_unmap ();
+}
+
 } // namespace cs237
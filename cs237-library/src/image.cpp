@@ -15,6 +15,7 @@
 #include "cs237.hpp"
 #include "png.h"
 #include <fstream>
+#include <streambuf>
 
 namespace cs237 {
 
@@ -54,6 +55,17 @@ static size_t sizeOfType (ChannelTy ty)
 
 } /* sizeOfType */
 
+//! \brief a read-only stream buffer over a block of memory, which lets us decode
+//!        PNG images that have already been read into memory
+class MemBuf : public std::streambuf {
+  public:
+    MemBuf (const void *data, size_t nBytes)
+    {
+        char *p = const_cast<char *>(static_cast<const char *>(data));
+        this->setg (p, p, p + nBytes);
+    }
+};
+
 //! \brief read function wrapper around an istream.
 static void readData (png_struct *pngPtr, png_bytep data, png_size_t length)
 {
@@ -78,7 +90,7 @@ static void readData (png_struct *pngPtr, png_bytep data, png_size_t length)
 //! \param sRGBOut output variable set to true if the image should be interpreted as sRGB
 //! \return a pointer to the image data, or nullptr on error
 void *readPNG (
-    std::ifstream &inS, bool flip, uint32_t *widOut, uint32_t *htOut,
+    std::istream &inS, bool flip, uint32_t *widOut, uint32_t *htOut,
     Channels *fmtOut, ChannelTy *tyOut, bool *sRGBOut)
 {
   /* check PNG signature */
@@ -307,7 +319,7 @@ static void flushData (png_struct *pngPtr)
 //! \param data a pointer to the image data
 //! \return true if the write is successful; otherwise false on error.
 bool writePNG (
-    std::ofstream &outS,
+    std::ostream &outS,
     bool flip, uint32_t wid, uint32_t ht,
     Channels fmt, ChannelTy ty, void *data)
 {
@@ -481,7 +493,7 @@ VkFormat toVkFormat (Channels chans, ChannelTy ty, bool isRGB)
 /***** virtual base class __detail::ImageBase member functions *****/
 
 ImageBase::ImageBase (uint32_t nd, Channels chans, ChannelTy ty, size_t npixels)
-  : _nDims(nd), _chans(chans), _type(ty),
+  : _nDims(nd), _chans(chans), _type(ty), _sRGB(false),
     _nBytes(numChannels(chans) * npixels * sizeOfType(ty))
 {
     this->_data = std::malloc(this->_nBytes);
@@ -620,7 +632,10 @@ bool Image1D::write (const char *file)
 
 Image2D::Image2D (uint32_t wid, uint32_t ht, Channels chans, ChannelTy ty)
     : __detail::ImageBase (2, chans, ty, wid * ht), _wid(wid), _ht(ht)
-{ }
+{
+  // 2D images are assumed to hold color data (see DataImage2D)
+    this->_sRGB = true;
+}
 
 Image2D::Image2D (std::string const &file, bool flip)
     : __detail::ImageBase (2)
@@ -652,7 +667,7 @@ Image2D::Image2D (std::string const &file, bool flip)
     }
 }
 
-Image2D::Image2D (std::ifstream &inS, bool flip)
+Image2D::Image2D (std::istream &inS, bool flip)
     : __detail::ImageBase (2)
 {
     this->_data = readPNG(
@@ -670,6 +685,27 @@ Image2D::Image2D (std::ifstream &inS, bool flip)
     }
 }
 
+Image2D::Image2D (const void *data, size_t nBytes, bool flip)
+    : __detail::ImageBase (2)
+{
+    MemBuf buf(data, nBytes);
+    std::istream inS(&buf);
+
+    this->_data = readPNG(
+        inS, flip, &this->_wid, &this->_ht, &this->_chans, &this->_type, &this->_sRGB);
+    if (this->_data == nullptr) {
+        std::cerr << "Image2D::Image2D: unable to load 2D image from memory" << std::endl;
+        exit (1);
+    }
+    int nChannels = numChannels(this->_chans);
+    this->_nBytes = nChannels * this->_wid * this->_ht * sizeOfType(this->_type);
+
+    // because Vulkan prefers 4-channel images
+    if (nChannels == 3) {
+        this->addAlphaChannel();
+    }
+}
+
 // write the image to a file
 bool Image2D::write (const char *file, bool flip)
 {
@@ -690,7 +726,7 @@ bool Image2D::write (const char *file, bool flip)
 }
 
 // write the image to an output stream
-bool Image2D::write (std::ofstream &outS, bool flip)
+bool Image2D::write (std::ostream &outS, bool flip)
 {
     bool sts = writePNG (outS, flip, this->_wid, this->_ht, this->_chans, this->_type, this->_data);
 
@@ -727,6 +763,55 @@ void Image2D::bitblt (Image2D const &src, uint32_t row, uint32_t col)
     }
 }
 
+/***** class CompressedImage2D member functions *****/
+
+CompressedImage2D::CompressedImage2D (
+    VkFormat fmt, uint32_t wid, uint32_t ht, uint32_t nLevels)
+  : _fmt(fmt), _wid(wid), _ht(ht)
+{
+    if (! isCompressedFormat(fmt)) {
+        std::cerr << "CompressedImage2D::CompressedImage2D: unsupported format "
+            << static_cast<int>(fmt) << "\n";
+        exit (1);
+    }
+    if ((nLevels == 0) || (std::max(wid, ht) >> (nLevels - 1)) == 0) {
+        std::cerr << "CompressedImage2D::CompressedImage2D: invalid number of levels ("
+            << nLevels << ") for " << wid << "x" << ht << " image\n";
+        exit (1);
+    }
+
+    this->_offsets.resize (nLevels + 1);
+    size_t offset = 0;
+    for (uint32_t lvl = 0;  lvl < nLevels;  lvl++) {
+        this->_offsets[lvl] = offset;
+        offset += levelBytes (fmt, this->levelWidth(lvl), this->levelHeight(lvl));
+    }
+    this->_offsets[nLevels] = offset;
+    this->_data.resize (offset);
+}
+
+bool CompressedImage2D::isCompressedFormat (VkFormat fmt)
+{
+    return (blockBytes(fmt) != 0);
+}
+
+size_t CompressedImage2D::blockBytes (VkFormat fmt)
+{
+    switch (fmt) {
+    case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+    case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+    case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+    case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+        return 8;
+    case VK_FORMAT_BC3_UNORM_BLOCK:
+    case VK_FORMAT_BC3_SRGB_BLOCK:
+    case VK_FORMAT_BC5_UNORM_BLOCK:
+        return 16;
+    default:
+        return 0;
+    }
+}
+
 std::string to_string (Channels ch)
 {
     switch (ch) {
@@ -26,6 +26,7 @@ namespace json {
 class Input {
   public:
     Input (std::string filename);
+    Input (std::string name, std::string const &text);
     ~Input () { delete this->_buffer; }
 
 
@@ -94,6 +95,13 @@ Input::Input (std::string filename)
     this->_len = length;
 }
 
+Input::Input (std::string name, std::string const &text)
+    : _file(name), _buffer(nullptr), _i(0), _lnum(1), _len(text.size())
+{
+    this->_buffer = new char[this->_len];
+    text.copy (this->_buffer, this->_len);
+}
+
 // forward decls
 static bool skipWhitespace (Input &datap);
 static Value *parse (Input &datap);
@@ -120,6 +128,26 @@ Value *parseFile (std::string filename)
 
 }
 
+// parse json text that is already in memory; this returns nullptr if there is a
+// parsing error
+Value *parseString (std::string const &text, std::string name)
+{
+    Input datap(name, text);
+    if (datap.eof()) {
+#ifndef NDEBUG
+        std::cerr << "json::parseString: \"" << name << "\" is empty" << std::endl;
+#endif
+        return nullptr;
+    }
+
+    if (! skipWhitespace (datap)) {
+        return nullptr;
+    }
+
+    return parse (datap);
+
+}
+
 static bool skipWhitespace (Input &datap)
 {
     while ((! datap.eof()) && isspace(*datap))
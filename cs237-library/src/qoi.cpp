@@ -0,0 +1,248 @@
+/*! \file qoi.cpp
+ *
+ * An implementation of the QOI image format, which follows the reference
+ * implementation by Dominic Szablewski.
+ *
+ * \author John Reppy
+ */
+
+/*
+ * COPYRIGHT (c) 2022 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#include "qoi.hpp"
+#include <cstring>
+
+/* A QOI image is a 14-byte header, followed by a sequence of chunks, followed by an
+ * 8-byte end marker (seven 0x00 bytes and a 0x01).  The encoder and decoder track the
+ * previous pixel (initially opaque black) and a 64-entry table of recently seen pixels
+ * (initially zero), which is indexed by a hash of the pixel.  The chunks are:
+ *
+ *      0b00xxxxxx                      QOI_OP_INDEX: the pixel at index x of the table
+ *      0b01rrggbb                      QOI_OP_DIFF: small differences from the
+ *                                      previous pixel (biased by 2)
+ *      0b10gggggg 0brrrrbbbb           QOI_OP_LUMA: a green difference (biased by 32)
+ *                                      and red and blue differences relative to it
+ *                                      (biased by 8)
+ *      0b11xxxxxx                      QOI_OP_RUN: the previous pixel repeated x+1
+ *                                      times (x < 62)
+ *      0xfe r g b                      QOI_OP_RGB: a pixel with the previous alpha
+ *      0xff r g b a                    QOI_OP_RGBA: a pixel
+ */
+
+namespace qoi {
+
+static constexpr uint32_t kMagic = 0x716f6966;  // "qoif" in big-endian order
+static constexpr size_t kHeaderSize = 14;
+static constexpr size_t kPaddingSize = 8;
+static const uint8_t kPadding[kPaddingSize] = {0, 0, 0, 0, 0, 0, 0, 1};
+
+static constexpr uint8_t kOpIndex = 0x00;
+static constexpr uint8_t kOpDiff = 0x40;
+static constexpr uint8_t kOpLuma = 0x80;
+static constexpr uint8_t kOpRun = 0xc0;
+static constexpr uint8_t kOpRGB = 0xfe;
+static constexpr uint8_t kOpRGBA = 0xff;
+static constexpr uint8_t kMask2 = 0xc0;
+
+//! the maximum image size that we accept (the same limit as the reference code)
+static constexpr uint64_t kMaxPixels = 400000000;
+
+//! a pixel
+union Pixel {
+    struct { uint8_t r, g, b, a; } rgba;
+    uint32_t v;
+};
+
+inline uint32_t hash (Pixel px)
+{
+    return (px.rgba.r * 3 + px.rgba.g * 5 + px.rgba.b * 7 + px.rgba.a * 11) & 63;
+}
+
+inline uint32_t read32 (const uint8_t *p)
+{
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3];
+}
+
+inline void write32 (std::vector<uint8_t> &buf, uint32_t v)
+{
+    buf.push_back (static_cast<uint8_t>(v >> 24));
+    buf.push_back (static_cast<uint8_t>(v >> 16));
+    buf.push_back (static_cast<uint8_t>(v >> 8));
+    buf.push_back (static_cast<uint8_t>(v));
+}
+
+bool readHeader (const void *data, size_t nBytes, Header &hdr)
+{
+    const uint8_t *p = static_cast<const uint8_t *>(data);
+    if ((nBytes < kHeaderSize + kPaddingSize) || (read32(p) != kMagic)) {
+        return false;
+    }
+    hdr.width = read32(p + 4);
+    hdr.height = read32(p + 8);
+    hdr.channels = p[12];
+    hdr.colorspace = p[13];
+    return (hdr.width > 0) && (hdr.height > 0)
+        && ((hdr.channels == 3) || (hdr.channels == 4))
+        && (hdr.colorspace <= 1)
+        && (uint64_t(hdr.width) * hdr.height <= kMaxPixels);
+}
+
+bool decode (
+    const void *data, size_t nBytes, uint32_t wid, uint32_t ht,
+    uint8_t *rgba, bool flip)
+{
+    Header hdr;
+    if (! readHeader (data, nBytes, hdr) || (hdr.width != wid) || (hdr.height != ht)) {
+        return false;
+    }
+
+    const uint8_t *p = static_cast<const uint8_t *>(data) + kHeaderSize;
+  // every chunk is at most five bytes and is followed by the eight bytes of the end
+  // marker, so we only need to check for the end of the chunks before each chunk
+    const uint8_t *end = static_cast<const uint8_t *>(data) + nBytes - kPaddingSize;
+
+    Pixel index[64];
+    std::memset (index, 0, sizeof(index));
+    Pixel px;
+    px.rgba.r = px.rgba.g = px.rgba.b = 0;
+    px.rgba.a = 255;
+
+    size_t rowBytes = 4 * size_t(wid);
+    uint8_t *row = flip ? rgba + (ht - 1) * rowBytes : rgba;
+    ptrdiff_t rowStep = flip ? -ptrdiff_t(rowBytes) : ptrdiff_t(rowBytes);
+    uint32_t run = 0;
+    for (uint32_t y = 0;  y < ht;  y++, row += rowStep) {
+        uint8_t *q = row;
+        for (uint32_t x = 0;  x < wid;  x++, q += 4) {
+            if (run > 0) {
+                run--;
+            }
+            else if (p < end) {
+                uint8_t b1 = *p++;
+                if (b1 == kOpRGB) {
+                    px.rgba.r = p[0];
+                    px.rgba.g = p[1];
+                    px.rgba.b = p[2];
+                    p += 3;
+                }
+                else if (b1 == kOpRGBA) {
+                    px.rgba.r = p[0];
+                    px.rgba.g = p[1];
+                    px.rgba.b = p[2];
+                    px.rgba.a = p[3];
+                    p += 4;
+                }
+                else if ((b1 & kMask2) == kOpIndex) {
+                    px = index[b1];
+                }
+                else if ((b1 & kMask2) == kOpDiff) {
+                    px.rgba.r += ((b1 >> 4) & 0x03) - 2;
+                    px.rgba.g += ((b1 >> 2) & 0x03) - 2;
+                    px.rgba.b += (b1 & 0x03) - 2;
+                }
+                else if ((b1 & kMask2) == kOpLuma) {
+                    uint8_t b2 = *p++;
+                    int vg = (b1 & 0x3f) - 32;
+                    px.rgba.r += vg - 8 + ((b2 >> 4) & 0x0f);
+                    px.rgba.g += vg;
+                    px.rgba.b += vg - 8 + (b2 & 0x0f);
+                }
+                else {  // kOpRun
+                    run = (b1 & 0x3f);
+                }
+                index[hash(px)] = px;
+            }
+            else {
+              // truncated data
+                return false;
+            }
+            std::memcpy (q, &px, 4);
+        }
+    }
+
+    return true;
+}
+
+std::vector<uint8_t> encode (const uint8_t *rgba, uint32_t wid, uint32_t ht, bool sRGB)
+{
+    std::vector<uint8_t> buf;
+    size_t nPixels = size_t(wid) * ht;
+    buf.reserve (kHeaderSize + nPixels + kPaddingSize);
+
+    write32 (buf, kMagic);
+    write32 (buf, wid);
+    write32 (buf, ht);
+    buf.push_back (4);
+    buf.push_back (sRGB ? 0 : 1);
+
+    Pixel index[64];
+    std::memset (index, 0, sizeof(index));
+    Pixel prev;
+    prev.rgba.r = prev.rgba.g = prev.rgba.b = 0;
+    prev.rgba.a = 255;
+
+    uint32_t run = 0;
+    for (size_t i = 0;  i < nPixels;  i++) {
+        Pixel px;
+        std::memcpy (&px, rgba + 4 * i, 4);
+
+        if (px.v == prev.v) {
+            run++;
+            if ((run == 62) || (i == nPixels - 1)) {
+                buf.push_back (kOpRun | (run - 1));
+                run = 0;
+            }
+            continue;
+        }
+
+        if (run > 0) {
+            buf.push_back (kOpRun | (run - 1));
+            run = 0;
+        }
+
+        uint32_t h = hash(px);
+        if (index[h].v == px.v) {
+            buf.push_back (kOpIndex | h);
+        }
+        else {
+            index[h] = px;
+            if (px.rgba.a == prev.rgba.a) {
+                int8_t vr = static_cast<int8_t>(px.rgba.r - prev.rgba.r);
+                int8_t vg = static_cast<int8_t>(px.rgba.g - prev.rgba.g);
+                int8_t vb = static_cast<int8_t>(px.rgba.b - prev.rgba.b);
+                int8_t vgr = vr - vg;
+                int8_t vgb = vb - vg;
+                if ((vr > -3) && (vr < 2) && (vg > -3) && (vg < 2) && (vb > -3) && (vb < 2)) {
+                    buf.push_back (kOpDiff | ((vr + 2) << 4) | ((vg + 2) << 2) | (vb + 2));
+                }
+                else if ((vgr > -9) && (vgr < 8) && (vg > -33) && (vg < 32)
+                && (vgb > -9) && (vgb < 8)) {
+                    buf.push_back (kOpLuma | (vg + 32));
+                    buf.push_back (((vgr + 8) << 4) | (vgb + 8));
+                }
+                else {
+                    buf.push_back (kOpRGB);
+                    buf.push_back (px.rgba.r);
+                    buf.push_back (px.rgba.g);
+                    buf.push_back (px.rgba.b);
+                }
+            }
+            else {
+                buf.push_back (kOpRGBA);
+                buf.push_back (px.rgba.r);
+                buf.push_back (px.rgba.g);
+                buf.push_back (px.rgba.b);
+                buf.push_back (px.rgba.a);
+            }
+        }
+        prev = px;
+    }
+
+    buf.insert (buf.end(), kPadding, kPadding + kPaddingSize);
+
+    return buf;
+}
+
+} // namespace qoi
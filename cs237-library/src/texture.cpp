@@ -20,7 +20,14 @@ TextureBase::TextureBase (
     Application *app,
     uint32_t wid, uint32_t ht, uint32_t mipLvls,
     cs237::__detail::ImageBase const *img)
-  : _app(app), _wid(wid), _ht(ht), _nMipLevels(mipLvls), _fmt(img->format())
+  : TextureBase (app, wid, ht, mipLvls, img->format())
+{ }
+
+TextureBase::TextureBase (
+    Application *app,
+    uint32_t wid, uint32_t ht, uint32_t mipLvls,
+    VkFormat fmt)
+  : _app(app), _wid(wid), _ht(ht), _nMipLevels(mipLvls), _nLayers(1), _fmt(fmt)
 {
     VkImageUsageFlags usage = (mipLvls > 1) ?
         VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT :
@@ -39,6 +46,31 @@ TextureBase::TextureBase (
 
 }
 
+TextureBase::TextureBase (
+    Application *app,
+    uint32_t wid, uint32_t ht, uint32_t mipLvls, uint32_t nLayers,
+    VkFormat fmt)
+  : _app(app), _wid(wid), _ht(ht), _nMipLevels(mipLvls), _nLayers(nLayers), _fmt(fmt)
+{
+    VkImageUsageFlags usage = (mipLvls > 1) ?
+        VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT :
+        VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    this->_img = app->_createImage (
+        wid, ht, this->_fmt,
+        VK_IMAGE_TILING_OPTIMAL,
+        usage,
+        mipLvls,
+        nLayers);
+    this->_mem = app->_allocImageMemory(
+        this->_img,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    this->_view = app->_createArrayImageView(
+        this->_img, this->_fmt,
+        VK_IMAGE_ASPECT_COLOR_BIT,
+        mipLvls, nLayers);
+
+}
+
 TextureBase::~TextureBase ()
 {
     vkDestroyImageView(this->_app->_device, this->_view, nullptr);
@@ -80,6 +112,135 @@ void TextureBase::_init (cs237::__detail::ImageBase const *img)
     vkDestroyBuffer(device, stagingBuf, nullptr);
 }
 
+void TextureBase::_recordUpload (
+    VkCommandBuffer cmdBuf,
+    uint32_t layer,
+    VkBuffer buf,
+    std::vector<VkBufferImageCopy> const &regions,
+    bool genMipMaps,
+    VkImageLayout oldLayout)
+{
+    if (genMipMaps) {
+        VkFormatProperties props = this->_app->formatProps(this->_fmt);
+        if (!(props.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT)) {
+            ERROR("texture-image format does not support linear blitting!");
+        }
+    }
+
+    // the barriers only cover the layer being updated, so the other layers can
+    // still be in use
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.image = this->_img;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.levelCount = this->_nMipLevels;
+    barrier.subresourceRange.baseArrayLayer = layer;
+    barrier.subresourceRange.layerCount = 1;
+
+    barrier.oldLayout = oldLayout;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    VkPipelineStageFlags srcStage;
+    if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED) {
+        barrier.srcAccessMask = 0;
+        srcStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+    } else {
+        barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        srcStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    }
+
+    vkCmdPipelineBarrier(cmdBuf,
+        srcStage, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+        0, nullptr,
+        0, nullptr,
+        1, &barrier);
+
+    vkCmdCopyBufferToImage(cmdBuf,
+        buf, this->_img, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        static_cast<uint32_t>(regions.size()), regions.data());
+
+    uint32_t nSrcLevels = 0;  // number of levels in the TRANSFER_SRC layout
+    if (genMipMaps) {
+        int32_t mipWid = this->_wid;
+        int32_t mipHt = this->_ht;
+        barrier.subresourceRange.levelCount = 1;
+        for (uint32_t i = 1; i < this->_nMipLevels; i++) {
+            // make level i-1 the source of the blit
+            barrier.subresourceRange.baseMipLevel = i - 1;
+            barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+            barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+            vkCmdPipelineBarrier(cmdBuf,
+                VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                0, nullptr,
+                0, nullptr,
+                1, &barrier);
+
+            int32_t nextWid = (mipWid > 1) ? (mipWid >> 1) : 1;
+            int32_t nextHt = (mipHt > 1) ? (mipHt >> 1) : 1;
+
+            VkImageBlit blit{};
+            blit.srcOffsets[0] = {0, 0, 0};
+            blit.srcOffsets[1] = { mipWid, mipHt, 1 };
+            blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            blit.srcSubresource.mipLevel = i - 1;
+            blit.srcSubresource.baseArrayLayer = layer;
+            blit.srcSubresource.layerCount = 1;
+            blit.dstOffsets[0] = {0, 0, 0};
+            blit.dstOffsets[1] = { nextWid, nextHt, 1 };
+            blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            blit.dstSubresource.mipLevel = i;
+            blit.dstSubresource.baseArrayLayer = layer;
+            blit.dstSubresource.layerCount = 1;
+
+            vkCmdBlitImage(cmdBuf,
+                this->_img, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                this->_img, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                1, &blit,
+                VK_FILTER_LINEAR);
+
+            mipWid = nextWid;
+            mipHt = nextHt;
+        }
+        nSrcLevels = this->_nMipLevels - 1;
+    }
+
+    // transition the layer to the shader layout; the levels that were blit
+    // sources are in a different layout from the last level
+    if (nSrcLevels > 0) {
+        barrier.subresourceRange.baseMipLevel = 0;
+        barrier.subresourceRange.levelCount = nSrcLevels;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+        vkCmdPipelineBarrier(cmdBuf,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+            0, nullptr,
+            0, nullptr,
+            1, &barrier);
+    }
+    barrier.subresourceRange.baseMipLevel = nSrcLevels;
+    barrier.subresourceRange.levelCount = this->_nMipLevels - nSrcLevels;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+    vkCmdPipelineBarrier(cmdBuf,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+        0, nullptr,
+        0, nullptr,
+        1, &barrier);
+
+}
+
 } // namespce __detail
 
 /******************** class Texture1D methods ********************/
@@ -124,6 +285,48 @@ static uint32_t mipLevels (Image2D const *img, bool mipmap)
     }
 }
 
+// the copy region for an uncompressed image whose data starts at the given
+// offset in the source buffer
+static std::vector<VkBufferImageCopy> imageRegions (
+    uint32_t layer, VkDeviceSize offset, uint32_t wid, uint32_t ht)
+{
+    std::vector<VkBufferImageCopy> regions(1);
+    VkBufferImageCopy &region = regions[0];
+    region.bufferOffset = offset;
+    region.bufferRowLength = 0;
+    region.bufferImageHeight = 0;
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.mipLevel = 0;
+    region.imageSubresource.baseArrayLayer = layer;
+    region.imageSubresource.layerCount = 1;
+    region.imageOffset = {0, 0, 0};
+    region.imageExtent = { wid, ht, 1 };
+
+    return regions;
+}
+
+// the copy regions (one per mipmap level) for a compressed image whose data
+// starts at the given offset in the source buffer
+static std::vector<VkBufferImageCopy> compressedRegions (
+    uint32_t layer, VkDeviceSize offset, CompressedImage2D const *img)
+{
+    std::vector<VkBufferImageCopy> regions(img->nLevels());
+    for (uint32_t i = 0;  i < img->nLevels();  i++) {
+        VkBufferImageCopy &region = regions[i];
+        region.bufferOffset = offset + img->levelOffset(i);
+        region.bufferRowLength = 0;
+        region.bufferImageHeight = 0;
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.mipLevel = i;
+        region.imageSubresource.baseArrayLayer = layer;
+        region.imageSubresource.layerCount = 1;
+        region.imageOffset = {0, 0, 0};
+        region.imageExtent = { img->levelWidth(i), img->levelHeight(i), 1 };
+    }
+
+    return regions;
+}
+
 Texture2D::Texture2D (Application *app, Image2D const *img, bool mipmap)
   : __detail::TextureBase(app, img->width(), img->height(), mipLevels(img, mipmap), img)
 {
@@ -134,6 +337,89 @@ Texture2D::Texture2D (Application *app, Image2D const *img, bool mipmap)
     }
 }
 
+Texture2D::Texture2D (Application *app, CompressedImage2D const *img)
+  : __detail::TextureBase(app, img->width(), img->height(), img->nLevels(), img->format())
+{
+    this->_initCompressed (img);
+}
+
+Texture2D::Texture2D (
+    Application *app,
+    uint32_t wid, uint32_t ht,
+    VkFormat fmt, uint32_t mipLvls)
+  : __detail::TextureBase(app, wid, ht, mipLvls, fmt)
+{ }
+
+void Texture2D::recordUpdate (
+    VkCommandBuffer cmdBuf,
+    VkBuffer buf, VkDeviceSize offset,
+    Image2D const *img)
+{
+    assert ((img->width() == this->_wid) && (img->height() == this->_ht));
+    assert (img->format() == this->_fmt);
+
+    this->_recordUpload (
+        cmdBuf, 0, buf,
+        imageRegions (0, offset, this->_wid, this->_ht),
+        this->_nMipLevels > 1,
+        VK_IMAGE_LAYOUT_UNDEFINED);
+
+}
+
+void Texture2D::recordUpdate (
+    VkCommandBuffer cmdBuf,
+    VkBuffer buf, VkDeviceSize offset,
+    CompressedImage2D const *img)
+{
+    assert ((img->width() == this->_wid) && (img->height() == this->_ht));
+    assert ((img->format() == this->_fmt) && (img->nLevels() == this->_nMipLevels));
+
+    this->_recordUpload (
+        cmdBuf, 0, buf,
+        compressedRegions (0, offset, img),
+        false,
+        VK_IMAGE_LAYOUT_UNDEFINED);
+
+}
+
+// helper function for copying a compressed image, including its mipmap levels, into
+// the texture using a single command buffer
+void Texture2D::_initCompressed (CompressedImage2D const *img)
+{
+    size_t nBytes = img->nBytes();
+    auto device = this->_app->_device;
+
+    // create a staging buffer holding all of the levels
+    VkBuffer stagingBuf = this->_createBuffer (
+        nBytes, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+    VkDeviceMemory stagingBufMem = this->_allocBufferMemory(
+        stagingBuf,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+    void* stagingData;
+    vkMapMemory(device, stagingBufMem, 0, nBytes, 0, &stagingData);
+    memcpy(stagingData, img->data(), nBytes);
+    vkUnmapMemory(device, stagingBufMem);
+
+    VkCommandBuffer cmdBuf = this->_app->newCommandBuf();
+
+    this->_app->beginCommands(cmdBuf);
+
+    this->_recordUpload (
+        cmdBuf, 0, stagingBuf,
+        compressedRegions (0, 0, img),
+        false,
+        VK_IMAGE_LAYOUT_UNDEFINED);
+
+    this->_app->endCommands(cmdBuf);
+    this->_app->submitCommands(cmdBuf);
+    this->_app->freeCommandBuf(cmdBuf);
+
+    // free up the staging buffer
+    vkFreeMemory(device, stagingBufMem, nullptr);
+    vkDestroyBuffer(device, stagingBuf, nullptr);
+}
+
 // helper function for generating the mipmaps for a texture
 void Texture2D::_generateMipMaps (Image2D const *img)
 {
@@ -271,4 +557,148 @@ void Texture2D::_generateMipMaps (Image2D const *img)
 
 }
 
+/******************** class Texture2DArray methods ********************/
+
+Texture2DArray::Texture2DArray (
+    Application *app,
+    uint32_t wid, uint32_t ht, uint32_t nLayers,
+    VkFormat fmt, uint32_t mipLvls)
+  : __detail::TextureBase(app, wid, ht, mipLvls, nLayers, fmt)
+{
+    if (nLayers > app->limits()->maxImageArrayLayers) {
+        ERROR("too many layers for array texture");
+    }
+
+    // put all of the layers into the layout that the shaders expect, so that the
+    // texture can be bound before all of its layers have been filled in
+    VkCommandBuffer cmdBuf = this->_app->newCommandBuf();
+
+    this->_app->beginCommands(cmdBuf);
+
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.image = this->_img;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.levelCount = this->_nMipLevels;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = this->_nLayers;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+    vkCmdPipelineBarrier(cmdBuf,
+        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+        0, nullptr,
+        0, nullptr,
+        1, &barrier);
+
+    this->_app->endCommands(cmdBuf);
+    this->_app->submitCommands(cmdBuf);
+    this->_app->freeCommandBuf(cmdBuf);
+
+}
+
+void Texture2DArray::update (uint32_t layer, Image2D const *img)
+{
+    assert (layer < this->_nLayers);
+    assert ((img->width() == this->_wid) && (img->height() == this->_ht));
+    assert (img->format() == this->_fmt);
+
+    this->_upload (
+        layer, img->data(), img->nBytes(),
+        imageRegions (layer, 0, this->_wid, this->_ht),
+        this->_nMipLevels > 1);
+
+}
+
+void Texture2DArray::update (uint32_t layer, CompressedImage2D const *img)
+{
+    assert (layer < this->_nLayers);
+    assert ((img->width() == this->_wid) && (img->height() == this->_ht));
+    assert ((img->format() == this->_fmt) && (img->nLevels() == this->_nMipLevels));
+
+    this->_upload (
+        layer, img->data(), img->nBytes(),
+        compressedRegions (layer, 0, img),
+        false);
+
+}
+
+void Texture2DArray::recordUpdate (
+    VkCommandBuffer cmdBuf,
+    uint32_t layer,
+    VkBuffer buf, VkDeviceSize offset,
+    Image2D const *img)
+{
+    assert (layer < this->_nLayers);
+    assert ((img->width() == this->_wid) && (img->height() == this->_ht));
+    assert (img->format() == this->_fmt);
+
+    this->_recordUpload (
+        cmdBuf, layer, buf,
+        imageRegions (layer, offset, this->_wid, this->_ht),
+        this->_nMipLevels > 1,
+        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+}
+
+void Texture2DArray::recordUpdate (
+    VkCommandBuffer cmdBuf,
+    uint32_t layer,
+    VkBuffer buf, VkDeviceSize offset,
+    CompressedImage2D const *img)
+{
+    assert (layer < this->_nLayers);
+    assert ((img->width() == this->_wid) && (img->height() == this->_ht));
+    assert ((img->format() == this->_fmt) && (img->nLevels() == this->_nMipLevels));
+
+    this->_recordUpload (
+        cmdBuf, layer, buf,
+        compressedRegions (layer, offset, img),
+        false,
+        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+}
+
+void Texture2DArray::_upload (
+    uint32_t layer,
+    const void *data, size_t nBytes,
+    std::vector<VkBufferImageCopy> const &regions,
+    bool genMipMaps)
+{
+    auto device = this->_app->_device;
+
+    // create a staging buffer for copying the data
+    VkBuffer stagingBuf = this->_createBuffer (
+        nBytes, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+    VkDeviceMemory stagingBufMem = this->_allocBufferMemory(
+        stagingBuf,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+    void* stagingData;
+    vkMapMemory(device, stagingBufMem, 0, nBytes, 0, &stagingData);
+    memcpy(stagingData, data, nBytes);
+    vkUnmapMemory(device, stagingBufMem);
+
+    VkCommandBuffer cmdBuf = this->_app->newCommandBuf();
+
+    this->_app->beginCommands(cmdBuf);
+
+    this->_recordUpload (
+        cmdBuf, layer, stagingBuf, regions, genMipMaps,
+        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+    this->_app->endCommands(cmdBuf);
+    this->_app->submitCommands(cmdBuf);
+    this->_app->freeCommandBuf(cmdBuf);
+
+    // free up the staging buffer
+    vkFreeMemory(device, stagingBufMem, nullptr);
+    vkDestroyBuffer(device, stagingBuf, nullptr);
+}
+
 } // namespace cs237
@@ -1,8 +1,8 @@
 /*! \file tqt.cpp
  *
  * Implementation of texture quadtrees.  This implementation is based on the public-domain
- * implementation by Thatcher Ulrich.  The main difference is that we use PNG files to
- * represent the texture data.
+ * implementation by Thatcher Ulrich.  The main difference is that we use PNG or QOI
+ * images, or GPU block-compressed mipmap chains, to represent the texture data.
  *
  * \author John Reppy
  */
@@ -14,6 +14,17 @@
 
 #include "cs237.hpp"
 #include "tqt.hpp"
+#include "qoi.hpp"
+#include "bc-decode.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sstream>
+#include <sys/stat.h>
+#include <unistd.h>
 
 /***** inline utility functions *****/
 
@@ -35,134 +46,344 @@ inline uint32_t nodeIndex (uint32_t level, uint32_t row, uint32_t col)
     return fullSize(level) + (row << level) + col;
 }
 
-inline bool readUI32 (std::ifstream *inS, uint32_t &v)
+// flip the rows of a square RGBA8 image in place
+static void flipRows (uint8_t *pixels, int wid)
 {
-    if (inS->read(reinterpret_cast<char *>(&v), sizeof(v)).fail()) {
-#ifndef NDEBUG
-        std::cerr << "TextureQTree::loadImage: error reading file" << std::endl;
-#endif
-        return false;
+    size_t rowBytes = 4 * size_t(wid);
+    for (int r = 0;  r < wid / 2;  r++) {
+        std::swap_ranges (
+            pixels + r * rowBytes, pixels + (r + 1) * rowBytes,
+            pixels + (wid - 1 - r) * rowBytes);
     }
-    else
-        return true;
 }
 
-inline bool readUI64 (std::ifstream *inS, uint64_t &v)
+// read a range of a file using a positional read, which does not use or change the
+// file position, so it is safe to call from multiple threads on the same descriptor;
+// returns false on error
+static bool readRange (int fd, uint64_t offset, void *buf, size_t n)
 {
-    if (inS->read(reinterpret_cast<char *>(&v), sizeof(v)).fail()) {
-#ifndef NDEBUG
-        std::cerr << "TextureQTree::loadImage: error reading file" << std::endl;
-#endif
-        return false;
+    uint8_t *p = static_cast<uint8_t *>(buf);
+    while (n > 0) {
+        ssize_t nb = pread (fd, p, n, static_cast<off_t>(offset));
+        if (nb < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        else if (nb == 0) {
+          // unexpected end of file
+            return false;
+        }
+        p += nb;
+        offset += nb;
+        n -= nb;
     }
-    else
-        return true;
+    return true;
+}
+
+// write a buffer at the given offset of a file using a positional write, which is
+// safe to call from multiple threads on the same descriptor; returns false on error
+static bool writeRange (int fd, uint64_t offset, const void *buf, size_t n)
+{
+    const uint8_t *p = static_cast<const uint8_t *>(buf);
+    while (n > 0) {
+        ssize_t nb = pwrite (fd, p, n, static_cast<off_t>(offset));
+        if (nb < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        p += nb;
+        offset += nb;
+        n -= nb;
+    }
+    return true;
 }
 
 namespace tqt {
 
-  // file header
-    struct Hdr {
-        uint32_t        magic;          // magic number
-        uint32_t        version;        // file format version
-        uint32_t        depth;          // tree depth
-        uint32_t        tileSize;       // width of tiles; should be power of 2
-    };
+  // the size of the header for a given version
+    inline size_t headerSize (uint32_t version)
+    {
+        return (version == kVersionBC) ? sizeof(FileHdrV2) : sizeof(FileHdr);
+    }
 
-    #define TQT_MAGIC   0x00545154      // "TQT\0" in little-endian order
-    #define TQT_VERSION 1
+  // the number of bytes in a compressed tile with a complete mipmap chain
+    static size_t compressedTileBytes (VkFormat fmt, uint32_t tileSize, uint32_t nLevels)
+    {
+        size_t nb = 0;
+        for (uint32_t lvl = 0;  lvl < nLevels;  lvl++) {
+            uint32_t wid = std::max(1u, tileSize >> lvl);
+            nb += cs237::CompressedImage2D::levelBytes (fmt, wid, wid);
+        }
+        return nb;
+    }
 
-    static bool readHeader (std::ifstream *inS, Hdr &hdr)
+  // read and check the header; for version 1 files, the format is set to PNG and
+  // the number of levels to 1
+    static bool readHeader (int fd, uint64_t base, uint64_t size, FileHdrV2 &hdr)
     {
-      // read header data
-        if ((! readUI32(inS, hdr.magic))
-        ||  (! readUI32(inS, hdr.version))
-        ||  (! readUI32(inS, hdr.depth))
-        ||  (! readUI32(inS, hdr.tileSize))) {
+      // read the common part of the header
+        if ((size < sizeof(FileHdr)) || ! readRange (fd, base, &hdr.hdr, sizeof(FileHdr))) {
             return false;
         }
 
       // check data
-        if ((hdr.magic != TQT_MAGIC) || (hdr.version != TQT_VERSION)) {
+        if ((hdr.hdr.magic != kMagic)
+        || ((hdr.hdr.version != kVersionPNG) && (hdr.hdr.version != kVersionBC))) {
+            return false;
+        }
+        uint32_t ts = hdr.hdr.tileSize;
+        if ((hdr.hdr.depth == 0) || (hdr.hdr.depth > 16) || (ts == 0) || ((ts & (ts - 1)) != 0)) {
             return false;
         }
-// FIXME: should also check that depth is reasonable and tileSize is power of 2
 
-        return true;
+        if (hdr.hdr.version == kVersionPNG) {
+            hdr.format = static_cast<uint32_t>(Format::PNG);
+            hdr.nLevels = 1;
+            return true;
+        }
+
+      // the version 2 header extension
+        if ((size < sizeof(FileHdrV2))
+        || ! readRange (fd, base + sizeof(FileHdr), &hdr.format, 2 * sizeof(uint32_t))) {
+            return false;
+        }
+        switch (static_cast<Format>(hdr.format)) {
+        case Format::BC1:
+        case Format::BC3:
+        case Format::BC5: {
+              // the tiles must have complete mipmap chains
+                uint32_t nLevels = 1;
+                while ((ts >> nLevels) > 0) {
+                    nLevels++;
+                }
+                return (hdr.nLevels == nLevels);
+            }
+        case Format::QOI:
+            return (hdr.nLevels == 1);
+        default:
+            return false;
+        }
     }
 
     /***** class TextureQuadTree member functions *****/
 
+  // the source of unique tree IDs
+    static std::atomic<uint64_t> gNextId(1);
+
     TextureQTree::TextureQTree (std::string const &filename, bool flip, bool sRGB)
-        : _flip(flip), _sRGB(sRGB), _source(nullptr)
+        : _id(gNextId.fetch_add(1)), _flip(flip), _sRGB(sRGB), _fd(-1), _ownsFd(true),
+          _base(0)
     {
-        Hdr hdr;
-
-        std::ifstream *inS = new std::ifstream(filename);
-        if (inS->fail()) {
+        int fd = open (filename.c_str(), O_RDONLY);
+        struct stat st;
+        if ((fd < 0) || (fstat(fd, &st) < 0)) {
 #ifndef NDEBUG
             std::cerr << "TextureQTree::TextureQTree: unable to open \""
                 << filename << "\"\n";
-            delete inS;
 #endif
             exit (1);
         }
-        else if (! readHeader(inS, hdr)) {
+        this->_init (fd, 0, static_cast<uint64_t>(st.st_size), filename);
+    }
+
+    TextureQTree::TextureQTree (int fd, uint64_t base, uint64_t size, bool flip, bool sRGB)
+        : _id(gNextId.fetch_add(1)), _flip(flip), _sRGB(sRGB), _fd(-1), _ownsFd(false),
+          _base(base)
+    {
+        this->_init (fd, base, size, "<embedded>");
+    }
+
+    TextureQTree::TextureQTree (int depth, int tileSize, TileFn tileFn, bool flip, bool sRGB)
+        : _id(gNextId.fetch_add(1)), _depth(depth), _tileSize(tileSize),
+          _version(kVersionPNG), _format(Format::PNG), _nLevels(1), _flip(flip), _sRGB(sRGB),
+          _fd(-1), _ownsFd(false), _base(0), _tileFn(tileFn)
+    {
+        assert ((depth > 0) && (depth <= 16));
+        assert ((tileSize > 0) && ((tileSize & (tileSize - 1)) == 0));
+    }
+
+    void TextureQTree::_init (int fd, uint64_t base, uint64_t size, std::string const &name)
+    {
+        FileHdrV2 hdr;
+        if (! readHeader (fd, base, size, hdr)) {
 #ifndef NDEBUG
-            std::cerr << "TextureQTree::TextureQTree: file \"" << filename
+            std::cerr << "TextureQTree::TextureQTree: file \"" << name
                 << "\" has bogus header\n";
-            delete inS;
 #endif
             exit (1);
         }
-        else {
-            this->_depth = hdr.depth;
-            this->_tileSize = hdr.tileSize;
-            int nTiles = fullSize(hdr.depth);
-            this->_toc.resize(nTiles, 0);
-            this->_source = inS;
-          // read the TOC
-            for (int i = 0;  i < nTiles;  i++) {
-                uint64_t offset;
-                if (! readUI64(inS, offset)) {
+
+        this->_depth = hdr.hdr.depth;
+        this->_tileSize = hdr.hdr.tileSize;
+        this->_version = hdr.hdr.version;
+        this->_format = static_cast<Format>(hdr.format);
+        this->_nLevels = hdr.nLevels;
+        size_t hdrSize = headerSize(hdr.hdr.version);
+        int nTiles = fullSize(hdr.hdr.depth);
+        std::vector<uint64_t> toc(nTiles);
+        if (((size - hdrSize) / sizeof(uint64_t) < toc.size())
+        || ! readRange (fd, base + hdrSize, toc.data(), nTiles * sizeof(uint64_t))) {
 #ifndef NDEBUG
-                    std::cerr << "TextureQTree::TextureQTree: file \"" << filename
-                        << "\" has bogus TOC\n";
+            std::cerr << "TextureQTree::TextureQTree: file \"" << name
+                << "\" has bogus TOC\n";
 #endif
-                    this->_source = nullptr;
-                    inS->close();
-                    delete inS;
-                    exit (1);
-                }
-                this->_toc[i] = static_cast<std::streamoff>(offset);
+            exit (1);
+        }
+
+      // the tiles are stored back to back, so the size of a PNG or QOI tile is the
+      // distance to the next tile in the file (or to the end of the TQT for the last one).  The
+      // size of a compressed tile is determined by its format, but it must also fit.
+        size_t cTileBytes = this->isCompressed()
+            ? compressedTileBytes (this->_vkFormat(), this->_tileSize, this->_nLevels)
+            : 0;
+        std::vector<uint64_t> sorted = toc;
+        sorted.push_back (size);
+        std::sort (sorted.begin(), sorted.end());
+        this->_toc.resize (nTiles);
+        this->_tileBytes.resize (nTiles);
+        for (int i = 0;  i < nTiles;  i++) {
+            uint64_t next = *std::upper_bound (sorted.begin(), sorted.end() - 1, toc[i]);
+            if ((toc[i] > size) || (next - toc[i] > UINT32_MAX)
+            || (next - toc[i] < cTileBytes)) {
+#ifndef NDEBUG
+                std::cerr << "TextureQTree::TextureQTree: file \"" << name
+                    << "\" has bogus TOC\n";
+#endif
+                exit (1);
             }
+            this->_toc[i] = toc[i];
+            this->_tileBytes[i] = this->isCompressed()
+                ? static_cast<uint32_t>(cTileBytes)
+                : static_cast<uint32_t>(next - toc[i]);
         }
+
+        this->_fd = fd;
     }
 
     TextureQTree::~TextureQTree ()
     {
-        if (this->_source != nullptr) {
-            this->_source->close();
-            delete this->_source;
+        if (this->_ownsFd && (this->_fd >= 0)) {
+            close (this->_fd);
+        }
+    }
+
+    VkFormat TextureQTree::_vkFormat () const
+    {
+        switch (this->_format) {
+        case Format::BC1:
+            return this->_sRGB ? VK_FORMAT_BC1_RGBA_SRGB_BLOCK : VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+        case Format::BC3:
+            return this->_sRGB ? VK_FORMAT_BC3_SRGB_BLOCK : VK_FORMAT_BC3_UNORM_BLOCK;
+        case Format::BC5:
+            return VK_FORMAT_BC5_UNORM_BLOCK;
+        default:
+            return VK_FORMAT_UNDEFINED;
         }
     }
 
-    cs237::Image2D *TextureQTree::loadImage (int level, int row, int col)
+  // the only shared state is the file descriptor, which we do not seek, so this
+  // function is thread safe
+    bool TextureQTree::_readTile (uint32_t index, void *buf) const
+    {
+        if (! readRange (
+            this->_fd, this->_base + this->_toc[index], buf, this->_tileBytes[index]))
+        {
+#ifndef NDEBUG
+            std::cerr << "TextureQTree: error reading file" << std::endl;
+#endif
+            return false;
+        }
+        return true;
+    }
+
+    cs237::Image2D *TextureQTree::loadImage (int level, int row, int col) const
     {
         if (! this->isValid()) {
             return nullptr;
         }
         assert (level < this->_depth);
 
+        cs237::Image2D *img;
+        if (this->isProcedural()) {
+            if (this->_sRGB) {
+                img = new cs237::Image2D (
+                    this->_tileSize, this->_tileSize,
+                    cs237::Channels::RGBA, cs237::ChannelTy::U8);
+            } else {
+                img = new cs237::DataImage2D (
+                    this->_tileSize, this->_tileSize,
+                    cs237::Channels::RGBA, cs237::ChannelTy::U8);
+            }
+            uint8_t *pixels = static_cast<uint8_t *>(img->data());
+            if (! this->_tileFn (level, row, col, pixels)) {
+                delete img;
+                return nullptr;
+            }
+            if (this->_flip) {
+                flipRows (pixels, this->_tileSize);
+            }
+            return img;
+        }
+
         uint32_t index = nodeIndex(level, row, col);
         assert (index < this->_toc.size());
 
-        this->_source->seekg(this->_toc[index]);
-        cs237::Image2D *img;
+        std::vector<uint8_t> buf(this->_tileBytes[index]);
+        if (! this->_readTile (index, buf.data())) {
+            return nullptr;
+        }
+
+        if (this->isCompressed()) {
+          // decode the base level of the compressed tile; this path is for when
+          // the GPU does not support the compressed formats
+            if (this->_sRGB && (this->_format != Format::BC5)) {
+                img = new cs237::Image2D (
+                    this->_tileSize, this->_tileSize,
+                    cs237::Channels::RGBA, cs237::ChannelTy::U8);
+            } else {
+                img = new cs237::DataImage2D (
+                    this->_tileSize, this->_tileSize,
+                    cs237::Channels::RGBA, cs237::ChannelTy::U8);
+            }
+            uint8_t *pixels = static_cast<uint8_t *>(img->data());
+            bc::decode (this->_vkFormat(), this->_tileSize, this->_tileSize, buf.data(), pixels);
+            if (this->_flip) {
+                flipRows (pixels, this->_tileSize);
+            }
+            return img;
+        }
+        else if (this->_format == Format::QOI) {
+          // decode the QOI data straight into the image's pixels
+            if (this->_sRGB) {
+                img = new cs237::Image2D (
+                    this->_tileSize, this->_tileSize,
+                    cs237::Channels::RGBA, cs237::ChannelTy::U8);
+            } else {
+                img = new cs237::DataImage2D (
+                    this->_tileSize, this->_tileSize,
+                    cs237::Channels::RGBA, cs237::ChannelTy::U8);
+            }
+            if (! qoi::decode (buf.data(), buf.size(), this->_tileSize, this->_tileSize,
+                static_cast<uint8_t *>(img->data()), this->_flip))
+            {
+#ifndef NDEBUG
+                std::cerr << "TextureQTree::loadImage: bad QOI tile" << std::endl;
+#endif
+                delete img;
+                return nullptr;
+            }
+            return img;
+        }
+
+      // decode the tile's PNG data from memory
         if (this->_sRGB) {
-            img = new cs237::Image2D (*(this->_source), this->_flip);
+            img = new cs237::Image2D (buf.data(), buf.size(), this->_flip);
         } else {
-            img = new cs237::DataImage2D (*(this->_source), this->_flip);
+            img = new cs237::DataImage2D (buf.data(), buf.size(), this->_flip);
         }
         if ((img->width() != this->_tileSize)
         ||  (img->height() != this->_tileSize)
@@ -175,18 +396,194 @@ namespace tqt {
         }
     }
 
+    cs237::CompressedImage2D *TextureQTree::loadCompressed (int level, int row, int col) const
+    {
+        if (! this->isValid() || ! this->isCompressed()) {
+            return nullptr;
+        }
+        assert (level < this->_depth);
+
+        uint32_t index = nodeIndex(level, row, col);
+        assert (index < this->_toc.size());
+
+        VkFormat fmt = this->_vkFormat();
+        cs237::CompressedImage2D *img = new cs237::CompressedImage2D (
+            fmt, this->_tileSize, this->_tileSize, this->_nLevels);
+        assert (img->nBytes() == this->_tileBytes[index]);
+        if (! this->_readTile (index, img->data())) {
+            delete img;
+            return nullptr;
+        }
+        if (this->_flip) {
+            for (uint32_t lvl = 0;  lvl < this->_nLevels;  lvl++) {
+                bc::flip (fmt, img->levelWidth(lvl), img->levelHeight(lvl),
+                    img->data() + img->levelOffset(lvl));
+            }
+        }
+
+        return img;
+    }
+
   // Return true if the given file looks like a .tqt file of our
   // appropriate version.  Do this by attempting to read the header.
     /* static */ bool TextureQTree::isTQTFile (std::string const &filename)
     {
-        std::ifstream inS(filename);
-        if (inS.fail()) {
+        int fd = open (filename.c_str(), O_RDONLY);
+        if (fd < 0) {
             return false;
         }
-        Hdr hdr;
-        bool sts = readHeader (&inS, hdr);
-        inS.close();
+        FileHdrV2 hdr;
+        bool sts = readHeader (fd, 0, sizeof(FileHdrV2), hdr);
+        close (fd);
         return sts;
     }
 
+    /***** class Writer member functions *****/
+
+    Writer::Writer (
+        std::string const &filename,
+        uint32_t depth, uint32_t tileSize,
+        Format format, bool sRGB)
+      : _file(filename), _tmpFile(filename + ".tmp"), _fd(-1),
+        _depth(depth), _tileSize(tileSize), _format(format), _nLevels(1), _sRGB(sRGB),
+        _hdrSize(0), _offset(0)
+    {
+        if ((depth == 0) || (depth > 16) || (tileSize == 0)
+        || ((tileSize & (tileSize - 1)) != 0)) {
+#ifndef NDEBUG
+            std::cerr << "tqt::Writer: invalid depth " << depth << " or tile size "
+                << tileSize << "\n";
+#endif
+            return;
+        }
+        this->_toc.resize (fullSize(depth), 0);
+        if ((format == Format::BC1) || (format == Format::BC3) || (format == Format::BC5)) {
+          // block-compressed tiles have complete mipmap chains
+            while ((tileSize >> this->_nLevels) > 0) {
+                this->_nLevels++;
+            }
+        }
+
+        FileHdrV2 hdr;
+        hdr.hdr.magic = kMagic;
+        hdr.hdr.version = (format == Format::PNG) ? kVersionPNG : kVersionBC;
+        hdr.hdr.depth = depth;
+        hdr.hdr.tileSize = tileSize;
+        hdr.format = static_cast<uint32_t>(format);
+        hdr.nLevels = this->_nLevels;
+        size_t hdrSize = headerSize (hdr.hdr.version);
+        this->_hdrSize = hdrSize + this->_toc.size() * sizeof(uint64_t);
+        this->_offset = this->_hdrSize;
+
+        int fd = open (this->_tmpFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if ((fd < 0) || ! writeRange (fd, 0, &hdr, hdrSize)) {
+#ifndef NDEBUG
+            std::cerr << "tqt::Writer: unable to create \"" << this->_tmpFile << "\"\n";
+#endif
+            if (fd >= 0) {
+                close (fd);
+                std::remove (this->_tmpFile.c_str());
+            }
+            return;
+        }
+        this->_fd = fd;
+    }
+
+    Writer::~Writer ()
+    {
+        if (this->_fd >= 0) {
+            close (this->_fd);
+            std::remove (this->_tmpFile.c_str());
+        }
+    }
+
+    bool Writer::addImage (int level, int row, int col, const uint8_t *rgba)
+    {
+        if (this->_format == Format::QOI) {
+            std::vector<uint8_t> data = qoi::encode (
+                rgba, this->_tileSize, this->_tileSize, this->_sRGB);
+            return this->addTile (level, row, col, data.data(), data.size());
+        }
+        else if (this->_format == Format::PNG) {
+          // the image constructor allocates the pixels, so we copy them in
+            cs237::Image2D img(
+                this->_tileSize, this->_tileSize, cs237::Channels::RGBA, cs237::ChannelTy::U8);
+            std::memcpy (img.data(), rgba, img.nBytes());
+            std::ostringstream outS;
+            if (! img.write (outS, false)) {
+                return false;
+            }
+            std::string data = outS.str();
+            return this->addTile (level, row, col, data.data(), data.size());
+        }
+        else {
+#ifndef NDEBUG
+            std::cerr << "tqt::Writer::addImage: block-compressed tiles must be "
+                << "added with addTile\n";
+#endif
+            return false;
+        }
+    }
+
+    bool Writer::addTile (int level, int row, int col, const void *data, size_t nBytes)
+    {
+        if (! this->isValid() || (level < 0) || (uint32_t(level) >= this->_depth)
+        || (row < 0) || (row >= (1 << level)) || (col < 0) || (col >= (1 << level))
+        || (nBytes == 0)) {
+            return false;
+        }
+        uint32_t index = nodeIndex(level, row, col);
+
+      // allocate space for the tile; the data is written without holding the lock
+        uint64_t offset;
+        {
+            std::lock_guard<std::mutex> lk(this->_mu);
+            if (this->_toc[index] != 0) {
+#ifndef NDEBUG
+                std::cerr << "tqt::Writer::addTile: tile (" << level << ", " << row
+                    << ", " << col << ") was already added\n";
+#endif
+                return false;
+            }
+            offset = this->_offset;
+            this->_offset += nBytes;
+            this->_toc[index] = offset;
+        }
+
+        return writeRange (this->_fd, offset, data, nBytes);
+    }
+
+    bool Writer::finish ()
+    {
+        if (! this->isValid()) {
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lk(this->_mu);
+        for (size_t i = 0;  i < this->_toc.size();  i++) {
+            if (this->_toc[i] == 0) {
+#ifndef NDEBUG
+                std::cerr << "tqt::Writer::finish: tile " << i << " of \""
+                    << this->_file << "\" is missing\n";
+#endif
+                return false;
+            }
+        }
+
+        size_t tocBytes = this->_toc.size() * sizeof(uint64_t);
+        bool ok = writeRange (
+            this->_fd, this->_hdrSize - tocBytes, this->_toc.data(), tocBytes);
+        ok = (close (this->_fd) == 0) && ok;
+        this->_fd = -1;
+        if (! ok || (std::rename (this->_tmpFile.c_str(), this->_file.c_str()) != 0)) {
+#ifndef NDEBUG
+            std::cerr << "tqt::Writer::finish: error writing \"" << this->_file << "\"\n";
+#endif
+            std::remove (this->_tmpFile.c_str());
+            return false;
+        }
+
+        return true;
+    }
+
 } // namespace tqt
@@ -15,14 +15,24 @@
 #include "app.hpp"
 #include "window.hpp"
 #include <cstdlib>
+#include <cstring>
 #include <unistd.h>
 
 constexpr uint32_t kWindowWidth = 1024;
 constexpr uint32_t kWindowHeight = 768;
 
+// when streaming, cells within this distance (in cell widths) of the camera are loaded
+// and cells beyond the unload distance are released
+constexpr double kStreamLoadRadius = 2.0;
+constexpr double kStreamUnloadRadius = 3.0;
+
 static void usage (int sts)
 {
     std::cerr << "usage: part1 [options] <scene>\n";
+    std::cerr << "options:\n";
+    std::cerr << "  -mmap     memory-map the cell files instead of reading them\n";
+    std::cerr << "  -stream   load the cells around the camera in the background\n";
+    std::cerr << "  -j <n>    load the cells using n threads (0 picks a default)\n";
     exit (sts);
 }
 
@@ -35,6 +45,24 @@ Project::Project (std::vector<const char *> &args)
     }
     std::string mapName = args.back();
 
+    // process the project-specific command-line options; note that the
+    // generic options are handled by the cs237::Application constructor
+    for (auto it = args.cbegin();  it != args.cend() - 1;  ++it) {
+        if (strcmp(*it, "-mmap") == 0) {
+            this->_map.useMMap (true);
+        }
+        else if (strcmp(*it, "-stream") == 0) {
+            this->_map.enableStreaming (kStreamLoadRadius, kStreamUnloadRadius);
+        }
+        else if (strcmp(*it, "-j") == 0) {
+            if (it+1 == args.cend() - 1) {
+                usage(EXIT_FAILURE);
+            }
+            ++it;
+            this->_map.setLoadThreads (static_cast<unsigned int>(atoi(*it)));
+        }
+    }
+
     // verify that the scene path exists
     if (access(mapName.c_str(), F_OK) < 0) {
         std::cerr << "map '" << mapName
@@ -77,6 +105,11 @@ void Project::run ()
 
         /** HINT: Update camera if necessary */
 
+        // load/unload cells around the camera
+        if (this->_map.isStreaming()) {
+            this->_map.updateStreaming (win->camera().position(), win);
+        }
+
         win->render (dt);
 
         // update animation state as necessary
@@ -0,0 +1,49 @@
+/*! \file binary-io.hpp
+ *
+ * \author John Reppy
+ *
+ * Helper functions for reading and writing the binary values of the map's file formats
+ * (cells, map packs, and the map manifest).
+ */
+
+/* CMSC23700 Final Project sample code (Autumn 2022)
+ *
+ * COPYRIGHT (c) 2022 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#ifndef _BINARY_IO_HPP_
+#define _BINARY_IO_HPP_
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// the file formats are little endian and the loaders use the data in place (e.g.,
+// vertex arrays in a mapped cell file), so we require a little-endian host
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__)
+#  error "the map file formats require a little-endian host"
+#endif
+
+//! \brief fetch a binary value from memory that may not be suitably aligned for T
+//! \param p  pointer to the first byte of the value
+//! \return the value
+template <typename T>
+inline T getVal (const uint8_t *p)
+{
+    T v;
+    std::memcpy (&v, p, sizeof(T));
+    return v;
+}
+
+//! \brief append a binary value to a byte buffer
+//! \param buf  the buffer
+//! \param v    the value to append
+template <typename T>
+inline void putVal (std::vector<uint8_t> &buf, T v)
+{
+    const uint8_t *p = reinterpret_cast<const uint8_t *>(&v);
+    buf.insert (buf.end(), p, p + sizeof(T));
+}
+
+#endif // !_BINARY_IO_HPP_
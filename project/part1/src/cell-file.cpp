@@ -0,0 +1,349 @@
+/*! \file cell-file.cpp
+ *
+ * \author John Reppy
+ *
+ * An in-memory representation of "hf.cell" files that is used by the offline
+ * tools that convert cell files.
+ */
+
+/* CMSC23700 Final Project sample code (Autumn 2022)
+ *
+ * COPYRIGHT (c) 2022 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#include "cell-file.hpp"
+#include "chunk-codec.hpp"
+#include "qtree-util.hpp"
+#include "binary-io.hpp"
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+// is the range [offset..offset+len) inside the buffer?
+inline bool inBounds (std::vector<uint8_t> const &buf, uint64_t offset, uint64_t len)
+{
+    return (offset <= buf.size()) && (len <= buf.size() - offset);
+}
+
+static bool error (std::string const &file, std::string const &msg)
+{
+    std::cerr << "error reading cell file \"" << file << "\": " << msg << "\n";
+    return false;
+}
+
+// read the payload of a chunk from the buffer
+static bool readPayload (
+    std::vector<uint8_t> const &buf, uint64_t offset, bool compressed,
+    CellFile::ChunkData &chunk)
+{
+    uint16_t *vp = reinterpret_cast<uint16_t *>(chunk.verts.data());
+    if (compressed) {
+        if (! inBounds(buf, offset, CellFile::kCompressedHeaderSize)) {
+            return false;
+        }
+        uint32_t vBytes = getVal<uint32_t>(buf.data() + offset);
+        uint32_t iBytes = getVal<uint32_t>(buf.data() + offset + 4);
+        offset += CellFile::kCompressedHeaderSize;
+        if (! inBounds(buf, offset, uint64_t(vBytes) + uint64_t(iBytes))) {
+            return false;
+        }
+        return codec::decode (
+                buf.data() + offset, vBytes, vp, 4*chunk.verts.size(), codec::kVertexDist)
+            && codec::decode (
+                buf.data() + offset + vBytes, iBytes,
+                chunk.indices.data(), chunk.indices.size(), codec::kIndexDist);
+    } else {
+        uint64_t vSize = chunk.verts.size() * sizeof(HFVertex);
+        uint64_t iSize = chunk.indices.size() * sizeof(uint16_t);
+        if (! inBounds(buf, offset, vSize + iSize)) {
+            return false;
+        }
+        std::memcpy (vp, buf.data() + offset, vSize);
+        std::memcpy (chunk.indices.data(), buf.data() + offset + vSize, iSize);
+        return true;
+    }
+}
+
+bool CellFile::read (std::string const &file)
+{
+    std::ifstream inS(file, std::ifstream::in | std::ifstream::binary);
+    if (inS.fail()) {
+        return error (file, "unable to open");
+    }
+    std::vector<uint8_t> buf(
+        (std::istreambuf_iterator<char>(inS)),
+        std::istreambuf_iterator<char>());
+    inS.close();
+
+  // get header info
+    if (! inBounds(buf, 0, kHeaderSize)) {
+        return error (file, "missing header");
+    }
+    if (getVal<uint32_t>(buf.data()) != Cell::kMagic) {
+        return error (file, "bogus magic number in header");
+    }
+    uint32_t flags = getVal<uint32_t>(buf.data() + 4);
+    this->compressed = ((flags & kCompressedFlag) != 0);
+    this->version = flags >> kVersionShift;
+    if (this->version == 0) {
+        this->version = 1;
+    }
+    this->size = getVal<uint32_t>(buf.data() + 8);
+    this->nLODs = getVal<uint32_t>(buf.data() + 12);
+    if ((this->nLODs < Cell::kMinLODs) || (Cell::kMaxLODs < this->nLODs)) {
+        return error (file, "unsupported number of LODs");
+    }
+
+    uint32_t nChunks = qtree::fullSize(this->nLODs);
+    this->chunks.resize (nChunks);
+
+    if (this->version == 1) {
+        if (! inBounds(buf, kHeaderSize, nChunks * sizeof(uint64_t))) {
+            return error (file, "truncated TOC");
+        }
+        for (uint32_t id = 0;  id < nChunks;  id++) {
+            ChunkData &chunk = this->chunks[id];
+            uint64_t offset = getVal<uint64_t>(buf.data() + kHeaderSize + id * sizeof(uint64_t));
+            if (! inBounds(buf, offset, kChunkHeaderSize)) {
+                return error (file, "bogus TOC entry for chunk " + std::to_string(id));
+            }
+            chunk.maxError = getVal<float>(buf.data() + offset);
+            chunk.verts.resize (getVal<uint32_t>(buf.data() + offset + 4));
+            chunk.indices.resize (getVal<uint32_t>(buf.data() + offset + 8));
+            chunk.minY = getVal<int16_t>(buf.data() + offset + 12);
+            chunk.maxY = getVal<int16_t>(buf.data() + offset + 14);
+            if (! readPayload (buf, offset + kChunkHeaderSize, this->compressed, chunk)) {
+                return error (file, "bad data in chunk " + std::to_string(id));
+            }
+        }
+    }
+    else if (this->version == 2) {
+        if (! inBounds(buf, 0, kV2HeaderSize + nChunks * sizeof(CellTileMeta))) {
+            return error (file, "truncated metadata");
+        }
+        this->hScale = getVal<float>(buf.data() + 16);
+        this->vScale = getVal<float>(buf.data() + 20);
+        this->baseElev = getVal<float>(buf.data() + 24);
+        for (uint32_t id = 0;  id < nChunks;  id++) {
+            ChunkData &chunk = this->chunks[id];
+            CellTileMeta meta = getVal<CellTileMeta>(buf.data() + kV2HeaderSize + id * sizeof(CellTileMeta));
+            chunk.maxError = meta.maxError;
+            chunk.minY = meta.minY;
+            chunk.maxY = meta.maxY;
+            chunk.verts.resize (meta.nVerts);
+            chunk.indices.resize (meta.nIndices);
+            if (! inBounds(buf, meta.offset, meta.size)
+            ||  ! readPayload (buf, meta.offset, this->compressed, chunk)) {
+                return error (file, "bad data in chunk " + std::to_string(id));
+            }
+        }
+    }
+    else {
+        return error (file, "unsupported version " + std::to_string(this->version));
+    }
+
+    return true;
+
+}
+
+void CellFile::tileBBox (
+    uint32_t lod, uint32_t row, uint32_t col, ChunkData const &chunk,
+    float bbox[6]) const
+{
+  // we follow the same computation as Cell::_initBBox so that the results match
+    double w = double(this->hScale) * double(this->size >> lod);
+    double x = double(this->hScale) * double(col);
+    double z = double(this->hScale) * double(row);
+    bbox[0] = float(x);
+    bbox[1] = this->baseElev + this->vScale * float(chunk.minY);
+    bbox[2] = float(z);
+    bbox[3] = float(x + w);
+    bbox[4] = this->baseElev + this->vScale * float(chunk.maxY);
+    bbox[5] = float(z + w);
+
+}
+
+// the tiles of a quadtree in depth-first (preorder) order, which is the order in which
+// a frontier walk visits them
+static void dfsOrder (
+    uint32_t id, uint32_t lod, uint32_t nLODs, std::vector<uint32_t> &order)
+{
+    order.push_back (id);
+    if (lod+1 < nLODs) {
+        uint32_t kid = qtree::nwChild(id);
+        for (uint32_t i = 0;  i < 4;  i++) {
+            dfsOrder (kid + i, lod+1, nLODs, order);
+        }
+    }
+}
+
+// append the payload of a chunk to a buffer and return its size
+static uint32_t writePayload (
+    std::vector<uint8_t> &buf, CellFile::ChunkData const &chunk, bool compress)
+{
+    size_t start = buf.size();
+    const uint16_t *vp = reinterpret_cast<const uint16_t *>(chunk.verts.data());
+    if (compress) {
+      // placeholders for the encoded sizes
+        putVal<uint32_t> (buf, 0);
+        putVal<uint32_t> (buf, 0);
+        uint32_t vBytes = codec::encode (
+            vp, 4*chunk.verts.size(), codec::kVertexDist, buf);
+        uint32_t iBytes = codec::encode (
+            chunk.indices.data(), chunk.indices.size(), codec::kIndexDist, buf);
+        std::memcpy (buf.data() + start, &vBytes, sizeof(uint32_t));
+        std::memcpy (buf.data() + start + 4, &iBytes, sizeof(uint32_t));
+    } else {
+        const uint8_t *p = reinterpret_cast<const uint8_t *>(vp);
+        buf.insert (buf.end(), p, p + chunk.verts.size() * sizeof(HFVertex));
+        p = reinterpret_cast<const uint8_t *>(chunk.indices.data());
+        buf.insert (buf.end(), p, p + chunk.indices.size() * sizeof(uint16_t));
+    }
+    return static_cast<uint32_t>(buf.size() - start);
+}
+
+bool CellFile::write (std::string const &file, bool compress) const
+{
+    uint32_t nChunks = qtree::fullSize(this->nLODs);
+    if (this->chunks.size() != nChunks) {
+        std::cerr << "CellFile::write: expected " << nChunks << " chunks, but have "
+            << this->chunks.size() << "\n";
+        return false;
+    }
+    if ((this->version != 1) && (this->version != 2)) {
+        std::cerr << "CellFile::write: unsupported version " << this->version << "\n";
+        return false;
+    }
+
+  // the header
+    std::vector<uint8_t> buf;
+    uint32_t flags = compress ? kCompressedFlag : 0;
+    if (this->version > 1) {
+        flags |= (this->version << kVersionShift);
+    }
+    putVal<uint32_t> (buf, Cell::kMagic);
+    putVal<uint32_t> (buf, flags);
+    putVal<uint32_t> (buf, this->size);
+    putVal<uint32_t> (buf, this->nLODs);
+
+    if (this->version == 1) {
+      // reserve space for the TOC, which we fill in as we go
+        buf.resize (kHeaderSize + nChunks * sizeof(uint64_t), 0);
+
+        for (uint32_t id = 0;  id < nChunks;  id++) {
+            ChunkData const &chunk = this->chunks[id];
+            uint64_t offset = buf.size();
+            std::memcpy (buf.data() + kHeaderSize + id * sizeof(uint64_t), &offset, sizeof(uint64_t));
+
+            putVal<float> (buf, chunk.maxError);
+            putVal<uint32_t> (buf, chunk.verts.size());
+            putVal<uint32_t> (buf, chunk.indices.size());
+            putVal<int16_t> (buf, chunk.minY);
+            putVal<int16_t> (buf, chunk.maxY);
+            writePayload (buf, chunk, compress);
+        }
+    }
+    else {
+        putVal<float> (buf, this->hScale);
+        putVal<float> (buf, this->vScale);
+        putVal<float> (buf, this->baseElev);
+        putVal<uint32_t> (buf, uint32_t(kPageSize));
+
+      // compute the metadata for the tiles (except for the payload location)
+        std::vector<CellTileMeta> meta(nChunks);
+        std::vector<uint32_t> lods(nChunks), rows(nChunks), cols(nChunks);
+        lods[0] = rows[0] = cols[0] = 0;
+        for (uint32_t id = 0;  id < nChunks;  id++) {
+            ChunkData const &chunk = this->chunks[id];
+            CellTileMeta &m = meta[id];
+            std::memset (&m, 0, sizeof(CellTileMeta));
+            m.maxError = chunk.maxError;
+            m.nVerts = chunk.verts.size();
+            m.nIndices = chunk.indices.size();
+            m.minY = chunk.minY;
+            m.maxY = chunk.maxY;
+            this->tileBBox (lods[id], rows[id], cols[id], chunk, m.bbox);
+          // set the position of the children (in the same order as Tile::_init)
+            if (lods[id]+1 < this->nLODs) {
+                uint32_t halfWid = this->size >> (lods[id]+1);
+                uint32_t kid = qtree::nwChild(id);
+                const uint32_t dr[4] = { 0, 0, halfWid, halfWid };
+                const uint32_t dc[4] = { 0, halfWid, halfWid, 0 };
+                for (uint32_t i = 0;  i < 4;  i++) {
+                    lods[kid+i] = lods[id] + 1;
+                    rows[kid+i] = rows[id] + dr[i];
+                    cols[kid+i] = cols[id] + dc[i];
+                }
+            }
+        }
+
+      // reserve space for the metadata and then pad to the first page boundary
+        size_t metaPos = buf.size();
+        buf.resize (metaPos + nChunks * sizeof(CellTileMeta), 0);
+        buf.resize ((buf.size() + kPageSize - 1) & ~(kPageSize - 1), 0);
+
+      // the payloads in depth-first order.  Payloads that are at least a page in size
+      // start on a page boundary, so that they span as few pages as possible; smaller
+      // payloads are packed, since padding them would waste about half a page each
+      // and the depth-first order means that their neighbors are read together.
+        std::vector<uint32_t> order;
+        order.reserve (nChunks);
+        dfsOrder (0, 0, this->nLODs, order);
+        std::vector<uint8_t> payload;
+        for (uint32_t id : order) {
+            payload.clear();
+            uint32_t sz = writePayload (payload, this->chunks[id], compress);
+            size_t offset = (buf.size() + 7) & ~size_t(7);
+            size_t pageOffset = offset & (kPageSize - 1);
+            if ((pageOffset != 0) && (sz >= kPageSize)) {
+                offset = (offset + kPageSize - 1) & ~(kPageSize - 1);
+            }
+            buf.resize (offset, 0);
+            buf.insert (buf.end(), payload.begin(), payload.end());
+            meta[id].offset = offset;
+            meta[id].size = sz;
+        }
+
+        std::memcpy (buf.data() + metaPos, meta.data(), nChunks * sizeof(CellTileMeta));
+    }
+
+    std::ofstream outS(file, std::ofstream::out | std::ofstream::binary);
+    if (outS.fail()) {
+        std::cerr << "CellFile::write: unable to open \"" << file << "\"\n";
+        return false;
+    }
+    outS.write (reinterpret_cast<const char *>(buf.data()), buf.size());
+    outS.close();
+    if (outS.fail()) {
+        std::cerr << "CellFile::write: error writing \"" << file << "\"\n";
+        return false;
+    }
+
+    return true;
+
+}
+
+bool CellFile::sameData (CellFile const &other) const
+{
+    if ((this->size != other.size)
+    ||  (this->nLODs != other.nLODs)
+    ||  (this->chunks.size() != other.chunks.size())) {
+        return false;
+    }
+
+    for (size_t i = 0;  i < this->chunks.size();  i++) {
+        ChunkData const &a = this->chunks[i];
+        ChunkData const &b = other.chunks[i];
+        if ((a.maxError != b.maxError) || (a.minY != b.minY) || (a.maxY != b.maxY)
+        ||  (a.verts.size() != b.verts.size())
+        ||  (a.indices.size() != b.indices.size())
+        ||  (std::memcmp(a.verts.data(), b.verts.data(), a.verts.size() * sizeof(HFVertex)) != 0)
+        ||  (a.indices != b.indices)) {
+            return false;
+        }
+    }
+
+    return true;
+
+}
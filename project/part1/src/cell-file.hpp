@@ -0,0 +1,107 @@
+/*! \file cell-file.hpp
+ *
+ * \author John Reppy
+ *
+ * An in-memory representation of "hf.cell" files that is used by the offline
+ * tools that convert cell files.  The renderer loads cell files using the Cell
+ * class.
+ */
+
+/* CMSC23700 Final Project sample code (Autumn 2022)
+ *
+ * COPYRIGHT (c) 2022 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#ifndef _CELL_FILE_HPP_
+#define _CELL_FILE_HPP_
+
+#include "map-cell.hpp"
+#include <string>
+#include <vector>
+
+//! The on-disk metadata for a tile in a version 2 "hf.cell" file (see map-cell.cpp)
+struct CellTileMeta {
+    uint64_t offset;            //!< file offset of the chunk's payload
+    uint32_t size;              //!< size of the payload in bytes
+    float maxError;             //!< maximum geometric error (in meters)
+    uint32_t nVerts;            //!< number of vertices
+    uint32_t nIndices;          //!< number of indices
+    int16_t minY;               //!< minimum Y value of the chunk's vertices
+    int16_t maxY;               //!< maximum Y value of the chunk's vertices
+    float bbox[6];              //!< the tile's bounding box relative to the cell's NW
+                                //!  corner (minX, minY, minZ, maxX, maxY, maxZ) in meters
+    uint32_t reserved;          //!< padding; should be zero
+};
+
+static_assert (sizeof(CellTileMeta) == 56, "unexpected CellTileMeta layout");
+
+//! The contents of a "hf.cell" file.  See map-cell.cpp for a description of the file
+//! layout.
+struct CellFile {
+
+    //! the mesh data of a single LOD chunk
+    struct ChunkData {
+        float maxError;                 //!< maximum geometric error (in meters)
+        int16_t minY;                   //!< minimum Y value of the chunk's vertices
+        int16_t maxY;                   //!< maximum Y value of the chunk's vertices
+        std::vector<HFVertex> verts;    //!< the chunk's vertices
+        std::vector<uint16_t> indices;  //!< the chunk's triangle-strip indices (0xffff
+                                        //!  restarts a strip)
+    };
+
+    uint32_t version;                   //!< the file format version (1 or 2)
+    uint32_t size;                      //!< cell width (will be width+1 vertices wide)
+    uint32_t nLODs;                     //!< the number of levels of detail
+    bool compressed;                    //!< true if the file was compressed
+    float hScale;                       //!< the map's horizontal scale (version 2 only)
+    float vScale;                       //!< the map's vertical scale (version 2 only)
+    float baseElev;                     //!< the map's base elevation (version 2 only)
+    std::vector<ChunkData> chunks;      //!< the chunks in breadth-first quadtree order
+
+    CellFile ()
+      : version(1), size(0), nLODs(0), compressed(false),
+        hScale(1.0f), vScale(1.0f), baseElev(0.0f)
+    { }
+
+    //! \brief read a cell file
+    //! \param file the path to the file
+    //! \return true if successful; otherwise an error message is printed to std::cerr
+    //!         and false is returned.
+    bool read (std::string const &file);
+
+    //! \brief write the cell data to a file using the format specified by the
+    //!        `version` field.  For version 2 files, the scale fields must be set to
+    //!        the map's values, since they are used to compute the tile bounding boxes.
+    //! \param file the path to the file
+    //! \param compress if true, the chunks are written in compressed form
+    //! \return true if successful, false otherwise
+    bool write (std::string const &file, bool compress) const;
+
+    //! return true if two cells have the same mesh data (the representation
+    //! of the file does not matter)
+    bool sameData (CellFile const &other) const;
+
+    //! \brief compute the bounding box of a tile relative to its cell's NW corner
+    //! \param lod    the tile's level of detail
+    //! \param row    the row of the tile's NW vertex in the cell
+    //! \param col    the column of the tile's NW vertex in the cell
+    //! \param chunk  the tile's chunk
+    //! \param[out] bbox the bounding box (minX, minY, minZ, maxX, maxY, maxZ) in meters
+    void tileBBox (
+        uint32_t lod, uint32_t row, uint32_t col, ChunkData const &chunk,
+        float bbox[6]) const;
+
+    // file layout constants
+    static constexpr uint64_t kHeaderSize = 16;         //!< size of the file header
+    static constexpr uint64_t kChunkHeaderSize = 16;    //!< size of a chunk header
+    static constexpr uint64_t kCompressedHeaderSize = 8; //!< size of the additional
+                                                        //!  header of a compressed chunk
+    static constexpr uint64_t kV2HeaderSize = 32;       //!< size of the version 2 header
+    static constexpr uint64_t kPageSize = 4096;         //!< payload alignment for version 2
+    static constexpr uint32_t kCompressedFlag = 1;      //!< flags bit for compressed chunks
+    static constexpr uint32_t kVersionShift = 16;       //!< position of the version in
+                                                        //!  the flags word
+};
+
+#endif // !_CELL_FILE_HPP_
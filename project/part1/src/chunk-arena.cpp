@@ -0,0 +1,102 @@
+/*! \file chunk-arena.cpp
+ *
+ * \author John Reppy
+ *
+ * A single block of memory that holds the chunk mesh data for a cell.
+ */
+
+/* CMSC23700 Final Project sample code (Autumn 2022)
+ *
+ * COPYRIGHT (c) 2022 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#include "chunk-arena.hpp"
+#include <cassert>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#ifndef MAP_ANONYMOUS
+#  define MAP_ANONYMOUS MAP_ANON
+#endif
+#ifndef MAP_NORESERVE
+#  define MAP_NORESERVE 0
+#endif
+
+ChunkArena::ChunkArena (size_t size)
+    : _data(nullptr), _size(size),
+      _pageSz(static_cast<size_t>(sysconf(_SC_PAGESIZE))), _nCommitted(0)
+{
+    if (size == 0) {
+        return;
+    }
+
+    void *addr = mmap (
+        nullptr, size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+    if (addr != MAP_FAILED) {
+        this->_data = static_cast<uint8_t *>(addr);
+        this->_pageRefs.resize ((size + this->_pageSz - 1) / this->_pageSz, 0);
+    }
+
+}
+
+ChunkArena::~ChunkArena ()
+{
+    if (this->_data != nullptr) {
+        munmap (this->_data, this->_size);
+    }
+}
+
+size_t ChunkArena::acquire (size_t offset, size_t len)
+{
+    if (len == 0) {
+        return 0;
+    }
+
+    size_t nNew = 0;
+    size_t last = (offset + len - 1) / this->_pageSz;
+    for (size_t pg = offset / this->_pageSz;  pg <= last;  pg++) {
+        if (this->_pageRefs[pg]++ == 0) {
+            nNew++;
+        }
+    }
+    this->_nCommitted += nNew;
+
+    return nNew * this->_pageSz;
+
+}
+
+size_t ChunkArena::release (size_t offset, size_t len)
+{
+    if (len == 0) {
+        return 0;
+    }
+
+  // drop the counts of the pages that the range touches and return the runs of pages
+  // whose counts reach zero
+    size_t nFreed = 0;
+    size_t runStart = 0, runLen = 0;
+    size_t last = (offset + len - 1) / this->_pageSz;
+    for (size_t pg = offset / this->_pageSz;  pg <= last;  pg++) {
+        assert (this->_pageRefs[pg] > 0);
+        if (--this->_pageRefs[pg] == 0) {
+            if (runLen == 0) {
+                runStart = pg;
+            }
+            runLen++;
+        }
+        else if (runLen > 0) {
+            madvise (this->_data + runStart * this->_pageSz, runLen * this->_pageSz, MADV_DONTNEED);
+            nFreed += runLen;
+            runLen = 0;
+        }
+    }
+    if (runLen > 0) {
+        madvise (this->_data + runStart * this->_pageSz, runLen * this->_pageSz, MADV_DONTNEED);
+        nFreed += runLen;
+    }
+    this->_nCommitted -= nFreed;
+
+    return nFreed * this->_pageSz;
+
+}
@@ -0,0 +1,86 @@
+/*! \file chunk-arena.hpp
+ *
+ * \author John Reppy
+ *
+ * A single block of memory that holds the chunk mesh data for a cell.
+ */
+
+/* CMSC23700 Final Project sample code (Autumn 2022)
+ *
+ * COPYRIGHT (c) 2022 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#ifndef _CHUNK_ARENA_HPP_
+#define _CHUNK_ARENA_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//! A contiguous region of anonymous virtual memory that holds the vertex and index
+//! arrays of all of the chunks in a cell.  The region is reserved up front, but
+//! physical pages are only committed when they are first written, so the arena costs
+//! no more memory than the chunks that are actually loaded.  Freeing the arena is a
+//! single operation.
+//!
+//! Chunks are much smaller than a page, so the arena counts the resident chunks that
+//! touch each page; a page is returned to the operating system when the last of its
+//! chunks is released.
+class ChunkArena {
+  public:
+
+    //! reserve an arena
+    //! \param size the size of the arena in bytes
+    //!
+    //! Use `isValid()` to check if the reservation was successful.
+    explicit ChunkArena (size_t size);
+
+    ~ChunkArena ();
+
+    //! was the arena successfully reserved?
+    bool isValid () const { return (this->_data != nullptr); }
+
+    //! the base address of the arena
+    uint8_t *data () const { return this->_data; }
+
+    //! the size of the arena in bytes
+    size_t size () const { return this->_size; }
+
+    //! the number of bytes in the pages that hold resident chunk data
+    size_t committedBytes () const { return this->_nCommitted * this->_pageSz; }
+
+    //! \brief mark a range of the arena as holding resident chunk data.  The range
+    //!        should be acquired when its data has been written.
+    //! \param offset  the offset of the range from the start of the arena
+    //! \param len     the length of the range in bytes
+    //! \return the number of bytes in the pages that this range newly commits
+    size_t acquire (size_t offset, size_t len);
+
+    //! \brief release a range that was acquired by `acquire`.  The pages that no
+    //!        longer hold any resident data are returned to the operating system;
+    //!        they stay reserved, so they can be written again later.
+    //! \param offset  the offset of the range from the start of the arena
+    //! \param len     the length of the range in bytes
+    //! \return the number of bytes in the pages that were returned
+    size_t release (size_t offset, size_t len);
+
+    //! round a size or offset up to the alignment of chunk data (8 bytes, which is the
+    //! size of an HFVertex)
+    static size_t align (size_t n) { return (n + 7) & ~size_t(7); }
+
+  private:
+    uint8_t *_data;             //!< the base address of the arena (nullptr on error)
+    size_t _size;               //!< the size of the arena in bytes
+    size_t _pageSz;             //!< the system page size
+    size_t _nCommitted;         //!< the number of pages with a non-zero count
+    std::vector<uint32_t> _pageRefs; //!< the number of resident ranges that touch
+                                //!  each page of the arena
+
+    // arenas are not copyable
+    ChunkArena (ChunkArena const &) = delete;
+    ChunkArena &operator= (ChunkArena const &) = delete;
+
+};
+
+#endif // !_CHUNK_ARENA_HPP_
@@ -0,0 +1,144 @@
+/*! \file chunk-codec.cpp
+ *
+ * \author John Reppy
+ *
+ * Compression of the vertex and index arrays of LOD mesh chunks.  See
+ * chunk-codec.hpp for a description of the encoding.
+ */
+
+/* CMSC23700 Final Project sample code (Autumn 2022)
+ *
+ * COPYRIGHT (c) 2022 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#include "chunk-codec.hpp"
+#include <array>
+
+namespace codec {
+
+  // zig-zag encoding of a 16-bit residual
+    inline uint16_t zigzag (uint16_t d)
+    {
+        return static_cast<uint16_t>((d << 1) ^ (0u - (d >> 15)));
+    }
+
+  // inverse of zigzag
+    inline uint16_t unzigzag (uint16_t z)
+    {
+        return static_cast<uint16_t>((z >> 1) ^ (-(z & 1)));
+    }
+
+  // the number of payload bytes that follow a tag byte, or 0xff if the tag is illegal
+    static constexpr std::array<uint8_t, 256> makeGroupLengths ()
+    {
+        std::array<uint8_t, 256> lens{};
+        for (int tag = 0;  tag < 256;  tag++) {
+            int len = 0;
+            for (int k = 0;  k < 4;  k++) {
+                int code = (tag >> (2*k)) & 3;
+                if (code == 3) {
+                    len = 0xff;
+                    break;
+                }
+                len += code;
+            }
+            lens[tag] = static_cast<uint8_t>(len);
+        }
+        return lens;
+    }
+    static constexpr std::array<uint8_t, 256> kGroupLen = makeGroupLengths();
+
+  // masks for extracting a residual from two bytes of input given its length code
+    static constexpr uint16_t kMask[4] = { 0x0000, 0x00ff, 0xffff, 0x0000 };
+
+    size_t encode (const uint16_t *src, size_t n, size_t dist, std::vector<uint8_t> &out)
+    {
+        size_t start = out.size();
+        for (size_t i = 0;  i < n;  i += 4) {
+            size_t tagPos = out.size();
+            uint8_t tag = 0;
+            out.push_back(0);
+            for (size_t k = 0;  (k < 4) && (i+k < n);  k++) {
+                size_t j = i + k;
+                uint16_t pred = (j < dist) ? 0 : src[j - dist];
+                uint16_t z = zigzag(static_cast<uint16_t>(src[j] - pred));
+                if (z == 0) {
+                    // code 0: nothing to emit
+                }
+                else if (z < 0x100) {
+                    tag |= (1 << (2*k));
+                    out.push_back(static_cast<uint8_t>(z));
+                }
+                else {
+                    tag |= (2 << (2*k));
+                    out.push_back(static_cast<uint8_t>(z & 0xff));
+                    out.push_back(static_cast<uint8_t>(z >> 8));
+                }
+            }
+            out[tagPos] = tag;
+        }
+
+        return out.size() - start;
+
+    }
+
+  // decode a group of four values with explicit bounds checks; this function is used
+  // at the beginning and end of the sequence.  It returns false on error.
+    inline bool decodeGroup (
+        const uint8_t *&src, const uint8_t *end,
+        uint16_t *dst, size_t &i, size_t n, size_t dist)
+    {
+        if (src >= end) return false;
+        unsigned tag = *src++;
+        if (kGroupLen[tag] == 0xff) return false;
+        if (kGroupLen[tag] > end - src) return false;
+        for (size_t k = 0;  k < 4;  k++, i++) {
+            unsigned code = (tag >> (2*k)) & 3;
+            if (i >= n) {
+              // missing values in the last group must have code 0
+                if (code != 0) return false;
+                continue;
+            }
+            uint16_t z = 0;
+            if (code == 1) { z = src[0]; }
+            else if (code == 2) { z = src[0] | (src[1] << 8); }
+            src += code;
+            dst[i] = ((i < dist) ? 0 : dst[i - dist]) + unzigzag(z);
+        }
+        return true;
+    }
+
+    bool decode (const uint8_t *src, size_t nBytes, uint16_t *dst, size_t n, size_t dist)
+    {
+        const uint8_t *end = src + nBytes;
+        size_t i = 0;
+
+      // the first `dist` values are predicted by zero
+        while ((i < n) && (i < dist)) {
+            if (! decodeGroup (src, end, dst, i, n, dist)) return false;
+        }
+
+      // main loop over complete groups.  We load residuals with a two-byte read that is
+      // masked by the length code, so we need 8 bytes of slack after the tag.
+        while ((i + 4 <= n) && (end - src >= 9)) {
+            unsigned tag = *src++;
+            if (kGroupLen[tag] == 0xff) return false;
+            for (int k = 0;  k < 4;  k++, i++) {
+                unsigned code = (tag >> (2*k)) & 3;
+                uint16_t z = (src[0] | (src[1] << 8)) & kMask[code];
+                src += code;
+                dst[i] = dst[i - dist] + unzigzag(z);
+            }
+        }
+
+      // the tail of the sequence
+        while (i < n) {
+            if (! decodeGroup (src, end, dst, i, n, dist)) return false;
+        }
+
+        return (src == end);
+
+    }
+
+} // namespace codec
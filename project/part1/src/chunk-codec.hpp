@@ -0,0 +1,67 @@
+/*! \file chunk-codec.hpp
+ *
+ * \author John Reppy
+ *
+ * Compression of the vertex and index arrays of LOD mesh chunks.
+ */
+
+/* CMSC23700 Final Project sample code (Autumn 2022)
+ *
+ * COPYRIGHT (c) 2022 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#ifndef _CHUNK_CODEC_HPP_
+#define _CHUNK_CODEC_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Both the vertex and the index arrays of a chunk are treated as sequences of 16-bit
+// values.  Each value is predicted by the value `dist` positions earlier in the
+// sequence (or 0 at the start); for vertices dist == 4, so each component is predicted
+// by the same component of the previous vertex, and for indices dist == 1.  The
+// prediction residual (computed modulo 2^16) is zig-zag encoded so that small negative
+// and positive residuals both become small unsigned numbers.
+//
+// The encoded residuals are packed in groups of four values.  Each group starts with
+// a tag byte that holds a 2-bit length code for each value in the group (value k of
+// the group uses bits 2k..2k+1 of the tag):
+//
+//      0       -- the residual is zero and no bytes follow
+//      1       -- the residual is stored in one byte
+//      2       -- the residual is stored in two bytes (little-endian)
+//
+// Length code 3 is illegal.  If the number of values is not a multiple of four, then
+// the length codes of the missing values in the last group are 0.  A decoder only
+// branches on the tag bytes, which makes it fast enough to keep up with the disk.
+
+namespace codec {
+
+  //! the prediction distance for vertex data (HFVertex has four components)
+    constexpr size_t kVertexDist = 4;
+
+  //! the prediction distance for index data
+    constexpr size_t kIndexDist = 1;
+
+  //! \brief encode a sequence of 16-bit values
+  //! \param[in] src   the values to encode
+  //! \param[in] n     the number of values
+  //! \param[in] dist  the prediction distance
+  //! \param[out] out  the encoded bytes are appended to this vector
+  //! \return the number of bytes appended to out
+    size_t encode (const uint16_t *src, size_t n, size_t dist, std::vector<uint8_t> &out);
+
+  //! \brief decode a sequence of 16-bit values
+  //! \param[in] src     the encoded data
+  //! \param[in] nBytes  the number of bytes of encoded data
+  //! \param[out] dst    the output array; it must have room for n values
+  //! \param[in] n       the number of values to decode
+  //! \param[in] dist    the prediction distance that was used to encode the data
+  //! \return true if the encoded data was well formed and exactly nBytes long
+    bool decode (const uint8_t *src, size_t nBytes, uint16_t *dst, size_t n, size_t dist);
+
+} // namespace codec
+
+#endif // !_CHUNK_CODEC_HPP_
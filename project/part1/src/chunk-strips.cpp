@@ -0,0 +1,104 @@
+/*! \file chunk-strips.cpp
+ *
+ * \author John Reppy
+ */
+
+/* CMSC23700 Final Project sample code (Autumn 2022)
+ *
+ * COPYRIGHT (c) 2022 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#include "chunk-strips.hpp"
+
+namespace strips {
+
+// is a triangle degenerate?
+inline bool isDegenerate (uint16_t a, uint16_t b, uint16_t c)
+{
+    return (a == b) || (b == c) || (a == c);
+}
+
+std::vector<uint16_t> toList (const uint16_t *strip, size_t n)
+{
+    std::vector<uint16_t> list;
+    list.reserve (3 * n);
+
+    size_t start = 0;  // index of the first vertex of the current strip
+    for (size_t i = 0;  i <= n;  i++) {
+        if ((i == n) || (strip[i] == kRestart)) {
+            for (size_t j = start;  j + 2 < i;  j++) {
+                uint16_t a = strip[j], b = strip[j+1], c = strip[j+2];
+                if (isDegenerate(a, b, c)) {
+                    continue;
+                }
+                if (((j - start) & 1) == 0) {
+                    list.push_back(a);  list.push_back(b);  list.push_back(c);
+                } else {
+                    list.push_back(b);  list.push_back(a);  list.push_back(c);
+                }
+            }
+            start = i + 1;
+        }
+    }
+
+    return list;
+
+}
+
+// if the triangle has the directed edge x->y, then return its third vertex; otherwise
+// return -1
+static int thirdVertex (const uint16_t *tri, uint16_t x, uint16_t y)
+{
+    for (int k = 0;  k < 3;  k++) {
+        if ((tri[k] == x) && (tri[(k+1)%3] == y)) {
+            return tri[(k+2)%3];
+        }
+    }
+    return -1;
+}
+
+std::vector<uint16_t> fromList (const uint16_t *list, size_t n)
+{
+    std::vector<uint16_t> strip;
+    size_t nTris = n / 3;
+    size_t len = 0;  // number of vertices in the current strip
+    for (size_t t = 0;  t < nTris;  t++) {
+        const uint16_t *tri = &list[3*t];
+        if (len >= 3) {
+          // the next triangle of the strip is (a, b, c) if it is even and (b, a, c)
+          // if it is odd; the next triangle's index in the strip is len-2
+            uint16_t a = strip[strip.size() - 2];
+            uint16_t b = strip[strip.size() - 1];
+            int c = ((len & 1) == 0) ? thirdVertex(tri, a, b) : thirdVertex(tri, b, a);
+            if (c >= 0) {
+                strip.push_back (static_cast<uint16_t>(c));
+                len++;
+                continue;
+            }
+        }
+      // start a new strip; we rotate the triangle so that the next triangle can
+      // continue the strip, if possible
+        if (! strip.empty()) {
+            strip.push_back (kRestart);
+        }
+        int rot = 0;
+        if (t + 1 < nTris) {
+            for (int r = 0;  r < 3;  r++) {
+                if (thirdVertex(&list[3*t+3], tri[(r+2)%3], tri[(r+1)%3]) >= 0) {
+                    rot = r;
+                    break;
+                }
+            }
+        }
+        for (int k = 0;  k < 3;  k++) {
+            strip.push_back (tri[(rot+k)%3]);
+        }
+        len = 3;
+    }
+
+    return strip;
+
+}
+
+} // namespace strips
@@ -0,0 +1,62 @@
+/*! \file chunk-strips.hpp
+ *
+ * \author John Reppy
+ *
+ * Conversion between the triangle-strip representation of chunk indices and
+ * triangle lists.
+ */
+
+/* CMSC23700 Final Project sample code (Autumn 2022)
+ *
+ * COPYRIGHT (c) 2022 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#ifndef _CHUNK_STRIPS_HPP_
+#define _CHUNK_STRIPS_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// The index array of a chunk is a sequence of triangle strips that are separated by
+// restart indices (0xffff), which is the form expected by a pipeline that uses the
+// VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP topology with primitive restart enabled.
+// Triangle k of a strip uses the vertices k, k+1, and k+2 of the strip, with the order
+// of the first two swapped for odd k so that all of the triangles have the same winding.
+// Strips use degenerate triangles (i.e., triangles with a repeated vertex) to turn
+// corners; these produce no fragments.
+
+namespace strips {
+
+  //! the index value that restarts a strip
+    constexpr uint16_t kRestart = 0xffff;
+
+  //! \brief convert triangle strips to a triangle list; degenerate triangles are dropped
+  //!        and the winding of the other triangles is preserved
+  //! \param strip  the strip indices
+  //! \param n      the number of strip indices
+  //! \return the triangle-list indices
+    std::vector<uint16_t> toList (const uint16_t *strip, size_t n);
+
+  //! \brief convert a triangle list to triangle strips.  The triangles are kept in the
+  //!        same order; a triangle extends the current strip if it shares the strip's
+  //!        last edge with the right orientation, otherwise a new strip is started.
+  //! \param list  the triangle-list indices
+  //! \param n     the number of list indices (a multiple of 3)
+  //! \return the strip indices
+    std::vector<uint16_t> fromList (const uint16_t *list, size_t n);
+
+  //! vector versions of the conversions
+    inline std::vector<uint16_t> toList (std::vector<uint16_t> const &strip)
+    {
+        return toList (strip.data(), strip.size());
+    }
+    inline std::vector<uint16_t> fromList (std::vector<uint16_t> const &list)
+    {
+        return fromList (list.data(), list.size());
+    }
+
+} // namespace strips
+
+#endif // !_CHUNK_STRIPS_HPP_
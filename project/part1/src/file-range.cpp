@@ -0,0 +1,91 @@
+/*! \file file-range.cpp
+ *
+ * \author John Reppy
+ */
+
+/* CMSC23700 Final Project sample code (Autumn 2022)
+ *
+ * COPYRIGHT (c) 2022 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#include "file-range.hpp"
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+bool FileRange::open (std::string const &file)
+{
+    this->close ();
+
+    int fd = ::open (file.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        ::close (fd);
+        return false;
+    }
+
+    this->_fd = fd;
+    this->_owned = true;
+    this->_base = 0;
+    this->_size = static_cast<uint64_t>(st.st_size);
+
+    return true;
+
+}
+
+void FileRange::open (int fd, uint64_t base, uint64_t size)
+{
+    this->close ();
+
+    this->_fd = fd;
+    this->_owned = false;
+    this->_base = base;
+    this->_size = size;
+
+}
+
+void FileRange::close ()
+{
+    if (this->_owned && (this->_fd >= 0)) {
+        ::close (this->_fd);
+    }
+    this->_fd = -1;
+    this->_owned = false;
+    this->_base = 0;
+    this->_size = 0;
+
+}
+
+bool FileRange::read (uint64_t offset, void *buf, size_t n) const
+{
+    if ((this->_fd < 0) || ! this->inBounds(offset, n)) {
+        return false;
+    }
+
+    uint8_t *p = static_cast<uint8_t *>(buf);
+    off_t pos = static_cast<off_t>(this->_base + offset);
+    while (n > 0) {
+        ssize_t nb = pread (this->_fd, p, n, pos);
+        if (nb < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        else if (nb == 0) {
+          // unexpected end of file
+            return false;
+        }
+        p += nb;
+        pos += nb;
+        n -= size_t(nb);
+    }
+
+    return true;
+
+}
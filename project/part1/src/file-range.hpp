@@ -0,0 +1,78 @@
+/*! \file file-range.hpp
+ *
+ * \author John Reppy
+ *
+ * Positional reads from a byte range of a file.
+ */
+
+/* CMSC23700 Final Project sample code (Autumn 2022)
+ *
+ * COPYRIGHT (c) 2022 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#ifndef _FILE_RANGE_HPP_
+#define _FILE_RANGE_HPP_
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+//! A read-only byte range of an open file, which is either a whole file or a member
+//! of a map pack (see pack-file.hpp).  Reads are done with `pread`, so there is no
+//! file position to manage and several ranges (possibly on different threads) can
+//! share the same file descriptor.
+class FileRange {
+  public:
+
+    FileRange () : _fd(-1), _owned(false), _base(0), _size(0) { }
+
+    ~FileRange () { this->close(); }
+
+    //! open a whole file; the range owns the file descriptor
+    //! \param file the path to the file
+    //! \return true if the file was successfully opened
+    bool open (std::string const &file);
+
+    //! make the range a view of part of a file that is owned by someone else
+    //! \param fd    the shared file descriptor
+    //! \param base  the offset of the start of the range in the file
+    //! \param size  the size of the range in bytes
+    void open (int fd, uint64_t base, uint64_t size);
+
+    //! close the range (the file descriptor is only closed if the range owns it)
+    void close ();
+
+    //! is the range open?
+    bool isOpen () const { return (this->_fd >= 0); }
+
+    //! the size of the range in bytes
+    uint64_t size () const { return this->_size; }
+
+    //! is the byte range [offset..offset+len) inside the range?
+    bool inBounds (uint64_t offset, uint64_t len) const
+    {
+        return (offset <= this->_size) && (len <= this->_size - offset);
+    }
+
+    //! \brief read bytes from the range
+    //! \param offset    the offset of the bytes relative to the start of the range
+    //! \param[out] buf  the buffer to read into
+    //! \param n         the number of bytes to read
+    //! \return true if all `n` bytes were read; false if the bytes are not in the
+    //!         range or if there was an I/O error
+    bool read (uint64_t offset, void *buf, size_t n) const;
+
+  private:
+    int _fd;                    //!< the file descriptor (-1 when closed)
+    bool _owned;                //!< true if we should close the file descriptor
+    uint64_t _base;             //!< the file offset of the start of the range
+    uint64_t _size;             //!< the size of the range in bytes
+
+    // ranges are not copyable
+    FileRange (FileRange const &) = delete;
+    FileRange &operator= (FileRange const &) = delete;
+
+};
+
+#endif // !_FILE_RANGE_HPP_
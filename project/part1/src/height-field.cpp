@@ -0,0 +1,351 @@
+/*! \file height-field.cpp
+ *
+ * \author John Reppy
+ */
+
+/* CMSC23700 Final Project sample code (Autumn 2022)
+ *
+ * COPYRIGHT (c) 2022 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#include "height-field.hpp"
+#include "map.hpp"
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// the maximum number of pyramid levels (one for each power of 2 up to Map::kMaxCellSize)
+static constexpr int kMaxLevels = 15;
+
+HeightField::HeightField (std::string const &file, float hScale, float vScale, float baseElev)
+  : _size(0), _hScale(hScale), _invHScale(1.0f / hScale), _vScale(vScale), _baseElev(baseElev)
+{
+    cs237::DataImage2D img(file, false);
+    this->_init (img, file);
+}
+
+HeightField::HeightField (
+    cs237::Image2D const &img, std::string const &name,
+    float hScale, float vScale, float baseElev)
+  : _size(0), _hScale(hScale), _invHScale(1.0f / hScale), _vScale(vScale), _baseElev(baseElev)
+{
+    this->_init (img, name);
+}
+
+void HeightField::_init (cs237::Image2D const &img, std::string const &name)
+{
+    if ((img.channels() != cs237::Channels::R) || (img.type() != cs237::ChannelTy::U16)) {
+        std::cerr << "HeightField: \"" << name << "\" is not a 16-bit grayscale image\n";
+        return;
+    }
+    uint32_t size = img.width() - 1;
+    if ((img.width() != img.height()) || (ilog2(size) < 0)
+    || (size < Map::kMinCellSize) || (size > Map::kMaxCellSize)) {
+        std::cerr << "HeightField: \"" << name << "\" has bogus size "
+            << img.width() << "x" << img.height() << "\n";
+        return;
+    }
+
+    this->_samples.resize (size_t(img.width()) * size_t(img.height()));
+    std::memcpy (this->_samples.data(), img.data(), this->_samples.size() * sizeof(uint16_t));
+    this->_size = size;
+
+    this->_buildPyramid ();
+
+}
+
+void HeightField::_buildPyramid ()
+{
+    int nLevels = ilog2(this->_size) + 1;
+    assert (nLevels <= kMaxLevels);
+    this->_levels.resize (nLevels);
+
+  // level 0 has one entry per grid square
+    uint32_t n = this->_size;
+    std::vector<MinMax> &base = this->_levels[0];
+    base.resize (size_t(n) * n);
+    for (uint32_t row = 0;  row < n;  row++) {
+        for (uint32_t col = 0;  col < n;  col++) {
+            uint16_t s00 = this->_sample(row, col);
+            uint16_t s01 = this->_sample(row, col+1);
+            uint16_t s10 = this->_sample(row+1, col);
+            uint16_t s11 = this->_sample(row+1, col+1);
+            MinMax &mm = base[size_t(row) * n + col];
+            mm.min = std::min(std::min(s00, s01), std::min(s10, s11));
+            mm.max = std::max(std::max(s00, s01), std::max(s10, s11));
+        }
+    }
+
+  // each entry of the other levels covers a 2x2 block of the level below it
+    for (int k = 1;  k < nLevels;  k++) {
+        const std::vector<MinMax> &src = this->_levels[k-1];
+        std::vector<MinMax> &dst = this->_levels[k];
+        uint32_t srcN = n;
+        n >>= 1;
+        dst.resize (size_t(n) * n);
+        for (uint32_t row = 0;  row < n;  row++) {
+            for (uint32_t col = 0;  col < n;  col++) {
+                const MinMax *a = &src[size_t(2*row) * srcN + 2*col];
+                const MinMax *b = a + srcN;
+                MinMax &mm = dst[size_t(row) * n + col];
+                mm.min = std::min(std::min(a[0].min, a[1].min), std::min(b[0].min, b[1].min));
+                mm.max = std::max(std::max(a[0].max, a[1].max), std::max(b[0].max, b[1].max));
+            }
+        }
+    }
+
+}
+
+float HeightField::heightAt (float x, float z) const
+{
+    float maxUV = float(this->_size);
+    float u = std::clamp(x * this->_invHScale, 0.0f, maxUV);
+    float v = std::clamp(z * this->_invHScale, 0.0f, maxUV);
+    uint32_t col = std::min(uint32_t(u), this->_size - 1);
+    uint32_t row = std::min(uint32_t(v), this->_size - 1);
+    float fu = u - float(col);
+    float fv = v - float(row);
+
+    float s00 = this->_sample(row, col);
+    float s01 = this->_sample(row, col+1);
+    float s10 = this->_sample(row+1, col);
+    float s11 = this->_sample(row+1, col+1);
+    float s;
+    if (fu >= fv) {
+      // the NE triangle (NW, NE, SE)
+        s = s00 + fu * (s01 - s00) + fv * (s11 - s01);
+    } else {
+      // the SW triangle (NW, SE, SW)
+        s = s00 + fv * (s10 - s00) + fu * (s11 - s10);
+    }
+
+    return this->_toHeight(s);
+
+}
+
+void HeightField::heightAt (size_t n, const float *x, const float *z, float *h) const
+{
+    size_t i = 0;
+
+#if defined(__SSE2__)
+  // we compute the grid coordinates, interpolation weights, and final heights four
+  // points at a time; SSE2 does not have a gather instruction, so the sample loads
+  // are scalar.
+    const size_t stride = this->_size + 1;
+    const uint16_t *samples = this->_samples.data();
+    const __m128 invH = _mm_set1_ps(this->_invHScale);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 maxUV = _mm_set1_ps(float(this->_size));
+    const __m128 maxRC = _mm_set1_ps(float(this->_size - 1));
+    const __m128 vScale = _mm_set1_ps(this->_vScale);
+    const __m128 baseElev = _mm_set1_ps(this->_baseElev);
+    alignas(16) int32_t rows[4], cols[4];
+    alignas(16) float s00[4], s01[4], s10[4], s11[4];
+    for (;  i + 4 <= n;  i += 4) {
+        __m128 u = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(x + i), invH), zero), maxUV);
+        __m128 v = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(z + i), invH), zero), maxUV);
+      // u and v are non-negative, so truncation is the same as floor
+        __m128 col = _mm_min_ps(_mm_cvtepi32_ps(_mm_cvttps_epi32(u)), maxRC);
+        __m128 row = _mm_min_ps(_mm_cvtepi32_ps(_mm_cvttps_epi32(v)), maxRC);
+        _mm_store_si128 (reinterpret_cast<__m128i *>(cols), _mm_cvttps_epi32(col));
+        _mm_store_si128 (reinterpret_cast<__m128i *>(rows), _mm_cvttps_epi32(row));
+        __m128 fu = _mm_sub_ps(u, col);
+        __m128 fv = _mm_sub_ps(v, row);
+
+        for (int k = 0;  k < 4;  k++) {
+            const uint16_t *p = samples + size_t(rows[k]) * stride + size_t(cols[k]);
+            s00[k] = p[0];
+            s01[k] = p[1];
+            s10[k] = p[stride];
+            s11[k] = p[stride + 1];
+        }
+        __m128 a = _mm_load_ps(s00);
+        __m128 b = _mm_load_ps(s01);
+        __m128 c = _mm_load_ps(s10);
+        __m128 d = _mm_load_ps(s11);
+
+      // evaluate both triangles' planes and select using the fu >= fv mask
+        __m128 ne = _mm_add_ps(a,
+            _mm_add_ps(_mm_mul_ps(fu, _mm_sub_ps(b, a)), _mm_mul_ps(fv, _mm_sub_ps(d, b))));
+        __m128 sw = _mm_add_ps(a,
+            _mm_add_ps(_mm_mul_ps(fv, _mm_sub_ps(c, a)), _mm_mul_ps(fu, _mm_sub_ps(d, c))));
+        __m128 mask = _mm_cmpge_ps(fu, fv);
+        __m128 s = _mm_or_ps(_mm_and_ps(mask, ne), _mm_andnot_ps(mask, sw));
+
+        _mm_storeu_ps (h + i, _mm_add_ps(baseElev, _mm_mul_ps(vScale, s)));
+    }
+#endif
+
+    for (;  i < n;  i++) {
+        h[i] = this->heightAt(x[i], z[i]);
+    }
+
+}
+
+// clip the parameter interval [t0, t1] of a ray to the slab lo <= o + t*d <= hi;
+// returns false if the clipped interval is empty
+static inline bool clipSlab (float o, float d, float lo, float hi, float &t0, float &t1)
+{
+    if (d == 0.0f) {
+        return (lo <= o) && (o <= hi);
+    }
+    float invD = 1.0f / d;
+    float ta = (lo - o) * invD;
+    float tb = (hi - o) * invD;
+    if (ta > tb) {
+        std::swap (ta, tb);
+    }
+    t0 = std::max(t0, ta);
+    t1 = std::min(t1, tb);
+    return (t0 <= t1);
+}
+
+bool HeightField::rayCast (
+    glm::vec3 const &org, glm::vec3 const &dir, float tMin, float tMax,
+    float &tHit) const
+{
+  // a block of the pyramid that the ray passes through, with the parameter interval
+  // of the ray inside the block's bounding box
+    struct Block {
+        int level;
+        uint32_t row, col;
+        float t0, t1;
+    };
+
+  // convert the ray to grid units; the Y coordinate stays in meters
+    glm::vec3 o(org.x * this->_invHScale, org.y, org.z * this->_invHScale);
+    glm::vec3 d(dir.x * this->_invHScale, dir.y, dir.z * this->_invHScale);
+
+  // clip the ray to a block; returns false if the ray misses the block.  The vertical
+  // extent of a block is padded by half a sample, since it has zero thickness when the
+  // block is flat.  For grid squares, we keep the whole interval where the ray is over
+  // the square, since _hitSquare does its own test against the surface.
+    float pad = 0.5f * this->_vScale;
+    auto clip = [this, &o, &d, pad](Block &b) -> bool {
+        float lo = float(b.col << b.level);
+        float hi = float((b.col + 1) << b.level);
+        if (! clipSlab (o.x, d.x, lo, hi, b.t0, b.t1)) {
+            return false;
+        }
+        lo = float(b.row << b.level);
+        hi = float((b.row + 1) << b.level);
+        if (! clipSlab (o.z, d.z, lo, hi, b.t0, b.t1)) {
+            return false;
+        }
+        MinMax const &mm = this->_levels[b.level][size_t(b.row) * (this->_size >> b.level) + b.col];
+        float t0 = b.t0, t1 = b.t1;
+        if (! clipSlab (o.y, d.y, this->_toHeight(mm.min) - pad, this->_toHeight(mm.max) + pad, t0, t1)) {
+            return false;
+        }
+        if (b.level > 0) {
+            b.t0 = t0;
+            b.t1 = t1;
+        }
+        return true;
+    };
+
+  // at most three siblings are pending at each level, plus the block being visited
+    Block stk[3 * kMaxLevels + 1];
+    int sp = 0;
+    stk[0] = { int(this->_levels.size()) - 1, 0, 0, tMin, tMax };
+    if (! clip(stk[0])) {
+        return false;
+    }
+    sp = 1;
+
+    while (sp > 0) {
+        Block blk = stk[--sp];
+        if (blk.level == 0) {
+            if (this->_hitSquare (blk.row, blk.col, o, d, blk.t0, blk.t1, tHit)) {
+                return true;
+            }
+            continue;
+        }
+      // clip the ray to the four children and push the ones that it hits so that the
+      // nearest one is on top of the stack
+        Block kids[4];
+        int nKids = 0;
+        for (uint32_t i = 0;  i < 4;  i++) {
+            Block kid = {
+                blk.level - 1, 2*blk.row + (i >> 1), 2*blk.col + (i & 1), blk.t0, blk.t1
+            };
+            if (clip(kid)) {
+              // insertion sort by decreasing entry parameter
+                int j = nKids++;
+                while ((j > 0) && (kids[j-1].t0 < kid.t0)) {
+                    kids[j] = kids[j-1];
+                    j--;
+                }
+                kids[j] = kid;
+            }
+        }
+        for (int j = 0;  j < nKids;  j++) {
+            stk[sp++] = kids[j];
+        }
+    }
+
+    return false;
+
+}
+
+bool HeightField::_hitSquare (
+    uint32_t row, uint32_t col, glm::vec3 const &o, glm::vec3 const &d,
+    float t0, float t1, float &tHit) const
+{
+    float h00 = this->_toHeight(this->_sample(row, col));
+    float h01 = this->_toHeight(this->_sample(row, col+1));
+    float h10 = this->_toHeight(this->_sample(row+1, col));
+    float h11 = this->_toHeight(this->_sample(row+1, col+1));
+
+  // we parameterize the segment by s = t - t0 starting from the point where the ray
+  // enters the square, which keeps the square-relative coordinates small
+    float gu = o.x + d.x * t0 - float(col);
+    float gv = o.z + d.z * t0 - float(row);
+    float gy = o.y + d.y * t0;
+
+  // split the segment where it crosses the diagonal (fu == fv) of the square
+    float ss[3] = { 0.0f, t1 - t0, t1 - t0 };
+    int n = 2;
+    float dd = d.x - d.z;
+    if (dd != 0.0f) {
+        float sc = (gv - gu) / dd;
+        if ((0.0f < sc) && (sc < ss[1])) {
+            ss[1] = sc;
+            n = 3;
+        }
+    }
+
+    for (int i = 0;  i + 1 < n;  i++) {
+        float a = ss[i], b = ss[i+1];
+        float sm = 0.5f * (a + b);
+      // the plane of the triangle that contains the sub-segment is h00 + A*fu + B*fv
+        float A, B;
+        if (gu + d.x * sm >= gv + d.z * sm) {
+            A = h01 - h00;
+            B = h11 - h01;
+        } else {
+            A = h11 - h10;
+            B = h10 - h00;
+        }
+      // the height of the ray above the plane is c0 + c1*s
+        float c0 = gy - h00 - A * gu - B * gv;
+        float c1 = d.y - A * d.x - B * d.z;
+        float fa = c0 + c1 * a;
+        if (fa <= 0.0f) {
+            tHit = t0 + a;
+            return true;
+        }
+        float fb = c0 + c1 * b;
+        if (fb <= 0.0f) {
+            tHit = t0 + std::clamp(-c0 / c1, a, b);
+            return true;
+        }
+    }
+
+    return false;
+
+}
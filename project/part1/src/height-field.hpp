@@ -0,0 +1,155 @@
+/*! \file height-field.hpp
+ *
+ * \author John Reppy
+ *
+ * The full-resolution height field of a cell with a min/max pyramid for fast
+ * spatial queries (height lookup, ray casting, and line of sight).
+ */
+
+/* CMSC23700 Final Project sample code (Autumn 2022)
+ *
+ * COPYRIGHT (c) 2022 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#ifndef _HEIGHT_FIELD_HPP_
+#define _HEIGHT_FIELD_HPP_
+
+#include "cs237.hpp"
+#include <string>
+#include <vector>
+
+//! The height field of a cell, which is loaded from the cell's "hf.png" file.  The
+//! samples form a grid of (size+1) x (size+1) vertices, where sample (row, col) is at
+//! (col * hScale, baseElev + vScale * sample, row * hScale) relative to the cell's
+//! NW corner.  The surface is piecewise linear: each grid square is split into two
+//! triangles by the diagonal from its NW corner to its SE corner.
+//!
+//! All of the query functions take coordinates relative to the cell's NW corner.
+//!
+//! For ray casting, we build a pyramid over the grid squares where each entry at
+//! level k holds the minimum and maximum samples of a 2^k x 2^k block of squares.
+//! A ray cast descends the pyramid front to back and only visits the blocks whose
+//! bounding boxes the ray passes through.
+class HeightField {
+  public:
+
+    //! load a height field
+    //! \param file      the path to the "hf.png" file
+    //! \param hScale    the map's horizontal scale
+    //! \param vScale    the map's vertical scale
+    //! \param baseElev  the map's base elevation
+    //!
+    //! Use `isValid()` to check if the height field was successfully loaded.
+    HeightField (std::string const &file, float hScale, float vScale, float baseElev);
+
+    //! make a height field from an image that has already been loaded (e.g., from a
+    //! map pack)
+    //! \param img       the 16-bit grayscale height-field image (not flipped)
+    //! \param name      the name of the image (for error messages)
+    //! \param hScale    the map's horizontal scale
+    //! \param vScale    the map's vertical scale
+    //! \param baseElev  the map's base elevation
+    //!
+    //! Use `isValid()` to check if the image was a valid height field.
+    HeightField (
+        cs237::Image2D const &img, std::string const &name,
+        float hScale, float vScale, float baseElev);
+
+    ~HeightField () { }
+
+    //! was the height field successfully loaded?
+    bool isValid () const { return (this->_size > 0); }
+
+    //! the number of grid squares along each side of the height field
+    uint32_t size () const { return this->_size; }
+
+    //! the horizontal scale (meters per grid square)
+    float hScale () const { return this->_hScale; }
+
+    //! the vertical scale (meters per sample unit)
+    float vScale () const { return this->_vScale; }
+
+    //! the (size+1) x (size+1) raw samples in row-major order (north to south)
+    const uint16_t *samples () const { return this->_samples.data(); }
+
+    //! the minimum height of the surface in meters
+    float minHeight () const { return this->_toHeight(this->_levels.back()[0].min); }
+
+    //! the maximum height of the surface in meters
+    float maxHeight () const { return this->_toHeight(this->_levels.back()[0].max); }
+
+    //! \brief the height of the surface at a point; points outside the height field
+    //!        are clamped to its edges
+    //! \param x  the X coordinate
+    //! \param z  the Z coordinate
+    //! \return the height of the surface in meters
+    float heightAt (float x, float z) const;
+
+    //! \brief the heights of the surface at an array of points.  This is faster than
+    //!        calling `heightAt` for each point, since it uses SIMD instructions when
+    //!        they are available.
+    //! \param n       the number of points
+    //! \param x       the X coordinates of the points
+    //! \param z       the Z coordinates of the points
+    //! \param[out] h  the heights of the surface at the points
+    void heightAt (size_t n, const float *x, const float *z, float *h) const;
+
+    //! \brief find the first intersection of a ray with the surface
+    //! \param org       the origin of the ray
+    //! \param dir       the direction of the ray (it does not have to be normalized)
+    //! \param tMin      the start of the ray segment to test
+    //! \param tMax      the end of the ray segment to test
+    //! \param[out] tHit the parameter of the first point on the segment that is on or
+    //!                  below the surface
+    //! \return true if the segment hits the surface
+    bool rayCast (
+        glm::vec3 const &org, glm::vec3 const &dir, float tMin, float tMax,
+        float &tHit) const;
+
+  private:
+    //! the minimum and maximum samples of a block of grid squares
+    struct MinMax {
+        uint16_t min, max;
+    };
+
+    uint32_t _size;             //!< number of grid squares per side (a power of 2)
+    float _hScale;              //!< the horizontal scale (meters per grid square)
+    float _invHScale;           //!< 1 / _hScale
+    float _vScale;              //!< the vertical scale (meters per sample unit)
+    float _baseElev;            //!< the height of a zero sample
+    std::vector<uint16_t> _samples; //!< the (_size+1)^2 samples in row-major order
+    std::vector<std::vector<MinMax>> _levels; //!< the pyramid; level k is a square grid
+                                //!  of (_size >> k)^2 blocks in row-major order
+
+    //! convert a sample to a height in meters
+    float _toHeight (float s) const { return this->_baseElev + this->_vScale * s; }
+
+    //! the sample at a grid vertex
+    uint16_t _sample (uint32_t row, uint32_t col) const
+    {
+        return this->_samples[size_t(row) * (this->_size + 1) + col];
+    }
+
+    //! initialize the samples from an image and build the pyramid
+    void _init (cs237::Image2D const &img, std::string const &name);
+
+    //! build the min/max pyramid from the samples
+    void _buildPyramid ();
+
+    //! intersect a ray with the surface of a single grid square
+    //! \param row   the row of the square
+    //! \param col   the column of the square
+    //! \param o     the ray origin in grid units (the Y coordinate is in meters)
+    //! \param d     the ray direction in grid units (the Y coordinate is in meters)
+    //! \param t0    the parameter where the ray enters the square
+    //! \param t1    the parameter where the ray leaves the square
+    //! \param[out] tHit the parameter of the first point that is on or below the surface
+    //! \return true if the ray hits the surface inside the square
+    bool _hitSquare (
+        uint32_t row, uint32_t col, glm::vec3 const &o, glm::vec3 const &d,
+        float t0, float t1, float &tHit) const;
+
+};
+
+#endif // !_HEIGHT_FIELD_HPP_
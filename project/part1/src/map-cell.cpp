@@ -15,14 +15,25 @@
 #include "map.hpp"
 #include "map-cell.hpp"
 #include "qtree-util.hpp"
-#include <fstream>
+#include "mapped-file.hpp"
+#include "pack-file.hpp"
+#include "chunk-arena.hpp"
+#include "tile-tree.hpp"
+#include "height-field.hpp"
+#include "normal-map.hpp"
+#include "cell-file.hpp"
+#include "chunk-codec.hpp"
+#include "binary-io.hpp"
+#include <cstring>
 #include <vector>
 #include <iomanip>
+#include <unistd.h>
 
 // A cell file has the following layout on disk.  All data is in little-endian layout.
 //
 //      uint32_t magic;         // Magic number; should be 0x63656C6C ('cell')
-//      uint32_t compressed;    // true if the chunks are compressed
+//      uint32_t flags;         // bit 0 is set if the chunks are compressed; bits 16-31
+//                              // hold the format version (0 for version 1 files)
 //      uint32_t size;          // cell width (will be width+1 vertices wide)
 //      uint32_t nLODs;
 //      uint64_t toc[N];        // file offsets of chunks
@@ -37,38 +48,139 @@
 //      Vertex verts[nVerts];
 //      uint16_t indices[nIndices];
 //
-// Each Vertex is represented by four 16-bit signed integers.
+// Each Vertex is represented by four 16-bit signed integers.  The indices are
+// triangle strips that are separated by 0xffff restart indices (see chunk-strips.hpp).
+//
+// If the compressed flag is set in the file header, then the vertex and index
+// arrays of each chunk are replaced by
+//
+//      uint32_t vBytes;        // number of bytes of encoded vertex data
+//      uint32_t iBytes;        // number of bytes of encoded index data
+//      uint8_t vData[vBytes];  // encoded vertex data
+//      uint8_t iData[iBytes];  // encoded index data
+//
+// where the encoding is described in chunk-codec.hpp.
+//
+// Version 2 files replace the TOC and chunk headers with a metadata block that
+// immediately follows the header, so that the metadata can be loaded with a single
+// read:
+//
+//      uint32_t magic;
+//      uint32_t flags;         // (2 << 16) | compressed
+//      uint32_t size;
+//      uint32_t nLODs;
+//      float hScale;           // the map scales that were used to compute the
+//      float vScale;           // bounding boxes in the metadata
+//      float baseElev;
+//      uint32_t align;         // payload page size (4096)
+//      CellTileMeta meta[N];   // per-tile metadata in tile ID order (see cell-file.hpp)
+//
+// The payload of a chunk is its vertex and index arrays (or their compressed form).
+// Payloads follow the metadata starting at the first 4K page boundary, are stored in
+// depth-first order so that a frontier walk reads them sequentially, and are 8-byte
+// aligned.  Payloads that are a page or larger start on a page boundary.
 
-// A generic helper function for reading binary values from a input file
-template <typename T>
-inline T readVal (std::ifstream &inS)
+// A helper function for reading bytes from the cell's file
+inline void readBytes (FileRange const &inS, uint64_t offset, void *buf, size_t n)
 {
-    T v;
-
-    if (inS.read(reinterpret_cast<char *>(&v), sizeof(T)).fail()) {
+    if (! inS.read (offset, buf, n)) {
 #ifndef NDEBUG
         std::cerr << "Cell::load: error reading file\n";
 #endif
         exit (1);
     }
-    return v;
 }
 
-inline int16_t readI16 (std::ifstream &inS) { return readVal<int16_t>(inS); }
-inline uint32_t readUI32 (std::ifstream &inS) { return readVal<uint32_t>(inS); }
-inline float readF32 (std::ifstream &inS) { return readVal<float>(inS); }
-inline uint64_t readUI64 (std::ifstream &inS) { return readVal<uint64_t>(inS); }
+// sizes of the file header and of chunk headers in bytes
+constexpr uint64_t kHeaderSize = CellFile::kHeaderSize;
+constexpr uint64_t kChunkHeaderSize = CellFile::kChunkHeaderSize;
+constexpr uint64_t kCompressedHeaderSize = CellFile::kCompressedHeaderSize;
+constexpr uint64_t kV2HeaderSize = CellFile::kV2HeaderSize;
+
+// decode the compressed vertex and index data of a chunk; the chunk's arrays must
+// already be allocated.
+static void decodeChunk (
+    Chunk *cp, uint32_t id,
+    const uint8_t *vData, uint32_t vBytes,
+    const uint8_t *iData, uint32_t iBytes)
+{
+    if (! codec::decode (
+            vData, vBytes,
+            reinterpret_cast<uint16_t *>(cp->vertices), 4 * cp->nVertices,
+            codec::kVertexDist))
+    {
+        std::cerr << "Cell::load: corrupt vertex data for tile " << id << "\n";
+        exit (1);
+    }
+    if (! codec::decode (iData, iBytes, cp->indices, cp->nIndices, codec::kIndexDist)) {
+        std::cerr << "Cell::load: corrupt index data for tile " << id << "\n";
+        exit (1);
+    }
+}
 
 
 /***** class Cell member functions *****/
 
 Cell::Cell (Map *map, uint32_t r, uint32_t c, std::string const &stem)
-    : _map(map), _row(r), _col(c), _stem(stem), _nLODs(0), _nTiles(0), _tiles(nullptr),
-      _colorTQT(nullptr), _normTQT(nullptr)
+    : _map(map), _row(r), _col(c), _cellsIdx(0), _stem(stem), _nLODs(0), _nTiles(0), _tiles(nullptr),
+      _tree(nullptr), _hf(nullptr),
+      _colorTQT(nullptr), _normTQT(nullptr), _mappedFile(nullptr), _arena(nullptr),
+      _compressed(false), _state(State::Unloaded)
+{
+}
+
+Cell::~Cell ()
 {
+  // a cell can only be in the Loading state here if its load request was discarded
+  // when the map's worker pool was shut down, in which case it has no data
+    if (this->_state.load() == State::Loading) {
+        this->_state.store (State::Unloaded);
+    }
+    this->unload ();
 }
 
-Cell::~Cell () { }
+// release the cell's data
+void Cell::unload ()
+{
+    assert (this->_state.load() != State::Loading);
+
+    if (this->_tiles != nullptr) {
+      // remove the resident chunks from the map's LRU list; their memory is freed with
+      // the arena.  Chunks that were prefetched by a worker, but not yet adopted, are not
+      // in the LRU list, and when the cell is mapped and uncompressed, the chunk data
+      // belongs to the mapping.
+        bool inLRU = (this->_state.load(std::memory_order_relaxed) == State::Ready);
+        if (inLRU && this->_ownsChunks()) {
+            this->_map->_residentBytes -= this->_arena->committedBytes();
+            for (uint32_t id = 0;  id < this->_nTiles;  id++) {
+                Tile *tile = &(this->_tiles[id]);
+                if (tile->_resident) {
+                    this->_map->_lruRemove (tile);
+                }
+            }
+        }
+        delete[] this->_tiles;
+        this->_tiles = nullptr;
+    }
+    delete this->_tree;
+    this->_tree = nullptr;
+  // a computed normal map shares the height field, so we release it first
+    delete this->_normTQT;
+    this->_normTQT = nullptr;
+    this->_hf.reset();
+    delete this->_arena;
+    this->_arena = nullptr;
+    delete this->_mappedFile;
+    this->_mappedFile = nullptr;
+    this->_inS.close();
+    delete this->_colorTQT;
+    this->_colorTQT = nullptr;
+    this->_nLODs = 0;
+    this->_nTiles = 0;
+
+    this->_state.store (State::Unloaded, std::memory_order_relaxed);
+
+}
 
 // load the cell data
 void Cell::load ()
@@ -77,19 +189,52 @@ void Cell::load ()
         return;
 
     std::string file = this->_stem + "/hf.cell";
-    std::ifstream inS(file, std::ifstream::in | std::ifstream::binary);
-    if (inS.fail()) {
-#ifndef NDEBUG
-        std::cerr << "Cell::load: unable to open \"" << file << "\"\n";
-#endif
-        exit (1);
+    if (this->_map->usesMMap()) {
+        this->_loadFromMapping (file);
+    } else {
+        this->_loadFromStream (file);
     }
 
-  // get header info
-    uint32_t magic = readUI32(inS);
-    bool compressed = (readUI32(inS) != 0);
-    uint32_t size = readUI32(inS);
-    uint32_t nLODs = readUI32(inS);
+    this->_tree = new TileTree (this);
+
+}
+
+// get the cell's height field, loading it if necessary
+HeightField const *Cell::heightField ()
+{
+    this->_loadHeightField ();
+    return this->_hf.get();
+}
+
+void Cell::_loadHeightField ()
+{
+    if (this->_hf == nullptr) {
+        std::string file = this->datafile("/hf.png");
+        PackFile const *pack = this->_map->_pack;
+        if (pack != nullptr) {
+            std::vector<uint8_t> png;
+            if (! pack->read (file, png)) {
+                std::cerr << "Cell::heightField: missing \"" << file << "\" in map pack\n";
+                exit (1);
+            }
+            cs237::DataImage2D img(png.data(), png.size(), false);
+            this->_hf = std::make_shared<const HeightField> (
+                img, file, this->_map->_hScale, this->_map->_vScale, this->_map->_baseElev);
+        } else {
+            this->_hf = std::make_shared<const HeightField> (
+                file, this->_map->_hScale, this->_map->_vScale, this->_map->_baseElev);
+        }
+        if (! this->_hf->isValid()) {
+            std::cerr << "Cell::heightField: unable to load height field for cell "
+                << this->_row << "," << this->_col << "\n";
+            exit (1);
+        }
+    }
+}
+
+// check the header information of a cell file
+void Cell::_checkHeader (uint32_t magic, uint32_t size, uint32_t nLODs)
+{
     if (magic != Cell::kMagic) {
 #ifndef NDEBUG
         std::cerr << "Cell::load: bogus magic number in header\n";
@@ -110,61 +255,411 @@ void Cell::load ()
         exit (1);
     }
 
-    if (compressed) {
-        std::cerr << "Cell::load: compressed files are not supported yet\n";
-        exit (1);
-    }
+}
 
+// allocate the tile quadtree.  Note that tiles are numbered in a breadth-first
+// order in the LOD quadtree.
+void Cell::_allocTiles (uint32_t nLODs)
+{
     uint32_t qtreeSize = qtree::fullSize(nLODs);
-    std::vector<std::streamoff> toc(qtreeSize);
-    for (int i = 0;  i < qtreeSize;  i++) {
-        toc[i] = static_cast<std::streamoff>(readUI64(inS));
-    }
 
-  // allocate and load the tiles.  Note that tiles are numbered in a breadth-first
-  // order in the LOD quadtree.
     this->_nLODs = nLODs;
     this->_nTiles = qtreeSize;
     this->_tiles = new class Tile[qtreeSize];
 
     this->_tiles[0]._init (this, 0, 0, 0, 0);
 
-  // load the tile mesh data
+}
+
+// compute the tile's bounding box.  We use double precision here, so that we can
+// support large worlds.
+void Cell::_initBBox (Tile *tile)
+{
+    Chunk const &chunk = tile->_chunk;
+    glm::dvec3 nwCorner =
+        this->_map->nwCellCorner(this->_row, this->_col) +
+        glm::dvec3(
+            this->_map->hScale() * double(tile->_col),
+            double(this->_map->baseElevation() + this->_map->vScale() * float(chunk.minY)),
+            this->_map->hScale() * double(tile->_row));
+    double w = this->_map->hScale() * tile->width();
+    glm::dvec3 seCorner = nwCorner + glm::dvec3(w, 0.0, w);
+    seCorner.y = static_cast<double>(
+        this->_map->baseElevation() + this->_map->vScale() * float(chunk.maxY));
+    tile->_bbox = cs237::AABBd(nwCorner, seCorner);
+
+}
+
+// initialize a tile from its chunk header.  The chunk header has everything that we
+// need for LOD selection and culling, so the mesh data can be loaded later.
+void Cell::_initTile (Tile *tile, const uint8_t *hdr, uint64_t dataOffset)
+{
+    Chunk *cp = &(tile->_chunk);
+    cp->maxError = getVal<float>(hdr);
+    cp->nVertices = getVal<uint32_t>(hdr + 4);
+    cp->nIndices = getVal<uint32_t>(hdr + 8);
+    cp->minY = getVal<int16_t>(hdr + 12);
+    cp->maxY = getVal<int16_t>(hdr + 14);
+    tile->_dataOffset = dataOffset;
+    this->_initBBox (tile);
+
+}
+
+// initialize a tile from its version 2 metadata.  If the bounding box in the metadata
+// was computed with this map's scales, then we just translate it to the cell's position.
+void Cell::_initTile (Tile *tile, CellTileMeta const &meta, bool useBBox)
+{
+    Chunk *cp = &(tile->_chunk);
+    cp->maxError = meta.maxError;
+    cp->nVertices = meta.nVerts;
+    cp->nIndices = meta.nIndices;
+    cp->minY = meta.minY;
+    cp->maxY = meta.maxY;
+    tile->_dataOffset = meta.offset;
+    if (useBBox) {
+        glm::dvec3 nwCorner = this->_map->nwCellCorner(this->_row, this->_col);
+        tile->_bbox = cs237::AABBd(
+            nwCorner + glm::dvec3(meta.bbox[0], meta.bbox[1], meta.bbox[2]),
+            nwCorner + glm::dvec3(meta.bbox[3], meta.bbox[4], meta.bbox[5]));
+    } else {
+        this->_initBBox (tile);
+    }
+
+}
+
+// get the format version from the flags word of the header and check that it is supported
+uint32_t Cell::_checkVersion (uint32_t flags)
+{
+    uint32_t version = (flags >> CellFile::kVersionShift);
+    if (version == 0) {
+        version = 1;
+    }
+    if ((version != 1) && (version != 2)) {
+#ifndef NDEBUG
+        std::cerr << "Cell::load: unsupported file version " << version << "\n";
+#endif
+        exit (1);
+    }
+    this->_compressed = ((flags & CellFile::kCompressedFlag) != 0);
+
+    return version;
+
+}
+
+// returns true if the version 2 metadata was computed using this map's scales
+bool Cell::_sameScales (float hScale, float vScale, float baseElev) const
+{
+    return (hScale == this->_map->_hScale)
+        && (vScale == this->_map->_vScale)
+        && (baseElev == this->_map->_baseElev);
+}
+
+// load the cell's headers from the file.  We keep the file open so that the chunks'
+// mesh data can be read on demand.  For a map pack, the file is a range of the pack
+// that shares the pack's file descriptor.
+void Cell::_loadFromStream (std::string const &file)
+{
+    PackFile const *pack = this->_map->_pack;
+    bool ok = (pack != nullptr) ? pack->open (file, this->_inS) : this->_inS.open (file);
+    if (! ok) {
+#ifndef NDEBUG
+        std::cerr << "Cell::load: unable to open \"" << file << "\"\n";
+#endif
+        exit (1);
+    }
+
+  // get header info; we read enough for the version 2 header, which includes the
+  // scales, since every valid file is at least that long
+    uint8_t hdr[kV2HeaderSize];
+    readBytes (this->_inS, 0, hdr, kV2HeaderSize);
+    uint32_t magic = getVal<uint32_t>(hdr);
+    uint32_t version = this->_checkVersion (getVal<uint32_t>(hdr + 4));
+    uint32_t size = getVal<uint32_t>(hdr + 8);
+    uint32_t nLODs = getVal<uint32_t>(hdr + 12);
+    this->_checkHeader (magic, size, nLODs);
+
+    uint32_t qtreeSize = qtree::fullSize(nLODs);
+
+  // allocate the tiles
+    this->_allocTiles (nLODs);
+
+    if (version == 1) {
+        std::vector<uint64_t> toc(qtreeSize);
+        readBytes (this->_inS, kHeaderSize, toc.data(), qtreeSize * sizeof(uint64_t));
+
+      // read the chunk headers
+        for (uint32_t id = 0;  id < qtreeSize;  id++) {
+            uint8_t hdr[kChunkHeaderSize];
+            if (! this->_inS.read (toc[id], hdr, kChunkHeaderSize)) {
+                std::cerr << "Cell::load: error reading header for tile " << id << "\n";
+                exit (1);
+            }
+            this->_initTile (&(this->_tiles[id]), hdr, toc[id] + kChunkHeaderSize);
+        }
+    }
+    else {
+        bool useBBox = this->_sameScales (
+            getVal<float>(hdr + 16), getVal<float>(hdr + 20), getVal<float>(hdr + 24));
+
+      // read the metadata with a single read
+        std::vector<CellTileMeta> meta(qtreeSize);
+        if (! this->_inS.read (kV2HeaderSize, meta.data(), qtreeSize * sizeof(CellTileMeta))) {
+            std::cerr << "Cell::load: error reading tile metadata\n";
+            exit (1);
+        }
+        for (uint32_t id = 0;  id < qtreeSize;  id++) {
+            this->_initTile (&(this->_tiles[id]), meta[id], useBBox);
+        }
+    }
+
+    this->_allocArena ();
+
+}
+
+// load the cell's headers by mapping the file into our address space.  For uncompressed
+// files, the chunk vertex and index arrays point directly into the mapping, so the only
+// cost of loading the mesh data is the page faults when it is first touched.  For a
+// map pack, the mapping is a view of the mapping of the whole pack.
+void Cell::_loadFromMapping (std::string const &file)
+{
+    PackFile *pack = this->_map->_pack;
+    MappedFile *mf = (pack != nullptr) ? pack->map (file) : new MappedFile (file);
+    if ((mf == nullptr) || ! mf->isValid()) {
+#ifndef NDEBUG
+        std::cerr << "Cell::load: unable to map \"" << file << "\"\n";
+#endif
+        exit (1);
+    }
+
+  // get header info
+    if (! mf->inBounds(0, kHeaderSize)) {
+        std::cerr << "Cell::load: \"" << file << "\" is too small\n";
+        exit (1);
+    }
+    const uint8_t *base = mf->data();
+    uint32_t magic = getVal<uint32_t>(base);
+    uint32_t version = this->_checkVersion (getVal<uint32_t>(base + 4));
+    uint32_t size = getVal<uint32_t>(base + 8);
+    uint32_t nLODs = getVal<uint32_t>(base + 12);
+    this->_checkHeader (magic, size, nLODs);
+
+    uint32_t qtreeSize = qtree::fullSize(nLODs);
+
+    this->_allocTiles (nLODs);
+    this->_mappedFile = mf;
+
+    if (version == 1) {
+      // the TOC immediately follows the header; since the mapping is page aligned and
+      // the header is 16 bytes, the TOC is properly aligned for direct access.
+        if (! mf->inBounds(kHeaderSize, qtreeSize * sizeof(uint64_t))) {
+            std::cerr << "Cell::load: \"" << file << "\" has a truncated TOC\n";
+            exit (1);
+        }
+        const uint64_t *toc = reinterpret_cast<const uint64_t *>(base + kHeaderSize);
+
+      // initialize the tiles from the chunk headers in the mapped file
+        for (uint32_t id = 0;  id < qtreeSize;  id++) {
+            uint64_t offset = toc[id];
+            if (! mf->inBounds(offset, kChunkHeaderSize)) {
+                std::cerr << "Cell::load: bogus TOC entry for tile " << id << "\n";
+                exit (1);
+            }
+          // the chunk header is not necessarily 4-byte aligned, so _initTile copies it out
+            this->_initTile (&(this->_tiles[id]), base + offset, offset + kChunkHeaderSize);
+        }
+    }
+    else {
+      // the metadata immediately follows the 32-byte header, so it is properly aligned
+      // for direct access
+        if (! mf->inBounds(0, kV2HeaderSize + qtreeSize * sizeof(CellTileMeta))) {
+            std::cerr << "Cell::load: \"" << file << "\" has truncated metadata\n";
+            exit (1);
+        }
+        bool useBBox = this->_sameScales (
+            getVal<float>(base + 16), getVal<float>(base + 20), getVal<float>(base + 24));
+        const CellTileMeta *meta = reinterpret_cast<const CellTileMeta *>(base + kV2HeaderSize);
+        for (uint32_t id = 0;  id < qtreeSize;  id++) {
+            this->_initTile (&(this->_tiles[id]), meta[id], useBBox);
+        }
+    }
+
+  // compressed data cannot be used in place, so it is decoded on demand
+    if (this->_compressed) {
+        this->_allocArena ();
+        return;
+    }
+
+  // otherwise we point the chunks at their data in the mapping
     for (uint32_t id = 0;  id < qtreeSize;  id++) {
+        Tile *tile = &(this->_tiles[id]);
+      // check that the chunk's data is inside the file and suitably aligned for direct access
+        Chunk *cp = &(tile->_chunk);
+        uint64_t vOffset = tile->_dataOffset;
+        uint64_t iOffset = vOffset + cp->vSize();
+        if (! mf->inBounds(vOffset, cp->vSize() + cp->iSize())) {
+            std::cerr << "Cell::load: chunk data for tile " << id << " is out of bounds\n";
+            exit (1);
+        }
+        if ((vOffset % alignof(HFVertex)) != 0) {
+            std::cerr << "Cell::load: chunk data for tile " << id << " is misaligned\n";
+            exit (1);
+        }
+        cp->vertices = reinterpret_cast<HFVertex *>(const_cast<uint8_t *>(base + vOffset));
+        cp->indices = reinterpret_cast<uint16_t *>(const_cast<uint8_t *>(base + iOffset));
+        tile->_resident = true;
+    }
+
+}
+
+// allocate a single arena that is large enough for the mesh data of all of the chunks
+// in the cell and assign each tile its slot.  The chunk headers must have been loaded.
+void Cell::_allocArena ()
+{
+    size_t total = 0;
+    for (uint32_t id = 0;  id < this->_nTiles;  id++) {
+        Chunk const &chunk = this->_tiles[id]._chunk;
+        total += ChunkArena::align(chunk.vSize() + chunk.iSize());
+    }
+
+    this->_arena = new ChunkArena (total);
+    if ((total > 0) && ! this->_arena->isValid()) {
+        std::cerr << "Cell::load: unable to allocate " << total << " bytes for chunk data\n";
+        exit (1);
+    }
+
+  // carve out the chunks' arrays; the vertex array is at the start of the slot, so it
+  // is 8-byte aligned, and the index array immediately follows it
+    uint8_t *p = this->_arena->data();
+    for (uint32_t id = 0;  id < this->_nTiles;  id++) {
         Chunk *cp = &(this->_tiles[id]._chunk);
-      // find the beginning of the chunk in the input file
-        inS.seekg(toc[id]);
-      // read the chunk's header
-        cp->maxError = readF32(inS);
-        uint32_t nVerts = readUI32(inS);
-        uint32_t nIndices = readUI32(inS);
-        cp->minY = readI16(inS);
-        cp->maxY = readI16(inS);
-      // allocate space for the chunk data
-        this->_tiles[id]._allocChunk(nVerts, nIndices);
-      // read the vertex data
-        if (inS.read(reinterpret_cast<char *>(cp->vertices), cp->vSize()).fail()) {
-            std::cerr << "Cell::load: error reading vertex data for tile " << id << "\n";
+        cp->vertices = reinterpret_cast<HFVertex *>(p);
+        cp->indices = reinterpret_cast<uint16_t *>(p + cp->vSize());
+        p += ChunkArena::align(cp->vSize() + cp->iSize());
+    }
+
+}
+
+// return a tile's chunk, loading its mesh data if it is not resident
+Chunk const &Cell::_residentChunk (uint32_t id)
+{
+    assert (this->isLoaded());
+    Tile *tile = &(this->_tiles[id]);
+    if (! tile->_resident) {
+        this->_loadChunk (tile);
+    }
+    else if (this->_ownsChunks()) {
+        this->_map->_lruTouch (tile);
+    }
+
+    return tile->_chunk;
+
+}
+
+// load a chunk's mesh data and make it subject to the map's chunk budget
+void Cell::_loadChunk (Tile *tile)
+{
+    this->_map->_residentBytes += this->_readChunk (tile);
+    this->_map->_lruInsert (tile);
+    this->_map->_evictChunks (tile);
+
+}
+
+// read a chunk's mesh data from either the mapping or the open file
+size_t Cell::_readChunk (Tile *tile)
+{
+    Chunk *cp = &(tile->_chunk);
+
+    if (this->_mappedFile != nullptr) {
+      // the mapping is only kept for compressed files, since uncompressed chunks
+      // are always resident
+        assert (this->_compressed);
+        MappedFile *mf = this->_mappedFile;
+        uint64_t dOffset = tile->_dataOffset;
+        if (! mf->inBounds(dOffset, kCompressedHeaderSize)) {
+            std::cerr << "Cell::load: chunk data for tile " << tile->_id << " is out of bounds\n";
             exit (1);
         }
-      // read the index array
-        if (inS.read(reinterpret_cast<char *>(cp->indices), cp->iSize()).fail()) {
-            std::cerr << "Cell::load: error reading index data for tile " << id << "\n";
+        const uint8_t *base = mf->data();
+        uint32_t vBytes = getVal<uint32_t>(base + dOffset);
+        uint32_t iBytes = getVal<uint32_t>(base + dOffset + 4);
+        dOffset += kCompressedHeaderSize;
+        if (! mf->inBounds(dOffset, uint64_t(vBytes) + uint64_t(iBytes))) {
+            std::cerr << "Cell::load: chunk data for tile " << tile->_id << " is out of bounds\n";
             exit (1);
         }
-      // compute the tile's bounding box.  We use double precision here, so that we can
-      // support large worlds.
-        glm::dvec3 nwCorner =
-            this->_map->nwCellCorner(this->_row, this->_col) +
-            glm::dvec3(
-                this->_map->hScale() * double(this->_tiles[id]._col),
-                double(this->_map->baseElevation() + this->_map->vScale() * float(cp->minY)),
-                this->_map->hScale() * double(this->_tiles[id]._row));
-        double w = this->_map->hScale() * this->_tiles[id].width();
-        glm::dvec3 seCorner = nwCorner + glm::dvec3(w, 0.0, w);
-        seCorner.y = static_cast<double>(
-            this->_map->baseElevation() + this->_map->vScale() * float(cp->maxY));
-        this->_tiles[id]._bbox = cs237::AABBd(nwCorner, seCorner);
+        decodeChunk (cp, tile->_id, base + dOffset, vBytes, base + dOffset + vBytes, iBytes);
+    }
+    else {
+        uint64_t dOffset = tile->_dataOffset;
+        if (this->_compressed) {
+          // read the encoded data and then decode it into the chunk
+            uint32_t sizes[2];
+            readBytes (this->_inS, dOffset, sizes, sizeof(sizes));
+            uint32_t vBytes = sizes[0];
+            uint32_t iBytes = sizes[1];
+            if (! this->_inS.inBounds(dOffset + kCompressedHeaderSize, uint64_t(vBytes) + uint64_t(iBytes))) {
+                std::cerr << "Cell::load: chunk data for tile " << tile->_id << " is out of bounds\n";
+                exit (1);
+            }
+            std::vector<uint8_t> encoded(size_t(vBytes) + size_t(iBytes));
+            if (! this->_inS.read (dOffset + kCompressedHeaderSize, encoded.data(), encoded.size())) {
+                std::cerr << "Cell::load: error reading data for tile " << tile->_id << "\n";
+                exit (1);
+            }
+            decodeChunk (cp, tile->_id, encoded.data(), vBytes, encoded.data() + vBytes, iBytes);
+        } else {
+          // read the vertex data
+            if (! this->_inS.read (dOffset, cp->vertices, cp->vSize())) {
+                std::cerr << "Cell::load: error reading vertex data for tile " << tile->_id << "\n";
+                exit (1);
+            }
+          // read the index array
+            if (! this->_inS.read (dOffset + cp->vSize(), cp->indices, cp->iSize())) {
+                std::cerr << "Cell::load: error reading index data for tile " << tile->_id << "\n";
+                exit (1);
+            }
+        }
+    }
+
+    tile->_resident = true;
+
+  // the vertex and index arrays are adjacent in the arena (see _allocArena)
+    size_t offset = reinterpret_cast<uint8_t *>(cp->vertices) - this->_arena->data();
+    return this->_arena->acquire (offset, cp->vSize() + cp->iSize());
+
+}
+
+// load a streamed cell.  This function runs on a worker thread, so it must not touch
+// any shared state of the map (such as the LRU list).
+void Cell::_streamIn ()
+{
+    this->load ();
+    this->_openTQTs ();
+
+    if (this->_ownsChunks()) {
+        uint32_t nPrefetch = qtree::fullSize(std::min(this->_nLODs, uint32_t(Cell::kPrefetchLODs)));
+        for (uint32_t id = 0;  id < nPrefetch;  id++) {
+            this->_readChunk (&(this->_tiles[id]));
+        }
+    }
+
+  // publish the cell to the render thread
+    this->_state.store (State::Loaded, std::memory_order_release);
+
+}
+
+// make the prefetched chunks subject to the map's chunk budget
+void Cell::_adoptChunks ()
+{
+    if (this->_ownsChunks()) {
+        this->_map->_residentBytes += this->_arena->committedBytes();
+        for (uint32_t id = 0;  id < this->_nTiles;  id++) {
+            Tile *tile = &(this->_tiles[id]);
+            if (tile->_resident) {
+                this->_map->_lruInsert (tile);
+            }
+        }
+        this->_map->_evictChunks (nullptr);
     }
 
 }
@@ -180,12 +675,38 @@ void Cell::loadObjects ()
 //
 void Cell::initTextures (Window *win)
 {
-  // load textures
-    if (this->_map->hasColorMap()) {
-        this->_colorTQT = new tqt::TextureQTree (this->datafile("/color.tqt"), true, true);
+  // load textures; for streamed cells, the texture quadtrees were opened by the
+  // worker that loaded the cell
+    this->_openTQTs ();
+
+    /** HINT: add tile-specific texture initialization for the root tile here */
+
+}
+
+// open the texture quadtrees for the cell
+void Cell::_openTQTs ()
+{
+    if (this->_map->hasColorMap() && (this->_colorTQT == nullptr)) {
+        this->_colorTQT = this->_openTQT (this->datafile("/color.tqt"), true);
     }
-    if (this->_map->hasNormalMap()) {
-        this->_normTQT = new tqt::TextureQTree (this->datafile("/norm.tqt"), true, false);
+    if (this->_map->hasNormalMap() && (this->_normTQT == nullptr)) {
+        std::string file = this->datafile("/norm.tqt");
+        if (this->_hasDatafile (file)) {
+            this->_normTQT = this->_openTQT (file, false);
+        } else {
+          // the normal map can be computed from the height field, so the file is
+          // optional; in that case, we compute the tiles on demand.  Note that when
+          // the cell is streamed, we are running on a worker thread, which owns the
+          // cell until it is published, so we load the height field directly.
+            this->_loadHeightField ();
+            uint32_t cellSize = this->_map->_cellSize;
+            uint32_t depth = (this->_colorTQT != nullptr)
+                ? this->_colorTQT->depth()
+                : NormalMap::defaultDepth (cellSize);
+            NormalMap gen(
+                this->_hf, depth, NormalMap::defaultTileSize (cellSize, depth));
+            this->_normTQT = gen.makeTQT (true);
+        }
     }
 #ifndef NDEBUG
     if ((this->_colorTQT != nullptr) && (this->_normTQT != nullptr)) {
@@ -193,13 +714,40 @@ void Cell::initTextures (Window *win)
     }
 #endif
 
-    /** HINT: add tile-specific texture initialization for the root tile here */
+}
+
+// open one of the cell's texture quadtrees; for a map pack, the quadtree reads its
+// tiles using the pack's file descriptor
+tqt::TextureQTree *Cell::_openTQT (std::string const &file, bool sRGB)
+{
+    PackFile const *pack = this->_map->_pack;
+    if (pack == nullptr) {
+        return new tqt::TextureQTree (file, true, sRGB);
+    }
+
+    PackFile::Member m;
+    if (! pack->find (file, m)) {
+        std::cerr << "Cell::load: missing \"" << file << "\" in map pack\n";
+        exit (1);
+    }
+    return new tqt::TextureQTree (pack->fd(), m.offset, m.size, true, sRGB);
 
 }
 
+bool Cell::_hasDatafile (std::string const &file) const
+{
+    PackFile const *pack = this->_map->_pack;
+    if (pack == nullptr) {
+        return (access (file.c_str(), R_OK) == 0);
+    }
+    PackFile::Member m;
+    return pack->find (file, m);
+}
+
 /***** class Tile member functions *****/
 
 Tile::Tile ()
+  : _dataOffset(0), _resident(false), _lruPrev(nullptr), _lruNext(nullptr)
 {
     this->_chunk.nVertices = 0;
     this->_chunk.nIndices = 0;
@@ -207,18 +755,17 @@ Tile::Tile ()
     this->_chunk.indices = nullptr;
 }
 
-Tile::~Tile ()
-{
-    delete this->_chunk.vertices;
-    delete this->_chunk.indices;
-}
+// the mesh data is owned by the containing cell (see Cell::~Cell)
+Tile::~Tile () { }
 
-void Tile::_allocChunk (uint32_t nv, uint32_t ni)
+// the chunk's vertex and index arrays are adjacent in the cell's arena (see
+// Cell::_allocArena), so we can release them as a single range
+size_t Tile::_releaseChunk ()
 {
-    this->_chunk.nVertices = nv;
-    this->_chunk.nIndices = ni;
-    this->_chunk.vertices = new HFVertex[nv];
-    this->_chunk.indices = new uint16_t[ni];
+    ChunkArena *arena = this->_cell->_arena;
+    size_t offset = reinterpret_cast<uint8_t *>(this->_chunk.vertices) - arena->data();
+    this->_resident = false;
+    return arena->release (offset, this->_chunk.vSize() + this->_chunk.iSize());
 }
 
 // initialize the _cell, _id, etc. fields of this tile and its descendants.  The chunk and
@@ -15,13 +15,27 @@
 #include "map.hpp"
 #include "qtree-util.hpp"
 #include "tqt.hpp"
+#include "file-range.hpp"
+#include <atomic>
+#include <memory>
 
 class Tile;
+class TileTree;
+class HeightField;
+class MappedFile;
+class ChunkArena;
 struct Instance; // will be defined in Part 2
 
 class Cell {
 public:
 
+    //! the loading state of a cell.  When the map is streamed, a cell moves from
+    //! `Unloaded` to `Loading` when it is requested, to `Loaded` when a worker thread
+    //! has finished loading it, and then to `Ready` when the render thread takes
+    //! ownership of it (see `Map::updateStreaming`).  Otherwise, cells are `Ready`
+    //! once `Map::load` returns.
+    enum class State { Unloaded, Loading, Loaded, Ready };
+
     //! Cell constructor
     //! \param[in] map  the map containing this cell
     //! \param[in] r    this cell's row in the grid of cells
@@ -31,12 +45,33 @@ public:
 
     ~Cell ();
 
-    //! load the cell data from the "hf.cell" file
+    //! load the cell's quadtree from the "hf.cell" file.  Only the file header and the
+    //! chunk headers are read, which is enough to compute the tiles' bounding boxes; the
+    //! chunks' mesh data is loaded on demand (see `Tile::chunk`).  If the map has memory
+    //! mapping enabled (see `Map::useMMap`) and the file is not compressed, then the chunk
+    //! data is not copied; instead the tiles' vertex and index arrays point directly into
+    //! the mapped file.
     void load ();
 
+    //! release the cell's tiles, chunk data, and texture quadtrees; the cell must either
+    //! be ready or not loaded.  This function is used to unload streamed cells.
+    void unload ();
+
     //! returns true if cell data has been loaded
     bool isLoaded () const { return (this->_tiles != nullptr); }
 
+    //! returns true if the cell is ready to be rendered.  The frontier traversal should
+    //! skip cells that are not ready and should treat tiles whose chunks are not resident
+    //! (see `Tile::isResident`) as leaves, so that it uses the coarsest available data
+    //! instead of stalling on I/O.
+    bool isReady () const
+    {
+        return (this->_state.load(std::memory_order_acquire) == State::Ready);
+    }
+
+    //! returns true if the cell's "hf.cell" file is memory mapped
+    bool isMapped () const { return (this->_mappedFile != nullptr); }
+
     //! the row of this cell in the grid of cells in the map
     int row () const { return this->_row; }
     //! the column of this cell in the grid of cells in the map
@@ -58,6 +93,16 @@ public:
     //! get a particular tile; we assume that the cell data has been loaded
     class Tile &tile (int id);
 
+    //! get the compact traversal data for the cell's tiles (nullptr if the cell is not
+    //! loaded).  Use this instead of the Tile objects to select the mesh frontier.
+    class TileTree const *tileTree () const { return this->_tree; }
+
+    //! get the full-resolution height field of the cell for spatial queries.  The
+    //! height field is loaded from the cell's "hf.png" file on first use (or when the
+    //! cell's normal map is computed) and is released when the cell is unloaded.  It
+    //! is only accessed by the render thread.
+    class HeightField const *heightField ();
+
     //! initialize the textures for the cell
     void initTextures (class Window *win);
 
@@ -73,23 +118,121 @@ public:
     static const uint32_t kMagic = 0x63656C6C;  // 'cell'
     static const uint32_t kMinLODs = 1;         //!< minimum number of LODs in a map
     static const uint32_t kMaxLODs = 9;         //!< maximum number of LODs in a map
+    static const uint32_t kPrefetchLODs = 3;    //!< number of LODs whose chunk data is
+                                                //!  loaded by the streaming workers
 
 private:
     Map         *_map;          //!< the map containing this cell
     uint32_t    _row, _col;     //!< the row and column of this cell in its map
+    uint32_t    _cellsIdx;      //!< the index of this cell in its map's vector of cells
     std::string _stem;          //!< prefix of pathnames for access cell data files
     uint32_t    _nLODs;         //!< number of levels of detail in this cell's representation
     uint32_t    _nTiles;        //!< the number of tiles
     class Tile  *_tiles;        //!< the complete quadtree of tiles
+    class TileTree *_tree;      //!< the traversal data for the tiles in cache-friendly form
+    std::shared_ptr<const HeightField> _hf; //!< the height field for spatial queries
+                                //!  (nullptr if it has not been loaded); it is shared
+                                //!  with the computed normal map, if any
     tqt::TextureQTree *_colorTQT; //!< texture quadtree for the cell's color map (nullptr if
                                 //! not present)
     tqt::TextureQTree *_normTQT; //!< texture quadtree for the cell's normal map (nullptr if
                                 //! not present)
     std::vector<Instance *> _objects; //!< the objects (if any) that are on this map cell
+    MappedFile  *_mappedFile;   //!< the memory-mapped "hf.cell" file when the cell was
+                                //!  loaded using mmap; nullptr otherwise.  When non-null
+                                //!  and the file is not compressed, the tiles' chunk data
+                                //!  points into the mapping.
+    ChunkArena  *_arena;        //!< the memory for the tiles' chunk data when the cell owns
+                                //!  it (see _ownsChunks); nullptr otherwise
+    FileRange   _inS;           //!< the open "hf.cell" file when the cell is not mapped;
+                                //!  chunk data is read from it on demand
+    bool        _compressed;    //!< true if the chunk data in the file is compressed
+    std::atomic<State> _state;  //!< the loading state of the cell; the transition from
+                                //!  Loading to Loaded is made by a worker thread and
+                                //!  publishes the cell's data to the render thread
+
+    //! load the cell's headers by reading them from the "hf.cell" file
+    void _loadFromStream (std::string const &file);
+
+    //! load the cell's headers by mapping the "hf.cell" file into memory
+    void _loadFromMapping (std::string const &file);
+
+    //! initialize a tile from its chunk header
+    //! \param tile        the tile to initialize
+    //! \param hdr         the chunk header (kChunkHeaderSize bytes)
+    //! \param dataOffset  the file offset of the chunk's mesh data
+    void _initTile (class Tile *tile, const uint8_t *hdr, uint64_t dataOffset);
+
+    //! initialize a tile from its metadata in a version 2 file
+    //! \param tile     the tile to initialize
+    //! \param meta     the tile's metadata
+    //! \param useBBox  if true, the bounding box in the metadata is valid for this map
+    void _initTile (class Tile *tile, struct CellTileMeta const &meta, bool useBBox);
+
+    //! check the version in the flags word of a cell-file header and set _compressed;
+    //! exits the program if the version is not supported
+    //! \return the file's version (1 or 2)
+    uint32_t _checkVersion (uint32_t flags);
+
+    //! returns true if the given scales (from a version 2 file) match the map's scales
+    bool _sameScales (float hScale, float vScale, float baseElev) const;
+
+    //! allocate the arena for the tiles' chunk data and point each chunk at its slot
+    void _allocArena ();
+
+    //! returns true if the tiles' chunk data is allocated in the cell's arena (and thus
+    //! is subject to the map's chunk budget)
+    bool _ownsChunks () const { return (this->_mappedFile == nullptr) || this->_compressed; }
+
+    //! return the chunk of a tile, loading its mesh data if necessary
+    struct Chunk const &_residentChunk (uint32_t id);
+
+    //! load the mesh data of a tile's chunk from the cell's file and add the tile to
+    //! the map's LRU list
+    void _loadChunk (class Tile *tile);
+
+    //! read the mesh data of a tile's chunk from the cell's file
+    //! \return the number of bytes of arena pages that the chunk newly commits
+    size_t _readChunk (class Tile *tile);
+
+    //! load the cell on a worker thread: read the headers, open the texture quadtrees,
+    //! and read the chunk data for the first kPrefetchLODs levels
+    void _streamIn ();
+
+    //! add the chunks that were read by _streamIn to the map's LRU list; this function
+    //! is called by the render thread
+    void _adoptChunks ();
+
+    //! open the cell's texture quadtrees (if they are not already open)
+    void _openTQTs ();
+
+    //! load the cell's height field (if it is not already loaded)
+    void _loadHeightField ();
+
+    //! open one of the cell's texture quadtrees
+    //! \param file  the name of the ".tqt" file
+    //! \param sRGB  are the textures in sRGB format?
+    tqt::TextureQTree *_openTQT (std::string const &file, bool sRGB);
+
+    //! does one of the cell's data files exist (either as a file or in the map pack)?
+    bool _hasDatafile (std::string const &file) const;
+
+    //! check the header information of a cell file; exits the program on error
+    void _checkHeader (uint32_t magic, uint32_t size, uint32_t nLODs);
+
+    //! allocate the tile quadtree for the given number of LODs
+    void _allocTiles (uint32_t nLODs);
+
+    //! set the world-space bounding box of a tile from its chunk's elevation range
+    void _initBBox (class Tile *tile);
 
 /** HINT: you will probably want to add additional methods to this class to
  ** support visibility testing and rendering
  **/
+
+    friend class Tile;
+    friend class TileTree;
+    friend class Map;
 };
 
 //! packed vertex representation
@@ -130,8 +273,9 @@ struct Chunk {
     int16_t     maxY;           //!< maximum Y value of the vertices in this chunk
     uint32_t    nVertices;      //!< number of vertices in chunk; should be < 2^16
     uint32_t    nIndices;       //!< number of indices in chunk
-    HFVertex    *vertices;      //!< vertex array; each vertex is packed into 64-bits
-    uint16_t    *indices;       //!< index array
+    HFVertex    *vertices;      //!< vertex array; each vertex is packed into 64-bits.
+                                //!  Note that this array is read-only when the cell is mapped
+    uint16_t    *indices;       //!< index array (read-only when the cell is mapped)
 
     size_t vSize() const { return this->nVertices * sizeof(HFVertex); }
     size_t iSize() const { return this->nIndices * sizeof(uint16_t); }
@@ -146,6 +290,8 @@ class Tile {
     Tile();
     ~Tile();
 
+  //! the ID of this tile, which is its index in the cell's quadtree (see qtree-util.hpp)
+    uint32_t id () const { return this->_id; }
   //! the row of this tile's NW vertex in its cell
     uint32_t nwRow () const { return this->_row; }
   //! the column of this tile's NW vertex in its cell
@@ -155,10 +301,21 @@ class Tile {
   //! the level of detail of this tile (0 is coarsest)
     int lod () const { return this->_lod; }
 
-  //! read-only access to mesh data for this tile
-    struct Chunk const & chunk() const { return this->_chunk; }
+  //! read-only access to mesh data for this tile.  The chunk's mesh data is loaded the
+  //! first time that it is accessed and may be evicted by later calls to `chunk` on
+  //! other tiles, so the vertex and index arrays should be used (e.g., copied to a
+  //! VAO) before accessing another tile's chunk.
+    struct Chunk const & chunk() const;
+
+  //! the maximum geometric error of this tile's chunk (in meters); this does not require
+  //! the chunk's mesh data to be resident
+    float maxError () const { return this->_chunk.maxError; }
+
+  //! returns true if this tile's chunk mesh data is currently in memory
+    bool isResident () const { return this->_resident; }
 
-  //! the tile's bounding box in world coordinates
+  //! the tile's bounding box in world coordinates; this does not require the chunk's
+  //! mesh data to be resident
     cs237::AABBd const & bBox () const { return this->_bbox; }
 
   //! return the i'th child of this tile (nullptr if the tile is a leaf)
@@ -177,7 +334,13 @@ class Tile {
     uint32_t _row;              //!< the row of this tile's NW vertex in its cell
     uint32_t _col;              //!< the column of this tile's NW vertex in its cell
     int32_t _lod;               //!< the level of detail of this tile (0 == coarsest)
-    struct Chunk _chunk;        //!< mesh data for this tile
+    struct Chunk _chunk;        //!< mesh data for this tile; the header fields are valid
+                                //!  once the cell is loaded, but the vertex and index
+                                //!  arrays are only valid when _resident is true
+    uint64_t _dataOffset;       //!< file offset of the chunk's mesh data
+    bool _resident;             //!< true if the chunk's mesh data is in memory
+    Tile *_lruPrev;             //!< the next more-recently used tile in the map's LRU list
+    Tile *_lruNext;             //!< the next less-recently used tile in the map's LRU list
     cs237::AABBd _bbox;         //!< the tile's bounding box in world coordinates; note that we use
                                 //!  double precision here so that we can support large maps
 
@@ -190,10 +353,13 @@ class Tile {
   //! bounding box get set later
     void _init (Cell *cell, uint32_t id, uint32_t row, uint32_t col, uint32_t lod);
 
-  //! allocate memory for the chunk
-    void _allocChunk (uint32_t nv, uint32_t ni);
+  //! release the chunk's mesh data and mark the chunk as not resident; the chunk keeps
+  //! its slot in the cell's arena
+  //! \return the number of bytes of arena pages that were returned to the OS
+    size_t _releaseChunk ();
 
     friend class Cell;
+    friend class Map;
 };
 
 /***** Inline functions *****/
@@ -211,6 +377,11 @@ inline class Tile &Cell::tile (int id)
     return this->_tiles[id];
 }
 
+inline struct Chunk const & Tile::chunk () const
+{
+    return this->_cell->_residentChunk(this->_id);
+}
+
 inline class Tile *Tile::child (int i) const
 {
     assert ((0 <= i) && (i < 4));
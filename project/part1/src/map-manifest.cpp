@@ -0,0 +1,294 @@
+/*! \file map-manifest.cpp
+ *
+ * \author John Reppy
+ *
+ * Reading and writing the binary map manifest, which is a cache of the information
+ * in a map's "map.json" file.  For large maps, most of the JSON file is the grid of
+ * cell names, which is expensive to parse.
+ */
+
+/* CMSC23700 Final Project sample code (Autumn 2022)
+ *
+ * COPYRIGHT (c) 2022 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#include "cs237.hpp"
+#include "map.hpp"
+#include "binary-io.hpp"
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+
+/* The format of the "map.manifest" file is as follows (all values are little endian;
+ * see binary-io.hpp):
+ *
+ *      uint32_t        magic number ('mapm')
+ *      uint32_t        version (currently 1)
+ *      uint64_t        size of the "map.json" file in bytes
+ *      int64_t         modification time of the "map.json" file
+ *      uint64_t        hash of the contents of the "map.json" file (64-bit FNV-1a)
+ *      float[7]        hScale, vScale, baseElev, minElev, maxElev, minSky, maxSky
+ *      uint32_t[3]     width, height, cellSize
+ *      uint32_t        flags (see below)
+ *      float[13]       sunDir, sunI, ambI, fogColor, fogDensity
+ *      uint32_t        length of the map name (K)
+ *      char[K]         the map name
+ *      uint32_t        number of cells (N)
+ *      uint32_t        total length of the cell names (L)
+ *      uint32_t[N+1]   offsets of the cell names (in row-major order) plus the end
+ *      char[L]         the cell names
+ *
+ * The manifest is valid if the size and modification time of the "map.json" file
+ * match the header.  If only the modification time differs (e.g., because the map was
+ * copied), then we compare the hash of the JSON file with the header and, if they
+ * match, rewrite the manifest.
+ */
+
+static constexpr uint32_t kManifestMagic = 0x6D61706D;  // 'mapm'
+static constexpr uint32_t kManifestVersion = 1;
+
+// flag bits
+static constexpr uint32_t kHasColor = 1;
+static constexpr uint32_t kHasNormals = 2;
+static constexpr uint32_t kHasWater = 4;
+static constexpr uint32_t kHasFog = 8;
+
+// the part of the manifest that identifies the JSON file that it was generated from
+struct Stamp {
+    uint64_t size;
+    int64_t mtime;
+    uint64_t hash;
+};
+
+// fetch the next binary value from a byte buffer and advance the offset past it;
+// returns false if the value is not in bounds
+template <typename T>
+inline bool nextVal (std::vector<uint8_t> const &buf, size_t &offset, T &v)
+{
+    if (buf.size() - offset < sizeof(T)) {
+        return false;
+    }
+    v = getVal<T>(buf.data() + offset);
+    offset += sizeof(T);
+    return true;
+}
+
+// read a file into a byte buffer
+static bool readFile (std::string const &file, std::vector<uint8_t> &buf)
+{
+    std::ifstream inS(file, std::ios::in | std::ios::binary);
+    if (inS.fail()) {
+        return false;
+    }
+    buf.assign (std::istreambuf_iterator<char>(inS), std::istreambuf_iterator<char>());
+    return ! inS.bad();
+}
+
+// get the size and modification time of a file
+static bool statFile (std::string const &file, Stamp &stamp)
+{
+    std::error_code ec;
+    auto sz = std::filesystem::file_size(file, ec);
+    if (ec) {
+        return false;
+    }
+    auto mtime = std::filesystem::last_write_time(file, ec);
+    if (ec) {
+        return false;
+    }
+    stamp.size = static_cast<uint64_t>(sz);
+    stamp.mtime = static_cast<int64_t>(mtime.time_since_epoch().count());
+    return true;
+}
+
+// compute the 64-bit FNV-1a hash of a file's contents
+static bool hashFile (std::string const &file, uint64_t &hash)
+{
+    std::vector<uint8_t> buf;
+    if (! readFile (file, buf)) {
+        return false;
+    }
+    hash = 0xcbf29ce484222325ull;
+    for (uint8_t b : buf) {
+        hash = (hash ^ b) * 0x100000001b3ull;
+    }
+    return true;
+}
+
+bool Map::_readManifest ()
+{
+    std::string jsonFile = this->_path + "map.json";
+    Stamp stamp;
+    if (! statFile (jsonFile, stamp)) {
+        return false;
+    }
+
+    std::vector<uint8_t> buf;
+    if (! readFile (this->_path + "map.manifest", buf)) {
+        return false;
+    }
+
+  // check the header
+    size_t offset = 0;
+    uint32_t magic, version;
+    Stamp hdr;
+    if (! nextVal (buf, offset, magic) || (magic != kManifestMagic)
+    || ! nextVal (buf, offset, version) || (version != kManifestVersion)
+    || ! nextVal (buf, offset, hdr.size) || (hdr.size != stamp.size)
+    || ! nextVal (buf, offset, hdr.mtime)
+    || ! nextVal (buf, offset, hdr.hash)) {
+        return false;
+    }
+    bool rewrite = false;
+    if (hdr.mtime != stamp.mtime) {
+        if (! hashFile (jsonFile, stamp.hash) || (hdr.hash != stamp.hash)) {
+            return false;
+        }
+        rewrite = true;
+    }
+
+  // the map information
+    uint32_t flags;
+    float sunDir[3], sunI[3], ambI[3], fogColor[3];
+    bool ok = nextVal (buf, offset, this->_hScale)
+        && nextVal (buf, offset, this->_vScale)
+        && nextVal (buf, offset, this->_baseElev)
+        && nextVal (buf, offset, this->_minElev)
+        && nextVal (buf, offset, this->_maxElev)
+        && nextVal (buf, offset, this->_minSky)
+        && nextVal (buf, offset, this->_maxSky)
+        && nextVal (buf, offset, this->_width)
+        && nextVal (buf, offset, this->_height)
+        && nextVal (buf, offset, this->_cellSize)
+        && nextVal (buf, offset, flags);
+    for (int i = 0;  ok && (i < 3);  i++) {
+        ok = nextVal (buf, offset, sunDir[i]);
+    }
+    for (int i = 0;  ok && (i < 3);  i++) {
+        ok = nextVal (buf, offset, sunI[i]);
+    }
+    for (int i = 0;  ok && (i < 3);  i++) {
+        ok = nextVal (buf, offset, ambI[i]);
+    }
+    for (int i = 0;  ok && (i < 3);  i++) {
+        ok = nextVal (buf, offset, fogColor[i]);
+    }
+    ok = ok && nextVal (buf, offset, this->_fogDensity);
+    if (! ok) {
+        return false;
+    }
+    this->_hasColor = ((flags & kHasColor) != 0);
+    this->_hasNormals = ((flags & kHasNormals) != 0);
+    this->_hasWater = ((flags & kHasWater) != 0);
+    this->_hasFog = ((flags & kHasFog) != 0);
+    this->_sunDir = glm::vec3(sunDir[0], sunDir[1], sunDir[2]);
+    this->_sunI = glm::vec3(sunI[0], sunI[1], sunI[2]);
+    this->_ambI = glm::vec3(ambI[0], ambI[1], ambI[2]);
+    this->_fogColor = glm::vec3(fogColor[0], fogColor[1], fogColor[2]);
+
+  // the strings
+    uint32_t nameLen, nCells, namesLen;
+    if (! nextVal (buf, offset, nameLen) || (buf.size() - offset < nameLen)) {
+        return false;
+    }
+    this->_name.assign (reinterpret_cast<const char *>(buf.data() + offset), nameLen);
+    offset += nameLen;
+    if (! nextVal (buf, offset, nCells) || ! nextVal (buf, offset, namesLen)
+    || ((buf.size() - offset) / sizeof(uint32_t) < size_t(nCells) + 1)) {
+        return false;
+    }
+    this->_cellNameOffsets.resize (size_t(nCells) + 1);
+    std::memcpy (this->_cellNameOffsets.data(), buf.data() + offset,
+        this->_cellNameOffsets.size() * sizeof(uint32_t));
+    offset += this->_cellNameOffsets.size() * sizeof(uint32_t);
+    if ((buf.size() - offset != namesLen) || (this->_cellNameOffsets[0] != 0)
+    || (this->_cellNameOffsets[nCells] != namesLen)) {
+        return false;
+    }
+    for (uint32_t i = 0;  i < nCells;  i++) {
+        if (this->_cellNameOffsets[i] > this->_cellNameOffsets[i+1]) {
+            return false;
+        }
+    }
+    this->_cellNames.assign (reinterpret_cast<const char *>(buf.data() + offset), namesLen);
+
+    if (rewrite) {
+        this->_writeManifest ();
+    }
+
+    return true;
+
+}
+
+void Map::_writeManifest ()
+{
+    std::string jsonFile = this->_path + "map.json";
+    Stamp stamp;
+    if (! statFile (jsonFile, stamp) || ! hashFile (jsonFile, stamp.hash)) {
+        return;
+    }
+
+    std::vector<uint8_t> buf;
+    buf.reserve (128 + this->_name.size()
+        + this->_cellNameOffsets.size() * sizeof(uint32_t) + this->_cellNames.size());
+    putVal (buf, kManifestMagic);
+    putVal (buf, kManifestVersion);
+    putVal (buf, stamp.size);
+    putVal (buf, stamp.mtime);
+    putVal (buf, stamp.hash);
+
+    putVal (buf, this->_hScale);
+    putVal (buf, this->_vScale);
+    putVal (buf, this->_baseElev);
+    putVal (buf, this->_minElev);
+    putVal (buf, this->_maxElev);
+    putVal (buf, this->_minSky);
+    putVal (buf, this->_maxSky);
+    putVal (buf, this->_width);
+    putVal (buf, this->_height);
+    putVal (buf, this->_cellSize);
+    uint32_t flags = (this->_hasColor ? kHasColor : 0)
+        | (this->_hasNormals ? kHasNormals : 0)
+        | (this->_hasWater ? kHasWater : 0)
+        | (this->_hasFog ? kHasFog : 0);
+    putVal (buf, flags);
+    for (int i = 0;  i < 3;  i++) {
+        putVal (buf, this->_sunDir[i]);
+    }
+    for (int i = 0;  i < 3;  i++) {
+        putVal (buf, this->_sunI[i]);
+    }
+    for (int i = 0;  i < 3;  i++) {
+        putVal (buf, this->_ambI[i]);
+    }
+    for (int i = 0;  i < 3;  i++) {
+        putVal (buf, this->_fogColor[i]);
+    }
+    putVal (buf, this->_fogDensity);
+
+    putVal (buf, static_cast<uint32_t>(this->_name.size()));
+    buf.insert (buf.end(), this->_name.begin(), this->_name.end());
+    putVal (buf, static_cast<uint32_t>(this->_cellNameOffsets.size() - 1));
+    putVal (buf, static_cast<uint32_t>(this->_cellNames.size()));
+    const uint8_t *p = reinterpret_cast<const uint8_t *>(this->_cellNameOffsets.data());
+    buf.insert (buf.end(), p, p + this->_cellNameOffsets.size() * sizeof(uint32_t));
+    buf.insert (buf.end(), this->_cellNames.begin(), this->_cellNames.end());
+
+  // write to a temporary file and then rename it, so that a concurrent load never sees
+  // a partial manifest
+    std::string file = this->_path + "map.manifest";
+    std::string tmpFile = file + ".tmp";
+    std::ofstream outS(tmpFile, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (outS.fail()) {
+        return;
+    }
+    outS.write (reinterpret_cast<const char *>(buf.data()), buf.size());
+    outS.close ();
+    if (outS.fail() || (std::rename(tmpFile.c_str(), file.c_str()) != 0)) {
+        std::remove (tmpFile.c_str());
+    }
+
+}
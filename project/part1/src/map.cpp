@@ -15,21 +15,39 @@
 #include "cs237.hpp"
 #include "map.hpp"
 #include "map-cell.hpp"
+#include "worker-pool.hpp"
+#include "height-field.hpp"
+#include "pack-file.hpp"
+#include <atomic>
+#include <limits>
+#include <memory>
+#include <mutex>
 #include <unistd.h>
 
 /***** class Map member functions *****/
 
-Map::Map (cs237::Application *app) : _app(app), _grid(nullptr), _objects(nullptr) { }
+Map::Map (cs237::Application *app)
+    : _app(app), _pack(nullptr), _nRows(0), _nCols(0), _nPageCols(0), _objects(nullptr),
+      _useMMap(false), _useManifest(true),
+      _loadThreads(1),
+      _chunkBudget(kDefaultChunkBudget), _residentBytes(0),
+      _lruHead(nullptr), _lruTail(nullptr),
+      _workers(nullptr), _loadRadius(0.0), _unloadRadius(0.0)
+{ }
 
 Map::~Map ()
 {
-    if (this->_grid != nullptr) {
-        for (int i = 0;  i < this->_nCells();  i++) {
-            if (this->_grid[i] != nullptr)
-                delete this->_grid[i];
-        }
-        delete this->_grid;
+  // stop the workers before deleting the cells that they might be loading
+    delete this->_workers;
+
+    for (auto cell : this->_cells) {
+        delete cell;
+    }
+    for (auto page : this->_pages) {
+        delete page;
     }
+  // the cells' data may refer to the pack, so we close it last
+    delete this->_pack;
 
 }
 
@@ -63,16 +81,22 @@ static bool getThreeFloats (const json::Array *arr, float out[3])
     return false;
 }
 
-bool Map::load (std::string const &mapName, bool verbose)
+// load the map information from the "map.json" file
+bool Map::_loadJSON (std::string const &mapName)
 {
-    if (this->_grid != nullptr) {
-      // map file has already been loaded, so return false
-        return false;
+    std::unique_ptr<json::Value> map;
+    if (this->_pack != nullptr) {
+        std::vector<uint8_t> text;
+        if (! this->_pack->read ("map.json", text)) {
+            error (mapName, "missing map.json member");
+            return false;
+        }
+        map.reset (json::parseString (
+            std::string(reinterpret_cast<const char *>(text.data()), text.size()),
+            mapName + ":map.json"));
+    } else {
+        map.reset (json::parseFile(this->_path + "map.json"));
     }
-
-    this->_path = mapName + "/";
-
-    json::Value *map = json::parseFile(this->_path + "map.json");
     const json::Object *root = (map != nullptr) ? map->asObject() : nullptr;
 
     if (root == nullptr) {
@@ -266,6 +290,65 @@ bool Map::load (std::string const &mapName, bool verbose)
   // are there any objects?
     /* PART 2 code goes here */
 
+  // get array of grid filenames; we only record the names of the cells here, the
+  // Cell objects are created on demand by Map::cell
+    const json::Array *grid = root->fieldAsArray("grid");
+    if (grid == nullptr) {
+        error (mapName, "missing/bogus grid field");
+        return false;
+    }
+    this->_cellNames.clear ();
+    this->_cellNameOffsets.resize (grid->length() + 1);
+    for (uint32_t i = 0;  i < grid->length();  i++) {
+        const json::String *s = (*grid)[i]->asString();
+        if (s == nullptr) {
+            error (mapName, "bogus grid item");
+            return false;
+        }
+        this->_cellNameOffsets[i] = static_cast<uint32_t>(this->_cellNames.size());
+        this->_cellNames += s->value();
+    }
+    this->_cellNameOffsets[grid->length()] = static_cast<uint32_t>(this->_cellNames.size());
+    this->_cellNames.shrink_to_fit ();
+
+    return true;
+
+}
+
+bool Map::load (std::string const &mapName, bool verbose)
+{
+    if (! this->_pages.empty()) {
+      // map file has already been loaded, so return false
+        return false;
+    }
+
+    if (PackFile::isPackFile (mapName)) {
+      // all of the map's files are members of the pack, which are named relative to
+      // the map directory
+        this->_pack = new PackFile (mapName);
+        if (! this->_pack->isValid()) {
+            error (mapName, "invalid map pack");
+            delete this->_pack;
+            this->_pack = nullptr;
+            return false;
+        }
+        this->_path = "";
+    } else {
+        this->_path = mapName + "/";
+    }
+
+  // we use the binary manifest when it is up to date; otherwise we parse the JSON file
+  // and regenerate the manifest
+    bool useManifest = this->_useManifest && (this->_pack == nullptr);
+    if (! useManifest || ! this->_readManifest()) {
+        if (! this->_loadJSON (mapName)) {
+            return false;
+        }
+        if (useManifest) {
+            this->_writeManifest ();
+        }
+    }
+
   // compute and check other map info
     int cellShft = ilog2(this->_cellSize);
     if ((cellShft < 0)
@@ -307,36 +390,439 @@ bool Map::load (std::string const &mapName, bool verbose)
         std::clog << "fog-density = " << this->_fogDensity << "\n";
     }
 
-  // get array of grid filenames
-    const json::Array *grid = root->fieldAsArray("grid");
-    if (num == nullptr) {
-        error (mapName, "missing/bogus h-scale field");
-        return false;
-    }
-    else if (grid->length() != this->_nCells()) {
+    if (this->_cellNameOffsets.size() != size_t(this->_nCells()) + 1) {
         error (mapName, "incorrect number of cells in grid field");
         return false;
     }
-    this->_grid = new class Cell*[this->_nCells()];
-    for (int r = 0;  r < this->_nRows;  r++) {
-        for (int c = 0;  c < this->_nCols;  c++) {
-            int i = this->_cellIdx(r, c);
-            const json::String *s = (*grid)[i]->asString();
-            if (s == nullptr) {
-                error (mapName, "bogus grid item");
-            }
-            this->_grid[i] = new class Cell(this, r, c, this->_path + s->value());
-        }
+
+    uint32_t pageMask = (1 << kPageShift) - 1;
+    this->_nPageCols = (this->_nCols + pageMask) >> kPageShift;
+    uint32_t nPageRows = (this->_nRows + pageMask) >> kPageShift;
+    this->_pages.resize (size_t(nPageRows) * size_t(this->_nPageCols), nullptr);
+
+  // when streaming, the cells are loaded on demand by updateStreaming
+    if (this->isStreaming()) {
+        return true;
+    }
+
+    if (this->_loadThreads != 1) {
+        this->_loadCellsInParallel (verbose);
+        return true;
     }
 
     std::clog << "loading cells\n";
     for (int r = 0;  r < this->nRows(); r++) {
         for (int c = 0;  c < this->nCols();  c++) {
-            this->cell(r, c)->load();
+            Cell *cell = this->cell(r, c);
+            cell->load();
+            cell->_state.store (Cell::State::Ready, std::memory_order_relaxed);
+        }
+    }
+
+    return true;
+
+}
+
+// load the cells using a pool of worker threads.  Each worker loads one cell at a time,
+// so the number of threads bounds the number of concurrent file reads.  The resulting
+// state is the same as for the serial loader, since the cells do not share any state
+// while they are being loaded.
+void Map::_loadCellsInParallel (bool verbose)
+{
+    uint32_t nCells = this->_nCells();
+    std::atomic<uint32_t> nDone(0);
+    std::mutex progressLock;
+    uint32_t nextReport = 0;    // protected by progressLock
+
+  // the workers must not create cells, so we create them all up front
+    for (uint32_t r = 0;  r < this->_nRows;  r++) {
+        for (uint32_t c = 0;  c < this->_nCols;  c++) {
+            this->cell (r, c);
         }
     }
 
+    WorkerPool pool(this->_loadThreads);
+    std::clog << "loading cells (" << pool.numThreads() << " threads)\n";
+    for (Cell *cell : this->_cells) {
+        pool.submit ([cell, nCells, verbose, &nDone, &progressLock, &nextReport] () {
+            cell->load();
+            cell->_state.store (Cell::State::Ready, std::memory_order_relaxed);
+            uint32_t n = nDone.fetch_add(1, std::memory_order_relaxed) + 1;
+          // report progress in steps of 10%
+            if (verbose) {
+                std::lock_guard<std::mutex> lk(progressLock);
+                if ((n * 10 >= nextReport * nCells) || (n == nCells)) {
+                    std::clog << "  " << n << "/" << nCells << " cells loaded\n";
+                    nextReport = (n * 10) / nCells + 1;
+                }
+            }
+        });
+    }
+
+  // wait for the loads to finish; this also makes the workers' writes visible
+    pool.wait ();
+
+}
+
+void Map::enableStreaming (double loadRadius, double unloadRadius, unsigned int nWorkers)
+{
+    assert (this->_pages.empty());
+    assert (loadRadius <= unloadRadius);
+
+    if (this->_workers == nullptr) {
+        this->_workers = new WorkerPool (nWorkers);
+    }
+    this->_loadRadius = loadRadius;
+    this->_unloadRadius = unloadRadius;
+
+}
+
+double Map::_cellDistance (uint32_t row, uint32_t col, glm::dvec3 const &pos) const
+{
+    double w = double(this->_hScale) * double(this->_cellSize);
+    glm::dvec3 nw = this->nwCellCorner(row, col);
+    double dx = std::max(0.0, std::max(nw.x - pos.x, pos.x - (nw.x + w)));
+    double dz = std::max(0.0, std::max(nw.z - pos.z, pos.z - (nw.z + w)));
+    return std::sqrt(dx*dx + dz*dz) / w;
+}
+
+void Map::updateStreaming (glm::dvec3 const &pos, Window *win)
+{
+    assert (this->isStreaming());
+
+  // first we take ownership of the cells that the workers have finished loading and
+  // unload the ready cells that are outside the unload radius.  Note that cells that
+  // are still loading are left alone until the next update.
+    size_t i = 0;
+    while (i < this->_activeCells.size()) {
+        Cell *cell = this->_activeCells[i];
+        Cell::State st = cell->_state.load (std::memory_order_acquire);
+        if (st == Cell::State::Loaded) {
+            cell->_adoptChunks ();
+          // the same per-cell initialization that the window does for eagerly loaded cells
+            if (this->hasObjects()) {
+                cell->loadObjects ();
+            }
+            cell->initTextures (win);
+            cell->_state.store (Cell::State::Ready, std::memory_order_relaxed);
+            st = Cell::State::Ready;
+        }
+        if ((st == Cell::State::Ready)
+        && (this->_cellDistance(cell->_row, cell->_col, pos) > this->_unloadRadius)) {
+            cell->unload ();
+            this->_activeCells[i] = this->_activeCells.back();
+            this->_activeCells.pop_back();
+            this->releaseCell (cell);
+        } else {
+            i++;
+        }
+    }
+
+  // then we request the unloaded cells that are inside the load radius, nearest first
+    double w = double(this->_hScale) * double(this->_cellSize);
+    double r = this->_loadRadius;
+    int minRow = std::max(0, int(std::floor(pos.z / w - r)));
+    int maxRow = std::min(int(this->_nRows) - 1, int(std::floor(pos.z / w + r)));
+    int minCol = std::max(0, int(std::floor(pos.x / w - r)));
+    int maxCol = std::min(int(this->_nCols) - 1, int(std::floor(pos.x / w + r)));
+    std::vector<std::pair<double, Cell *>> requests;
+    for (int row = minRow;  row <= maxRow;  row++) {
+        for (int col = minCol;  col <= maxCol;  col++) {
+            double d = this->_cellDistance(row, col, pos);
+            if (d <= r) {
+                Cell *cell = this->cell(row, col);
+                if (cell->_state.load(std::memory_order_relaxed) == Cell::State::Unloaded) {
+                    requests.push_back (std::make_pair(d, cell));
+                }
+            }
+        }
+    }
+    std::sort (requests.begin(), requests.end());
+    for (auto &req : requests) {
+        Cell *cell = req.second;
+        cell->_state.store (Cell::State::Loading, std::memory_order_relaxed);
+        this->_activeCells.push_back (cell);
+        this->_workers->submit ([cell] () { cell->_streamIn(); });
+    }
+
+}
+
+Cell *Map::_makeCell (uint32_t row, uint32_t col)
+{
+    CellPage *&page = this->_pages[this->_pageIdx(row, col)];
+    if (page == nullptr) {
+        page = new CellPage;
+    }
+    uint32_t i = this->_cellIdx(row, col);
+    uint32_t start = this->_cellNameOffsets[i];
+    std::string name = this->_cellNames.substr(start, this->_cellNameOffsets[i+1] - start);
+    Cell *cell = new Cell (this, row, col, this->_path + name);
+
+    page->cells[CellPage::slot(row, col)] = cell;
+    page->nCells++;
+    cell->_cellsIdx = static_cast<uint32_t>(this->_cells.size());
+    this->_cells.push_back (cell);
+
+    return cell;
+
+}
+
+bool Map::releaseCell (Cell *cell)
+{
+    if (cell->_state.load(std::memory_order_relaxed) != Cell::State::Unloaded) {
+        return false;
+    }
+
+  // remove the cell from the _cells vector by moving the last cell into its place
+    Cell *last = this->_cells.back();
+    last->_cellsIdx = cell->_cellsIdx;
+    this->_cells[cell->_cellsIdx] = last;
+    this->_cells.pop_back();
+
+    CellPage *&page = this->_pages[this->_pageIdx(cell->_row, cell->_col)];
+    page->cells[CellPage::slot(cell->_row, cell->_col)] = nullptr;
+    if (--page->nCells == 0) {
+        delete page;
+        page = nullptr;
+    }
+
+    delete cell;
+    return true;
+
+}
+
+void Map::setChunkBudget (size_t nBytes)
+{
+    this->_chunkBudget = nBytes;
+    this->_evictChunks (nullptr);
+}
+
+/* the LRU list of tiles that have resident chunk data; the head of the list is the
+ * most recently used tile.
+ */
+
+void Map::_lruInsert (Tile *tile)
+{
+    tile->_lruPrev = nullptr;
+    tile->_lruNext = this->_lruHead;
+    if (this->_lruHead != nullptr) {
+        this->_lruHead->_lruPrev = tile;
+    } else {
+        this->_lruTail = tile;
+    }
+    this->_lruHead = tile;
+}
+
+void Map::_lruRemove (Tile *tile)
+{
+    if (tile->_lruPrev != nullptr) {
+        tile->_lruPrev->_lruNext = tile->_lruNext;
+    } else {
+        this->_lruHead = tile->_lruNext;
+    }
+    if (tile->_lruNext != nullptr) {
+        tile->_lruNext->_lruPrev = tile->_lruPrev;
+    } else {
+        this->_lruTail = tile->_lruPrev;
+    }
+    tile->_lruPrev = tile->_lruNext = nullptr;
+}
+
+void Map::_lruTouch (Tile *tile)
+{
+    if (this->_lruHead != tile) {
+        this->_lruRemove (tile);
+        this->_lruInsert (tile);
+    }
+}
+
+void Map::_evictChunks (Tile *keep)
+{
+    if (this->_chunkBudget == 0) {
+        return;
+    }
+  // several chunks share a page, so evicting a chunk frees memory only when it was the
+  // last resident chunk on some page
+    while ((this->_residentBytes > this->_chunkBudget)
+    && (this->_lruTail != nullptr) && (this->_lruTail != keep)) {
+        Tile *victim = this->_lruTail;
+        this->_lruRemove (victim);
+        this->_residentBytes -= victim->_releaseChunk ();
+    }
+
+}
+
+
+/***** Spatial queries *****/
+
+Cell *Map::_queryCell (uint32_t row, uint32_t col)
+{
+    if (! this->isStreaming()) {
+        return this->cell(row, col);
+    }
+    Cell *cell = this->findCell(row, col);
+    if ((cell == nullptr) || ! cell->isReady()) {
+        return nullptr;
+    }
+    return cell;
+
+}
+
+bool Map::heightAt (double x, double z, float &h)
+{
+    if ((x < 0.0) || (z < 0.0)) {
+        return false;
+    }
+    double w = this->cellSize().x;
+    Cell *cell = this->_queryCell(uint32_t(z / w), uint32_t(x / w));
+    if (cell == nullptr) {
+        return false;
+    }
+    glm::dvec3 nw = this->nwCellCorner(cell->row(), cell->col());
+    h = cell->heightField()->heightAt(float(x - nw.x), float(z - nw.z));
     return true;
+}
+
+void Map::heightAt (size_t n, const glm::dvec2 *pts, float *h)
+{
+  // we convert runs of points that are in the same cell to cell coordinates and then
+  // pass them to the cell's height field as a batch
+    constexpr size_t kBatchSize = 256;
+    float xs[kBatchSize], zs[kBatchSize];
+    double w = this->cellSize().x;
+
+    size_t i = 0;
+    while (i < n) {
+        Cell *cell = nullptr;
+        if ((pts[i].x >= 0.0) && (pts[i].y >= 0.0)) {
+            cell = this->_queryCell(uint32_t(pts[i].y / w), uint32_t(pts[i].x / w));
+        }
+        if (cell == nullptr) {
+            h[i++] = std::numeric_limits<float>::quiet_NaN();
+            continue;
+        }
+        HeightField const *hf = cell->heightField();
+        glm::dvec3 nw = this->nwCellCorner(cell->row(), cell->col());
+        size_t m = 0;
+        while ((m < kBatchSize) && (i + m < n)) {
+            double x = pts[i+m].x - nw.x;
+            double z = pts[i+m].y - nw.z;
+          // the first point is in the cell by construction (even when rounding says otherwise)
+            if ((m > 0) && ((x < 0.0) || (x >= w) || (z < 0.0) || (z >= w))) {
+                break;
+            }
+            xs[m] = float(x);
+            zs[m] = float(z);
+            m++;
+        }
+        hf->heightAt (m, xs, zs, h + i);
+        i += m;
+    }
+
+}
+
+bool Map::rayCast (glm::dvec3 const &org, glm::dvec3 const &dir, double maxDist, glm::dvec3 &hit)
+{
+    double len = glm::length(dir);
+    if (len == 0.0) {
+        return false;
+    }
+    glm::dvec3 d = dir / len;
+    double t;
+    if (this->_rayCast (org, d, 0.0, maxDist, t)) {
+        hit = org + t * d;
+        return true;
+    }
+    return false;
+}
+
+bool Map::lineOfSight (glm::dvec3 const &a, glm::dvec3 const &b)
+{
+    double len = glm::distance(a, b);
+    if (len <= 2.0 * kSightTolerance) {
+        return true;
+    }
+    double t;
+    return ! this->_rayCast (a, (b - a) / len, kSightTolerance, len - kSightTolerance, t);
+}
+
+// clip the parameter interval [t0, t1] of a ray to the slab lo <= o + t*d <= hi;
+// returns false if the clipped interval is empty
+static bool clipSlab (double o, double d, double lo, double hi, double &t0, double &t1)
+{
+    if (d == 0.0) {
+        return (lo <= o) && (o <= hi);
+    }
+    double ta = (lo - o) / d;
+    double tb = (hi - o) / d;
+    if (ta > tb) {
+        std::swap (ta, tb);
+    }
+    t0 = std::max(t0, ta);
+    t1 = std::min(t1, tb);
+    return (t0 <= t1);
+}
+
+// we walk the cells that the ray passes through in order (using a 2D DDA) and test
+// the ray against each cell's height field
+bool Map::_rayCast (
+    glm::dvec3 const &org, glm::dvec3 const &dir, double tMin, double tMax,
+    double &tHit)
+{
+    double t0 = tMin, t1 = tMax;
+    if (! clipSlab (org.x, dir.x, this->west(), this->east(), t0, t1)
+    || ! clipSlab (org.z, dir.z, this->north(), this->south(), t0, t1)) {
+        return false;
+    }
+
+    double w = this->cellSize().x;
+    glm::dvec3 p = org + t0 * dir;
+    int col = std::clamp(int(std::floor(p.x / w)), 0, int(this->_nCols) - 1);
+    int row = std::clamp(int(std::floor(p.z / w)), 0, int(this->_nRows) - 1);
+
+  // the ray parameters of the next column and row boundaries and the distances between them
+    const double inf = std::numeric_limits<double>::infinity();
+    int colStep = (dir.x < 0.0) ? -1 : 1;
+    int rowStep = (dir.z < 0.0) ? -1 : 1;
+    double tNextCol = (dir.x == 0.0) ? inf : (w * double(col + (colStep > 0)) - org.x) / dir.x;
+    double tNextRow = (dir.z == 0.0) ? inf : (w * double(row + (rowStep > 0)) - org.z) / dir.z;
+    double tDeltaCol = (dir.x == 0.0) ? inf : w / std::fabs(dir.x);
+    double tDeltaRow = (dir.z == 0.0) ? inf : w / std::fabs(dir.z);
+
+    double tEnter = t0;
+    while (true) {
+        double tExit = std::min(std::min(tNextCol, tNextRow), t1);
+        if (tEnter <= tExit) {
+          // test the segment against the cell using a ray that starts where the segment
+          // enters the cell, so that the cell-relative coordinates stay small
+            Cell *cell = this->_queryCell(row, col);
+            glm::dvec3 nw = this->nwCellCorner(row, col);
+            float t;
+            if ((cell != nullptr) && cell->heightField()->rayCast (
+                glm::vec3(org + tEnter * dir - nw), glm::vec3(dir),
+                0.0f, float(tExit - tEnter), t))
+            {
+                tHit = tEnter + double(t);
+                return true;
+            }
+        }
+        if (tExit >= t1) {
+            return false;
+        }
+      // step to the next cell
+        if (tNextCol < tNextRow) {
+            col += colStep;
+            tEnter = tNextCol;
+            tNextCol += tDeltaCol;
+        } else {
+            row += rowStep;
+            tEnter = tNextRow;
+            tNextRow += tDeltaRow;
+        }
+        if ((col < 0) || (col >= int(this->_nCols)) || (row < 0) || (row >= int(this->_nRows))) {
+            return false;
+        }
+    }
 
 }
 
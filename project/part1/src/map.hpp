@@ -18,6 +18,7 @@
 
 class Cell; // cells in the map grid
 class Objects; // objects on the map
+class WorkerPool; // background loading threads
 
 //! Information about a heightfield map.
 class Map {
@@ -27,13 +28,83 @@ class Map {
     ~Map ();
 
   //! \brief load a map
-  //! \param path the name of the directory that contains that map
+  //! \param path the name of the directory that contains that map, or the name of a
+  //!        map pack (see pack-file.hpp) that holds all of the map's files
   //! \param verbose when true (the default), the loader prints information about
   //!        the map to \c std::clog.
   //! \return true if there are no errors, false if there was an error
   //!         reading the map.
     bool load (std::string const &path, bool verbose=true);
 
+  //! \brief specify how cell data is loaded.  This function should be called before `load`.
+  //! \param enable when true, the cells' "hf.cell" files are mapped into memory and the
+  //!        tiles' mesh data points directly into the mappings (instead of being copied
+  //!        into the cells' chunk arenas).
+    void useMMap (bool enable) { this->_useMMap = enable; }
+
+  //! does the map use memory-mapped cell files?
+    bool usesMMap () const { return this->_useMMap; }
+
+  //! was the map loaded from a map pack?
+    bool isPacked () const { return (this->_pack != nullptr); }
+
+  //! \brief specify if the map's binary manifest is used.  The manifest ("map.manifest")
+  //!        is a compact copy of the information in the "map.json" file that `load`
+  //!        generates next to the JSON file.  When it is enabled (the default), `load`
+  //!        reads the manifest instead of parsing the JSON file as long as the manifest
+  //!        is up to date.  Map packs do not use a manifest, since the pack's directory
+  //!        already avoids the per-file costs.  This function should be called before
+  //!        `load`.
+  //! \param enable when true, the manifest is read and generated by `load`
+    void useManifest (bool enable) { this->_useManifest = enable; }
+
+  //! \brief specify how many cells `load` loads concurrently.  This function should be
+  //!        called before `load`.
+  //! \param nThreads the number of threads used to load cells, which is also the bound
+  //!        on the number of concurrent file reads.  A value of 1 (the default) loads
+  //!        the cells serially on the calling thread; 0 picks a default based on the
+  //!        number of hardware threads.
+    void setLoadThreads (unsigned int nThreads) { this->_loadThreads = nThreads; }
+
+  //! \brief set the budget for CPU-side chunk memory.  The mesh data of a chunk is
+  //!        loaded the first time that it is accessed (see `Tile::chunk`) and the
+  //!        least-recently used chunks are evicted when the memory that holds the
+  //!        resident chunks exceeds the budget.  Memory is counted in whole pages.
+  //! \param nBytes the budget in bytes; 0 means that the budget is unlimited.
+    void setChunkBudget (size_t nBytes);
+
+  //! the budget for CPU-side chunk memory in bytes (0 means unlimited)
+    size_t chunkBudget () const { return this->_chunkBudget; }
+
+  //! the number of bytes of memory (in whole pages) that currently hold chunk mesh
+  //! data.  Chunks that point directly into a memory-mapped file are not counted.
+    size_t residentChunkBytes () const { return this->_residentBytes; }
+
+  //! \brief enable streaming of cells.  This function should be called before `load`.
+  //!        When streaming is enabled, `load` does not load the cells; instead, a pool
+  //!        of worker threads loads the cells around the camera in the background (see
+  //!        `updateStreaming`).
+  //! \param loadRadius    cells that are within this distance of the camera are loaded;
+  //!                      the distance is measured in the XZ plane from the camera to
+  //!                      the nearest point of the cell in units of cell width.
+  //! \param unloadRadius  cells that are farther than this distance are unloaded;
+  //!                      this value should be larger than loadRadius so that cells
+  //!                      near the boundary do not thrash.
+  //! \param nWorkers      the number of worker threads (0 means pick a default)
+    void enableStreaming (double loadRadius, double unloadRadius, unsigned int nWorkers = 0);
+
+  //! are cells streamed in the background?
+    bool isStreaming () const { return (this->_workers != nullptr); }
+
+  //! \brief update the set of loaded cells for the current camera position.  This
+  //!        function must be called by the render thread (typically once per frame);
+  //!        cells that have finished loading become ready (see `Cell::isReady`) during
+  //!        this call, which also does their per-cell initialization (objects and
+  //!        textures) for the window.
+  //! \param pos the camera position in world coordinates
+  //! \param win the window that renders the map
+    void updateStreaming (glm::dvec3 const &pos, class Window *win);
+
   // return the descriptive name of the map
     std::string name () const { return this->_name; }
   //! return the number of rows in the map's grid of cells (rows increase to the south)
@@ -82,11 +153,67 @@ class Map {
   //! does a map have an 'objects' directory?
     bool hasObjects () const { return (this->_objects != nullptr); }
 
-  //! return the cell at grid cell (row, col)
-    class Cell *cell (uint32_t row, uint32_t col) const;
+  //! \brief return the cell at grid cell (row, col).  The Cell objects are created on
+  //!        first access, so this function should only be called by the render thread.
+  //! \return the cell or nullptr if (row, col) is outside the grid
+    class Cell *cell (uint32_t row, uint32_t col);
+
+  //! return the cell at grid cell (row, col) if its Cell object exists; otherwise
+  //! return nullptr.  Unlike `cell`, this function never creates a cell.
+    class Cell *findCell (uint32_t row, uint32_t col) const;
 
   //! return the grid cell that contains the position (x, 0, z)
-    class Cell *cellAt (double x, double z) const;
+    class Cell *cellAt (double x, double z);
+
+  //! the cells whose Cell objects exist, in no particular order.  When the map is not
+  //! streamed, these are all of the cells in the grid once the map is loaded.
+    std::vector<class Cell *> const &cells () const { return this->_cells; }
+
+  //! \brief release the Cell object of an unloaded cell.  Streamed cells are released
+  //!        automatically when they are unloaded; this function is for cells that were
+  //!        created by other accesses (e.g., spatial queries).  Pointers to the cell are
+  //!        invalid after it is released.
+  //! \param cell  the cell to release
+  //! \return true if the cell was released; false if it is loaded or being loaded
+    bool releaseCell (class Cell *cell);
+
+  //! \brief get the height of the terrain at a point.  The height is computed from the
+  //!        full-resolution height field of the cell that contains the point (see
+  //!        `Cell::heightField`), so it does not depend on the LOD that is being rendered.
+  //! \param x       the X coordinate of the point in world coordinates
+  //! \param z       the Z coordinate of the point in world coordinates
+  //! \param[out] h  the height of the terrain at (x, z)
+  //! \return false if the point is outside the map or, when the map is streamed, if
+  //!         the cell that contains the point is not ready
+    bool heightAt (double x, double z, float &h);
+
+  //! \brief get the heights of the terrain at an array of points.  This is faster than
+  //!        calling `heightAt` for each point, particularly when consecutive points are
+  //!        in the same cell.
+  //! \param n       the number of points
+  //! \param pts     the (x, z) coordinates of the points in world coordinates
+  //! \param[out] h  the heights of the terrain at the points; the height of a point
+  //!                that is outside the map (or in a streamed cell that is not ready)
+  //!                is NaN
+    void heightAt (size_t n, const glm::dvec2 *pts, float *h);
+
+  //! \brief find the first point where a ray hits the terrain
+  //! \param org      the origin of the ray in world coordinates
+  //! \param dir      the direction of the ray (it does not have to be normalized)
+  //! \param maxDist  the maximum distance (in meters) from the origin to search
+  //! \param[out] hit the point where the ray hits the terrain
+  //! \return true if the ray hits the terrain within maxDist of its origin.  When the
+  //!         map is streamed, cells that are not ready are treated as empty.
+    bool rayCast (glm::dvec3 const &org, glm::dvec3 const &dir, double maxDist, glm::dvec3 &hit);
+
+  //! \brief is there a clear line of sight between two points?  The points should be
+  //!        above the terrain; a segment that only touches the terrain within
+  //!        kSightTolerance meters of its ends is considered to be clear.  When the
+  //!        map is streamed, cells that are not ready are treated as empty.
+  //! \param a  the first point in world coordinates
+  //! \param b  the second point in world coordinates
+  //! \return true if the segment from a to b does not intersect the terrain
+    bool lineOfSight (glm::dvec3 const &a, glm::dvec3 const &b);
 
   //! return the size of a cell in world coordinates (note that the Y component will be 0)
     glm::dvec3 cellSize () const;
@@ -110,10 +237,35 @@ class Map {
     static constexpr uint32_t kMinCellSize = (1 << 8);
   //! the maximum cell width
     static constexpr uint32_t kMaxCellSize = (1 << 14);
+  //! the default budget for CPU-side chunk memory
+    static constexpr size_t kDefaultChunkBudget = (size_t(256) << 20);
+  //! the distance (in meters) from the ends of a segment that is ignored by `lineOfSight`
+    static constexpr double kSightTolerance = 0.01;
 
   private:
+  //! the cell grid is split into square pages of (1 << kPageShift) cells on a side;
+  //! pages are allocated when the first of their cells is accessed
+    static constexpr uint32_t kPageShift = 4;
+
+  //! a square block of the map's cell grid
+    struct CellPage {
+        static constexpr uint32_t kWidth = (1 << kPageShift);
+        uint32_t nCells;                    //!< the number of non-null entries in cells
+        class Cell *cells[kWidth * kWidth]; //!< the cells of the page in row-major order
+
+        CellPage () : nCells(0), cells{} { }
+
+      //! the index in cells of the cell at the given row and column of the map
+        static uint32_t slot (uint32_t row, uint32_t col)
+        {
+            return ((row & (kWidth - 1)) << kPageShift) | (col & (kWidth - 1));
+        }
+    };
+
     cs237::Application *_app;   //!< application pointer
-    std::string _path;          //!< path to the map directory
+    std::string _path;          //!< path to the map directory (empty for a map pack, since
+                                //!  the members are named relative to the map directory)
+    class PackFile *_pack;      //!< the map pack (nullptr if the map is a directory)
     std::string _name;          //!< title of map
     float _hScale;              //!< horizontal scale in meters
     float _vScale;              //!< vertical scale in meters
@@ -131,7 +283,13 @@ class Map {
                                 //!  is _cellSize+1
     uint32_t _nRows;            //!< height of map in number of cells
     uint32_t _nCols;            //!< width of map in number of cells
-    class Cell **_grid;         //!< cells in column-major order
+    uint32_t _nPageCols;        //!< width of the map in number of cell pages
+    std::vector<CellPage *> _pages; //!< the grid of cell pages in row-major order;
+                                //!  an entry is nullptr if none of its cells exist
+    std::vector<class Cell *> _cells; //!< the cells whose Cell objects exist
+    std::string _cellNames;     //!< the names of the cell directories, concatenated
+    std::vector<uint32_t> _cellNameOffsets; //!< the start of each cell's name in
+                                //!  _cellNames (indexed by _cellIdx), plus the end
     bool _hasColor;             //!< true if the map has a color-map texture
     bool _hasNormals;           //!< true if the map has a normal-map texture
     bool _hasWater;             //!< true if the map has a water mask.
@@ -143,13 +301,80 @@ class Map {
     float _fogDensity;          //!< the density factor for the fog; will be 0 for no fog
     Objects *_objects;          //!< repository of object meshes and materials that
                                 //!< are placed on the map
+    bool _useMMap;              //!< true if cell files should be memory mapped
+    bool _useManifest;          //!< true if the binary manifest should be used
+    unsigned int _loadThreads;  //!< number of threads used by load (1 == serial)
+    size_t _chunkBudget;        //!< budget for resident chunk data in bytes (0 == unlimited)
+    size_t _residentBytes;      //!< the number of bytes in the pages that hold resident
+                                //!  chunk data
+    class Tile *_lruHead;       //!< the most recently used tile with resident chunk data
+    class Tile *_lruTail;       //!< the least recently used tile with resident chunk data
+    WorkerPool *_workers;       //!< worker threads for streaming (nullptr if streaming is
+                                //!  disabled)
+    double _loadRadius;         //!< cells within this distance of the camera are loaded
+    double _unloadRadius;       //!< cells beyond this distance from the camera are unloaded
+    std::vector<class Cell *> _activeCells; //!< streamed cells that are being loaded or
+                                //!  are loaded; only accessed by the render thread
 
   //! the number of cells in the map
     uint32_t _nCells () const { return this->_nRows * this->_nCols; }
 
+  //! load the map information from the "map.json" file
+    bool _loadJSON (std::string const &mapName);
+
+  //! \brief load the map information from the binary manifest (see map-manifest.cpp)
+  //! \return false if the manifest is missing, invalid, or out of date with respect
+  //!         to the "map.json" file
+    bool _readManifest ();
+
+  //! write the binary manifest for the map information that was loaded from the
+  //! "map.json" file; errors are ignored, since the manifest is only a cache
+    void _writeManifest ();
+
   //! the index of the cell at the given row and column
     uint32_t _cellIdx (uint32_t row, uint32_t col) const { return this->_nCols * row + col; }
 
+  //! the index of the page that holds the cell at the given row and column
+    uint32_t _pageIdx (uint32_t row, uint32_t col) const
+    {
+        return this->_nPageCols * (row >> kPageShift) + (col >> kPageShift);
+    }
+
+  //! create the Cell object for the cell at the given row and column
+    class Cell *_makeCell (uint32_t row, uint32_t col);
+
+  //! load all of the cells using a pool of _loadThreads worker threads
+    void _loadCellsInParallel (bool verbose);
+
+  //! return the cell at (row, col) if its height field can be used by a spatial query;
+  //! otherwise return nullptr.  When the map is streamed, only the Ready cells qualify
+  //! and no cells are created, since the streaming workers own the cells that are being
+  //! loaded and updateStreaming would never release a cell that it did not request.
+    class Cell *_queryCell (uint32_t row, uint32_t col);
+
+  //! find the first point where the segment [tMin, tMax] of a ray hits the terrain;
+  //! dir must be a unit vector, so that the ray parameter is the distance from org.
+    bool _rayCast (
+        glm::dvec3 const &org, glm::dvec3 const &dir, double tMin, double tMax,
+        double &tHit);
+
+  //! the distance (in units of cell width) in the XZ plane from a point to the cell at
+  //! the given row and column
+    double _cellDistance (uint32_t row, uint32_t col, glm::dvec3 const &pos) const;
+
+  //! add a tile whose chunk data has just been loaded to the front of the LRU list
+    void _lruInsert (class Tile *tile);
+
+  //! remove a tile from the LRU list
+    void _lruRemove (class Tile *tile);
+
+  //! move a tile to the front of the LRU list
+    void _lruTouch (class Tile *tile);
+
+  //! evict the chunk data of least-recently used tiles until the resident data fits
+  //! in the budget.  The chunk of the tile `keep` (which may be nullptr) is not evicted.
+    void _evictChunks (class Tile *keep);
+
     friend class Cell;
     friend class Objects;
 };
@@ -164,23 +389,36 @@ int ilog2 (uint32_t n);
 
 /***** Inline methods *****/
 
-inline class Cell *Map::cell (uint32_t row, uint32_t col) const
+inline class Cell *Map::findCell (uint32_t row, uint32_t col) const
+{
+    if ((row < this->_nRows) && (col < this->_nCols)) {
+        CellPage *page = this->_pages[this->_pageIdx(row, col)];
+        if (page != nullptr) {
+            return page->cells[CellPage::slot(row, col)];
+        }
+    }
+    return nullptr;
+}
+
+inline class Cell *Map::cell (uint32_t row, uint32_t col)
 {
     if ((row < this->_nRows) && (col < this->_nCols)) {
-        return this->_grid[this->_cellIdx(row, col)];
+        Cell *cell = this->findCell(row, col);
+        return (cell != nullptr) ? cell : this->_makeCell(row, col);
     }
     else
         return nullptr;
 }
 
-inline class Cell *Map::cellAt (double x, double z) const
+inline class Cell *Map::cellAt (double x, double z)
 {
     if ((x < 0.0) || (z < 0.0))
         return nullptr;
-    else
-        return this->cell(
-            static_cast<uint32_t>(z / this->_hScale),
-            static_cast<uint32_t>(x / this->_vScale));
+
+    double w = static_cast<double>(this->_hScale) * static_cast<double>(this->_cellSize);
+    return this->cell(
+        static_cast<uint32_t>(z / w),
+        static_cast<uint32_t>(x / w));
 }
 
 inline glm::dvec3 Map::nwCellCorner (uint32_t row, uint32_t col) const
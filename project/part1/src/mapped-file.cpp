@@ -0,0 +1,70 @@
+/*! \file mapped-file.cpp
+ *
+ * \author John Reppy
+ *
+ * Read-only memory-mapped files.
+ */
+
+/* CMSC23700 Final Project sample code (Autumn 2022)
+ *
+ * COPYRIGHT (c) 2022 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#include "mapped-file.hpp"
+#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile (std::string const &file)
+    : _data(nullptr), _size(0), _owned(true)
+{
+    int fd = open (file.c_str(), O_RDONLY);
+    if (fd < 0) {
+#ifndef NDEBUG
+        std::cerr << "MappedFile: unable to open \"" << file << "\"\n";
+#endif
+        return;
+    }
+
+    struct stat st;
+    if ((fstat(fd, &st) < 0) || (st.st_size == 0)) {
+#ifndef NDEBUG
+        std::cerr << "MappedFile: unable to stat \"" << file << "\"\n";
+#endif
+        close (fd);
+        return;
+    }
+
+    void *addr = mmap (nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // the mapping keeps its own reference to the file, so we can close the descriptor
+    close (fd);
+    if (addr == MAP_FAILED) {
+#ifndef NDEBUG
+        std::cerr << "MappedFile: unable to map \"" << file << "\"\n";
+#endif
+        return;
+    }
+
+    this->_data = static_cast<const uint8_t *>(addr);
+    this->_size = static_cast<size_t>(st.st_size);
+
+}
+
+MappedFile::MappedFile (MappedFile const *whole, uint64_t offset, uint64_t size)
+    : _data(nullptr), _size(0), _owned(false)
+{
+    if (whole->isValid() && whole->inBounds(offset, size)) {
+        this->_data = whole->data() + offset;
+        this->_size = static_cast<size_t>(size);
+    }
+}
+
+MappedFile::~MappedFile ()
+{
+    if (this->_owned && (this->_data != nullptr)) {
+        munmap (const_cast<uint8_t *>(this->_data), this->_size);
+    }
+}
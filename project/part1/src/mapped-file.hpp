@@ -0,0 +1,66 @@
+/*! \file mapped-file.hpp
+ *
+ * \author John Reppy
+ *
+ * Read-only memory-mapped files.
+ */
+
+/* CMSC23700 Final Project sample code (Autumn 2022)
+ *
+ * COPYRIGHT (c) 2022 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#ifndef _MAPPED_FILE_HPP_
+#define _MAPPED_FILE_HPP_
+
+#include <cstdint>
+#include <string>
+
+//! A read-only view of a file that has been mapped into the address space of the
+//! process.  Pages of the file are brought into memory by the OS on demand.
+class MappedFile {
+  public:
+
+    //! map a file into memory
+    //! \param file the path to the file
+    //!
+    //! Use `isValid()` to check if the mapping was successful.
+    explicit MappedFile (std::string const &file);
+
+    //! a view of part of another mapping (e.g., a member of a map pack).  The view
+    //! does not own its memory, so the other mapping must outlive it.
+    //! \param whole   the mapping that contains the view
+    //! \param offset  the offset of the view in the other mapping
+    //! \param size    the size of the view in bytes
+    MappedFile (MappedFile const *whole, uint64_t offset, uint64_t size);
+
+    ~MappedFile ();
+
+    //! was the file successfully mapped?
+    bool isValid () const { return (this->_data != nullptr); }
+
+    //! the address of the first byte of the file
+    const uint8_t *data () const { return this->_data; }
+
+    //! the size of the file in bytes
+    size_t size () const { return this->_size; }
+
+    //! is the byte range [offset..offset+len) inside the file?
+    bool inBounds (uint64_t offset, uint64_t len) const
+    {
+        return (offset <= this->_size) && (len <= this->_size - offset);
+    }
+
+  private:
+    const uint8_t *_data;       //!< the base address of the mapping (nullptr on error)
+    size_t _size;               //!< the size of the mapped file in bytes
+    bool _owned;                //!< true if we should unmap the data
+
+    // mappings are not copyable
+    MappedFile (MappedFile const &) = delete;
+    MappedFile &operator= (MappedFile const &) = delete;
+
+};
+
+#endif // !_MAPPED_FILE_HPP_
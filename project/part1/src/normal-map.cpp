@@ -0,0 +1,181 @@
+/*! \file normal-map.cpp
+ *
+ * \author John Reppy
+ */
+
+/* CMSC23700 Final Project sample code (Autumn 2022)
+ *
+ * COPYRIGHT (c) 2022 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#include "normal-map.hpp"
+#include "worker-pool.hpp"
+#include <atomic>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+NormalMap::NormalMap (std::shared_ptr<const HeightField> hf, uint32_t depth, uint32_t tileSize)
+  : _hf(std::move(hf)), _depth(depth), _tileSize(tileSize)
+{
+    assert (this->_hf->isValid());
+    assert ((depth > 0) && (depth <= 16));
+    assert ((tileSize > 0) && ((tileSize & (tileSize - 1)) == 0));
+}
+
+void NormalMap::computeTile (int level, int row, int col, uint8_t *rgba) const
+{
+    const uint32_t ts = this->_tileSize;
+    const uint32_t size = this->_hf->size();
+    const uint32_t stride = size + 1;
+    const uint16_t *samples = this->_hf->samples();
+
+  // a pixel's footprint is a "unit" of unitSz x unitSz grid squares; when the pixels
+  // are smaller than the grid squares, there are pixPerUnit x pixPerUnit pixels per unit
+    const uint32_t nPixels = ts << level;
+    const uint32_t unitSz = std::max(1u, size / nPixels);
+    const uint32_t pixPerUnit = std::max(1u, nPixels / size);
+
+  // the gradient is the difference of the mean heights of opposite edges of the unit
+  // divided by the width of the unit.  The means are computed with the trapezoid rule,
+  // which is exact for the piecewise-linear surface along the edges.
+    const float scale = this->_hf->vScale()
+        / (float(unitSz) * float(unitSz) * this->_hf->hScale());
+
+  // the range of units covered by the tile's columns
+    const uint32_t x0 = uint32_t(col) * ts;
+    const uint32_t u0 = x0 / pixPerUnit;
+    const uint32_t nUnits = (x0 + ts - 1) / pixPerUnit - u0 + 1;
+
+    std::vector<float> vert(nUnits + 1);        // sums along the vertical edges
+    std::vector<float> ugx(nUnits), ugz(nUnits); // the gradients of the units
+    std::vector<float> gx(ts), gz(ts);          // the gradients of a row of pixels
+
+    uint32_t curUnitRow = ~0u;
+    for (uint32_t y = 0;  y < ts;  y++) {
+        uint32_t unitRow = (uint32_t(row) * ts + y) / pixPerUnit;
+        if (unitRow != curUnitRow) {
+            curUnitRow = unitRow;
+            uint32_t r0 = unitRow * unitSz;
+
+          // sum the samples along the west edges of the units (and the east edge of
+          // the last unit)
+            std::fill (vert.begin(), vert.end(), 0.0f);
+            for (uint32_t r = r0;  r <= r0 + unitSz;  r++) {
+                float w = ((r == r0) || (r == r0 + unitSz)) ? 0.5f : 1.0f;
+                const uint16_t *p = samples + size_t(r) * stride + size_t(u0) * unitSz;
+                for (uint32_t j = 0;  j <= nUnits;  j++) {
+                    vert[j] += w * float(p[size_t(j) * unitSz]);
+                }
+            }
+
+          // sum the samples along the north and south edges of each unit
+            const uint16_t *north = samples + size_t(r0) * stride + size_t(u0) * unitSz;
+            const uint16_t *south = north + size_t(unitSz) * stride;
+            for (uint32_t j = 0;  j < nUnits;  j++) {
+                const uint16_t *pn = north + size_t(j) * unitSz;
+                const uint16_t *ps = south + size_t(j) * unitSz;
+                float sn = 0.5f * (float(pn[0]) + float(pn[unitSz]));
+                float ss = 0.5f * (float(ps[0]) + float(ps[unitSz]));
+                for (uint32_t k = 1;  k < unitSz;  k++) {
+                    sn += float(pn[k]);
+                    ss += float(ps[k]);
+                }
+                ugx[j] = (vert[j+1] - vert[j]) * scale;
+                ugz[j] = (ss - sn) * scale;
+            }
+
+            for (uint32_t x = 0;  x < ts;  x++) {
+                uint32_t j = (x0 + x) / pixPerUnit - u0;
+                gx[x] = ugx[j];
+                gz[x] = ugz[j];
+            }
+        }
+
+        NormalMap::_encodeRow (ts, gx.data(), gz.data(), rgba + 4 * size_t(ts) * y);
+    }
+
+}
+
+// The unit normal for the gradient (gx, gz) is (-gx, 1, -gz) / len, where
+// len = sqrt(gx^2 + gz^2 + 1), and a component v is encoded as round((v+1) * 127.5),
+// which is trunc(v * 127.5 + 128).
+void NormalMap::_encodeRow (uint32_t n, const float *gx, const float *gz, uint8_t *rgba)
+{
+    uint32_t i = 0;
+
+#if defined(__SSE2__)
+  // four pixels at a time; the packed pixels are stored as one 128-bit word
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 k127 = _mm_set1_ps(127.5f);
+    const __m128 k128 = _mm_set1_ps(128.0f);
+    const __m128i alpha = _mm_set1_epi32(int32_t(0xff000000));
+    for (;  i + 4 <= n;  i += 4) {
+        __m128 x = _mm_loadu_ps(gx + i);
+        __m128 z = _mm_loadu_ps(gz + i);
+        __m128 len = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(z, z)), one));
+        __m128 s = _mm_div_ps(k127, len);
+        __m128i r = _mm_cvttps_epi32(_mm_sub_ps(k128, _mm_mul_ps(x, s)));
+        __m128i g = _mm_cvttps_epi32(_mm_sub_ps(k128, _mm_mul_ps(z, s)));
+        __m128i b = _mm_cvttps_epi32(_mm_add_ps(k128, s));
+        __m128i px = _mm_or_si128(
+            _mm_or_si128(r, _mm_slli_epi32(g, 8)),
+            _mm_or_si128(_mm_slli_epi32(b, 16), alpha));
+        _mm_storeu_si128 (reinterpret_cast<__m128i *>(rgba + 4 * i), px);
+    }
+#endif
+
+    for (;  i < n;  i++) {
+        float len = std::sqrt((gx[i] * gx[i] + gz[i] * gz[i]) + 1.0f);
+        float s = 127.5f / len;
+        uint8_t *p = rgba + 4 * i;
+        p[0] = static_cast<uint8_t>(128.0f - gx[i] * s);
+        p[1] = static_cast<uint8_t>(128.0f - gz[i] * s);
+        p[2] = static_cast<uint8_t>(128.0f + s);
+        p[3] = 255;
+    }
+}
+
+tqt::TextureQTree *NormalMap::makeTQT (bool flip) const
+{
+    NormalMap gen = *this;
+    return new tqt::TextureQTree (
+        this->_depth, this->_tileSize,
+        [gen] (int level, int row, int col, uint8_t *rgba) {
+            gen.computeTile (level, row, col, rgba);
+            return true;
+        },
+        flip, false);
+}
+
+bool NormalMap::write (std::string const &file, tqt::Format format, unsigned int nThreads) const
+{
+    tqt::Writer writer(file, this->_depth, this->_tileSize, format, false);
+    if (! writer.isValid()) {
+        return false;
+    }
+
+    std::atomic<bool> failed(false);
+    {
+        WorkerPool pool(nThreads);
+        for (int level = 0;  level < int(this->_depth);  level++) {
+            for (int row = 0;  row < (1 << level);  row++) {
+                for (int col = 0;  col < (1 << level);  col++) {
+                    pool.submit ([this, &writer, &failed, level, row, col]() {
+                        std::vector<uint8_t> rgba(4 * size_t(this->_tileSize) * this->_tileSize);
+                        this->computeTile (level, row, col, rgba.data());
+                        if (! writer.addImage (level, row, col, rgba.data())) {
+                            failed = true;
+                        }
+                    });
+                }
+            }
+        }
+        pool.wait ();
+    }
+
+    return ! failed.load() && writer.finish();
+}
@@ -0,0 +1,101 @@
+/*! \file normal-map.hpp
+ *
+ * \author John Reppy
+ *
+ * Computing the normal-map texture quadtree of a cell from its height field.
+ */
+
+/* CMSC23700 Final Project sample code (Autumn 2022)
+ *
+ * COPYRIGHT (c) 2022 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#ifndef _NORMAL_MAP_HPP_
+#define _NORMAL_MAP_HPP_
+
+#include "cs237.hpp"
+#include "tqt.hpp"
+#include "height-field.hpp"
+#include <memory>
+
+//! Computes the tiles of a cell's normal-map texture quadtree from the cell's height
+//! field, so that the "norm.tqt" file does not have to be stored.  The tiles use the
+//! same encoding as the files: the X, Z, and Y (up) components of the unit normal are
+//! mapped from [-1..1] to [0..255] and stored in the R, G, and B channels, and A is 255.
+//!
+//! The level-L tiles cover the cell with (tileSize << L) pixels on a side.  The normal
+//! at a pixel is computed from the average gradient of the surface over the pixel's
+//! footprint, which is the central difference of the mean heights along the edges of
+//! the footprint.  When the pixels are smaller than the grid squares, the pixel gets the
+//! average gradient of the square that contains it.
+class NormalMap {
+  public:
+
+    //! \brief create a normal-map generator
+    //! \param hf        the height field; the generator and any trees made from it
+    //!                  share ownership of it
+    //! \param depth     the depth of the quadtree
+    //! \param tileSize  the width of the tiles; must be a power of 2
+    NormalMap (std::shared_ptr<const HeightField> hf, uint32_t depth, uint32_t tileSize);
+
+    //! the depth of the quadtree
+    uint32_t depth () const { return this->_depth; }
+
+    //! the width of the tiles
+    uint32_t tileSize () const { return this->_tileSize; }
+
+    //! \brief compute the pixels of a tile.  This function is thread safe.
+    //! \param level      the level of the tile in the tree (root = 0)
+    //! \param row        the row of the tile on its level (north == 0)
+    //! \param col        the column of the tile on its level (west == 0)
+    //! \param[out] rgba  the RGBA8 pixels of the tile, with the top row first
+    void computeTile (int level, int row, int col, uint8_t *rgba) const;
+
+    //! \brief make a texture quadtree whose tiles are computed on demand
+    //! \param flip  should the images be flipped to match OpenGL conventions
+    //! \return the tree, which the caller owns
+    tqt::TextureQTree *makeTQT (bool flip) const;
+
+    //! \brief compute all of the tiles and write them to a TQT file
+    //! \param file      the output file
+    //! \param format    the tile format (PNG or QOI)
+    //! \param nThreads  the number of threads to use
+    //! \return true if successful, false otherwise
+    bool write (std::string const &file, tqt::Format format, unsigned int nThreads) const;
+
+    //! the tile size of the trees that are not matched to a color map
+    static constexpr uint32_t kDefaultTileSize = 64;
+
+    //! \brief the depth of a tree with kDefaultTileSize tiles whose finest level has
+    //!        one pixel per grid square
+    //! \param cellSize  the width of the cell in grid squares
+    static uint32_t defaultDepth (uint32_t cellSize)
+    {
+        uint32_t depth = 1;
+        while ((kDefaultTileSize << depth) <= cellSize) {
+            depth++;
+        }
+        return depth;
+    }
+
+    //! \brief the tile size for a tree of the given depth, which makes the finest level
+    //!        have one pixel per grid square (but at least a 1x1 tile)
+    //! \param cellSize  the width of the cell in grid squares
+    //! \param depth     the depth of the quadtree
+    static uint32_t defaultTileSize (uint32_t cellSize, uint32_t depth)
+    {
+        return std::max(1u, cellSize >> (depth - 1));
+    }
+
+  private:
+    std::shared_ptr<const HeightField> _hf; //!< the source of the heights
+    uint32_t _depth;            //!< the depth of the quadtree
+    uint32_t _tileSize;         //!< the width of the tiles
+
+    //! compute and encode the normals for a row of pixels from the gradients
+    static void _encodeRow (uint32_t n, const float *gx, const float *gz, uint8_t *rgba);
+
+};
+
+#endif // !_NORMAL_MAP_HPP_
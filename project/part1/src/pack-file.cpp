@@ -0,0 +1,198 @@
+/*! \file pack-file.cpp
+ *
+ * \author John Reppy
+ */
+
+/* CMSC23700 Final Project sample code (Autumn 2022)
+ *
+ * COPYRIGHT (c) 2022 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#include "pack-file.hpp"
+#include "binary-io.hpp"
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+PackFile::PackFile (std::string const &file)
+    : _file(file), _fd(-1), _size(0), _mapping(nullptr)
+{
+    int fd = ::open (file.c_str(), O_RDONLY);
+    if (fd < 0) {
+#ifndef NDEBUG
+        std::cerr << "PackFile: unable to open \"" << file << "\"\n";
+#endif
+        return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+#ifndef NDEBUG
+        std::cerr << "PackFile: unable to stat \"" << file << "\"\n";
+#endif
+        ::close (fd);
+        return;
+    }
+
+    FileRange inS;
+    inS.open (fd, 0, static_cast<uint64_t>(st.st_size));
+    if (! this->_readDirectory (inS)) {
+        this->_dir.clear();
+        this->_names.clear();
+        ::close (fd);
+        return;
+    }
+
+    this->_fd = fd;
+    this->_size = inS.size();
+
+}
+
+PackFile::~PackFile ()
+{
+    delete this->_mapping;
+    if (this->_fd >= 0) {
+        ::close (this->_fd);
+    }
+}
+
+bool PackFile::find (std::string const &name, Member &m) const
+{
+  // binary search of the directory
+    size_t lo = 0, hi = this->_dir.size();
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        int cmp = this->_compare (this->_dir[mid], name);
+        if (cmp == 0) {
+            m.offset = this->_dir[mid].offset;
+            m.size = this->_dir[mid].size;
+            return true;
+        }
+        else if (cmp < 0) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+    return false;
+
+}
+
+bool PackFile::open (std::string const &name, FileRange &r) const
+{
+    Member m;
+    if (! this->isValid() || ! this->find (name, m)) {
+        return false;
+    }
+    r.open (this->_fd, m.offset, m.size);
+    return true;
+
+}
+
+bool PackFile::read (std::string const &name, std::vector<uint8_t> &buf) const
+{
+    FileRange r;
+    if (! this->open (name, r)) {
+        return false;
+    }
+    buf.resize (r.size());
+    return r.read (0, buf.data(), buf.size());
+
+}
+
+MappedFile *PackFile::map (std::string const &name)
+{
+    Member m;
+    if (! this->isValid() || ! this->find (name, m)) {
+        return nullptr;
+    }
+
+    {
+        std::lock_guard<std::mutex> lk(this->_mapMutex);
+        if (this->_mapping == nullptr) {
+            this->_mapping = new MappedFile (this->_file);
+        }
+    }
+    if (! this->_mapping->isValid()) {
+        return nullptr;
+    }
+
+    return new MappedFile (this->_mapping, m.offset, m.size);
+
+}
+
+// read and check the header and directory of the pack
+bool PackFile::_readDirectory (FileRange const &inS)
+{
+    uint8_t hdr[kHeaderSize];
+    if (! inS.read (0, hdr, kHeaderSize)) {
+        std::cerr << "PackFile: \"" << this->_file << "\" is too small\n";
+        return false;
+    }
+    uint32_t magic = getVal<uint32_t>(hdr);
+    uint32_t version = getVal<uint32_t>(hdr + 4);
+    uint32_t nMembers = getVal<uint32_t>(hdr + 8);
+    uint64_t dirOffset = getVal<uint64_t>(hdr + 16);
+    uint64_t dirSize = getVal<uint64_t>(hdr + 24);
+    if ((magic != kMagic) || (version != kVersion)) {
+        std::cerr << "PackFile: \"" << this->_file << "\" has a bogus header\n";
+        return false;
+    }
+    if (! inS.inBounds(dirOffset, dirSize) || (dirSize / kEntrySize < nMembers)) {
+        std::cerr << "PackFile: \"" << this->_file << "\" has a truncated directory\n";
+        return false;
+    }
+
+  // read the directory and the member names with a single read
+    std::vector<uint8_t> buf(dirSize);
+    if (! inS.read (dirOffset, buf.data(), buf.size())) {
+        std::cerr << "PackFile: error reading the directory of \"" << this->_file << "\"\n";
+        return false;
+    }
+    uint64_t namesOffset = uint64_t(nMembers) * kEntrySize;
+    this->_names.assign (
+        reinterpret_cast<const char *>(buf.data() + namesOffset), dirSize - namesOffset);
+    this->_dir.resize (nMembers);
+    for (uint32_t i = 0;  i < nMembers;  i++) {
+        const uint8_t *p = buf.data() + uint64_t(i) * kEntrySize;
+        Entry &e = this->_dir[i];
+        e.offset = getVal<uint64_t>(p);
+        e.size = getVal<uint64_t>(p + 8);
+        e.nameOffset = getVal<uint32_t>(p + 16);
+        e.nameLen = getVal<uint32_t>(p + 20);
+        if (! inS.inBounds(e.offset, e.size)
+        || (e.nameOffset > this->_names.size())
+        || (e.nameLen > this->_names.size() - e.nameOffset)) {
+            std::cerr << "PackFile: bogus directory entry " << i << " in \""
+                << this->_file << "\"\n";
+            return false;
+        }
+      // the binary search in find requires that the names be sorted
+        if ((i > 0) && (this->_names.compare(
+                this->_dir[i-1].nameOffset, this->_dir[i-1].nameLen,
+                this->_names, e.nameOffset, e.nameLen) >= 0))
+        {
+            std::cerr << "PackFile: the directory of \"" << this->_file
+                << "\" is not sorted\n";
+            return false;
+        }
+    }
+
+    return true;
+
+}
+
+/* static */ bool PackFile::isPackFile (std::string const &file)
+{
+    struct stat st;
+    if ((stat(file.c_str(), &st) < 0) || ! S_ISREG(st.st_mode)) {
+        return false;
+    }
+    FileRange inS;
+    uint32_t magic;
+    return inS.open (file) && inS.read (0, &magic, sizeof(magic)) && (magic == kMagic);
+
+}
@@ -0,0 +1,163 @@
+/*! \file pack-file.hpp
+ *
+ * \author John Reppy
+ *
+ * Map packs, which are single-file archives that hold all of the files of a map.
+ */
+
+/* CMSC23700 Final Project sample code (Autumn 2022)
+ *
+ * COPYRIGHT (c) 2022 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#ifndef _PACK_FILE_HPP_
+#define _PACK_FILE_HPP_
+
+#include "file-range.hpp"
+#include "mapped-file.hpp"
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// A map pack has the following layout on disk (all values are little endian):
+//
+//      uint32_t magic;         // Magic number; should be 0x6B61706D ('mpak')
+//      uint32_t version;       // format version (currently 1)
+//      uint32_t nMembers;      // number of member files
+//      uint32_t pageSize;      // alignment of large members (4096)
+//      uint64_t dirOffset;     // file offset of the directory
+//      uint64_t dirSize;       // size of the directory in bytes
+//      ...                     // the contents of the member files
+//      Entry dir[nMembers];    // the directory
+//      char names[];           // the member names
+//
+// where each directory entry is
+//
+//      uint64_t offset;        // file offset of the member's contents
+//      uint64_t size;          // size of the member in bytes
+//      uint32_t nameOffset;    // offset of the member's name in the names array
+//      uint32_t nameLen;       // length of the member's name
+//
+// The members are named by their paths relative to the map directory using '/' as
+// the separator (e.g., "map.json" and "00_00/hf.cell"), and the directory is sorted
+// by name.  Members start on an 8-byte boundary, and members that are a page or larger
+// start on a page boundary, which means that a mapping of the pack has the same
+// alignment properties as mappings of the individual files (in particular, version 2
+// "hf.cell" payloads are page aligned).
+
+//! A read-only map pack.  The pack is opened once; its members are read using the
+//! shared file descriptor or accessed through a single mapping of the whole pack.
+class PackFile {
+  public:
+
+    static constexpr uint32_t kMagic = 0x6B61706D;      //!< 'mpak'
+    static constexpr uint32_t kVersion = 1;             //!< the current format version
+    static constexpr uint64_t kPageSize = 4096;         //!< alignment of large members
+    static constexpr uint64_t kMinAlign = 8;            //!< alignment of other members
+    static constexpr uint64_t kHeaderSize = 32;         //!< size of the pack header
+    static constexpr uint64_t kEntrySize = 24;          //!< size of a directory entry
+
+    //! the location of a member in the pack
+    struct Member {
+        uint64_t offset;        //!< the file offset of the member's contents
+        uint64_t size;          //!< the size of the member in bytes
+    };
+
+    //! open a map pack
+    //! \param file the path to the pack
+    //!
+    //! Use `isValid()` to check if the pack was successfully opened.
+    explicit PackFile (std::string const &file);
+
+    ~PackFile ();
+
+    //! was the pack successfully opened?
+    bool isValid () const { return (this->_fd >= 0); }
+
+    //! the path to the pack
+    std::string const &file () const { return this->_file; }
+
+    //! the pack's file descriptor, which can be used with `pread` to read members
+    int fd () const { return this->_fd; }
+
+    //! the number of members in the pack
+    uint32_t nMembers () const { return static_cast<uint32_t>(this->_dir.size()); }
+
+    //! the name of the i'th member (in sorted order)
+    std::string memberName (uint32_t i) const
+    {
+        return this->_names.substr(this->_dir[i].nameOffset, this->_dir[i].nameLen);
+    }
+
+    //! the location of the i'th member (in sorted order)
+    Member member (uint32_t i) const
+    {
+        return Member{this->_dir[i].offset, this->_dir[i].size};
+    }
+
+    //! \brief find a member of the pack
+    //! \param name      the name of the member
+    //! \param[out] m    the location of the member
+    //! \return true if the pack has a member with the given name
+    bool find (std::string const &name, Member &m) const;
+
+    //! \brief set a file range to a member of the pack
+    //! \param name      the name of the member
+    //! \param[out] r    the range to set; it shares the pack's file descriptor
+    //! \return true if the pack has a member with the given name
+    bool open (std::string const &name, FileRange &r) const;
+
+    //! \brief read the contents of a member
+    //! \param name      the name of the member
+    //! \param[out] buf  the buffer to hold the contents
+    //! \return true if the member exists and was successfully read
+    bool read (std::string const &name, std::vector<uint8_t> &buf) const;
+
+    //! \brief get a view of a member in the mapping of the whole pack
+    //! \param name the name of the member
+    //! \return a view of the member that the caller must delete (deleting it does
+    //!         not unmap the pack), or nullptr if there is no such member or the
+    //!         pack cannot be mapped
+    //!
+    //! The pack is mapped on the first call; this function is thread safe.
+    MappedFile *map (std::string const &name);
+
+    //! return true if the file looks like a map pack (i.e., it is a regular file
+    //! with the right magic number)
+    static bool isPackFile (std::string const &file);
+
+  private:
+    //! a directory entry
+    struct Entry {
+        uint64_t offset;
+        uint64_t size;
+        uint32_t nameOffset;
+        uint32_t nameLen;
+    };
+
+    std::string _file;          //!< the path to the pack
+    int _fd;                    //!< the open pack (-1 on error)
+    uint64_t _size;             //!< the size of the pack in bytes
+    std::vector<Entry> _dir;    //!< the directory, sorted by name
+    std::string _names;         //!< the member names
+    std::mutex _mapMutex;       //!< protects the initialization of _mapping
+    MappedFile *_mapping;       //!< the mapping of the whole pack (created on demand)
+
+    //! read and check the pack's header and directory
+    bool _readDirectory (FileRange const &inS);
+
+    //! compare the name of a directory entry with a string
+    int _compare (Entry const &e, std::string const &name) const
+    {
+        return this->_names.compare(e.nameOffset, e.nameLen, name);
+    }
+
+    // packs are not copyable
+    PackFile (PackFile const &) = delete;
+    PackFile &operator= (PackFile const &) = delete;
+
+};
+
+#endif // !_PACK_FILE_HPP_
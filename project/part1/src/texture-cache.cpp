@@ -10,15 +10,165 @@
  */
 
 #include "texture-cache.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
 #include <utility>
 
-//! soft upper bound on the number of GPU resident textures
-constexpr uint32_t kNumActiveLimit = 1024;
+//! A pool of array textures whose layers all have the same size, format, and number
+//! of mipmap levels.  The layers are identified by "slots", where slot i is layer
+//! (i % layersPerArray) of array (i / layersPerArray).
+struct TexturePool {
+    uint32_t wid;               //!< the width of the layers
+    uint32_t ht;                //!< the height of the layers
+    VkFormat fmt;               //!< the texel format
+    uint32_t nLevels;           //!< the number of mipmap levels per layer
+    size_t layerBytes;          //!< the GPU memory used by a layer
+    uint32_t layersPerArray;    //!< the number of layers in each array texture
+    VkSampler sampler;          //!< the sampler shared by the textures in the pool
+    std::vector<cs237::Texture2DArray *> arrays; //!< the array textures
+    std::vector<uint32_t> free; //!< the free slots
+};
+
+//! the sampler used for all of the tile textures
+static const cs237::Application::SamplerInfo kTileSampler(
+    VK_FILTER_LINEAR,
+    VK_FILTER_LINEAR,
+    VK_SAMPLER_MIPMAP_MODE_LINEAR,
+    VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+    VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+    VK_BORDER_COLOR_INT_OPAQUE_BLACK);
+
+// the number of mipmap levels for an uncompressed image
+static uint32_t mipLevels (cs237::Image2D const *img, bool mipmaps)
+{
+    uint32_t nLevels = 1;
+    if (mipmaps) {
+        for (size_t w = std::max(img->width(), img->height());  w > 1;  w >>= 1) {
+            nLevels++;
+        }
+    }
+    return nLevels;
+}
+
+/***** struct TextureCacheStats member functions *****/
+
+void TextureCacheStats::clear ()
+{
+    this->hits = 0;
+    this->misses = 0;
+    this->pending = 0;
+    this->evictions = 0;
+    this->uploads = 0;
+    this->uploadBytes = 0;
+    this->decodeMS = 0.0;
+    std::fill (this->latency, this->latency + kLatencyBuckets, 0);
+    this->residentBytes = 0;
+    this->active = 0;
+    this->loading = 0;
+    std::fill (this->levels, this->levels + kMaxLevels, 0);
+}
+
+void TextureCacheStats::add (TextureCacheStats const &frame)
+{
+    this->hits += frame.hits;
+    this->misses += frame.misses;
+    this->pending += frame.pending;
+    this->evictions += frame.evictions;
+    this->uploads += frame.uploads;
+    this->uploadBytes += frame.uploadBytes;
+    this->decodeMS += frame.decodeMS;
+    for (int i = 0;  i < kLatencyBuckets;  i++) {
+        this->latency[i] += frame.latency[i];
+    }
+    this->residentBytes = frame.residentBytes;
+    this->active = frame.active;
+    this->loading = frame.loading;
+    std::copy (frame.levels, frame.levels + kMaxLevels, this->levels);
+}
+
+void TextureCacheStats::writeJSON (std::ostream &outS, uint64_t frame) const
+{
+  // trailing zeros are omitted from the arrays
+    auto writeArray = [&outS] (const char *name, auto const *a, int n) {
+        while ((n > 0) && (a[n-1] == 0)) {
+            n--;
+        }
+        outS << ",\"" << name << "\":[";
+        for (int i = 0;  i < n;  i++) {
+            outS << (i > 0 ? "," : "") << a[i];
+        }
+        outS << "]";
+    };
+
+    outS << "{\"frame\":" << frame
+        << ",\"hits\":" << this->hits
+        << ",\"misses\":" << this->misses
+        << ",\"pending\":" << this->pending
+        << ",\"activations\":" << this->activations()
+        << ",\"evictions\":" << this->evictions
+        << ",\"uploads\":" << this->uploads
+        << ",\"uploadBytes\":" << this->uploadBytes
+        << ",\"decodeMS\":" << this->decodeMS
+        << ",\"residentBytes\":" << this->residentBytes
+        << ",\"active\":" << this->active
+        << ",\"loading\":" << this->loading;
+    writeArray ("latency", this->latency, kLatencyBuckets);
+    writeArray ("levels", this->levels, kMaxLevels);
+    outS << "}\n";
+}
+
+/***** class TextureCache member functions *****/
 
 // initialize the texture cache
-TextureCache::TextureCache (cs237::Application *app, bool mipmap)
-    : _app(app), _numActive(0), _clock(0)
-{ }
+TextureCache::TextureCache (cs237::Application *app, bool mipmap, size_t imageBudget, size_t budget)
+    : _app(app), _numActive(0), _numEvictions(0), _clock(0),
+      _budget(budget), _residentBytes(0),
+      _lruHead(nullptr), _lruTail(nullptr), _usePool(false),
+      _images(imageBudget), _workers(nullptr), _staging(nullptr), _ring(nullptr),
+      _maxFrameBytes(kDefaultFrameBytes), _maxFrameMS(kDefaultFrameMS),
+      _decodeNS(0), _numLoading(0), _statsLog(nullptr)
+{
+    std::fill (this->_levelCount, this->_levelCount + TextureCacheStats::kMaxLevels, 0);
+}
+
+TextureCache::~TextureCache ()
+{
+  // finish the requests that the workers have started, so that there are no
+  // textures in the Decoding state
+    if (this->_workers != nullptr) {
+        this->_workers->wait();
+        delete this->_workers;
+        this->_workers = nullptr;
+    }
+    this->_finishUploads (true);
+
+  // the textures remove themselves from the table when they are deleted, so we
+  // take a copy of it first
+    std::vector<TileTexture *> txts;
+    txts.reserve (this->_textureTbl.size());
+    for (auto it : this->_textureTbl) {
+        txts.push_back (it.second);
+    }
+    for (auto txt : txts) {
+        delete txt;
+    }
+
+  // make sure that the GPU is done with the textures before destroying them
+    vkDeviceWaitIdle (this->_app->device());
+    this->_freeRetired (true);
+
+    for (auto pool : this->_pools) {
+        for (auto array : pool->arrays) {
+            delete array;
+        }
+        this->_app->releaseSampler (pool->sampler);
+        delete pool;
+    }
+
+    delete this->_staging;
+    delete this->_ring;
+}
 
 TileTexture *TextureCache::make (tqt::TextureQTree *tree, int level, int row, int col)
 {
@@ -35,28 +185,115 @@ TileTexture *TextureCache::make (tqt::TextureQTree *tree, int level, int row, in
 
 }
 
+TileTexture *TextureCache::_find (tqt::TextureQTree *tree, int level, int row, int col) const
+{
+    auto got = this->_textureTbl.find(TextureCache::Key(tree, level, row, col));
+    return (got == this->_textureTbl.end()) ? nullptr : got->second;
+}
+
+void TextureCache::newFrame ()
+{
+    this->_endFrameStats ();
+    this->_clock++;
+    if (this->isStreaming()) {
+        this->_finishUploads (false);
+        this->_upload ();
+        this->_evict ();
+    }
+    this->_freeRetired (false);
+}
+
+void TextureCache::_endFrameStats ()
+{
+    TextureCacheStats &cur = this->_curStats;
+    cur.decodeMS += 1.0e-6 * double(this->_decodeNS.exchange(0));
+    cur.residentBytes = this->_residentBytes;
+    cur.active = this->_numActive;
+    cur.loading = this->_numLoading;
+    std::copy (this->_levelCount, this->_levelCount + TextureCacheStats::kMaxLevels, cur.levels);
+
+    this->_frameStats = cur;
+    this->_totalStats.add (cur);
+    if (this->_statsLog != nullptr) {
+        cur.writeJSON (*this->_statsLog, this->_clock);
+    }
+    cur.clear ();
+}
+
+void TextureCache::_recordReady (TileTexture *txt)
+{
+    uint64_t frames = this->_clock - txt->_requested;
+    int bucket = static_cast<int>(
+        std::min(frames, uint64_t(TextureCacheStats::kLatencyBuckets - 1)));
+    this->_curStats.latency[bucket]++;
+    this->_numLoading--;
+}
+
+void TextureCache::setBudget (size_t nBytes)
+{
+    this->_budget = nBytes;
+    this->_evict ();
+}
+
+void TextureCache::usePool (bool enable)
+{
+    assert (this->_residentBytes == 0);
+    this->_usePool = enable;
+}
+
+void TextureCache::enableStreaming (
+    unsigned int nWorkers,
+    size_t stagingBytes,
+    size_t maxFrameBytes,
+    double maxFrameMS)
+{
+    assert (! this->isStreaming());
+    assert (this->_residentBytes == 0);
+
+  // round the staging buffer up to the ring's alignment
+    stagingBytes = (std::max(stagingBytes, UploadRing::kAlign) + UploadRing::kAlign - 1)
+        & ~(UploadRing::kAlign - 1);
+
+    this->_workers = new WorkerPool (nWorkers);
+    this->_staging = new cs237::StagingBuffer (this->_app, stagingBytes);
+    this->_ring = new UploadRing (stagingBytes);
+    this->setUploadLimits (maxFrameBytes, maxFrameMS);
+}
+
+void TextureCache::setUploadLimits (size_t maxFrameBytes, double maxFrameMS)
+{
+    this->_maxFrameBytes = maxFrameBytes;
+    this->_maxFrameMS = maxFrameMS;
+}
+
+size_t TextureCache::poolBytes () const
+{
+    size_t nBytes = 0;
+    for (auto pool : this->_pools) {
+        nBytes += pool->arrays.size() * pool->layersPerArray * pool->layerBytes;
+    }
+    return nBytes;
+}
+
 // record that the given texture is now active
-void TextureCache::_makeActive (TileTexture *txt)
+void TextureCache::_makeActive (TileTexture *txt, bool loaded)
 {
     assert (! txt->_active);
-    if (txt->_activeIdx >= 0) {
-        assert (this->_inactive[txt->_activeIdx] == txt);
-
-/** TODO: check if we are over the limit and, if so, free the
- ** resources associated with the LRU TileTexture
- */
 
-      // first remove txt from the inactive list by moving the last element to where it is
-        TileTexture *last = this->_inactive.back();
-        this->_inactive[txt->_activeIdx] = last;
-        this->_inactive.pop_back();
-        last->_activeIdx = txt->_activeIdx;
+    if (loaded) {
+      // the new texture might push us over the budget
+        assert (txt->_isResident());
+        this->_residentBytes += txt->_nBytes;
+        this->_evict ();
     }
-    // else txt did not have a texture associated with it, so it is not on the inactive list
+    else if (txt->isReady()) {
+      // txt was inactive, but still resident, so it is on the LRU list
+        this->_lruRemove (txt);
+    }
+  // otherwise, txt is still being loaded in streaming mode and is not on the LRU list
 
-  // add txt to the active list
-    txt->_activeIdx = this->_active.size();
-    this->_active.push_back(txt);
+    txt->_lastUsed = this->_clock;
+    this->_numActive++;
 
 }
 
@@ -64,21 +301,463 @@ void TextureCache::_makeActive (TileTexture *txt)
 void TextureCache::_release (TileTexture *txt)
 {
     assert (txt->_active);
-    assert (this->_active[txt->_activeIdx] == txt);
+    assert (this->_numActive > 0);
+
+    txt->_lastUsed = this->_clock;
+    this->_numActive--;
+
+  // add txt to the front of the LRU list, where it stays resident until it
+  // is reactivated or evicted.  A texture that is still being loaded is added
+  // to the list when its upload completes (or dropped before it is uploaded).
+    if (txt->isReady()) {
+        this->_lruInsert (txt);
+        this->_evict ();
+    }
+
+}
+
+/* the LRU list of inactive textures that are resident on the GPU; the head of the
+ * list is the most recently released texture.
+ */
+
+void TextureCache::_lruInsert (TileTexture *txt)
+{
+    txt->_lruPrev = nullptr;
+    txt->_lruNext = this->_lruHead;
+    if (this->_lruHead != nullptr) {
+        this->_lruHead->_lruPrev = txt;
+    } else {
+        this->_lruTail = txt;
+    }
+    this->_lruHead = txt;
+}
+
+void TextureCache::_lruRemove (TileTexture *txt)
+{
+    if (txt->_lruPrev != nullptr) {
+        txt->_lruPrev->_lruNext = txt->_lruNext;
+    } else {
+        this->_lruHead = txt->_lruNext;
+    }
+    if (txt->_lruNext != nullptr) {
+        txt->_lruNext->_lruPrev = txt->_lruPrev;
+    } else {
+        this->_lruTail = txt->_lruPrev;
+    }
+    txt->_lruPrev = txt->_lruNext = nullptr;
+}
+
+void TextureCache::_evict ()
+{
+    if (this->_budget == 0) {
+        return;
+    }
+    while ((this->_residentBytes > this->_budget) && (this->_lruTail != nullptr)) {
+        TileTexture *victim = this->_lruTail;
+        this->_lruRemove (victim);
+        this->_retire (victim);
+        this->_numEvictions++;
+        this->_curStats.evictions++;
+    }
+
+}
+
+void TextureCache::_retire (TileTexture *txt)
+{
+    assert (txt->_isResident());
+    if (txt->isPooled()) {
+      // the sampler belongs to the pool
+        this->_retired.push_back (Retired{
+            nullptr, VK_NULL_HANDLE, txt->_pool, txt->_array, txt->_layer, this->_clock });
+    } else {
+        this->_retired.push_back (Retired{
+            txt->_txt, txt->_sampler, nullptr, nullptr, 0, this->_clock });
+    }
+    this->_residentBytes -= txt->_nBytes;
+    this->_levelCount[_levelIdx(txt)]--;
+    txt->_txt = nullptr;
+    txt->_array = nullptr;
+    txt->_pool = nullptr;
+    txt->_sampler = VK_NULL_HANDLE;
+    txt->_nBytes = 0;
+    txt->_state = TileTexture::State::Unloaded;
+}
+
+void TextureCache::_freeRetired (bool all)
+{
+    while (! this->_retired.empty()
+    && (all || (this->_retired.front().frame + kRetireFrames <= this->_clock))) {
+        Retired &r = this->_retired.front();
+        if (r.pool != nullptr) {
+          // return the layer to its pool
+            TexturePool *pool = r.pool;
+            auto it = std::find (pool->arrays.begin(), pool->arrays.end(), r.array);
+            assert (it != pool->arrays.end());
+            uint32_t arrayIdx = static_cast<uint32_t>(it - pool->arrays.begin());
+            pool->free.push_back (arrayIdx * pool->layersPerArray + r.layer);
+        } else {
+            this->_app->releaseSampler (r.sampler);
+            delete r.txt;
+        }
+        this->_retired.pop_front();
+    }
+}
+
+void TextureCache::_allocLayer (
+    TileTexture *txt,
+    uint32_t wid, uint32_t ht, VkFormat fmt, uint32_t nLevels)
+{
+    assert (! txt->_isResident());
 
-  // first remove txt from the active list by moving the last element to where it is
-    TileTexture *last = this->_active.back();
-    this->_active[txt->_activeIdx] = last;
-    this->_active.pop_back();
-    last->_activeIdx = txt->_activeIdx;
+  // find the pool for the texture's shape; there are only a few of them
+    TexturePool *pool = nullptr;
+    for (auto p : this->_pools) {
+        if ((p->wid == wid) && (p->ht == ht) && (p->fmt == fmt) && (p->nLevels == nLevels)) {
+            pool = p;
+            break;
+        }
+    }
+    if (pool == nullptr) {
+        pool = new TexturePool;
+        pool->wid = wid;
+        pool->ht = ht;
+        pool->fmt = fmt;
+        pool->nLevels = nLevels;
+        pool->layerBytes = txt->_nBytes;
+        pool->layersPerArray = static_cast<uint32_t>(std::clamp(
+            kPoolArrayBytes / std::max(size_t(1), pool->layerBytes),
+            size_t(1), size_t(kMaxPoolLayers)));
+        pool->sampler = this->_app->acquireSampler (kTileSampler);
+        this->_pools.push_back (pool);
+    }
 
-  // add txt to the inactive list
-    txt->_activeIdx = this->_inactive.size();
-    this->_inactive.push_back(txt);
+    if (pool->free.empty()) {
+      // allocate a new array; we push its slots in reverse order so that the
+      // layers are handed out in order
+        uint32_t arrayIdx = static_cast<uint32_t>(pool->arrays.size());
+        pool->arrays.push_back (new cs237::Texture2DArray (
+            this->_app, wid, ht, pool->layersPerArray, fmt, nLevels));
+        for (uint32_t i = pool->layersPerArray;  i > 0;  --i) {
+            pool->free.push_back (arrayIdx * pool->layersPerArray + i - 1);
+        }
+    }
+
+    uint32_t slot = pool->free.back();
+    pool->free.pop_back();
+    txt->_pool = pool;
+    txt->_array = pool->arrays[slot / pool->layersPerArray];
+    txt->_layer = slot % pool->layersPerArray;
+    txt->_sampler = pool->sampler;
+    txt->_nBytes = pool->layerBytes;
+}
+
+void TextureCache::_allocate (
+    TileTexture *txt,
+    cs237::Image2D const *img,
+    cs237::CompressedImage2D const *cimg)
+{
+    assert ((img != nullptr) != (cimg != nullptr));
 
-/** TODO: check if we are over the limit and, if so, free the
- ** resources associated with the TileTexture
+    this->_levelCount[_levelIdx(txt)]++;
+    this->_curStats.uploads++;
+    this->_curStats.uploadBytes += (cimg != nullptr) ? cimg->nBytes() : img->nBytes();
+
+    if (cimg != nullptr) {
+        txt->_nBytes = cimg->nBytes();
+        if (this->_usePool) {
+            this->_allocLayer (
+                txt, cimg->width(), cimg->height(), cimg->format(), cimg->nLevels());
+        }
+    } else {
+        // a full mipmap chain adds a third to the size of the base level
+        txt->_nBytes = txt->_mipmaps ? (4 * img->nBytes()) / 3 : img->nBytes();
+        if (this->_usePool) {
+            this->_allocLayer (
+                txt, img->width(), img->height(), img->format(),
+                mipLevels(img, txt->_mipmaps));
+        }
+    }
+
+    if (! this->_usePool) {
+        // the sampler is shared with the other tile textures
+        txt->_sampler = this->_app->acquireSampler (kTileSampler);
+    }
+}
+
+void TextureCache::_createTexture (
+    TileTexture *txt,
+    cs237::Image2D const *img,
+    cs237::CompressedImage2D const *cimg)
+{
+    this->_allocate (txt, img, cimg);
+    if (cimg != nullptr) {
+        if (this->_usePool) {
+            txt->_array->update (txt->_layer, cimg);
+        } else {
+            txt->_txt = new cs237::Texture2D (this->_app, cimg);
+        }
+    } else {
+        if (this->_usePool) {
+            txt->_array->update (txt->_layer, img);
+        } else {
+            txt->_txt = new cs237::Texture2D (this->_app, img, txt->_mipmaps);
+        }
+    }
+    txt->_state = TileTexture::State::Ready;
+    this->_recordReady (txt);
+}
+
+void TextureCache::_recordTexture (
+    VkCommandBuffer cmdBuf,
+    TileTexture *txt,
+    size_t offset,
+    cs237::Image2D const *img,
+    cs237::CompressedImage2D const *cimg)
+{
+    VkBuffer buf = this->_staging->vkBuffer();
+
+    this->_allocate (txt, img, cimg);
+    if (cimg != nullptr) {
+        if (this->_usePool) {
+            txt->_array->recordUpdate (cmdBuf, txt->_layer, buf, offset, cimg);
+        } else {
+            txt->_txt = new cs237::Texture2D (
+                this->_app, cimg->width(), cimg->height(), cimg->format(), cimg->nLevels());
+            txt->_txt->recordUpdate (cmdBuf, buf, offset, cimg);
+        }
+    } else {
+        if (this->_usePool) {
+            txt->_array->recordUpdate (cmdBuf, txt->_layer, buf, offset, img);
+        } else {
+            txt->_txt = new cs237::Texture2D (
+                this->_app, img->width(), img->height(), img->format(),
+                mipLevels(img, txt->_mipmaps));
+            txt->_txt->recordUpdate (cmdBuf, buf, offset, img);
+        }
+    }
+    txt->_state = TileTexture::State::Uploading;
+}
+
+bool TextureCache::_load (TileTexture *txt)
+{
+    auto start = std::chrono::steady_clock::now();
+    // load the image data from the TQT and create a texture for it.  Compressed
+    // tiles already have their mipmap levels, so they can be uploaded directly
+    // when the device supports BC textures.
+    if (txt->_tree->isCompressed() && this->_app->hasBCTextures()) {
+        cs237::CompressedImage2D *img = txt->_tree->loadCompressed (
+            txt->_level, txt->_row, txt->_col);
+        this->_decodeNS += std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count();
+        if (img == nullptr) {
+            this->_fail (txt);
+            return false;
+        }
+        this->_createTexture (txt, nullptr, img);
+        delete img;
+    } else {
+        // the decoded image comes from the image cache, so a tile that was
+        // evicted from the GPU does not have to be read and decoded again
+        TileImageCache::ImagePtr img = this->_images.get (
+            txt->_tree, txt->_level, txt->_row, txt->_col);
+        this->_decodeNS += std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count();
+        if (img == nullptr) {
+            this->_fail (txt);
+            return false;
+        }
+        this->_createTexture (txt, img.get(), nullptr);
+    }
+    return true;
+}
+
+// a texture whose image cannot be loaded is not requested again; it is never
+// ready, so the renderer uses the nearest ancestor that is
+void TextureCache::_fail (TileTexture *txt)
+{
+    std::cerr << "TextureCache: unable to load tile (" << txt->_level << ", "
+        << txt->_row << ", " << txt->_col << ")\n";
+    txt->_state = TileTexture::State::Failed;
+    this->_numLoading--;
+}
+
+/* Streaming.  The render thread requests a texture by submitting a task to the worker
+ * pool, which loads the image and adds it to the _decoded list.  Each frame, the render
+ * thread moves the decoded images to the _pending list, copies as many of them as the
+ * limits allow into the staging ring, and submits the upload commands as one batch.
+ * The textures of a batch become ready once its fence is signaled.  Only the transition
+ * from Decoding to Decoded happens on a worker thread; it is protected by _decodedMu.
  */
+
+void TextureCache::_request (TileTexture *txt)
+{
+    assert (txt->_state == TileTexture::State::Unloaded);
+
+    txt->_state = TileTexture::State::Decoding;
+    bool compressed = txt->_tree->isCompressed() && this->_app->hasBCTextures();
+    this->_workers->submit ([this, txt, compressed]() { this->_decode (txt, compressed); });
+}
+
+void TextureCache::_decode (TileTexture *txt, bool compressed)
+{
+    auto start = std::chrono::steady_clock::now();
+    Decoded d{txt, nullptr, nullptr};
+    if (compressed) {
+        d.cimg = txt->_tree->loadCompressed (txt->_level, txt->_row, txt->_col);
+    } else {
+        d.img = this->_images.get (txt->_tree, txt->_level, txt->_row, txt->_col);
+    }
+    this->_decodeNS += std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count();
+
+    {
+        std::lock_guard<std::mutex> lk(this->_decodedMu);
+        this->_decoded.push_back (std::move(d));
+        txt->_state = TileTexture::State::Decoded;
+    }
+    this->_decodedCV.notify_all();
+}
+
+void TextureCache::_cancel (TileTexture *txt)
+{
+    auto remove = [txt] (std::vector<Decoded> &v) {
+        for (auto it = v.begin();  it != v.end();  ++it) {
+            if (it->txt == txt) {
+                delete it->cimg;
+                v.erase (it);
+                return;
+            }
+        }
+    };
+
+    {
+        std::unique_lock<std::mutex> lk(this->_decodedMu);
+        this->_decodedCV.wait (lk, [txt]() {
+            return (txt->_state != TileTexture::State::Decoding);
+        });
+        remove (this->_decoded);
+    }
+    remove (this->_pending);
+    txt->_state = TileTexture::State::Unloaded;
+    this->_numLoading--;
+}
+
+void TextureCache::_upload ()
+{
+    {
+        std::lock_guard<std::mutex> lk(this->_decodedMu);
+        for (auto &d : this->_decoded) {
+            this->_pending.push_back (std::move(d));
+        }
+        this->_decoded.clear();
+    }
+    if (this->_pending.empty()) {
+        return;
+    }
+
+  // upload the coarse levels first, since they are the fallbacks for the finer ones
+    std::stable_sort (this->_pending.begin(), this->_pending.end(),
+        [](Decoded const &a, Decoded const &b) { return a.txt->_level < b.txt->_level; });
+
+    auto start = std::chrono::steady_clock::now();
+    size_t nBytes = 0;
+    Batch batch{VK_NULL_HANDLE, VK_NULL_HANDLE, 0, {}};
+    size_t i = 0;
+    for (;  i < this->_pending.size();  i++) {
+        Decoded &d = this->_pending[i];
+        TileTexture *txt = d.txt;
+        if (! txt->_active) {
+          // the texture was released before it was uploaded, so we drop the image
+            delete d.cimg;
+            d.cimg = nullptr;
+            d.img.reset();
+            txt->_state = TileTexture::State::Unloaded;
+            this->_numLoading--;
+            continue;
+        }
+        if ((d.img == nullptr) && (d.cimg == nullptr)) {
+          // the worker could not load the image
+            this->_fail (txt);
+            continue;
+        }
+
+        const void *data = (d.cimg != nullptr) ? d.cimg->data() : d.img->data();
+        size_t sz = (d.cimg != nullptr) ? d.cimg->nBytes() : d.img->nBytes();
+
+      // check the per-frame limits; we always upload at least one image, so that
+      // the uploads make progress
+        if (nBytes > 0) {
+            std::chrono::duration<double, std::milli> elapsed =
+                std::chrono::steady_clock::now() - start;
+            if ((nBytes + sz > this->_maxFrameBytes) || (elapsed.count() >= this->_maxFrameMS)) {
+                break;
+            }
+        }
+
+        size_t offset;
+        if (sz > this->_ring->capacity()) {
+          // the image does not fit in the staging buffer, so we load it synchronously
+            this->_createTexture (txt, d.img.get(), d.cimg);
+        }
+        else if (this->_ring->alloc (sz, offset)) {
+            if (batch.cmdBuf == VK_NULL_HANDLE) {
+                batch.cmdBuf = this->_app->newCommandBuf();
+                this->_app->beginCommands (batch.cmdBuf);
+            }
+            memcpy (this->_staging->data() + offset, data, sz);
+            this->_recordTexture (batch.cmdBuf, txt, offset, d.img.get(), d.cimg);
+            batch.txts.push_back (txt);
+        }
+        else {
+          // the staging buffer is full until earlier batches complete
+            break;
+        }
+        this->_residentBytes += txt->_nBytes;
+        nBytes += sz;
+        delete d.cimg;
+        d.cimg = nullptr;
+        d.img.reset();
+    }
+    this->_pending.erase (this->_pending.begin(), this->_pending.begin() + i);
+
+    if (batch.cmdBuf != VK_NULL_HANDLE) {
+        this->_app->endCommands (batch.cmdBuf);
+
+        VkFenceCreateInfo fenceInfo{};
+        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        if (vkCreateFence(this->_app->device(), &fenceInfo, nullptr, &batch.fence) != VK_SUCCESS) {
+            ERROR("unable to create fence for texture uploads");
+        }
+        this->_app->submitCommands (batch.cmdBuf, batch.fence);
+        batch.mark = this->_ring->mark();
+        this->_batches.push_back (std::move(batch));
+    }
+
+}
+
+void TextureCache::_finishUploads (bool wait)
+{
+    auto device = this->_app->device();
+    while (! this->_batches.empty()) {
+        Batch &batch = this->_batches.front();
+        if (wait) {
+            vkWaitForFences (device, 1, &batch.fence, VK_TRUE, UINT64_MAX);
+        } else if (vkGetFenceStatus (device, batch.fence) != VK_SUCCESS) {
+            break;
+        }
+        for (auto txt : batch.txts) {
+            txt->_state = TileTexture::State::Ready;
+            this->_recordReady (txt);
+            if (! txt->_active) {
+              // the texture was released while it was being uploaded
+                this->_lruInsert (txt);
+            }
+        }
+        this->_ring->release (batch.mark);
+        this->_app->freeCommandBuf (batch.cmdBuf);
+        vkDestroyFence (device, batch.fence, nullptr);
+        this->_batches.pop_front();
+    }
 }
 
 /***** class TileTexture member functions *****/
@@ -88,9 +767,11 @@ TileTexture::TileTexture (
     tqt::TextureQTree *tree,
     int level, int row, int col,
     bool mipmaps)
-    : _txt(nullptr), _sampler(VK_NULL_HANDLE), _cache(cache), _tree(tree),
+    : _txt(nullptr), _array(nullptr), _pool(nullptr), _layer(0),
+      _sampler(VK_NULL_HANDLE), _cache(cache), _tree(tree),
       _level(level), _row(row), _col(col),
-      _lastUsed(0), _activeIdx(-1), _active(false), _mipmaps(mipmaps)
+      _lastUsed(0), _requested(0), _nBytes(0), _lruPrev(nullptr), _lruNext(nullptr),
+      _state(State::Unloaded), _active(false), _mipmaps(mipmaps)
 { }
 
 TileTexture::~TileTexture ()
@@ -98,35 +779,56 @@ TileTexture::~TileTexture ()
     if (this->_active) {
         this->release();
     }
-/* FIXME: remove from cache inactive list */
-    if (this->_txt != nullptr) {
-        vkDestroySampler(this->_cache->_app->device(), this->_sampler, nullptr);
-        delete this->_txt;
+    switch (this->_state) {
+      case State::Decoding:
+      case State::Decoded:
+        this->_cache->_cancel (this);
+        break;
+      case State::Uploading:
+      // this case is rare, so we just wait for the outstanding uploads, which
+      // makes the texture ready
+        this->_cache->_finishUploads (true);
+        break;
+      default:
+        break;
+    }
+    if (this->_isResident()) {
+      // the texture is on the LRU list; its resources are destroyed when the GPU is
+      // done with them
+        this->_cache->_lruRemove (this);
+        this->_cache->_retire (this);
     }
+    this->_cache->_textureTbl.erase (
+        TextureCache::Key(this->_tree, this->_level, this->_row, this->_col));
 }
 
 // preload the texture data into Vulkan; this operation is a hint to the texture
-// cache that the texture is going to be used soon.
+// cache that the texture is going to be used soon.  In streaming mode, the texture
+// is requested and becomes ready in a later frame.
 void TileTexture::activate ()
 {
     assert (! this->_active);
-    if (this->_txt == nullptr) {
-        // load the image data from the TQT and create a texture for it
-        cs237::Image2D *img = this->_tree->loadImage (this->_level, this->_row, this->_col);
-        this->_txt = new cs237::Texture2D (this->_cache->_app, img, this->_mipmaps);
-
-        // create the sampler for the texture
-        cs237::Application::SamplerInfo samplerInfo(
-            VK_FILTER_LINEAR,
-            VK_FILTER_LINEAR,
-            VK_SAMPLER_MIPMAP_MODE_LINEAR,
-            VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
-            VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
-            VK_BORDER_COLOR_INT_OPAQUE_BLACK);
-        this->_sampler = this->_cache->_app->createSampler (samplerInfo);
-    }
-
-    this->_cache->_makeActive (this);
+    TextureCache *cache = this->_cache;
+    bool loaded = false;
+    if (this->_state == State::Unloaded) {
+        cache->_curStats.misses++;
+        cache->_numLoading++;
+        this->_requested = cache->_clock;
+        if (cache->isStreaming()) {
+            cache->_request (this);
+        } else {
+            loaded = cache->_load (this);
+        }
+    } else if (this->_state == State::Ready) {
+        cache->_curStats.hits++;
+    } else if (this->_state == State::Failed) {
+        cache->_curStats.misses++;
+    } else {
+      // the texture was released and reactivated before its streamed load finished
+        cache->_curStats.pending++;
+    }
+
+    cache->_makeActive (this, loaded);
     this->_active = true;
 
 }
@@ -138,3 +840,28 @@ void TileTexture::release ()
     this->_cache->_release (this);
     this->_active = false;
 }
+
+TileTexture *TileTexture::fallback (glm::vec3 &xform)
+{
+    for (uint32_t d = 0;  d <= this->_level;  d++) {
+        int row = this->_row >> d;
+        int col = this->_col >> d;
+        TileTexture *txt = (d == 0)
+            ? this
+            : this->_cache->_find (this->_tree, this->_level - d, row, col);
+        if ((txt != nullptr) && txt->isReady()) {
+          // the position of this tile in the ancestor's tile; when the images are
+          // flipped, the first row is at the bottom of the texture
+            int dr = this->_row - (row << d);
+            int dc = this->_col - (col << d);
+            if (this->_tree->isFlipped()) {
+                dr = (1 << d) - 1 - dr;
+            }
+            float scale = 1.0f / float(1 << d);
+            xform = glm::vec3(scale, float(dc) * scale, float(dr) * scale);
+            return txt;
+        }
+    }
+
+    return nullptr;
+}
@@ -16,19 +16,93 @@
 
 #include "cs237.hpp"
 #include "tqt.hpp"
+#include "tile-image-cache.hpp"
+#include "upload-ring.hpp"
+#include "worker-pool.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
 #include <unordered_map>
 #include <vector>
 
 class TextureCache;
+struct TexturePool;
+
+//! Counters for tuning the texture cache.  The cache keeps the counts for the most
+//! recent frame and cumulative counts since it was created; the gauges (resident
+//! bytes, active and loading textures, and the occupancy by level) are sampled at the
+//! end of the frame in both cases.
+struct TextureCacheStats {
+    //! the number of buckets in the latency histogram
+    static constexpr int kLatencyBuckets = 16;
+
+    //! the number of TQT levels whose occupancy is tracked; deeper levels are
+    //! counted in the last one
+    static constexpr int kMaxLevels = 16;
+
+    uint64_t hits;              //!< activations of textures that were ready
+    uint64_t misses;            //!< activations of textures that had to be loaded (or
+                                //!< whose image could not be loaded)
+    uint64_t pending;           //!< activations of textures that were still being
+                                //!< streamed in from an earlier request
+    uint64_t evictions;         //!< textures evicted to stay within the budget
+    uint64_t uploads;           //!< textures uploaded to the GPU
+    uint64_t uploadBytes;       //!< bytes of image data uploaded to the GPU
+    double decodeMS;            //!< time spent reading and decoding tiles (summed over
+                                //!< the worker threads in streaming mode)
+    //! the number of textures that became ready i frames after they were requested
+    //! (bucket i); the last bucket also counts the longer latencies.  Without
+    //! streaming, the latency is always 0.
+    uint64_t latency[kLatencyBuckets];
+    size_t residentBytes;       //!< GPU memory used by the resident textures
+    uint64_t active;            //!< the number of active textures
+    uint64_t loading;           //!< requested textures that are not yet ready
+    uint32_t levels[kMaxLevels]; //!< the number of resident textures per TQT level
+
+    TextureCacheStats () { this->clear(); }
+
+    //! the number of activations
+    uint64_t activations () const { return this->hits + this->misses + this->pending; }
+
+    //! reset the stats to zero
+    void clear ();
+
+    //! add the counters of a frame to these stats and take the frame's gauges
+    void add (TextureCacheStats const &frame);
+
+    //! \brief write the stats as a single line of JSON
+    //! \param outS   the output stream
+    //! \param frame  the frame number that is included in the output
+    void writeJSON (std::ostream &outS, uint64_t frame) const;
+};
 
 //! A texture for a tile in the chunk quad treexs
 class TileTexture {
   public:
+    //! the loading state of a texture; in streaming mode, a texture goes through
+    //! the states in order after it is activated.  Otherwise, loading is synchronous
+    //! and only the Unloaded, Ready, and Failed states are used.
+    enum class State {
+        Unloaded,       //!< the texture is not resident and has not been requested
+        Decoding,       //!< a worker thread is loading the texture's image
+        Decoded,        //!< the image is waiting to be uploaded
+        Uploading,      //!< the upload has been submitted, but has not completed
+        Ready,          //!< the texture is resident and can be used by the shaders
+        Failed          //!< the image could not be loaded, so `fallback` uses an ancestor
+    };
+
     ~TileTexture ();
 
     //! is this texture active?
     bool isActive () const { return this->_active; }
 
+    //! the loading state of the texture
+    State state () const { return this->_state; }
+
+    //! can the texture be used by the shaders?
+    bool isReady () const { return (this->_state == State::Ready); }
+
     //! activate the texture; this operation is a hint to the texture
     //! cache that the texture is going to be used soon.
     void activate ();
@@ -36,20 +110,47 @@ class TileTexture {
     //! hint to the texture cache that this texture is not needed.
     void release ();
 
+    //! does this texture live in a layer of one of the cache's array textures?  This
+    //! is the case when the texture is active and the cache is in pool mode.
+    bool isPooled () const { return (this->_array != nullptr); }
+
+    //! the array layer that holds this texture (when it is pooled); the shaders use
+    //! this value to index the array texture that is bound by `getDescriptorInfo`
+    uint32_t layer () const { return this->_layer; }
+
+    //! \brief get the texture that should be used for this tile, which is the texture
+    //!        itself when it is ready.  Otherwise, it is the nearest ancestor in the
+    //!        quadtree that is ready, which lets a tile be drawn with a coarser image
+    //!        while its own image is streamed in.  The ancestors of the active textures
+    //!        should also be active, since inactive textures may be evicted.
+    //! \param[out] xform  the scale (x) and offset (y, z) that map this tile's texture
+    //!                    coordinates to the texture coordinates of the returned texture
+    //! \return the texture to use, or nullptr if neither this texture nor any of its
+    //!         ancestors are ready
+    TileTexture *fallback (glm::vec3 &xform);
+
     //! initialize the descriptor-info needed to update a descriptor for this
-    //! texture
+    //! texture.  For a pooled texture, the image view is the view of the whole
+    //! array texture, which is shared with the other textures in the array.  The
+    //! texture must be ready (in streaming mode, use `fallback` to pick the texture).
     void getDescriptorInfo (VkDescriptorImageInfo &info)
     {
         if (! this->isActive()) {
             this->activate();
         }
+        assert (this->isReady());
         info.sampler = this->_sampler;
-        info.imageView = this->_txt->view();
+        info.imageView = this->isPooled() ? this->_array->view() : this->_txt->view();
         info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
     }
 
   private:
-    cs237::Texture2D *_txt;     //!< the Vulkan texture (or nullptr, if not resident)
+    cs237::Texture2D *_txt;     //!< the Vulkan texture (or nullptr, if not resident
+                                //!< or pooled)
+    cs237::Texture2DArray *_array; //!< the array texture that holds this texture (or
+                                //!< nullptr, if not resident or not pooled)
+    TexturePool *_pool;         //!< the pool that _array belongs to
+    uint32_t _layer;            //!< the layer of _array that holds this texture
     VkSampler _sampler;         //!< the sampler for accessing the texture from the
                                 //!< shaders (when active)
     TextureCache *_cache;       //!< the cache that this texture belongs to
@@ -57,11 +158,20 @@ class TileTexture {
     uint32_t _level;            //!< the TQT level of this texture
     uint32_t _row;              //!< the TQT row of this texture
     uint32_t _col;              //!< the TQT column of this texture
-    uint32_t _lastUsed;         //!< the last frame that this texture was used
-    int _activeIdx;             //!< index of this texture in the cache's _active vector
+    uint64_t _lastUsed;         //!< the last frame that this texture was used
+    uint64_t _requested;        //!< the frame in which the texture was last loaded
+    size_t _nBytes;             //!< the GPU memory used by the texture when it is resident
+    TileTexture *_lruPrev;      //!< the next more-recently used texture in the cache's LRU
+                                //!< list of inactive textures
+    TileTexture *_lruNext;      //!< the next less-recently used texture in the cache's LRU
+                                //!< list of inactive textures
+    std::atomic<State> _state;  //!< the loading state of the texture
     bool _active;               //!< true when this texture is in use
     bool _mipmaps;              //!< should we generate mipmaps for the texture?
 
+    //! does this texture have GPU resources?
+    bool _isResident () const { return (this->_txt != nullptr) || (this->_array != nullptr); }
+
     TileTexture (
         TextureCache *cache,
         tqt::TextureQTree *tree,
@@ -69,17 +179,65 @@ class TileTexture {
         bool mipmaps);
 
     friend class TextureCache;
-    friend struct TxtCompare;
 };
 
-//! A cache of Vulkan textures that is backed by texture-quad-trees
+//! A cache of Vulkan textures that is backed by texture-quad-trees.  The GPU memory
+//! of the resident textures is limited by a byte budget.  Textures that have been
+//! released stay resident on an LRU list, so that they can be reactivated without
+//! reloading them, until the budget forces the cache to evict them.  Active textures
+//! are never evicted, so the budget is exceeded when the active textures alone do not
+//! fit in it.
+//!
+//! In pool mode, the cache allocates a few large 2D-array textures for each combination
+//! of tile size, format, and number of mipmap levels, and each resident tile texture
+//! occupies one layer of an array.  Loading a tile copies it into a free layer and
+//! evicting it returns the layer to the pool, so there is no per-tile allocation of
+//! Vulkan images, memory, views, or samplers.
+//!
+//! In streaming mode, activating a texture only requests it.  Worker threads read and
+//! decode the requested tiles, and once per frame (in `newFrame`) the decoded images
+//! are copied into a persistent staging buffer and uploaded in a single batch of
+//! commands, whose completion is tracked with a fence.  The number of bytes and the
+//! time spent per frame on uploads is limited; the rest is deferred to later frames.
+//! A texture is not ready until its batch has completed, so the renderer should use
+//! `TileTexture::fallback` to get the texture to draw a tile with.
 class TextureCache {
   public:
 
+    //! the default budget for GPU-resident textures
+    static constexpr size_t kDefaultBudget = (size_t(256) << 20);
+
+    //! \brief the number of frames after its eviction that the resources of a texture
+    //!        are kept alive, since the GPU may still be executing commands that use it
+    static constexpr uint64_t kRetireFrames = 3;
+
+    //! the target size of the array textures in pool mode
+    static constexpr size_t kPoolArrayBytes = (size_t(32) << 20);
+
+    //! the maximum number of layers in a pooled array texture, which is the smallest
+    //! value of `maxImageArrayLayers` that Vulkan allows
+    static constexpr uint32_t kMaxPoolLayers = 256;
+
+    //! the default size of the staging buffer in streaming mode
+    static constexpr size_t kDefaultStagingBytes = (size_t(32) << 20);
+
+    //! the default limit on the number of bytes uploaded per frame in streaming mode
+    static constexpr size_t kDefaultFrameBytes = (size_t(8) << 20);
+
+    //! the default limit on the time (in milliseconds) spent per frame on uploads in
+    //! streaming mode
+    static constexpr double kDefaultFrameMS = 2.0;
+
     //! TextureCache constructor
     //! \param app     the application
     //! \param mipmap  optional flag to request mipmaps for the textures when they are created.
-    TextureCache (cs237::Application *app, bool mipmap = false);
+    //! \param imageBudget  the budget in bytes for the cache of decoded tile images
+    //! \param budget  the budget in bytes for GPU-resident textures (0 means unlimited)
+    TextureCache (
+        cs237::Application *app,
+        bool mipmap = false,
+        size_t imageBudget = TileImageCache::kDefaultBudget,
+        size_t budget = kDefaultBudget);
     ~TextureCache ();
 
   //! \brief make a texture handle for the specified quad in the texture quad tree
@@ -91,13 +249,101 @@ class TextureCache {
     TileTexture *make (tqt::TextureQTree *tree, int level, int row, int col);
 
   //! mark the beginning of a new frame; the texture cache uses this information to
-  //! track LRU information
-    void newFrame () { this->_clock++; }
+  //! track LRU information and to free the resources of evicted textures once the GPU
+  //! is done with them
+    void newFrame ();
+
+  //! \brief set the budget for GPU-resident textures; inactive textures are evicted
+  //!        if the resident textures exceed the new budget
+  //! \param nBytes the budget in bytes; 0 means that the budget is unlimited.
+    void setBudget (size_t nBytes);
+
+  //! the budget for GPU-resident textures in bytes (0 means unlimited)
+    size_t budget () const { return this->_budget; }
+
+  //! the number of bytes of GPU memory used by the resident textures (active or not)
+    size_t residentBytes () const { return this->_residentBytes; }
+
+  //! the number of active textures
+    uint64_t numActive () const { return this->_numActive; }
+
+  //! the number of textures that have been evicted
+    uint64_t numEvictions () const { return this->_numEvictions; }
+
+  //! the stats for the most recent complete frame
+    TextureCacheStats const &frameStats () const { return this->_frameStats; }
+
+  //! the cumulative stats over all of the complete frames
+    TextureCacheStats const &totalStats () const { return this->_totalStats; }
+
+  //! \brief log the stats of every frame as JSON lines, which are written by `newFrame`
+  //! \param outS  the output stream for the log, or nullptr to stop logging
+    void logStats (std::ostream *outS) { this->_statsLog = outS; }
+
+  //! \brief enable or disable pool mode, in which the tile textures are stored in the
+  //!        layers of shared array textures.  The mode can only be changed when no
+  //!        textures are resident.
+  //! \param enable  true to enable pool mode
+    void usePool (bool enable);
+
+  //! is the cache in pool mode?
+    bool usesPool () const { return this->_usePool; }
+
+  //! the GPU memory allocated for the array textures of the pools, which includes the
+  //! free layers
+    size_t poolBytes () const;
+
+  //! \brief enable streaming mode, in which textures are loaded by worker threads and
+  //!        uploaded in batches.  Streaming can only be enabled when no textures are
+  //!        resident.
+  //! \param nWorkers       the number of worker threads (0 means one less than the
+  //!                       number of hardware threads)
+  //! \param stagingBytes   the size of the staging buffer; images that are larger than
+  //!                       the buffer are loaded synchronously
+  //! \param maxFrameBytes  the limit on the number of bytes uploaded per frame
+  //! \param maxFrameMS     the limit on the time (in milliseconds) spent per frame on
+  //!                       copying and recording uploads
+    void enableStreaming (
+        unsigned int nWorkers = 0,
+        size_t stagingBytes = kDefaultStagingBytes,
+        size_t maxFrameBytes = kDefaultFrameBytes,
+        double maxFrameMS = kDefaultFrameMS);
+
+  //! is the cache in streaming mode?
+    bool isStreaming () const { return (this->_workers != nullptr); }
+
+  //! \brief set the per-frame limits on uploads in streaming mode.  At least one
+  //!        texture is uploaded per frame when there are textures waiting.
+  //! \param maxFrameBytes  the limit on the number of bytes uploaded per frame
+  //! \param maxFrameMS     the limit on the time (in milliseconds) spent per frame
+    void setUploadLimits (size_t maxFrameBytes, double maxFrameMS);
+
+  //! the cache of decoded tile images that backs the GPU textures
+    TileImageCache &imageCache () { return this->_images; }
 
   private:
     cs237::Application *_app;   //!< application pointer
-    uint64_t _numActive;        //!< number of GPU resident textures
+    uint64_t _numActive;        //!< number of active textures
+    uint64_t _numEvictions;     //!< number of textures that have been evicted
     uint64_t _clock;            //!< counts number of frames
+    size_t _budget;             //!< budget for resident textures in bytes (0 == unlimited)
+    size_t _residentBytes;      //!< GPU memory used by the resident textures
+    TileTexture *_lruHead;      //!< the most recently released inactive resident texture
+    TileTexture *_lruTail;      //!< the least recently released inactive resident texture
+    bool _usePool;              //!< true if the textures are allocated from the pools
+    TileImageCache _images;     //!< decoded images for the uncompressed tiles
+    WorkerPool *_workers;       //!< the threads that decode tiles (streaming mode only)
+    cs237::StagingBuffer *_staging; //!< the staging buffer for uploads (streaming mode only)
+    UploadRing *_ring;          //!< allocator for _staging
+    size_t _maxFrameBytes;      //!< limit on the bytes uploaded per frame
+    double _maxFrameMS;         //!< limit on the time spent on uploads per frame
+    TextureCacheStats _curStats;        //!< the counters for the current frame
+    TextureCacheStats _frameStats;      //!< the stats of the previous frame
+    TextureCacheStats _totalStats;      //!< the cumulative stats
+    std::atomic<uint64_t> _decodeNS;    //!< decode time of the workers in the current frame
+    uint64_t _numLoading;               //!< requested textures that are not yet ready
+    uint32_t _levelCount[TextureCacheStats::kMaxLevels]; //!< resident textures per level
+    std::ostream *_statsLog;            //!< the stream for the per-frame stats (or nullptr)
 
     //! keys for hashing texture specifications
     struct Key {
@@ -130,26 +376,150 @@ class TextureCache {
         }
     };
 
-    // for ordering textures by timestamp
-    struct TxtCompare {
-        bool operator() (const TileTexture &lhs, const TileTexture &rhs) const
-        {
-            return (lhs._lastUsed > rhs._lastUsed);
-        }
+    typedef std::unordered_map<Key,TileTexture *,Hash,Equal> TextureTbl;
+
+    //! the Vulkan resources of an evicted texture, which are destroyed (or returned to
+    //! their pool) once the GPU can no longer be using them
+    struct Retired {
+        cs237::Texture2D *txt;  //!< the texture (nullptr for a pooled texture)
+        VkSampler sampler;      //!< the texture's sampler
+        TexturePool *pool;      //!< the pool of a pooled texture
+        cs237::Texture2DArray *array; //!< the array of a pooled texture
+        uint32_t layer;         //!< the array layer of a pooled texture
+        uint64_t frame;         //!< the frame in which the texture was evicted
     };
 
-    typedef std::unordered_map<Key,TileTexture *,Hash,Equal> TextureTbl;
+    //! a decoded image that is waiting to be uploaded
+    struct Decoded {
+        TileTexture *txt;               //!< the texture that the image is for
+        TileImageCache::ImagePtr img;   //!< the image of an uncompressed tile
+        cs237::CompressedImage2D *cimg; //!< the image of a compressed tile
+    };
+
+    //! a batch of uploads that was submitted with a single command buffer
+    struct Batch {
+        VkCommandBuffer cmdBuf;         //!< the command buffer
+        VkFence fence;                  //!< signaled when the commands have completed
+        uint64_t mark;                  //!< the ring mark for the batch's staging data
+        std::vector<TileTexture *> txts; //!< the textures in the batch
+    };
 
     TextureTbl _textureTbl;             //!< mapping from TQT spec to TileTexture
-    std::vector<TileTexture *> _active; //!< active textures
-    std::vector<TileTexture *> _inactive; //!< inactive textures that are loaded, but may be reused.
+    std::deque<Retired> _retired;       //!< evicted resources in order of eviction
+    std::vector<TexturePool *> _pools;  //!< the texture pools
+    std::mutex _decodedMu;              //!< protects _decoded and the Decoding state
+    std::condition_variable _decodedCV; //!< signaled when a worker has decoded an image
+    std::vector<Decoded> _decoded;      //!< images that the workers have decoded
+    std::vector<Decoded> _pending;      //!< images that are waiting to be uploaded
+    std::deque<Batch> _batches;         //!< submitted batches in order of submission
 
-    //! record that the given texture is now active
-    void _makeActive (TileTexture *txt);
+    //! \brief record that the given texture is now active
+    //! \param txt     the texture, which must be resident
+    //! \param loaded  true if the texture was just loaded; otherwise it was an inactive
+    //!                resident texture
+    void _makeActive (TileTexture *txt, bool loaded);
 
     //! record that the given texture is now inactive
     void _release (TileTexture *txt);
 
+    //! add an inactive resident texture to the front of the LRU list
+    void _lruInsert (TileTexture *txt);
+
+    //! remove an inactive resident texture from the LRU list
+    void _lruRemove (TileTexture *txt);
+
+    //! evict LRU inactive textures until the resident textures fit in the budget
+    void _evict ();
+
+    //! \brief take the Vulkan resources from a resident texture and add them to the
+    //!        retired list, which makes the texture non-resident
+    void _retire (TileTexture *txt);
+
+    //! destroy the resources of retired textures that the GPU has finished with
+    //! \param all  if true, destroy all of the retired resources
+    void _freeRetired (bool all);
+
+    //! \brief assign a free layer of a pooled array texture to a texture; a new array
+    //!        texture is allocated if the pool is full
+    //! \param txt      the texture, which must not be resident
+    //! \param wid      the width of the texture
+    //! \param ht       the height of the texture
+    //! \param fmt      the texel format of the texture
+    //! \param nLevels  the number of mipmap levels of the texture
+    void _allocLayer (
+        TileTexture *txt,
+        uint32_t wid, uint32_t ht, VkFormat fmt, uint32_t nLevels);
+
+    //! finish the stats for the current frame and log them
+    void _endFrameStats ();
+
+    //! record that a requested texture has become ready
+    void _recordReady (TileTexture *txt);
+
+    //! the index in the occupancy counts for a texture's level
+    static int _levelIdx (TileTexture const *txt)
+    {
+        return std::min(int(txt->_level), TextureCacheStats::kMaxLevels - 1);
+    }
+
+    //! find the texture for a tile, or return nullptr if there is not one
+    TileTexture *_find (tqt::TextureQTree *tree, int level, int row, int col) const;
+
+    //! \brief set the size of a texture for an image and, in pool mode, assign it a
+    //!        layer.  Exactly one of `img` and `cimg` is non-null.
+    void _allocate (
+        TileTexture *txt,
+        cs237::Image2D const *img,
+        cs237::CompressedImage2D const *cimg);
+
+    //! create the Vulkan texture for a tile from its image and wait for the upload
+    void _createTexture (
+        TileTexture *txt,
+        cs237::Image2D const *img,
+        cs237::CompressedImage2D const *cimg);
+
+    //! \brief create the Vulkan texture for a tile and record the commands to upload
+    //!        its image from the staging buffer
+    //! \param cmdBuf  the command buffer for the batch
+    //! \param txt     the texture
+    //! \param offset  the offset of the image data in the staging buffer
+    //! \param img     the image of an uncompressed tile (or nullptr)
+    //! \param cimg    the image of a compressed tile (or nullptr)
+    void _recordTexture (
+        VkCommandBuffer cmdBuf,
+        TileTexture *txt,
+        size_t offset,
+        cs237::Image2D const *img,
+        cs237::CompressedImage2D const *cimg);
+
+    //! load a texture synchronously
+    //! \return false if the texture's image could not be loaded
+    bool _load (TileTexture *txt);
+
+    //! mark a texture whose image could not be loaded as failed
+    void _fail (TileTexture *txt);
+
+    //! submit a request to load a texture to the worker threads
+    void _request (TileTexture *txt);
+
+    //! \brief load the image for a texture; this function runs in a worker thread.
+    //!        If the load fails, both images of the decoded entry are null.
+    //! \param txt         the texture
+    //! \param compressed  true if the texture is loaded from the compressed image
+    void _decode (TileTexture *txt, bool compressed);
+
+    //! wait for a texture's image to be decoded and then discard the image
+    void _cancel (TileTexture *txt);
+
+    //! record and submit a batch of uploads for the decoded images, subject to the
+    //! per-frame limits
+    void _upload ();
+
+    //! \brief make the textures of completed batches ready and release their staging
+    //!        space
+    //! \param wait  if true, wait for all of the batches to complete
+    void _finishUploads (bool wait);
+
     friend class TileTexture;
 };
 
@@ -0,0 +1,108 @@
+/*! \file tile-image-cache.cpp
+ *
+ * \author John Reppy
+ */
+
+/* CMSC23700 Final Project sample code (Autumn 2022)
+ *
+ * COPYRIGHT (c) 2022 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#include "tile-image-cache.hpp"
+
+TileImageCache::TileImageCache (size_t budget)
+  : _budget(budget), _bytes(0), _hits(0), _misses(0), _evictions(0)
+{ }
+
+TileImageCache::ImagePtr TileImageCache::get (
+    tqt::TextureQTree const *tree, int level, int row, int col)
+{
+    Key key{
+        tree->id(),
+        (uint64_t(level) << 48) | (uint64_t(row) << 24) | uint64_t(col)
+    };
+
+    {
+        std::lock_guard<std::mutex> lk(this->_mu);
+        auto it = this->_tbl.find(key);
+        if (it != this->_tbl.end()) {
+          // move the entry to the front of the LRU list
+            this->_lru.splice (this->_lru.begin(), this->_lru, it->second);
+            this->_hits.fetch_add (1, std::memory_order_relaxed);
+            return it->second->img;
+        }
+    }
+
+  // load the image without holding the lock, so that other threads can use the
+  // cache in the meantime
+    this->_misses.fetch_add (1, std::memory_order_relaxed);
+    ImagePtr img(tree->loadImage (level, row, col));
+    if ((img == nullptr) || (img->nBytes() > this->budget())) {
+        return img;
+    }
+
+    std::lock_guard<std::mutex> lk(this->_mu);
+    auto it = this->_tbl.find(key);
+    if (it != this->_tbl.end()) {
+      // another thread loaded the same tile while we were loading it
+        this->_lru.splice (this->_lru.begin(), this->_lru, it->second);
+        return it->second->img;
+    }
+    this->_lru.push_front (Entry{key, img});
+    this->_tbl.emplace (key, this->_lru.begin());
+    this->_bytes.fetch_add (img->nBytes(), std::memory_order_relaxed);
+    this->_evict ();
+
+    return img;
+
+}
+
+void TileImageCache::purge (tqt::TextureQTree const *tree)
+{
+    uint64_t id = tree->id();
+    std::lock_guard<std::mutex> lk(this->_mu);
+    for (auto it = this->_lru.begin();  it != this->_lru.end(); ) {
+        auto next = std::next(it);
+        if (it->key.tree == id) {
+            this->_remove (it);
+        }
+        it = next;
+    }
+}
+
+void TileImageCache::clear ()
+{
+    std::lock_guard<std::mutex> lk(this->_mu);
+    this->_tbl.clear ();
+    this->_lru.clear ();
+    this->_bytes.store (0, std::memory_order_relaxed);
+}
+
+void TileImageCache::setBudget (size_t budget)
+{
+    std::lock_guard<std::mutex> lk(this->_mu);
+    this->_budget.store (budget, std::memory_order_relaxed);
+    this->_evict ();
+}
+
+size_t TileImageCache::size () const
+{
+    std::lock_guard<std::mutex> lk(this->_mu);
+    return this->_tbl.size();
+}
+
+void TileImageCache::_evict ()
+{
+    while (! this->_lru.empty() && (this->bytes() > this->budget())) {
+        this->_remove (std::prev(this->_lru.end()));
+        this->_evictions.fetch_add (1, std::memory_order_relaxed);
+    }
+}
+
+void TileImageCache::_remove (LRUList::iterator it)
+{
+    this->_bytes.fetch_sub (it->img->nBytes(), std::memory_order_relaxed);
+    this->_tbl.erase (it->key);
+    this->_lru.erase (it);
+}
@@ -0,0 +1,126 @@
+/*! \file tile-image-cache.hpp
+ *
+ * \author John Reppy
+ *
+ * A CPU-side cache of decoded texture-quadtree tiles, which sits between the
+ * texture quadtrees and the GPU texture cache.
+ */
+
+/* CMSC23700 Final Project sample code (Autumn 2022)
+ *
+ * COPYRIGHT (c) 2022 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#ifndef _TILE_IMAGE_CACHE_HPP_
+#define _TILE_IMAGE_CACHE_HPP_
+
+#include "cs237.hpp"
+#include "tqt.hpp"
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+//! A cache of decoded tile images that is bounded by the number of bytes of image
+//! data.  When the GPU texture cache evicts a tile and later needs it again, the
+//! image comes from this cache instead of being read and decoded again.  Images are
+//! evicted in least-recently-used order.
+//!
+//! The cache can be shared by the texture quadtrees of all of the cells and it is
+//! safe to call from multiple threads.  Tiles are identified by the tree's ID (see
+//! `tqt::TextureQTree::id`), so tiles of a tree that has been deleted are never
+//! returned for a new tree; they just age out of the cache.
+class TileImageCache {
+  public:
+
+    //! the default budget in bytes
+    static constexpr size_t kDefaultBudget = size_t(128) << 20;
+
+    //! a shared reference to a cached image; the image stays valid while there is
+    //! a reference to it, even if it is evicted from the cache
+    using ImagePtr = std::shared_ptr<const cs237::Image2D>;
+
+    //! create a cache
+    //! \param budget  the maximum number of bytes of image data in the cache
+    explicit TileImageCache (size_t budget = kDefaultBudget);
+
+    ~TileImageCache () { }
+
+    //! \brief get the decoded image for a tile; on a miss, the image is loaded from
+    //!        the tree (without holding the cache's lock) and added to the cache.
+    //! \param tree   the texture quadtree
+    //! \param level  the level of the tile in the tree
+    //! \param row    the row of the tile
+    //! \param col    the column of the tile
+    //! \return the image, or nullptr if it could not be loaded
+    ImagePtr get (tqt::TextureQTree const *tree, int level, int row, int col);
+
+    //! remove all of the images of a tree from the cache
+    void purge (tqt::TextureQTree const *tree);
+
+    //! remove all of the images from the cache
+    void clear ();
+
+    //! set the budget; images are evicted if the cache is over the new budget
+    void setBudget (size_t budget);
+
+    //! the budget in bytes
+    size_t budget () const { return this->_budget.load(std::memory_order_relaxed); }
+    //! the number of bytes of image data in the cache
+    size_t bytes () const { return this->_bytes.load(std::memory_order_relaxed); }
+    //! the number of images in the cache
+    size_t size () const;
+    //! the number of requests that were satisfied by the cache
+    uint64_t hits () const { return this->_hits.load(std::memory_order_relaxed); }
+    //! the number of requests that required loading the image
+    uint64_t misses () const { return this->_misses.load(std::memory_order_relaxed); }
+    //! the number of images that have been evicted to stay within the budget
+    uint64_t evictions () const { return this->_evictions.load(std::memory_order_relaxed); }
+
+  private:
+    //! the key for a tile
+    struct Key {
+        uint64_t tree;          //!< the tree's ID
+        uint64_t node;          //!< the level, row, and column packed into 64 bits
+
+        bool operator== (Key const &other) const
+        {
+            return (this->tree == other.tree) && (this->node == other.node);
+        }
+    };
+    //! hashing keys
+    struct Hash {
+        std::size_t operator() (Key const &k) const
+        {
+            return std::hash<uint64_t>()(k.tree * 0x9E3779B97F4A7C15ull ^ k.node);
+        }
+    };
+    //! an entry in the LRU list
+    struct Entry {
+        Key key;
+        ImagePtr img;
+    };
+    //! the LRU list; the most recently used image is at the front
+    using LRUList = std::list<Entry>;
+
+    mutable std::mutex _mu;     //!< protects _lru and _tbl
+    LRUList _lru;               //!< the cached images in LRU order
+    std::unordered_map<Key, LRUList::iterator, Hash> _tbl;
+                                //!< map from keys to the entries in _lru
+    std::atomic<size_t> _budget; //!< the budget in bytes
+    std::atomic<size_t> _bytes; //!< the number of bytes in the cache
+    std::atomic<uint64_t> _hits; //!< the number of hits
+    std::atomic<uint64_t> _misses; //!< the number of misses
+    std::atomic<uint64_t> _evictions; //!< the number of evicted images
+
+    //! evict images until the cache is within the budget; the lock must be held
+    void _evict ();
+
+    //! remove an entry; the lock must be held
+    void _remove (LRUList::iterator it);
+
+};
+
+#endif // !_TILE_IMAGE_CACHE_HPP_
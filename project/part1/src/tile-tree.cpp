@@ -0,0 +1,109 @@
+/*! \file tile-tree.cpp
+ *
+ * \author John Reppy
+ */
+
+/* CMSC23700 Final Project sample code (Autumn 2022)
+ *
+ * COPYRIGHT (c) 2022 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#include "tile-tree.hpp"
+#include "map-cell.hpp"
+#include <algorithm>
+
+TileTree::TileTree (Cell *cell)
+    : _origin(cell->_map->nwCellCorner(cell->row(), cell->col()))
+{
+    uint32_t n = qtree::fullSize(cell->depth());
+
+    this->_minX.resize(n);
+    this->_minY.resize(n);
+    this->_minZ.resize(n);
+    this->_maxX.resize(n);
+    this->_maxY.resize(n);
+    this->_maxZ.resize(n);
+    this->_maxErr.resize(n);
+    this->_firstChild.resize(n);
+    this->_tileId.resize(n);
+
+    this->_setNode (cell, 0, 0);
+    uint32_t next = this->_layout (cell, 0, 0, 0, 1);
+    assert (next == n);
+
+}
+
+void TileTree::_setNode (Cell *cell, uint32_t node, uint32_t id)
+{
+    Tile const &tile = cell->tile(id);
+    glm::vec3 lo(tile.bBox()._min - this->_origin);
+    glm::vec3 hi(tile.bBox()._max - this->_origin);
+    this->_minX[node] = lo.x;
+    this->_minY[node] = lo.y;
+    this->_minZ[node] = lo.z;
+    this->_maxX[node] = hi.x;
+    this->_maxY[node] = hi.y;
+    this->_maxZ[node] = hi.z;
+    this->_maxErr[node] = tile.maxError();
+    this->_firstChild[node] = kNoChildren;
+    this->_tileId[node] = id;
+}
+
+// allocate a group for the children of the tile at `node`, fill it in, and then lay
+// out the children's subtrees in order.  Returns the next free node index.
+uint32_t TileTree::_layout (Cell *cell, uint32_t node, uint32_t id, uint32_t lod, uint32_t next)
+{
+    if (lod + 1 >= uint32_t(cell->depth())) {
+        return next;
+    }
+
+    uint32_t group = next;
+    uint32_t kid = qtree::nwChild(id);
+    this->_firstChild[node] = group;
+    for (uint32_t i = 0;  i < 4;  i++) {
+        this->_setNode (cell, group + i, kid + i);
+    }
+    next += 4;
+    for (uint32_t i = 0;  i < 4;  i++) {
+        next = this->_layout (cell, group + i, kid + i, lod + 1, next);
+    }
+
+    return next;
+
+}
+
+void TileTree::selectFrontier (
+    glm::dvec3 const &eye, float errorFactor, float tolerance,
+    std::vector<uint32_t> &frontier) const
+{
+  // we work in single precision relative to the cell's corner
+    glm::vec3 pt(eye - this->_origin);
+
+  // explicit stack of nodes to visit; the depth is bounded by the number of LODs, so
+  // the stack never holds more than 3*kMaxLODs+1 nodes
+    uint32_t stk[3 * Cell::kMaxLODs + 1];
+    int sp = 0;
+    stk[sp++] = 0;
+    while (sp > 0) {
+        uint32_t node = stk[--sp];
+        uint32_t kids = this->_firstChild[node];
+        if (kids != kNoChildren) {
+            float dx = std::max(std::max(this->_minX[node] - pt.x, pt.x - this->_maxX[node]), 0.0f);
+            float dy = std::max(std::max(this->_minY[node] - pt.y, pt.y - this->_maxY[node]), 0.0f);
+            float dz = std::max(std::max(this->_minZ[node] - pt.z, pt.z - this->_maxZ[node]), 0.0f);
+            float dist = sqrtf(dx*dx + dy*dy + dz*dz);
+            if (errorFactor * this->_maxErr[node] > tolerance * dist) {
+              // push the children in reverse order, so that they are visited in NW, NE,
+              // SE, SW order, which is also their memory order
+                stk[sp++] = kids + 3;
+                stk[sp++] = kids + 2;
+                stk[sp++] = kids + 1;
+                stk[sp++] = kids;
+                continue;
+            }
+        }
+        frontier.push_back (this->_tileId[node]);
+    }
+
+}
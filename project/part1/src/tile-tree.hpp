@@ -0,0 +1,102 @@
+/*! \file tile-tree.hpp
+ *
+ * \author John Reppy
+ *
+ * A compact, cache-friendly copy of the data in a cell's tile quadtree that is needed
+ * to select the mesh frontier.
+ */
+
+/* CMSC23700 Final Project sample code (Autumn 2022)
+ *
+ * COPYRIGHT (c) 2022 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#ifndef _TILE_TREE_HPP_
+#define _TILE_TREE_HPP_
+
+#include "cs237.hpp"
+#include <vector>
+
+class Cell;
+
+//! The traversal data for a cell's tile quadtree in structure-of-arrays form.
+//!
+//! The `Tile` objects of a cell are large (most of their bytes are mesh and loading
+//! state) and are stored in breadth-first order, so walking a subtree touches a new
+//! cache line for almost every tile.  A TileTree holds just the data that frontier
+//! selection needs: the tile's bounding box (in single precision and relative to the
+//! cell's NW corner), its chunk's maximum geometric error, and the index of its first
+//! child.  The nodes are stored in depth-first order of sibling groups: the four
+//! children of a node are adjacent, and the groups of a subtree are contiguous, so a
+//! traversal reads the arrays mostly sequentially.
+//!
+//! Node indices are *not* tile IDs; use `tileId` to map a node back to its `Tile`.
+class TileTree {
+  public:
+
+    //! build the traversal tree for a cell; the cell's tiles must be loaded
+    explicit TileTree (Cell *cell);
+
+    ~TileTree () { }
+
+    //! the number of nodes in the tree
+    uint32_t size () const { return static_cast<uint32_t>(this->_maxErr.size()); }
+
+    //! the world-space origin (the cell's NW corner) of the node bounding boxes
+    glm::dvec3 const &origin () const { return this->_origin; }
+
+    //! the index of the first of a node's four children (kNoChildren for a leaf);
+    //! the other children follow it in NW, NE, SE, SW order
+    uint32_t firstChild (uint32_t node) const { return this->_firstChild[node]; }
+
+    //! the maximum geometric error of a node's chunk
+    float maxError (uint32_t node) const { return this->_maxErr[node]; }
+
+    //! the bounding box of a node relative to origin()
+    cs237::AABBf bBox (uint32_t node) const
+    {
+        return cs237::AABBf(
+            glm::vec3(this->_minX[node], this->_minY[node], this->_minZ[node]),
+            glm::vec3(this->_maxX[node], this->_maxY[node], this->_maxZ[node]));
+    }
+
+    //! the ID of the tile that corresponds to a node
+    uint32_t tileId (uint32_t node) const { return this->_tileId[node]; }
+
+    //! \brief select the tiles whose screen-space error is within a tolerance.
+    //!
+    //! A node is refined when `errorFactor * maxError / dist > tolerance`, where `dist`
+    //! is the distance from the eye to the node's bounding box.  This function does not
+    //! look at chunk residency; the renderer should check `Tile::isResident` for the
+    //! selected tiles.
+    //! \param eye          the eye position in world coordinates
+    //! \param errorFactor  the camera's error factor (viewport width / (2 tan(fov/2)))
+    //! \param tolerance    the screen-space error tolerance in pixels
+    //! \param[out] frontier the IDs of the selected tiles are appended to this vector
+    void selectFrontier (
+        glm::dvec3 const &eye, float errorFactor, float tolerance,
+        std::vector<uint32_t> &frontier) const;
+
+    //! node index used to mark leaves
+    static const uint32_t kNoChildren = 0;
+
+  private:
+    glm::dvec3 _origin;                 //!< the NW corner of the cell in world space
+  // hot per-node data
+    std::vector<float> _minX, _minY, _minZ;
+    std::vector<float> _maxX, _maxY, _maxZ;
+    std::vector<float> _maxErr;
+    std::vector<uint32_t> _firstChild;
+  // cold per-node data
+    std::vector<uint32_t> _tileId;
+
+    //! copy the data for a tile into a node
+    void _setNode (Cell *cell, uint32_t node, uint32_t id);
+
+    //! lay out the descendants of a tile that has been placed at the given node
+    uint32_t _layout (Cell *cell, uint32_t node, uint32_t id, uint32_t lod, uint32_t next);
+
+};
+
+#endif // !_TILE_TREE_HPP_
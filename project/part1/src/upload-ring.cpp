@@ -0,0 +1,55 @@
+/*! \file upload-ring.cpp
+ *
+ * \author John Reppy
+ */
+
+/* CMSC23700 Final Project sample code (Autumn 2022)
+ *
+ * COPYRIGHT (c) 2022 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#include "upload-ring.hpp"
+#include <cassert>
+
+UploadRing::UploadRing (size_t capacity)
+  : _capacity(capacity), _head(0), _tail(0)
+{
+    assert ((capacity > 0) && (capacity % kAlign == 0));
+}
+
+bool UploadRing::alloc (size_t nBytes, size_t &offset)
+{
+    if (nBytes > this->_capacity) {
+        return false;
+    }
+
+    uint64_t pos = (this->_head + kAlign - 1) & ~uint64_t(kAlign - 1);
+    size_t off = static_cast<size_t>(pos % this->_capacity);
+    if (off + nBytes > this->_capacity) {
+      // skip the space at the end of the buffer
+        pos += this->_capacity - off;
+        off = 0;
+    }
+    if (pos + nBytes - this->_tail > this->_capacity) {
+        return false;
+    }
+
+    this->_head = pos + nBytes;
+    offset = off;
+    return true;
+
+}
+
+void UploadRing::release (uint64_t m)
+{
+    assert ((this->_tail <= m) && (m <= this->_head));
+    if (m == this->_head) {
+      // the ring is empty, so we restart at the beginning of the buffer; otherwise an
+      // allocation that does not fit between the head and the end of the buffer, or
+      // between the start of the buffer and the head, could never be satisfied
+        this->_head = this->_tail = 0;
+    } else {
+        this->_tail = m;
+    }
+}
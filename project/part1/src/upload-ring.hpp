@@ -0,0 +1,71 @@
+/*! \file upload-ring.hpp
+ *
+ * \author John Reppy
+ *
+ * Allocation of space in a fixed-size staging buffer for data that is uploaded to
+ * the GPU in batches.
+ */
+
+/* CMSC23700 Final Project sample code (Autumn 2022)
+ *
+ * COPYRIGHT (c) 2022 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#ifndef _UPLOAD_RING_HPP_
+#define _UPLOAD_RING_HPP_
+
+#include <cstddef>
+#include <cstdint>
+
+//! A ring allocator for a staging buffer.  Space is allocated at the head of the
+//! ring and is released from the tail in the same order, which matches the way that
+//! batches of uploads are submitted and completed.  The head and tail are counters
+//! that increase, so a position in the buffer is the counter modulo the size of the
+//! ring.  An allocation never wraps around the end of the buffer; instead, the space
+//! at the end is skipped.  When the ring becomes empty, the head and tail are reset
+//! to the start of the buffer, so that any allocation that fits in the buffer can
+//! be satisfied by an empty ring.
+class UploadRing {
+  public:
+
+    //! the alignment of the allocations, which is enough for the texel blocks of
+    //! the compressed formats
+    static constexpr size_t kAlign = 16;
+
+    //! \brief create a ring allocator
+    //! \param capacity  the size of the staging buffer in bytes; it must be a multiple
+    //!                  of kAlign
+    explicit UploadRing (size_t capacity);
+
+    //! the size of the staging buffer in bytes
+    size_t capacity () const { return this->_capacity; }
+
+    //! the number of bytes that are allocated (including skipped space)
+    size_t used () const { return static_cast<size_t>(this->_head - this->_tail); }
+
+    //! \brief allocate space at the head of the ring
+    //! \param nBytes       the number of bytes to allocate
+    //! \param[out] offset  the offset of the allocation in the staging buffer
+    //! \return true if the space was allocated, or false if there is not enough free
+    //!         space until more space is released
+    bool alloc (size_t nBytes, size_t &offset);
+
+    //! \brief a mark for the current head of the ring, which is passed to `release`
+    //!        to free the space that has been allocated before the mark
+    uint64_t mark () const { return this->_head; }
+
+    //! \brief release the space that was allocated before the mark
+    //! \param m  a mark that was returned by `mark`; marks must be released in the
+    //!           order that they were made.  Releasing the current head empties the
+    //!           ring, which makes any other outstanding marks invalid.
+    void release (uint64_t m);
+
+  private:
+    size_t _capacity;           //!< size of the buffer
+    uint64_t _head;             //!< the position of the next allocation
+    uint64_t _tail;             //!< the position of the oldest allocated byte
+
+};
+
+#endif // !_UPLOAD_RING_HPP_
@@ -9,10 +9,24 @@
  */
 
 #include "vao.hpp"
+#include "chunk-strips.hpp"
 
-VAO::VAO (cs237::Application *app, struct Chunk const &chunk)
+// create the index buffer for a chunk
+static cs237::IndexBuffer *indexBuffer (
+    cs237::Application *app, struct Chunk const &chunk, bool asList)
+{
+    if (asList) {
+        std::vector<uint16_t> list = strips::toList(chunk.indices, chunk.nIndices);
+        return new cs237::IndexBuffer(
+            app, static_cast<uint32_t>(list.size()), VK_INDEX_TYPE_UINT16, list.data());
+    } else {
+        return new cs237::IndexBuffer(app, chunk.nIndices, VK_INDEX_TYPE_UINT16, chunk.indices);
+    }
+}
+
+VAO::VAO (cs237::Application *app, struct Chunk const &chunk, bool asList)
   : _vBuf(new cs237::VertexBuffer(app, chunk.vSize(), chunk.vertices)),
-    _iBuf(new cs237::IndexBuffer(app, chunk.nIndices, VK_INDEX_TYPE_UINT16, chunk.indices))
+    _iBuf(indexBuffer(app, chunk, asList))
 { }
 
 VAO::~VAO ()
@@ -20,7 +20,13 @@ struct VAO {
     cs237::VertexBuffer *_vBuf; //!< the vertex buffer
     cs237::IndexBuffer *_iBuf;  //!< the index buffer
 
-    VAO (cs237::Application *_app, struct Chunk const &chunk);
+    //! create the vertex and index buffers for a chunk
+    //! \param app     the application
+    //! \param chunk   the chunk; its mesh data must be resident
+    //! \param asList  if true, the chunk's triangle strips are converted to a triangle
+    //!                list; the pipeline must then use the TRIANGLE_LIST topology without
+    //!                primitive restart
+    VAO (cs237::Application *app, struct Chunk const &chunk, bool asList = false);
     ~VAO ();
 
     uint32_t nIndices () const { return this->_iBuf->nIndices(); }
@@ -29,8 +29,17 @@ Window::Window (Project *app, cs237::CreateWindowInfo const &info, Map *map)
             double(map->hScale()) * double(map->height())));
 
     // Place the viewer in the center of cell(0,0), just above the
-    // cell's bounding box.
-    cs237::AABBd bb = map->cell(0,0)->tile(0).bBox();
+    // cell's bounding box.  When the map is streamed, the cell has not been
+    // loaded yet, so we use the map's elevation range instead.
+    cs237::AABBd bb;
+    if (map->cell(0,0)->isReady()) {
+        bb = map->cell(0,0)->tile(0).bBox();
+    } else {
+        glm::dvec3 nw = map->nwCellCorner(0, 0);
+        bb = cs237::AABBd(
+            glm::dvec3(nw.x, double(map->minElevation()), nw.z),
+            nw + map->cellSize() + glm::dvec3(0.0, double(map->maxElevation()), 0.0));
+    }
     glm::dvec3 pos = bb.center();
     pos.y = bb.maxY() + 0.01 * (bb.maxX() - bb.minX());
 
@@ -58,14 +67,14 @@ Window::Window (Project *app, cs237::CreateWindowInfo const &info, Map *map)
 
     // initialize the Vulkan resources for the map cells
     std::clog << "initializing textures" << std::endl;
-    for (int r = 0;  r < map->nRows(); r++) {
-        for (int c = 0;  c < map->nCols();  c++) {
-            Cell *cell = map->cell(r, c);
-            if (map->hasObjects()) {
-                cell->loadObjects();
-            }
-            cell->initTextures (this);
+    for (Cell *cell : map->cells()) {
+        if (! cell->isReady()) {
+            continue;  // streamed cells are initialized by Map::updateStreaming
+        }
+        if (map->hasObjects()) {
+            cell->loadObjects();
         }
+        cell->initTextures (this);
     }
 
     /***** Vulkan initialization *****/
@@ -0,0 +1,85 @@
+/*! \file worker-pool.cpp
+ *
+ * \author John Reppy
+ *
+ * A simple pool of worker threads for background loading.
+ */
+
+/* CMSC23700 Final Project sample code (Autumn 2022)
+ *
+ * COPYRIGHT (c) 2022 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#include "worker-pool.hpp"
+
+WorkerPool::WorkerPool (unsigned int nThreads)
+    : _nBusy(0), _shutdown(false)
+{
+    if (nThreads == 0) {
+        unsigned int hw = std::thread::hardware_concurrency();
+        nThreads = (hw > 1) ? hw - 1 : 1;
+    }
+
+    this->_threads.reserve (nThreads);
+    for (unsigned int i = 0;  i < nThreads;  i++) {
+        this->_threads.emplace_back (&WorkerPool::_worker, this);
+    }
+
+}
+
+WorkerPool::~WorkerPool ()
+{
+    {
+        std::lock_guard<std::mutex> lk(this->_mu);
+        this->_shutdown = true;
+        this->_queue.clear();
+    }
+    this->_workCV.notify_all();
+    for (auto &t : this->_threads) {
+        t.join();
+    }
+}
+
+void WorkerPool::submit (std::function<void()> task)
+{
+    {
+        std::lock_guard<std::mutex> lk(this->_mu);
+        this->_queue.push_back (std::move(task));
+    }
+    this->_workCV.notify_one();
+}
+
+void WorkerPool::wait ()
+{
+    std::unique_lock<std::mutex> lk(this->_mu);
+    this->_idleCV.wait (lk, [this] {
+        return this->_queue.empty() && (this->_nBusy == 0);
+    });
+}
+
+void WorkerPool::_worker ()
+{
+    std::unique_lock<std::mutex> lk(this->_mu);
+    while (true) {
+        this->_workCV.wait (lk, [this] {
+            return this->_shutdown || !this->_queue.empty();
+        });
+        if (this->_shutdown) {
+            return;
+        }
+        std::function<void()> task = std::move(this->_queue.front());
+        this->_queue.pop_front();
+        this->_nBusy++;
+        lk.unlock();
+
+        task();
+
+        lk.lock();
+        this->_nBusy--;
+        if (this->_queue.empty() && (this->_nBusy == 0)) {
+            this->_idleCV.notify_all();
+        }
+    }
+
+}
@@ -0,0 +1,66 @@
+/*! \file worker-pool.hpp
+ *
+ * \author John Reppy
+ *
+ * A simple pool of worker threads for background loading.
+ */
+
+/* CMSC23700 Final Project sample code (Autumn 2022)
+ *
+ * COPYRIGHT (c) 2022 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#ifndef _WORKER_POOL_HPP_
+#define _WORKER_POOL_HPP_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//! A fixed-size pool of threads that execute tasks in FIFO order.  Tasks are
+//! responsible for publishing their own results (e.g., using an atomic flag), so
+//! the pool itself does not provide futures.
+class WorkerPool {
+  public:
+
+    //! create a pool of worker threads
+    //! \param nThreads the number of threads; if 0, then the number of threads is
+    //!        one less than the number of hardware threads (but at least one).
+    explicit WorkerPool (unsigned int nThreads = 0);
+
+    //! the destructor discards any tasks that have not started and then waits for
+    //! the running tasks to finish
+    ~WorkerPool ();
+
+    //! the number of worker threads
+    unsigned int numThreads () const { return this->_threads.size(); }
+
+    //! add a task to the end of the queue
+    void submit (std::function<void()> task);
+
+    //! wait until the queue is empty and all of the workers are idle
+    void wait ();
+
+  private:
+    std::vector<std::thread> _threads;          //!< the worker threads
+    std::deque<std::function<void()>> _queue;   //!< pending tasks
+    std::mutex _mu;                             //!< lock for the queue and counters
+    std::condition_variable _workCV;            //!< signaled when work arrives or at shutdown
+    std::condition_variable _idleCV;            //!< signaled when a worker becomes idle
+    unsigned int _nBusy;                        //!< number of workers running a task
+    bool _shutdown;                             //!< set when the pool is being destroyed
+
+    //! the main loop of a worker thread
+    void _worker ();
+
+    // pools are not copyable
+    WorkerPool (WorkerPool const &) = delete;
+    WorkerPool &operator= (WorkerPool const &) = delete;
+
+};
+
+#endif // !_WORKER_POOL_HPP_
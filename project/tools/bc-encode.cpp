@@ -0,0 +1,290 @@
+/*! \file bc-encode.cpp
+ *
+ * \author John Reppy
+ *
+ * A CPU encoder for the BC1, BC3, and BC5 block-compressed texture formats.
+ */
+
+/* CMSC23700 Final Project sample code (Autumn 2022)
+ *
+ * COPYRIGHT (c) 2022 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#include "bc-encode.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace bcenc {
+
+/***** BC1 *****/
+
+// the number of least-squares refinement passes for BC1 endpoints
+static constexpr int kRefinePasses = 2;
+
+// the weight of the first endpoint for the four-color palette entries
+static const float kWeights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+
+// the weighted average (wa*a + wb*b) / (wa + wb), rounded to nearest; this must
+// match the decoder
+inline int lerp (int a, int b, int wa, int wb)
+{
+    int w = wa + wb;
+    return (wa * a + wb * b + w / 2) / w;
+}
+
+// convert an RGB color in [0..255] to RGB565
+inline uint16_t to565 (float r, float g, float b)
+{
+    int ri = std::clamp(int(std::lround(r * (31.0f / 255.0f))), 0, 31);
+    int gi = std::clamp(int(std::lround(g * (63.0f / 255.0f))), 0, 63);
+    int bi = std::clamp(int(std::lround(b * (31.0f / 255.0f))), 0, 31);
+    return static_cast<uint16_t>((ri << 11) | (gi << 5) | bi);
+}
+
+// expand an RGB565 color to 8-bit components
+inline void from565 (uint16_t c, int rgb[3])
+{
+    int r = c >> 11, g = (c >> 5) & 0x3f, b = c & 0x1f;
+    rgb[0] = (r << 3) | (r >> 2);
+    rgb[1] = (g << 2) | (g >> 4);
+    rgb[2] = (b << 3) | (b >> 2);
+}
+
+// choose the best palette index for each pixel given the endpoints; returns the
+// total squared error
+static int chooseIndices (
+    const uint8_t rgba[16][4], uint16_t c0, uint16_t c1, uint8_t idx[16])
+{
+    int pal[4][3];
+    from565 (c0, pal[0]);
+    from565 (c1, pal[1]);
+    for (int i = 0;  i < 3;  i++) {
+        pal[2][i] = lerp(pal[0][i], pal[1][i], 2, 1);
+        pal[3][i] = lerp(pal[0][i], pal[1][i], 1, 2);
+    }
+
+    int err = 0;
+    for (int p = 0;  p < 16;  p++) {
+        int best = 0, bestErr = INT32_MAX;
+        for (int k = 0;  k < 4;  k++) {
+            int dr = int(rgba[p][0]) - pal[k][0];
+            int dg = int(rgba[p][1]) - pal[k][1];
+            int db = int(rgba[p][2]) - pal[k][2];
+            int e = dr*dr + dg*dg + db*db;
+            if (e < bestErr) {
+                best = k;
+                bestErr = e;
+            }
+        }
+        idx[p] = static_cast<uint8_t>(best);
+        err += bestErr;
+    }
+    return err;
+}
+
+// least-squares fit of the endpoints to the pixels for fixed palette indices; returns
+// false if the system is singular (i.e., all pixels use the same weight)
+static bool refitEndpoints (
+    const uint8_t rgba[16][4], const uint8_t idx[16], uint16_t &c0, uint16_t &c1)
+{
+  // minimize sum_p |w_p*e0 + (1-w_p)*e1 - x_p|^2
+    float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+    float ax[3] = {0.0f, 0.0f, 0.0f}, bx[3] = {0.0f, 0.0f, 0.0f};
+    for (int p = 0;  p < 16;  p++) {
+        float a = kWeights[idx[p]], b = 1.0f - a;
+        aa += a * a;
+        ab += a * b;
+        bb += b * b;
+        for (int i = 0;  i < 3;  i++) {
+            ax[i] += a * float(rgba[p][i]);
+            bx[i] += b * float(rgba[p][i]);
+        }
+    }
+    float det = aa * bb - ab * ab;
+    if (std::fabs(det) < 1.0e-6f) {
+        return false;
+    }
+    float e0[3], e1[3];
+    for (int i = 0;  i < 3;  i++) {
+        e0[i] = (bb * ax[i] - ab * bx[i]) / det;
+        e1[i] = (aa * bx[i] - ab * ax[i]) / det;
+    }
+    c0 = to565 (e0[0], e0[1], e0[2]);
+    c1 = to565 (e1[0], e1[1], e1[2]);
+    return true;
+}
+
+void encodeBC1 (const uint8_t rgba[16][4], uint8_t blk[8])
+{
+  // compute the principal axis of the colors using power iteration on the covariance
+  // matrix
+    float mean[3] = {0.0f, 0.0f, 0.0f};
+    for (int p = 0;  p < 16;  p++) {
+        for (int i = 0;  i < 3;  i++) {
+            mean[i] += float(rgba[p][i]);
+        }
+    }
+    for (int i = 0;  i < 3;  i++) {
+        mean[i] /= 16.0f;
+    }
+    float cov[6] = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+    for (int p = 0;  p < 16;  p++) {
+        float r = float(rgba[p][0]) - mean[0];
+        float g = float(rgba[p][1]) - mean[1];
+        float b = float(rgba[p][2]) - mean[2];
+        cov[0] += r*r;  cov[1] += r*g;  cov[2] += r*b;
+        cov[3] += g*g;  cov[4] += g*b;  cov[5] += b*b;
+    }
+    float axis[3] = {0.577f, 0.577f, 0.577f};
+    for (int iter = 0;  iter < 8;  iter++) {
+        float x = cov[0]*axis[0] + cov[1]*axis[1] + cov[2]*axis[2];
+        float y = cov[1]*axis[0] + cov[3]*axis[1] + cov[4]*axis[2];
+        float z = cov[2]*axis[0] + cov[4]*axis[1] + cov[5]*axis[2];
+        float len = std::max(std::fabs(x), std::max(std::fabs(y), std::fabs(z)));
+        if (len < 1.0e-6f) {
+            break;
+        }
+        axis[0] = x / len;  axis[1] = y / len;  axis[2] = z / len;
+    }
+
+  // the initial endpoints are the extreme colors along the axis
+    int minP = 0, maxP = 0;
+    float minD = 1.0e30f, maxD = -1.0e30f;
+    for (int p = 0;  p < 16;  p++) {
+        float d = float(rgba[p][0]) * axis[0] + float(rgba[p][1]) * axis[1]
+            + float(rgba[p][2]) * axis[2];
+        if (d < minD) { minD = d; minP = p; }
+        if (d > maxD) { maxD = d; maxP = p; }
+    }
+    uint16_t c0 = to565 (rgba[maxP][0], rgba[maxP][1], rgba[maxP][2]);
+    uint16_t c1 = to565 (rgba[minP][0], rgba[minP][1], rgba[minP][2]);
+    uint8_t idx[16];
+    int err = chooseIndices (rgba, c0, c1, idx);
+
+  // refine the endpoints
+    for (int pass = 0;  (pass < kRefinePasses) && (err > 0);  pass++) {
+        uint16_t n0, n1;
+        uint8_t nIdx[16];
+        if (! refitEndpoints (rgba, idx, n0, n1)) {
+            break;
+        }
+        int nErr = chooseIndices (rgba, n0, n1, nIdx);
+        if (nErr >= err) {
+            break;
+        }
+        c0 = n0;
+        c1 = n1;
+        err = nErr;
+        std::memcpy (idx, nIdx, 16);
+    }
+
+  // four-color mode requires that c0 > c1
+    if (c0 < c1) {
+        std::swap (c0, c1);
+        for (int p = 0;  p < 16;  p++) {
+            idx[p] ^= 1;
+        }
+    } else if (c0 == c1) {
+        std::memset (idx, 0, 16);
+    }
+
+    blk[0] = static_cast<uint8_t>(c0);
+    blk[1] = static_cast<uint8_t>(c0 >> 8);
+    blk[2] = static_cast<uint8_t>(c1);
+    blk[3] = static_cast<uint8_t>(c1 >> 8);
+    for (int r = 0;  r < 4;  r++) {
+        blk[4 + r] = static_cast<uint8_t>(
+            idx[4*r] | (idx[4*r + 1] << 2) | (idx[4*r + 2] << 4) | (idx[4*r + 3] << 6));
+    }
+}
+
+/***** BC4 *****/
+
+void encodeBC4 (const uint8_t vals[16], uint8_t blk[8])
+{
+    int lo = 255, hi = 0;
+    for (int p = 0;  p < 16;  p++) {
+        lo = std::min(lo, int(vals[p]));
+        hi = std::max(hi, int(vals[p]));
+    }
+
+  // use the eight-value mode, which requires that e0 > e1; if all of the values are
+  // the same, then every index is zero
+    uint64_t bits = 0;
+    if (hi > lo) {
+        int pal[8];
+        pal[0] = hi;
+        pal[1] = lo;
+        for (int i = 1;  i < 7;  i++) {
+            pal[i+1] = lerp(hi, lo, 7 - i, i);
+        }
+        for (int p = 0;  p < 16;  p++) {
+            int best = 0, bestErr = INT32_MAX;
+            for (int k = 0;  k < 8;  k++) {
+                int e = std::abs(int(vals[p]) - pal[k]);
+                if (e < bestErr) {
+                    best = k;
+                    bestErr = e;
+                }
+            }
+            bits |= uint64_t(best) << (3 * p);
+        }
+    }
+
+    blk[0] = static_cast<uint8_t>(hi);
+    blk[1] = static_cast<uint8_t>(lo);
+    for (int i = 0;  i < 6;  i++) {
+        blk[2 + i] = static_cast<uint8_t>(bits >> (8 * i));
+    }
+}
+
+/***** Images *****/
+
+void encodeImage (
+    tqt::Format fmt, uint32_t wid, uint32_t ht, const uint8_t *rgba, uint8_t *blocks)
+{
+    uint8_t pixels[16][4];
+    uint8_t chan[16];
+    for (uint32_t by = 0;  by < ht;  by += 4) {
+        for (uint32_t bx = 0;  bx < wid;  bx += 4) {
+          // gather the block, clamping to the edge of the image
+            for (uint32_t r = 0;  r < 4;  r++) {
+                uint32_t y = std::min(by + r, ht - 1);
+                for (uint32_t c = 0;  c < 4;  c++) {
+                    uint32_t x = std::min(bx + c, wid - 1);
+                    std::memcpy (pixels[4*r + c], rgba + 4 * (size_t(y) * wid + x), 4);
+                }
+            }
+            switch (fmt) {
+            case tqt::Format::BC1:
+                encodeBC1 (pixels, blocks);
+                blocks += 8;
+                break;
+            case tqt::Format::BC3:
+                for (int p = 0;  p < 16;  p++) {
+                    chan[p] = pixels[p][3];
+                }
+                encodeBC4 (chan, blocks);
+                encodeBC1 (pixels, blocks + 8);
+                blocks += 16;
+                break;
+            case tqt::Format::BC5:
+                for (int i = 0;  i < 2;  i++) {
+                    for (int p = 0;  p < 16;  p++) {
+                        chan[p] = pixels[p][i];
+                    }
+                    encodeBC4 (chan, blocks + 8*i);
+                }
+                blocks += 16;
+                break;
+            default:
+                std::cerr << "bcenc::encodeImage: unsupported format\n";
+                exit (1);
+            }
+        }
+    }
+}
+
+} // namespace bcenc
@@ -0,0 +1,48 @@
+/*! \file bc-encode.hpp
+ *
+ * \author John Reppy
+ *
+ * A CPU encoder for the BC1, BC3, and BC5 block-compressed texture formats.  The
+ * encoder favors simplicity over speed and quality; it is only meant for the offline
+ * conversion of texture quadtrees.
+ */
+
+/* CMSC23700 Final Project sample code (Autumn 2022)
+ *
+ * COPYRIGHT (c) 2022 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#ifndef _BC_ENCODE_HPP_
+#define _BC_ENCODE_HPP_
+
+#include "tqt.hpp"
+#include <cstdint>
+
+namespace bcenc {
+
+  //! \brief encode a 4x4 block of RGBA pixels as a BC1 block.  The block is always
+  //!        encoded in four-color mode, so alpha is ignored.
+  //! \param rgba     the pixels in row-major order
+  //! \param[out] blk the 8-byte compressed block
+    void encodeBC1 (const uint8_t rgba[16][4], uint8_t blk[8]);
+
+  //! \brief encode a 4x4 block of single-channel values as a BC4 block
+  //! \param vals     the values in row-major order
+  //! \param[out] blk the 8-byte compressed block
+    void encodeBC4 (const uint8_t vals[16], uint8_t blk[8]);
+
+  //! \brief encode an image as a row-major array of blocks.  Blocks that extend past
+  //!        the edge of the image are padded by replicating the edge pixels.
+  //! \param fmt      the block format (BC1, BC3, or BC5)
+  //! \param wid      the width of the image in pixels
+  //! \param ht       the height of the image in pixels
+  //! \param rgba     the RGBA8 pixels in row-major order; for BC5, the red and green
+  //!                 channels hold the X and Y components of the normal vectors
+  //! \param[out] blocks  the compressed blocks
+    void encodeImage (
+        tqt::Format fmt, uint32_t wid, uint32_t ht, const uint8_t *rgba, uint8_t *blocks);
+
+} // namespace bcenc
+
+#endif // !_BC_ENCODE_HPP_
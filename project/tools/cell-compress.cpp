@@ -0,0 +1,110 @@
+/*! \file cell-compress.cpp
+ *
+ * \author John Reppy
+ *
+ * A tool for converting "hf.cell" files between the uncompressed and compressed
+ * representations of the chunk data.
+ *
+ * usage: cell-compress [-d] <file> ...
+ */
+
+/* CMSC23700 Final Project sample code (Autumn 2022)
+ *
+ * COPYRIGHT (c) 2022 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#include "cell-file.hpp"
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <sys/stat.h>
+
+static void usage (int sts)
+{
+    std::cerr << "usage: cell-compress [-d] <file> ...\n";
+    std::cerr << "options:\n";
+    std::cerr << "  -d        decompress the files\n";
+    exit (sts);
+}
+
+static size_t fileSize (std::string const &file)
+{
+    struct stat st;
+    if (stat(file.c_str(), &st) < 0) {
+        return 0;
+    }
+    return static_cast<size_t>(st.st_size);
+}
+
+// convert a file in place; we write the result to a temporary file and check that
+// it has the same data as the original before replacing the original.
+static bool convert (std::string const &file, bool compress)
+{
+    CellFile src;
+    if (! src.read(file)) {
+        return false;
+    }
+    if (src.compressed == compress) {
+        std::cout << file << ": already " << (compress ? "compressed" : "uncompressed") << "\n";
+        return true;
+    }
+
+    std::string tmpFile = file + ".tmp";
+    if (! src.write(tmpFile, compress)) {
+        std::remove (tmpFile.c_str());
+        return false;
+    }
+
+  // verify the result
+    CellFile dst;
+    if (! dst.read(tmpFile) || ! src.sameData(dst)) {
+        std::cerr << file << ": verification of converted data failed\n";
+        std::remove (tmpFile.c_str());
+        return false;
+    }
+
+    size_t oldSize = fileSize(file);
+    size_t newSize = fileSize(tmpFile);
+    if (std::rename(tmpFile.c_str(), file.c_str()) != 0) {
+        std::cerr << file << ": unable to replace file\n";
+        std::remove (tmpFile.c_str());
+        return false;
+    }
+
+    std::cout << file << ": " << oldSize << " -> " << newSize << " bytes";
+    if (newSize > 0) {
+        std::cout << " (ratio " << double(oldSize) / double(newSize) << ")";
+    }
+    std::cout << "\n";
+
+    return true;
+
+}
+
+int main (int argc, char *argv[])
+{
+    bool compress = true;
+    int i = 1;
+    for (;  (i < argc) && (argv[i][0] == '-');  i++) {
+        if (strcmp(argv[i], "-d") == 0) {
+            compress = false;
+        } else if (strcmp(argv[i], "-h") == 0) {
+            usage (EXIT_SUCCESS);
+        } else {
+            usage (EXIT_FAILURE);
+        }
+    }
+    if (i == argc) {
+        usage (EXIT_FAILURE);
+    }
+
+    int sts = EXIT_SUCCESS;
+    for (;  i < argc;  i++) {
+        if (! convert (argv[i], compress)) {
+            sts = EXIT_FAILURE;
+        }
+    }
+
+    return sts;
+}
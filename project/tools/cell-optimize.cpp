@@ -0,0 +1,204 @@
+/*! \file cell-optimize.cpp
+ *
+ * \author John Reppy
+ *
+ * A tool that optimizes the chunk meshes in "hf.cell" files for the GPU.  The
+ * triangles of each chunk are reordered for post-transform vertex cache reuse and
+ * then the vertices are renumbered into first-use order, so that vertex fetches are
+ * sequential.  The tool reports the average cache miss ratio (ACMR) and the number
+ * of indices per LOD before and after optimization.
+ *
+ * Since the chunks are stored as triangle strips, the reordered triangles have to be
+ * converted back to strips, which usually takes more indices than the original strips.
+ * By default, the reordered triangles are only kept when they improve the ACMR without
+ * increasing the number of indices.
+ *
+ * usage: cell-optimize [-n] [-f] <file> ...
+ */
+
+/* CMSC23700 Final Project sample code (Autumn 2022)
+ *
+ * COPYRIGHT (c) 2022 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#include "cell-file.hpp"
+#include "mesh-opt.hpp"
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+
+static void usage (int sts)
+{
+    std::cerr << "usage: cell-optimize [-n] [-f] <file> ...\n";
+    std::cerr << "options:\n";
+    std::cerr << "  -n        report the ACMR, but do not modify the files\n";
+    std::cerr << "  -f        keep reordered triangles even if they need more indices\n";
+    exit (sts);
+}
+
+using Triangle = std::array<uint16_t, 3>;
+
+// get the triangles of a chunk in terms of the given vertex numbering, with each
+// triangle rotated so that its smallest vertex is first (which preserves its winding)
+static std::vector<Triangle> canonicalTris (
+    std::vector<uint16_t> const &strip, std::vector<uint16_t> const *newToOld)
+{
+    std::vector<uint16_t> indices = strips::toList(strip);
+    std::vector<Triangle> tris;
+    tris.reserve (indices.size() / 3);
+    for (size_t i = 0;  i + 2 < indices.size();  i += 3) {
+        Triangle t;
+        for (int k = 0;  k < 3;  k++) {
+            t[k] = (newToOld != nullptr) ? (*newToOld)[indices[i+k]] : indices[i+k];
+        }
+        std::rotate (t.begin(), std::min_element(t.begin(), t.end()), t.end());
+        tris.push_back (t);
+    }
+    std::sort (tris.begin(), tris.end());
+    return tris;
+}
+
+// optimize a chunk in place; returns false if the optimized chunk does not describe
+// the same mesh as the original.  The reordered flag is set if the chunk's triangles
+// were reordered.
+static bool optimizeChunk (CellFile::ChunkData &chunk, bool force, bool &reordered)
+{
+    std::vector<HFVertex> oldVerts = chunk.verts;
+    std::vector<uint16_t> oldIndices = chunk.indices;
+    uint32_t nVerts = static_cast<uint32_t>(chunk.verts.size());
+
+    std::vector<uint16_t> list = strips::toList(chunk.indices);
+    meshopt::optimizeVertexCache (list, nVerts);
+    std::vector<uint16_t> strip = strips::fromList(list);
+    reordered = force
+        || ((meshopt::acmr(strip, nVerts) < meshopt::acmr(chunk.indices, nVerts))
+            && (strip.size() <= chunk.indices.size()));
+    if (reordered) {
+        chunk.indices.swap (strip);
+    }
+
+    std::vector<uint16_t> oldToNew = meshopt::optimizeVertexFetch (chunk.verts, chunk.indices);
+
+  // check that the new chunk has the same vertices and triangles as the old one
+    std::vector<uint16_t> newToOld(nVerts);
+    for (uint32_t v = 0;  v < nVerts;  v++) {
+        newToOld[oldToNew[v]] = v;
+        if (std::memcmp(&chunk.verts[oldToNew[v]], &oldVerts[v], sizeof(HFVertex)) != 0) {
+            return false;
+        }
+    }
+    return (canonicalTris(oldIndices, nullptr) == canonicalTris(chunk.indices, &newToOld));
+
+}
+
+// optimize a file in place; we write the result to a temporary file and check that it
+// has the same data as the optimized cell before replacing the original.
+static bool optimize (std::string const &file, bool update, bool force)
+{
+    CellFile cell;
+    if (! cell.read(file)) {
+        return false;
+    }
+
+  // per-LOD statistics
+    std::vector<double> nTris(cell.nLODs, 0.0), before(cell.nLODs, 0.0), after(cell.nLODs, 0.0);
+    std::vector<size_t> nIndicesBefore(cell.nLODs, 0), nIndicesAfter(cell.nLODs, 0);
+    std::vector<uint32_t> nChunks(cell.nLODs, 0), nReordered(cell.nLODs, 0);
+    uint32_t lod = 0;
+    for (uint32_t id = 0;  id < cell.chunks.size();  id++) {
+        if (id == qtree::fullSize(lod + 1)) {
+            lod++;
+        }
+        CellFile::ChunkData &chunk = cell.chunks[id];
+        uint32_t nVerts = static_cast<uint32_t>(chunk.verts.size());
+        double n = double(strips::toList(chunk.indices).size() / 3);
+        nTris[lod] += n;
+        before[lod] += n * meshopt::acmr(chunk.indices, nVerts);
+        nIndicesBefore[lod] += chunk.indices.size();
+        bool reordered;
+        if (! optimizeChunk (chunk, force, reordered)) {
+            std::cerr << file << ": optimization of chunk " << id << " changed the mesh\n";
+            return false;
+        }
+        after[lod] += n * meshopt::acmr(chunk.indices, nVerts);
+        nIndicesAfter[lod] += chunk.indices.size();
+        nChunks[lod]++;
+        if (reordered) {
+            nReordered[lod]++;
+        }
+    }
+
+    std::cout << file << ": ACMR (FIFO cache of " << meshopt::kCacheSize
+        << " vertices) and number of indices\n";
+    std::cout << std::fixed << std::setprecision(3);
+    for (lod = 0;  lod < cell.nLODs;  lod++) {
+        if (nTris[lod] > 0.0) {
+            std::cout << "  LOD " << lod << ": ACMR " << before[lod] / nTris[lod]
+                << " -> " << after[lod] / nTris[lod] << ", indices "
+                << nIndicesBefore[lod] << " -> " << nIndicesAfter[lod] << ", "
+                << nReordered[lod] << "/" << nChunks[lod] << " chunks reordered\n";
+        }
+    }
+    std::cout.unsetf (std::ios::floatfield);
+
+    if (! update) {
+        return true;
+    }
+
+    std::string tmpFile = file + ".tmp";
+    if (! cell.write(tmpFile, cell.compressed)) {
+        std::remove (tmpFile.c_str());
+        return false;
+    }
+
+  // verify the result
+    CellFile dst;
+    if (! dst.read(tmpFile) || ! cell.sameData(dst)) {
+        std::cerr << file << ": verification of optimized data failed\n";
+        std::remove (tmpFile.c_str());
+        return false;
+    }
+
+    if (std::rename(tmpFile.c_str(), file.c_str()) != 0) {
+        std::cerr << file << ": unable to replace file\n";
+        std::remove (tmpFile.c_str());
+        return false;
+    }
+
+    return true;
+
+}
+
+int main (int argc, char *argv[])
+{
+    bool update = true;
+    bool force = false;
+    int i = 1;
+    for (;  (i < argc) && (argv[i][0] == '-');  i++) {
+        if (strcmp(argv[i], "-n") == 0) {
+            update = false;
+        } else if (strcmp(argv[i], "-f") == 0) {
+            force = true;
+        } else if (strcmp(argv[i], "-h") == 0) {
+            usage (EXIT_SUCCESS);
+        } else {
+            usage (EXIT_FAILURE);
+        }
+    }
+    if (i == argc) {
+        usage (EXIT_FAILURE);
+    }
+
+    int sts = EXIT_SUCCESS;
+    for (;  i < argc;  i++) {
+        if (! optimize (argv[i], update, force)) {
+            sts = EXIT_FAILURE;
+        }
+    }
+
+    return sts;
+}
@@ -0,0 +1,191 @@
+/*! \file cell-repack.cpp
+ *
+ * \author John Reppy
+ *
+ * A tool for converting the "hf.cell" files of a map between the version 1 and
+ * version 2 layouts.  Version 2 files store precomputed per-tile metadata (including
+ * the tile bounding boxes) up front, so the tool needs the map's scales from the
+ * "map.json" file.
+ *
+ * usage: cell-repack [-v1] [-c | -u] <map-dir> ...
+ */
+
+/* CMSC23700 Final Project sample code (Autumn 2022)
+ *
+ * COPYRIGHT (c) 2022 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#include "cell-file.hpp"
+#include "json.hpp"
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <sys/stat.h>
+
+static void usage (int sts)
+{
+    std::cerr << "usage: cell-repack [-v1] [-c | -u] <map-dir> ...\n";
+    std::cerr << "options:\n";
+    std::cerr << "  -v1       convert the cells back to the version 1 layout\n";
+    std::cerr << "  -c        compress the chunk data\n";
+    std::cerr << "  -u        do not compress the chunk data\n";
+    exit (sts);
+}
+
+static size_t fileSize (std::string const &file)
+{
+    struct stat st;
+    if (stat(file.c_str(), &st) < 0) {
+        return 0;
+    }
+    return static_cast<size_t>(st.st_size);
+}
+
+//! the information from the map.json file that we need to repack the cells
+struct MapInfo {
+    float hScale;
+    float vScale;
+    float baseElev;
+    std::vector<std::string> cells;     //!< the cell directory names
+};
+
+static bool getScale (std::string const &file, const json::Object *root, const char *name, float &out)
+{
+    const json::Number *num = root->fieldAsNumber(name);
+    if (num == nullptr) {
+        std::cerr << file << ": missing/bogus " << name << " field\n";
+        return false;
+    }
+    out = static_cast<float>(num->realVal());
+    return true;
+}
+
+// get the scales and cell names from the map's "map.json" file.  We convert the
+// scales to float in the same way that Map::load does, since the bounding boxes
+// must match the ones that the renderer would compute.
+static bool readMapInfo (std::string const &dir, MapInfo &info)
+{
+    std::string file = dir + "/map.json";
+    json::Value *map = json::parseFile(file);
+    const json::Object *root = (map != nullptr) ? map->asObject() : nullptr;
+    if (root == nullptr) {
+        std::cerr << file << ": unable to read map description\n";
+        delete map;
+        return false;
+    }
+
+    bool ok = getScale(file, root, "h-scale", info.hScale)
+        && getScale(file, root, "v-scale", info.vScale);
+
+    info.baseElev = 0.0f;
+    if (ok && ((*root)["base-elev"] != nullptr)) {
+        ok = getScale(file, root, "base-elev", info.baseElev);
+    }
+
+    const json::Array *grid = ok ? root->fieldAsArray("grid") : nullptr;
+    if (ok && (grid == nullptr)) {
+        std::cerr << file << ": missing/bogus grid field\n";
+        ok = false;
+    }
+    for (int i = 0;  ok && (i < grid->length());  i++) {
+        const json::String *s = (*grid)[i]->asString();
+        if (s == nullptr) {
+            std::cerr << file << ": bogus grid item\n";
+            ok = false;
+        } else {
+            info.cells.push_back (s->value());
+        }
+    }
+
+    delete map;
+    return ok;
+
+}
+
+// convert a cell file in place; we write the result to a temporary file and check
+// that it has the same data as the original before replacing the original.
+// The compress argument is -1 to preserve the file's representation, 0 to
+// decompress, and 1 to compress.
+static bool repack (std::string const &file, MapInfo const &info, uint32_t version, int compress)
+{
+    CellFile src;
+    if (! src.read(file)) {
+        return false;
+    }
+
+    bool dstCompressed = (compress < 0) ? src.compressed : (compress != 0);
+    CellFile out = src;
+    out.version = version;
+    out.hScale = info.hScale;
+    out.vScale = info.vScale;
+    out.baseElev = info.baseElev;
+
+    std::string tmpFile = file + ".tmp";
+    if (! out.write(tmpFile, dstCompressed)) {
+        std::remove (tmpFile.c_str());
+        return false;
+    }
+
+  // verify the result
+    CellFile dst;
+    if (! dst.read(tmpFile) || (dst.version != version) || ! src.sameData(dst)) {
+        std::cerr << file << ": verification of repacked data failed\n";
+        std::remove (tmpFile.c_str());
+        return false;
+    }
+
+    size_t oldSize = fileSize(file);
+    size_t newSize = fileSize(tmpFile);
+    if (std::rename(tmpFile.c_str(), file.c_str()) != 0) {
+        std::cerr << file << ": unable to replace file\n";
+        std::remove (tmpFile.c_str());
+        return false;
+    }
+
+    std::cout << file << ": v" << src.version << " -> v" << version << ", "
+        << oldSize << " -> " << newSize << " bytes\n";
+
+    return true;
+
+}
+
+int main (int argc, char *argv[])
+{
+    uint32_t version = 2;
+    int compress = -1;
+    int i = 1;
+    for (;  (i < argc) && (argv[i][0] == '-');  i++) {
+        if (strcmp(argv[i], "-v1") == 0) {
+            version = 1;
+        } else if (strcmp(argv[i], "-c") == 0) {
+            compress = 1;
+        } else if (strcmp(argv[i], "-u") == 0) {
+            compress = 0;
+        } else if (strcmp(argv[i], "-h") == 0) {
+            usage (EXIT_SUCCESS);
+        } else {
+            usage (EXIT_FAILURE);
+        }
+    }
+    if (i == argc) {
+        usage (EXIT_FAILURE);
+    }
+
+    int sts = EXIT_SUCCESS;
+    for (;  i < argc;  i++) {
+        std::string dir = argv[i];
+        MapInfo info;
+        if (! readMapInfo (dir, info)) {
+            sts = EXIT_FAILURE;
+            continue;
+        }
+        for (auto const &cell : info.cells) {
+            if (! repack (dir + "/" + cell + "/hf.cell", info, version, compress)) {
+                sts = EXIT_FAILURE;
+            }
+        }
+    }
+
+    return sts;
+}
@@ -0,0 +1,172 @@
+/*! \file chunk-budget-check.cpp
+ *
+ * \author John Reppy
+ *
+ * A check that the chunk budget bounds the memory that the process actually uses.
+ * It loads a map, touches every chunk with an unlimited budget, and then lowers the
+ * budget and touches the chunks again, checking that
+ *
+ *   - the resident chunk bytes stay within the budget;
+ *   - the resident set size (RSS) of the process drops by the bytes that eviction
+ *     released, and it does not grow by more than the budget when the chunks are
+ *     touched again.
+ *
+ * The RSS is read from /proc/self/statm, so the check only runs on Linux.
+ *
+ * usage: chunk-budget-check [-mmap] <map-dir> [<budget-KB>]
+ */
+
+/* CMSC23700 Final Project sample code (Autumn 2022)
+ *
+ * COPYRIGHT (c) 2022 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#include "map.hpp"
+#include "map-cell.hpp"
+#include "qtree-util.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <unistd.h>
+
+constexpr size_t kSlack = size_t(256) << 10;    //!< allowance for RSS changes that are
+                                                //!  not caused by the chunk data
+
+static void usage (int sts)
+{
+    std::cerr << "usage: chunk-budget-check [-mmap] <map-dir> [<budget-KB>]\n";
+    exit (sts);
+}
+
+// the resident set size of the process in bytes (0 if it is not available)
+static size_t rss ()
+{
+    FILE *f = fopen ("/proc/self/statm", "r");
+    if (f == nullptr) {
+        return 0;
+    }
+    unsigned long size, resident;
+    int n = fscanf (f, "%lu %lu", &size, &resident);
+    fclose (f);
+    if (n != 2) {
+        return 0;
+    }
+    return size_t(resident) * size_t(sysconf(_SC_PAGESIZE));
+}
+
+// touch the chunks of all of the loaded cells and return the largest value of
+// residentChunkBytes seen after a touch
+static size_t touchAll (Map &map)
+{
+    size_t maxResident = 0;
+    for (auto cell : map.cells()) {
+        if ((cell == nullptr) || ! cell->isLoaded()) {
+            continue;
+        }
+        uint32_t nTiles = qtree::fullSize(cell->depth());
+        for (uint32_t id = 0;  id < nTiles;  id++) {
+            cell->tile(id).chunk();
+            maxResident = std::max(maxResident, map.residentChunkBytes());
+        }
+    }
+    return maxResident;
+}
+
+// report a failed check
+static int check (bool ok, const char *what, size_t a, size_t b)
+{
+    if (! ok) {
+        std::cerr << "FAILED: " << what << " (" << a << " vs. " << b << ")\n";
+        return 1;
+    }
+    return 0;
+}
+
+int main (int argc, char *argv[])
+{
+    bool useMMap = false;
+    int i = 1;
+    for (;  (i < argc) && (argv[i][0] == '-');  i++) {
+        if (strcmp(argv[i], "-mmap") == 0) {
+            useMMap = true;
+        } else if (strcmp(argv[i], "-h") == 0) {
+            usage (EXIT_SUCCESS);
+        } else {
+            usage (EXIT_FAILURE);
+        }
+    }
+    if ((i == argc) || (argc - i > 2)) {
+        usage (EXIT_FAILURE);
+    }
+    std::string dir = argv[i];
+    long budgetKB = (i + 1 < argc) ? atol(argv[i+1]) : 0;
+    if (budgetKB < 0) {
+        usage (EXIT_FAILURE);
+    }
+
+    if (rss() == 0) {
+        std::cerr << "chunk-budget-check: RSS is not available on this system\n";
+        return EXIT_SUCCESS;
+    }
+
+    Map map(nullptr);
+    map.useMMap (useMMap);
+    map.setChunkBudget (0);
+    if (! map.load (dir, false)) {
+        return EXIT_FAILURE;
+    }
+
+  // load all of the chunks
+    size_t rss0 = rss();
+    touchAll (map);
+    size_t full = map.residentChunkBytes();
+    size_t rss1 = rss();
+    if (full == 0) {
+        std::cerr << "chunk-budget-check: the map has no evictable chunks\n";
+        return EXIT_SUCCESS;
+    }
+
+  // the default budget is a quarter of the chunk data
+    size_t budget = (budgetKB > 0) ? size_t(budgetKB) << 10 : full / 4;
+
+  // evict down to the budget
+    map.setChunkBudget (budget);
+    size_t resident = map.residentChunkBytes();
+    size_t rss2 = rss();
+
+  // touch the chunks again under the budget
+    size_t maxResident = touchAll (map);
+    size_t rss3 = rss();
+
+    std::cout << dir << ": " << (full >> 10) << " KB of chunk data, budget "
+        << (budget >> 10) << " KB\n";
+    std::cout << "  RSS: loaded " << (rss0 >> 10) << " KB, all chunks " << (rss1 >> 10)
+        << " KB, evicted " << (rss2 >> 10) << " KB, touched again " << (rss3 >> 10)
+        << " KB\n";
+
+    int nFailed = 0;
+    nFailed += check (rss1 + kSlack >= rss0 + full,
+        "RSS grew by less than the resident chunk data", rss1 - rss0, full);
+    nFailed += check (resident <= budget,
+        "resident chunk data exceeds the budget after eviction", resident, budget);
+    nFailed += check (rss2 + (full - resident) <= rss1 + kSlack,
+        "RSS did not drop by the evicted chunk data", rss1 - std::min(rss1, rss2),
+        full - resident);
+    nFailed += check (rss3 <= rss2 + budget + kSlack,
+        "RSS grew by more than the budget when the chunks were touched again",
+        rss3 - std::min(rss2, rss3), budget);
+    nFailed += check (map.residentChunkBytes() <= budget,
+        "resident chunk data exceeds the budget after touching the chunks",
+        map.residentChunkBytes(), budget);
+
+    if (nFailed > 0) {
+        std::cerr << nFailed << " checks failed (peak resident chunk data "
+            << (maxResident >> 10) << " KB)\n";
+        return EXIT_FAILURE;
+    }
+    std::cout << "  all checks passed\n";
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,72 @@
+/*! \file map-load-bench.cpp
+ *
+ * \author John Reppy
+ *
+ * A benchmark that measures the time from the start of `Map::load` until the map's
+ * grid is ready, when the map information comes from the "map.json" file and when it
+ * comes from the binary manifest.  The map is loaded with streaming enabled, so that
+ * the time does not include loading any cells.
+ *
+ * usage: map-load-bench <map-dir> [<iterations>]
+ */
+
+/* CMSC23700 Final Project sample code (Autumn 2022)
+ *
+ * COPYRIGHT (c) 2022 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#include "map.hpp"
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+static void usage (int sts)
+{
+    std::cerr << "usage: map-load-bench <map-dir> [<iterations>]\n";
+    exit (sts);
+}
+
+// the average time in milliseconds to load the map
+static double timeLoad (std::string const &dir, bool useManifest, int nIters)
+{
+    double total = 0.0;
+    for (int i = 0;  i < nIters;  i++) {
+        Map map(nullptr);
+        map.useManifest (useManifest);
+        map.enableStreaming (1.0, 2.0, 1);
+        auto t0 = std::chrono::steady_clock::now();
+        if (! map.load (dir, false)) {
+            exit (EXIT_FAILURE);
+        }
+        auto t1 = std::chrono::steady_clock::now();
+        total += std::chrono::duration<double, std::milli>(t1 - t0).count();
+    }
+    return total / double(nIters);
+}
+
+int main (int argc, char *argv[])
+{
+    if ((argc < 2) || (argc > 3)) {
+        usage (EXIT_FAILURE);
+    }
+    if (strcmp(argv[1], "-h") == 0) {
+        usage (EXIT_SUCCESS);
+    }
+    std::string dir = argv[1];
+    int nIters = (argc == 3) ? atoi(argv[2]) : 10;
+    if (nIters < 1) {
+        usage (EXIT_FAILURE);
+    }
+
+  // make sure that the manifest is up to date
+    timeLoad (dir, true, 1);
+
+    double tJSON = timeLoad (dir, false, nIters);
+    double tManifest = timeLoad (dir, true, nIters);
+
+    std::cout << dir << ": map.json " << tJSON << " ms, manifest " << tManifest
+        << " ms (speedup " << tJSON / tManifest << ")\n";
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,248 @@
+/*! \file map-pack.cpp
+ *
+ * \author John Reppy
+ *
+ * A tool for packing the files of a map directory into a single map pack (see
+ * pack-file.hpp), which can be loaded by `Map::load` in place of the directory.
+ * It can also list the members of an existing pack.
+ *
+ * usage: map-pack <map-dir> [<pack-file>]
+ *        map-pack -l <pack-file>
+ */
+
+/* CMSC23700 Final Project sample code (Autumn 2022)
+ *
+ * COPYRIGHT (c) 2022 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#include "pack-file.hpp"
+#include "binary-io.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+namespace fs = std::filesystem;
+
+static void usage (int sts)
+{
+    std::cerr << "usage: map-pack <map-dir> [<pack-file>]\n";
+    std::cerr << "       map-pack -l <pack-file>\n";
+    std::cerr << "options:\n";
+    std::cerr << "  -l        list the members of a pack\n";
+    std::cerr << "The default pack file is the name of the map directory with \".pack\" added\n";
+    exit (sts);
+}
+
+// round an offset up to a multiple of align (which must be a power of 2)
+inline uint64_t alignUp (uint64_t offset, uint64_t align)
+{
+    return (offset + align - 1) & ~(align - 1);
+}
+
+// write zero bytes to pad the output to the given offset
+static void padTo (std::ofstream &outS, uint64_t &pos, uint64_t offset)
+{
+    static const char zeros[PackFile::kPageSize] = { };
+    while (pos < offset) {
+        uint64_t n = std::min<uint64_t>(offset - pos, sizeof(zeros));
+        outS.write (zeros, n);
+        pos += n;
+    }
+}
+
+//! a file that will be a member of the pack
+struct Member {
+    std::string name;   //!< the member name (relative to the map directory)
+    fs::path path;      //!< the path to the file
+    uint64_t size;      //!< the size of the file in bytes
+    uint64_t offset;    //!< the offset of the member in the pack
+};
+
+// collect the files of the map directory in sorted order.  We skip the binary manifest,
+// which is only a cache of the "map.json" file, and hidden files.
+static bool collectFiles (fs::path const &dir, std::vector<Member> &members)
+{
+    std::error_code ec;
+    for (auto it = fs::recursive_directory_iterator(dir, ec);
+        it != fs::recursive_directory_iterator();
+        it.increment(ec))
+    {
+        if (ec) {
+            break;
+        }
+        std::string base = it->path().filename().string();
+        if (base[0] == '.') {
+            if (it->is_directory()) {
+                it.disable_recursion_pending ();
+            }
+            continue;
+        }
+        if (! it->is_regular_file() || (base == "map.manifest") || (base == "map.manifest.tmp")) {
+            continue;
+        }
+        Member m;
+        m.name = it->path().lexically_relative(dir).generic_string();
+        m.path = it->path();
+        m.size = static_cast<uint64_t>(it->file_size());
+        m.offset = 0;
+        members.push_back (m);
+    }
+    if (ec) {
+        std::cerr << "map-pack: error reading " << dir << ": " << ec.message() << "\n";
+        return false;
+    }
+
+    std::sort (members.begin(), members.end(),
+        [](Member const &a, Member const &b) { return a.name < b.name; });
+
+    return true;
+
+}
+
+// write the pack; returns false on error
+static bool writePack (std::string const &file, std::vector<Member> &members)
+{
+    std::ofstream outS(file, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (outS.fail()) {
+        std::cerr << "map-pack: unable to open \"" << file << "\"\n";
+        return false;
+    }
+
+  // the header is written after the members, when we know where the directory is
+    uint64_t pos = 0;
+    padTo (outS, pos, PackFile::kHeaderSize);
+
+  // copy the members
+    std::vector<char> buf(1 << 20);
+    for (auto &m : members) {
+        uint64_t align = (m.size >= PackFile::kPageSize) ? PackFile::kPageSize : PackFile::kMinAlign;
+        padTo (outS, pos, alignUp(pos, align));
+        m.offset = pos;
+        std::ifstream inS(m.path, std::ios::in | std::ios::binary);
+        uint64_t remaining = m.size;
+        while ((remaining > 0) && inS.good()) {
+            size_t n = static_cast<size_t>(std::min<uint64_t>(remaining, buf.size()));
+            if (inS.read (buf.data(), n).fail()) {
+                break;
+            }
+            outS.write (buf.data(), n);
+            remaining -= n;
+        }
+        if (remaining > 0) {
+            std::cerr << "map-pack: error reading " << m.path << "\n";
+            return false;
+        }
+        pos += m.size;
+    }
+
+  // the directory and the member names
+    std::vector<uint8_t> dir;
+    std::string names;
+    for (auto &m : members) {
+        putVal (dir, m.offset);
+        putVal (dir, m.size);
+        putVal (dir, static_cast<uint32_t>(names.size()));
+        putVal (dir, static_cast<uint32_t>(m.name.size()));
+        names += m.name;
+    }
+    dir.insert (dir.end(), names.begin(), names.end());
+    padTo (outS, pos, alignUp(pos, PackFile::kMinAlign));
+    uint64_t dirOffset = pos;
+    outS.write (reinterpret_cast<const char *>(dir.data()), dir.size());
+
+  // the header
+    std::vector<uint8_t> hdr;
+    putVal (hdr, PackFile::kMagic);
+    putVal (hdr, PackFile::kVersion);
+    putVal (hdr, static_cast<uint32_t>(members.size()));
+    putVal (hdr, static_cast<uint32_t>(PackFile::kPageSize));
+    putVal (hdr, dirOffset);
+    putVal (hdr, static_cast<uint64_t>(dir.size()));
+    outS.seekp (0);
+    outS.write (reinterpret_cast<const char *>(hdr.data()), hdr.size());
+
+    outS.close ();
+    if (outS.fail()) {
+        std::cerr << "map-pack: error writing \"" << file << "\"\n";
+        return false;
+    }
+
+    return true;
+
+}
+
+// list the members of a pack
+static int listPack (std::string const &file)
+{
+    PackFile pack(file);
+    if (! pack.isValid()) {
+        return EXIT_FAILURE;
+    }
+    for (uint32_t i = 0;  i < pack.nMembers();  i++) {
+        PackFile::Member m = pack.member(i);
+        std::cout << std::setw(12) << m.size << "  " << std::setw(12) << m.offset
+            << "  " << pack.memberName(i) << "\n";
+    }
+    return EXIT_SUCCESS;
+}
+
+int main (int argc, char *argv[])
+{
+    if ((argc < 2) || (argc > 3)) {
+        usage (EXIT_FAILURE);
+    }
+    if (strcmp(argv[1], "-h") == 0) {
+        usage (EXIT_SUCCESS);
+    }
+    if (strcmp(argv[1], "-l") == 0) {
+        if (argc != 3) {
+            usage (EXIT_FAILURE);
+        }
+        return listPack (argv[2]);
+    }
+
+    fs::path dir = fs::path(argv[1]);
+    if (! dir.has_filename()) {
+      // remove the trailing '/'
+        dir = dir.parent_path();
+    }
+    if (! fs::is_regular_file(dir / "map.json")) {
+        std::cerr << "map-pack: " << dir << " is not a map directory\n";
+        return EXIT_FAILURE;
+    }
+    std::string packFile = (argc == 3) ? std::string(argv[2]) : dir.string() + ".pack";
+
+    std::vector<Member> members;
+    if (! collectFiles (dir, members)) {
+        return EXIT_FAILURE;
+    }
+
+  // write to a temporary file and then rename it, so that a map that is being loaded
+  // never sees a partial pack
+    std::string tmpFile = packFile + ".tmp";
+    if (! writePack (tmpFile, members) || (std::rename(tmpFile.c_str(), packFile.c_str()) != 0)) {
+        std::remove (tmpFile.c_str());
+        return EXIT_FAILURE;
+    }
+
+  // check that the pack can be read back
+    PackFile pack(packFile);
+    if (! pack.isValid() || (pack.nMembers() != members.size())) {
+        std::cerr << "map-pack: unable to read back \"" << packFile << "\"\n";
+        return EXIT_FAILURE;
+    }
+
+    uint64_t total = 0;
+    for (auto const &m : members) {
+        total += m.size;
+    }
+    std::cout << packFile << ": " << members.size() << " files, " << total
+        << " bytes of data, " << fs::file_size(packFile) << " bytes packed\n";
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,237 @@
+/*! \file mesh-opt.cpp
+ *
+ * \author John Reppy
+ */
+
+/* CMSC23700 Final Project sample code (Autumn 2022)
+ *
+ * COPYRIGHT (c) 2022 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#include "mesh-opt.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace meshopt {
+
+float acmr (std::vector<uint16_t> const &strip, uint32_t nVerts, uint32_t cacheSize)
+{
+    size_t nTris = strips::toList(strip).size() / 3;
+    if (nTris == 0) {
+        return 0.0f;
+    }
+
+  // timestamps[v] is the value of the miss counter when v was last added to the cache;
+  // v is in the cache iff misses - timestamps[v] < cacheSize
+    std::vector<uint32_t> timestamps(nVerts, 0);
+    uint32_t misses = 0;
+    for (uint16_t v : strip) {
+        if (v == strips::kRestart) {
+            continue;
+        }
+        if ((timestamps[v] == 0) || (misses - timestamps[v] >= cacheSize)) {
+            timestamps[v] = ++misses;
+        }
+    }
+
+    return float(misses) / float(nTris);
+
+}
+
+/***** Forsyth's vertex-cache optimization *****/
+
+// the scoring parameters from Forsyth's paper
+constexpr float kCacheDecayPower = 1.5f;
+constexpr float kLastTriScore = 0.75f;
+constexpr float kValenceBoostScale = 2.0f;
+constexpr float kValenceBoostPower = 0.5f;
+
+// score a vertex given its position in the cache (-1 if not in the cache) and the
+// number of triangles that still use it
+static float vertexScore (int cachePos, uint32_t valence)
+{
+    if (valence == 0) {
+      // no triangles need this vertex
+        return -1.0f;
+    }
+
+    float score = 0.0f;
+    if (cachePos >= 0) {
+        if (cachePos < 3) {
+          // the vertex was used in the last triangle; we give these vertices a fixed
+          // score so that the algorithm does not prefer to repeat the same triangle
+            score = kLastTriScore;
+        } else {
+            float s = 1.0f - float(cachePos - 3) / float(kCacheSize - 3);
+            score = powf(s, kCacheDecayPower);
+        }
+    }
+
+  // boost the score of vertices with few remaining triangles, so that we finish off
+  // vertices instead of leaving lone triangles behind
+    score += kValenceBoostScale * powf(float(valence), -kValenceBoostPower);
+
+    return score;
+
+}
+
+void optimizeVertexCache (std::vector<uint16_t> &list, uint32_t nVerts)
+{
+    uint32_t nTris = static_cast<uint32_t>(list.size() / 3);
+    if (nTris == 0) {
+        return;
+    }
+
+  // build the vertex to triangle adjacency (in compressed form); the first valence[v]
+  // entries of v's slice of triAdj are the triangles that have not been emitted yet
+    std::vector<uint32_t> valence(nVerts, 0);
+    for (uint16_t v : list) {
+        valence[v]++;
+    }
+    std::vector<uint32_t> adjStart(nVerts + 1, 0);
+    for (uint32_t v = 0;  v < nVerts;  v++) {
+        adjStart[v+1] = adjStart[v] + valence[v];
+    }
+    std::vector<uint32_t> triAdj(list.size());
+    {
+        std::vector<uint32_t> fill(adjStart.begin(), adjStart.end() - 1);
+        for (uint32_t t = 0;  t < nTris;  t++) {
+            for (int k = 0;  k < 3;  k++) {
+                triAdj[fill[list[3*t+k]]++] = t;
+            }
+        }
+    }
+
+    std::vector<int> cachePos(nVerts, -1);
+    std::vector<float> vScore(nVerts);
+    for (uint32_t v = 0;  v < nVerts;  v++) {
+        vScore[v] = vertexScore (-1, valence[v]);
+    }
+    std::vector<float> tScore(nTris);
+    std::vector<bool> emitted(nTris, false);
+    for (uint32_t t = 0;  t < nTris;  t++) {
+        tScore[t] = vScore[list[3*t]] + vScore[list[3*t+1]] + vScore[list[3*t+2]];
+    }
+
+    std::vector<uint16_t> out;
+    out.reserve (list.size());
+    std::vector<uint32_t> cache, newCache;
+    cache.reserve (kCacheSize + 3);
+    newCache.reserve (kCacheSize + 3);
+
+    int64_t bestTri = -1;
+    uint32_t scanPos = 0;  // all triangles before this position have been emitted
+    for (uint32_t nEmitted = 0;  nEmitted < nTris;  nEmitted++) {
+        if (bestTri < 0) {
+          // none of the triangles that use cached vertices are left, so we pick the
+          // best remaining triangle
+            float best = -1.0f;
+            while (emitted[scanPos]) {
+                scanPos++;
+            }
+            for (uint32_t t = scanPos;  t < nTris;  t++) {
+                if (!emitted[t] && (tScore[t] > best)) {
+                    best = tScore[t];
+                    bestTri = t;
+                }
+            }
+        }
+
+      // emit the triangle and remove it from its vertices' adjacency lists
+        uint32_t tri = static_cast<uint32_t>(bestTri);
+        emitted[tri] = true;
+        newCache.clear();
+        for (int k = 0;  k < 3;  k++) {
+            uint16_t v = list[3*tri+k];
+            out.push_back (v);
+            if (std::find(newCache.begin(), newCache.end(), v) == newCache.end()) {
+                newCache.push_back (v);  // degenerate triangles can repeat a vertex
+            }
+            uint32_t *adj = &triAdj[adjStart[v]];
+            for (uint32_t i = 0;  i < valence[v];  i++) {
+                if (adj[i] == tri) {
+                    adj[i] = adj[valence[v] - 1];
+                    break;
+                }
+            }
+            valence[v]--;
+        }
+
+      // update the cache; the triangle's vertices move to the front
+        size_t nNew = newCache.size();
+        for (uint32_t v : cache) {
+            if (std::find(newCache.begin(), newCache.begin() + nNew, v) == newCache.begin() + nNew) {
+                newCache.push_back (v);
+            }
+        }
+        for (uint32_t i = 0;  i < newCache.size();  i++) {
+            uint32_t v = newCache[i];
+            cachePos[v] = (i < kCacheSize) ? int(i) : -1;
+            vScore[v] = vertexScore (cachePos[v], valence[v]);
+        }
+
+      // rescore the triangles that use the affected vertices and pick the best one
+        bestTri = -1;
+        float best = -1.0f;
+        for (uint32_t v : newCache) {
+            const uint32_t *adj = &triAdj[adjStart[v]];
+            for (uint32_t i = 0;  i < valence[v];  i++) {
+                uint32_t t = adj[i];
+                float s = vScore[list[3*t]] + vScore[list[3*t+1]] + vScore[list[3*t+2]];
+                tScore[t] = s;
+                if (s > best) {
+                    best = s;
+                    bestTri = t;
+                }
+            }
+        }
+
+        if (newCache.size() > kCacheSize) {
+            newCache.resize (kCacheSize);
+        }
+        std::swap (cache, newCache);
+    }
+
+    list.swap (out);
+
+}
+
+/***** Vertex fetch optimization *****/
+
+std::vector<uint16_t> optimizeVertexFetch (
+    std::vector<HFVertex> &verts, std::vector<uint16_t> &indices)
+{
+    const uint16_t kUnused = strips::kRestart;  // a vertex index can never be kRestart
+    uint32_t nVerts = static_cast<uint32_t>(verts.size());
+
+  // assign new indices in order of first use
+    std::vector<uint16_t> remap(nVerts, kUnused);
+    uint32_t next = 0;
+    for (uint16_t &v : indices) {
+        if (v == strips::kRestart) {
+            continue;
+        }
+        if (remap[v] == kUnused) {
+            remap[v] = next++;
+        }
+        v = remap[v];
+    }
+  // unused vertices keep their relative order at the end
+    for (uint32_t v = 0;  v < nVerts;  v++) {
+        if (remap[v] == kUnused) {
+            remap[v] = next++;
+        }
+    }
+
+    std::vector<HFVertex> newVerts(nVerts);
+    for (uint32_t v = 0;  v < nVerts;  v++) {
+        newVerts[remap[v]] = verts[v];
+    }
+    verts.swap (newVerts);
+
+    return remap;
+
+}
+
+} // namespace meshopt
@@ -0,0 +1,59 @@
+/*! \file mesh-opt.hpp
+ *
+ * \author John Reppy
+ *
+ * Offline optimization of the triangle and vertex order of chunk meshes.
+ */
+
+/* CMSC23700 Final Project sample code (Autumn 2022)
+ *
+ * COPYRIGHT (c) 2022 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#ifndef _MESH_OPT_HPP_
+#define _MESH_OPT_HPP_
+
+#include "map-cell.hpp"
+#include "chunk-strips.hpp"
+#include <cstdint>
+#include <vector>
+
+namespace meshopt {
+
+  //! the size of the vertex cache that the optimizer targets
+    constexpr uint32_t kCacheSize = 32;
+
+  //! \brief compute the average cache miss ratio (ACMR) of a chunk's triangle strips,
+  //!        which is the number of post-transform vertex cache misses per (non-degenerate)
+  //!        triangle for a FIFO cache.
+  //! \param strip      the strip indices (see chunk-strips.hpp)
+  //! \param nVerts     the number of vertices
+  //! \param cacheSize  the number of entries in the simulated cache
+  //! \return the ACMR; this will be between 0.5 (for a large regular grid) and 3.0
+    float acmr (
+        std::vector<uint16_t> const &strip, uint32_t nVerts,
+        uint32_t cacheSize = kCacheSize);
+
+  //! \brief reorder the triangles of a triangle list to improve post-transform vertex
+  //!        cache reuse.  We use Forsyth's "linear-speed vertex cache optimization"
+  //!        algorithm.  The order of the vertices in each triangle (and thus the
+  //!        triangle's winding) is preserved.
+  //! \param[in,out] list  the triangle-list indices
+  //! \param nVerts        the number of vertices
+    void optimizeVertexCache (std::vector<uint16_t> &list, uint32_t nVerts);
+
+  //! \brief renumber the vertices into the order of their first use in the index
+  //!        array, so that vertex fetches walk the vertex array sequentially.
+  //!        Vertices are moved as a whole (including `_morphDelta`); vertices that are
+  //!        not referenced by any triangle are moved to the end.  Restart indices are
+  //!        left unchanged.
+  //! \param[in,out] verts    the vertices
+  //! \param[in,out] indices  the strip or list indices
+  //! \return the permutation from old to new vertex indices
+    std::vector<uint16_t> optimizeVertexFetch (
+        std::vector<HFVertex> &verts, std::vector<uint16_t> &indices);
+
+} // namespace meshopt
+
+#endif // !_MESH_OPT_HPP_
@@ -0,0 +1,145 @@
+/*! \file normal-tqt.cpp
+ *
+ * \author John Reppy
+ *
+ * A tool for generating the normal-map texture quadtrees ("norm.tqt") of a map's cells
+ * from their height fields.  By default, each tree has the same depth as the cell's
+ * color quadtree and the finest level has one pixel per grid square.  The tiles of
+ * each tree are computed and encoded in parallel.  Since the renderer computes the
+ * normal-map tiles on demand when a cell does not have a "norm.tqt" file, this tool
+ * is only needed to trade disk space for load time.
+ *
+ * usage: normal-tqt [options] <map-dir>
+ */
+
+/* CMSC23700 Final Project sample code (Autumn 2022)
+ *
+ * COPYRIGHT (c) 2022 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#include "cs237.hpp"
+#include "tqt.hpp"
+#include "map.hpp"
+#include "map-cell.hpp"
+#include "height-field.hpp"
+#include "normal-map.hpp"
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <sys/stat.h>
+#include <thread>
+
+static void usage (int sts)
+{
+    std::cerr << "usage: normal-tqt [options] <map-dir>\n";
+    std::cerr << "options:\n";
+    std::cerr << "  -depth <d>       the depth of the trees (default: the depth of the\n";
+    std::cerr << "                   color trees)\n";
+    std::cerr << "  -tile-size <n>   the width of the tiles (default: one pixel per grid\n";
+    std::cerr << "                   square at the finest level)\n";
+    std::cerr << "  -qoi             encode the tiles with the QOI codec instead of PNG\n";
+    std::cerr << "  -j <n>           use <n> threads (default: the number of cores)\n";
+    exit (sts);
+}
+
+static size_t fileSize (std::string const &file)
+{
+    struct stat st;
+    if (stat(file.c_str(), &st) < 0) {
+        return 0;
+    }
+    return static_cast<size_t>(st.st_size);
+}
+
+int main (int argc, char *argv[])
+{
+    int depth = 0;
+    int tileSize = 0;
+    bool useQOI = false;
+    unsigned int nThreads = std::max(1u, std::thread::hardware_concurrency());
+    int argi = 1;
+    if ((argc > 1) && (strcmp(argv[1], "-h") == 0)) {
+        usage (EXIT_SUCCESS);
+    }
+    for (;  (argi < argc) && (argv[argi][0] == '-');  argi++) {
+        if ((strcmp(argv[argi], "-depth") == 0) && (argi + 1 < argc)) {
+            depth = atoi(argv[++argi]);
+            if ((depth < 1) || (depth > 16)) {
+                usage (EXIT_FAILURE);
+            }
+        } else if ((strcmp(argv[argi], "-tile-size") == 0) && (argi + 1 < argc)) {
+            tileSize = atoi(argv[++argi]);
+            if ((tileSize < 1) || ((tileSize & (tileSize - 1)) != 0)) {
+                usage (EXIT_FAILURE);
+            }
+        } else if (strcmp(argv[argi], "-qoi") == 0) {
+            useQOI = true;
+        } else if ((strcmp(argv[argi], "-j") == 0) && (argi + 1 < argc)) {
+            int n = atoi(argv[++argi]);
+            if (n < 1) {
+                usage (EXIT_FAILURE);
+            }
+            nThreads = n;
+        } else {
+            usage (EXIT_FAILURE);
+        }
+    }
+    if (argc - argi != 1) {
+        usage (EXIT_FAILURE);
+    }
+    std::string dir = argv[argi];
+
+    Map map(nullptr);
+    if (! map.load (dir, false)) {
+        std::cerr << "normal-tqt: unable to load map \"" << dir << "\"\n";
+        return EXIT_FAILURE;
+    }
+    if (map.isPacked()) {
+        std::cerr << "normal-tqt: \"" << dir << "\" is a map pack; run the tool on the "
+            << "map directory before packing it\n";
+        return EXIT_FAILURE;
+    }
+
+    for (uint32_t r = 0;  r < map.nRows();  r++) {
+        for (uint32_t c = 0;  c < map.nCols();  c++) {
+            Cell *cell = map.cell(r, c);
+            if (cell == nullptr) {
+                continue;
+            }
+            auto t0 = std::chrono::steady_clock::now();
+            auto hf = std::make_shared<const HeightField> (
+                cell->datafile("/hf.png"), map.hScale(), map.vScale(), map.baseElevation());
+            if (! hf->isValid()) {
+                std::cerr << "normal-tqt: unable to load height field for cell "
+                    << r << "," << c << "\n";
+                return EXIT_FAILURE;
+            }
+
+          // pick the shape of the tree
+            int d = depth;
+            std::string colorFile = cell->datafile("/color.tqt");
+            if ((d == 0) && map.hasColorMap() && tqt::TextureQTree::isTQTFile(colorFile)) {
+                tqt::TextureQTree color(colorFile, false, true);
+                d = color.depth();
+            } else if (d == 0) {
+                d = NormalMap::defaultDepth (hf->size());
+            }
+            int ts = (tileSize != 0) ? tileSize : NormalMap::defaultTileSize (hf->size(), d);
+
+            NormalMap gen(hf, d, ts);
+            std::string file = cell->datafile("/norm.tqt");
+            if (! gen.write (file, useQOI ? tqt::Format::QOI : tqt::Format::PNG, nThreads)) {
+                std::cerr << "normal-tqt: error writing \"" << file << "\"\n";
+                return EXIT_FAILURE;
+            }
+            auto t1 = std::chrono::steady_clock::now();
+            std::cout << file << ": depth " << d << ", " << ts << "x" << ts << " tiles, "
+                << fileSize(file) << " bytes, "
+                << std::chrono::duration<double, std::milli>(t1 - t0).count() << " ms\n";
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
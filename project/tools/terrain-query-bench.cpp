@@ -0,0 +1,248 @@
+/*! \file terrain-query-bench.cpp
+ *
+ * \author John Reppy
+ *
+ * A benchmark for the terrain spatial queries (Map::heightAt, Map::rayCast, and
+ * Map::lineOfSight).  It measures the throughput of each query on random inputs and
+ * checks the results against brute-force versions that march along the rays.
+ *
+ * usage: terrain-query-bench <map-dir> [<n-queries>]
+ */
+
+/* CMSC23700 Final Project sample code (Autumn 2022)
+ *
+ * COPYRIGHT (c) 2022 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#include "map.hpp"
+#include "map-cell.hpp"
+#include "height-field.hpp"
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+
+static void usage (int sts)
+{
+    std::cerr << "usage: terrain-query-bench <map-dir> [<n-queries>]\n";
+    exit (sts);
+}
+
+// the number of rays and segments that are checked against the brute-force versions
+static constexpr size_t kNumChecked = 2000;
+
+// time a function in seconds
+template <typename F>
+static double timeIt (F fn)
+{
+    auto t0 = std::chrono::steady_clock::now();
+    fn ();
+    auto t1 = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(t1 - t0).count();
+}
+
+static void report (const char *name, size_t n, double secs)
+{
+    std::cout << "  " << std::left << std::setw(24) << name << std::right
+        << std::setw(9) << std::setprecision(2) << std::fixed << (double(n) / secs) * 1.0e-6
+        << " Mqueries/s (" << std::setprecision(1) << (secs * 1.0e9) / double(n)
+        << " ns/query)\n";
+    std::cout.unsetf (std::ios::floatfield);
+}
+
+// brute-force ray cast: march along the ray in small steps and return the first sample
+// that is on or below the terrain
+static bool marchRay (
+    Map &map, glm::dvec3 const &org, glm::dvec3 const &dir, double tMin, double tMax,
+    double step, double &tHit)
+{
+    for (double t = tMin;  t <= tMax;  t += step) {
+        glm::dvec3 p = org + t * dir;
+        float h;
+        if (map.heightAt(p.x, p.z, h) && (p.y <= double(h))) {
+            tHit = t;
+            return true;
+        }
+    }
+    return false;
+}
+
+int main (int argc, char *argv[])
+{
+    if ((argc < 2) || (argc > 3)) {
+        usage (EXIT_FAILURE);
+    }
+    if (strcmp(argv[1], "-h") == 0) {
+        usage (EXIT_SUCCESS);
+    }
+    size_t nQueries = (argc == 3) ? size_t(atol(argv[2])) : (size_t(1) << 22);
+    if (nQueries < kNumChecked) {
+        usage (EXIT_FAILURE);
+    }
+
+    Map map(nullptr);
+    if (! map.load (argv[1], false)) {
+        return EXIT_FAILURE;
+    }
+
+    double east = map.east(), south = map.south();
+    double step = double(map.hScale()) / 8.0;
+    std::mt19937_64 rng(17);
+    std::uniform_real_distribution<double> xDist(0.0, east);
+    std::uniform_real_distribution<double> zDist(0.0, south);
+
+  // load the height fields before timing anything
+    float minH = std::numeric_limits<float>::max();
+    float maxH = -minH;
+    size_t nCells = 0;
+    double loadTime = timeIt ([&]() {
+        for (uint32_t r = 0;  r < map.nRows();  r++) {
+            for (uint32_t c = 0;  c < map.nCols();  c++) {
+                HeightField const *hf = map.cell(r, c)->heightField();
+                minH = std::min(minH, hf->minHeight());
+                maxH = std::max(maxH, hf->maxHeight());
+                nCells++;
+            }
+        }
+    });
+    std::cout << argv[1] << ": " << nCells << " cells; heights " << minH << " .. " << maxH
+        << "; height fields loaded in " << loadTime * 1000.0 << " ms\n";
+
+  /***** heightAt *****/
+
+    std::vector<glm::dvec2> pts(nQueries);
+    for (auto &pt : pts) {
+        pt = glm::dvec2(xDist(rng), zDist(rng));
+    }
+    std::vector<float> h1(nQueries), h2(nQueries);
+
+    std::cout << "heightAt (" << nQueries << " random points):\n";
+    double secs = timeIt ([&]() {
+        for (size_t i = 0;  i < nQueries;  i++) {
+            map.heightAt (pts[i].x, pts[i].y, h1[i]);
+        }
+    });
+    report ("Map scalar", nQueries, secs);
+    secs = timeIt ([&]() { map.heightAt (nQueries, pts.data(), h2.data()); });
+    report ("Map batched", nQueries, secs);
+
+    float maxDiff = 0.0f;
+    for (size_t i = 0;  i < nQueries;  i++) {
+        maxDiff = std::max(maxDiff, std::fabs(h1[i] - h2[i]));
+    }
+
+  // the height field of a single cell, without the map's cell lookup
+    {
+        HeightField const *hf = map.cell(0, 0)->heightField();
+        double w = map.cellSize().x;
+        std::uniform_real_distribution<float> uDist(0.0f, float(w));
+        std::vector<float> xs(nQueries), zs(nQueries);
+        for (size_t i = 0;  i < nQueries;  i++) {
+            xs[i] = uDist(rng);
+            zs[i] = uDist(rng);
+        }
+        secs = timeIt ([&]() {
+            for (size_t i = 0;  i < nQueries;  i++) {
+                h1[i] = hf->heightAt(xs[i], zs[i]);
+            }
+        });
+        report ("HeightField scalar", nQueries, secs);
+        secs = timeIt ([&]() { hf->heightAt (nQueries, xs.data(), zs.data(), h2.data()); });
+        report ("HeightField batched", nQueries, secs);
+        for (size_t i = 0;  i < nQueries;  i++) {
+            maxDiff = std::max(maxDiff, std::fabs(h1[i] - h2[i]));
+        }
+    }
+    std::cout << "  max |scalar - batched| = " << maxDiff << "\n";
+
+  /***** rayCast *****/
+
+    size_t nRays = nQueries / 4;
+    std::vector<glm::dvec3> orgs(nRays), dirs(nRays);
+    std::uniform_real_distribution<double> hDist(10.0, 500.0);
+    std::uniform_real_distribution<double> dDist(-1.0, 1.0);
+    std::uniform_real_distribution<double> dyDist(-1.0, -0.05);
+    for (size_t i = 0;  i < nRays;  i++) {
+        orgs[i] = glm::dvec3(xDist(rng), double(maxH) + hDist(rng), zDist(rng));
+        dirs[i] = glm::normalize(glm::dvec3(dDist(rng), dyDist(rng), dDist(rng)));
+    }
+    double maxDist = 2.0 * std::sqrt(east * east + south * south);
+
+    std::cout << "rayCast (" << nRays << " random rays):\n";
+    size_t nHits = 0;
+    std::vector<glm::dvec3> hits(nRays);
+    std::vector<bool> hit(nRays);
+    secs = timeIt ([&]() {
+        for (size_t i = 0;  i < nRays;  i++) {
+            hit[i] = map.rayCast (orgs[i], dirs[i], maxDist, hits[i]);
+            nHits += hit[i];
+        }
+    });
+    report ("Map::rayCast", nRays, secs);
+
+  // check that the hits are on the surface and agree with the brute-force version,
+  // which can only be accurate to within its step size
+    size_t nOffSurface = 0, nMismatch = 0;
+    for (size_t i = 0;  i < nRays;  i++) {
+        if (hit[i]) {
+            float h;
+            map.heightAt (hits[i].x, hits[i].z, h);
+            if (std::fabs(hits[i].y - double(h)) > 0.01) {
+                nOffSurface++;
+            }
+        }
+        if (i < kNumChecked) {
+            double tMarch;
+            bool marchHit = marchRay (map, orgs[i], dirs[i], 0.0, maxDist, step, tMarch);
+            double t = glm::distance(orgs[i], hits[i]);
+            if ((marchHit != hit[i]) || (hit[i] && ((t > tMarch + 0.01) || (t < tMarch - step)))) {
+                nMismatch++;
+            }
+        }
+    }
+    std::cout << "  " << nHits << " hits; " << nOffSurface << " hits off the surface; "
+        << nMismatch << " of " << kNumChecked << " rays disagree with brute force\n";
+
+  /***** lineOfSight *****/
+
+  // pairs of points at eye height above the terrain
+    std::vector<glm::dvec3> as(nRays), bs(nRays);
+    for (size_t i = 0;  i < nRays;  i++) {
+        float ha, hb;
+        as[i] = glm::dvec3(xDist(rng), 0.0, zDist(rng));
+        bs[i] = glm::dvec3(xDist(rng), 0.0, zDist(rng));
+        map.heightAt (as[i].x, as[i].z, ha);
+        map.heightAt (bs[i].x, bs[i].z, hb);
+        as[i].y = double(ha) + 2.0;
+        bs[i].y = double(hb) + 2.0;
+    }
+
+    std::cout << "lineOfSight (" << nRays << " random segments):\n";
+    size_t nVisible = 0;
+    std::vector<bool> visible(nRays);
+    secs = timeIt ([&]() {
+        for (size_t i = 0;  i < nRays;  i++) {
+            visible[i] = map.lineOfSight (as[i], bs[i]);
+            nVisible += visible[i];
+        }
+    });
+    report ("Map::lineOfSight", nRays, secs);
+
+    nMismatch = 0;
+    for (size_t i = 0;  i < kNumChecked;  i++) {
+        double len = glm::distance(as[i], bs[i]);
+        double t;
+        bool blocked = marchRay (map, as[i], (bs[i] - as[i]) / len,
+            Map::kSightTolerance, len - Map::kSightTolerance, step, t);
+      // marching can miss a blocker that is thinner than the step size
+        if (blocked && visible[i]) {
+            nMismatch++;
+        }
+    }
+    std::cout << "  " << nVisible << " visible; " << nMismatch << " of " << kNumChecked
+        << " segments are blocked according to brute force\n";
+
+    return EXIT_SUCCESS;
+}
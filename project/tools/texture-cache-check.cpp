@@ -0,0 +1,363 @@
+/*! \file texture-cache-check.cpp
+ *
+ * \author John Reppy
+ *
+ * A stress check for the `TextureCache`.  It flies a camera across a synthetic map
+ * whose cells have procedural texture quadtrees, activates the tiles near the camera
+ * each frame (as the renderer does), and checks the cache's invariants every frame:
+ *
+ *   - the resident textures stay within the budget (the budget can only be exceeded
+ *     when the active textures alone do not fit in it);
+ *   - in pool mode, no two ready textures share an array layer;
+ *   - in streaming mode, `fallback` returns the texture itself or a ready ancestor
+ *     with the right coordinate transform, the uploads of a frame stay within
+ *     the per-frame limit, and the active textures all become ready once the
+ *     camera stops;
+ *   - the per-frame stats match the state of the cache and add up to the totals.
+ *
+ * usage: texture-cache-check [options] [<n-cells>]
+ */
+
+/* CMSC23700 Final Project sample code (Autumn 2022)
+ *
+ * COPYRIGHT (c) 2022 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#include "cs237.hpp"
+#include "tqt.hpp"
+#include "texture-cache.hpp"
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <set>
+#include <vector>
+
+static void usage (int sts)
+{
+    std::cerr << "usage: texture-cache-check [options] [<n-cells>]\n";
+    std::cerr << "options:\n";
+    std::cerr << "  -budget <MB>     the texture budget (default 8)\n";
+    std::cerr << "  -pool            use pool mode\n";
+    std::cerr << "  -stream          use streaming mode\n";
+    std::cerr << "  -frame-kb <KB>   the per-frame upload limit in streaming mode (default 64)\n";
+    std::cerr << "  -staging-kb <KB> the size of the staging buffer in streaming mode\n";
+    std::cerr << "  -mixed           use smaller tiles for every other cell\n";
+    std::cerr << "  -fail            make some of the tiles fail to load\n";
+    exit (sts);
+}
+
+constexpr int kDepth = 5;               //!< the depth of the cells' quadtrees
+constexpr int kTileSize = 64;           //!< the width of the tiles
+constexpr size_t kTileBytes = 4 * kTileSize * kTileSize;
+constexpr size_t kTextureBytes = (4 * kTileBytes) / 3; //!< the GPU memory of a tile's texture,
+                                        //!  which has a full mipmap chain
+constexpr double kCellWidth = 1024.0;   //!< the width of a cell in meters
+constexpr double kStep = 40.0;          //!< the distance that the camera moves per frame
+constexpr double kViewDist = 3000.0;    //!< tiles farther than this are not activated
+constexpr int kDeletePeriod = 37;       //!< in streaming mode, we delete textures that are
+                                        //!  still loading every kDeletePeriod frames
+constexpr int kDrainFrames = 100;       //!< in streaming mode, the number of frames that the
+                                        //!  active textures have to become ready once the
+                                        //!  camera stops
+
+//! the location of a tile
+struct TileId {
+    int cell, level, row, col;
+};
+
+class CheckApp : public cs237::Application {
+  public:
+    CheckApp (std::vector<const char *> &args) : cs237::Application (args, "texture-cache-check") { }
+
+    void run () override { }
+
+    //! fly across the map and check the cache each frame
+    //! \return the number of failed checks
+    int fly (
+        int nCells, size_t budget, bool pool, bool stream, size_t frameBytes,
+        size_t stagingBytes, bool fail, bool mixed);
+};
+
+// report a failed check
+static int check (bool ok, long frame, const char *what)
+{
+    if (! ok) {
+        std::cerr << "frame " << frame << ": " << what << "\n";
+        return 1;
+    }
+    return 0;
+}
+
+int CheckApp::fly (
+    int nCells, size_t budget, bool pool, bool stream, size_t frameBytes,
+    size_t stagingBytes, bool fail, bool mixed)
+{
+  // with mixed tile sizes, the staging buffer is not always allocated in multiples
+  // of the largest image
+    std::vector<tqt::TextureQTree *> trees;
+    for (int i = 0;  i < nCells * nCells;  i++) {
+        int tileSize = (mixed && (i % 2 == 1)) ? kTileSize / 2 : kTileSize;
+        trees.push_back (new tqt::TextureQTree (
+            kDepth, tileSize,
+            [fail, tileSize] (int level, int row, int col, uint8_t *rgba) {
+                if (fail && (level == 3) && ((row + col) % 5 == 0)) {
+                    return false;
+                }
+                std::memset (rgba, 16 * level + row + col, 4 * tileSize * tileSize);
+                return true;
+            },
+            false, true));
+    }
+
+    TextureCache *cache = new TextureCache (this, false, TileImageCache::kDefaultBudget, budget);
+    cache->usePool (pool);
+    if (stream) {
+        cache->enableStreaming (0, stagingBytes, frameBytes);
+    }
+
+    std::map<TileTexture *, TileId> ids;        // the textures that we have made
+    std::set<TileTexture *> active;
+    TextureCacheStats sum;                      // the sum of the per-frame stats
+    uint64_t nActivations = 0;
+    size_t maxResident = 0;
+    int nErrors = 0;
+
+  // the state of the cache at the end of the previous frame, which should be
+  // reported by the frame's stats
+    size_t prevResident = 0;
+    uint64_t prevActive = 0, prevLoading = 0;
+
+    long frame = 0;
+    for (double x = 100.0;  x < nCells * kCellWidth - 100.0;  x += kStep, frame++) {
+        double z = 0.5 * nCells * kCellWidth + 2000.0 * std::sin(x / 3000.0);
+
+        cache->newFrame ();
+
+      // check the stats of the previous frame
+        TextureCacheStats const &fs = cache->frameStats();
+        if (frame > 0) {
+            nErrors += check (fs.residentBytes == prevResident, frame, "stats: resident bytes");
+            nErrors += check (fs.active == prevActive, frame, "stats: active textures");
+            nErrors += check (fs.loading == prevLoading, frame, "stats: loading textures");
+        }
+        sum.add (fs);
+
+        if (stream) {
+          // the uploads are limited, but at least one texture is uploaded per frame
+            nErrors += check ((fs.uploadBytes <= frameBytes) || (fs.uploads == 1),
+                frame, "streaming: upload limit exceeded");
+          // each active tile must be drawn with itself or a ready ancestor
+            for (auto txt : active) {
+                glm::vec3 xform;
+                TileTexture *fb = txt->fallback (xform);
+                if (fb == nullptr) {
+                    continue;
+                }
+                TileId const &id = ids[txt];
+                TileId const &fbId = ids[fb];
+                int d = id.level - fbId.level;
+                float s = 1.0f / float(1 << d);
+                bool ok = fb->isReady() && (fbId.cell == id.cell) && (d >= 0)
+                    && ((id.row >> d) == fbId.row) && ((id.col >> d) == fbId.col)
+                    && (xform == glm::vec3(
+                        s, float(id.col - (fbId.col << d)) * s, float(id.row - (fbId.row << d)) * s));
+                nErrors += check (ok, frame, "streaming: bad fallback");
+            }
+          // delete some of the textures that are still loading
+            if (frame % kDeletePeriod == 0) {
+                std::vector<TileTexture *> victims;
+                for (auto &it : ids) {
+                    auto st = it.first->state();
+                    if ((st == TileTexture::State::Decoding) || (st == TileTexture::State::Decoded)
+                    || (st == TileTexture::State::Uploading)) {
+                        victims.push_back (it.first);
+                        if (victims.size() == 5) {
+                            break;
+                        }
+                    }
+                }
+                for (auto txt : victims) {
+                    active.erase (txt);
+                    ids.erase (txt);
+                    delete txt;
+                }
+            }
+        }
+
+      // pick the tiles near the camera by descending each cell's quadtree
+        std::set<TileTexture *> want;
+        for (int cr = 0;  cr < nCells;  cr++) {
+            for (int cc = 0;  cc < nCells;  cc++) {
+                int cell = cr * nCells + cc;
+                std::vector<TileId> stk{TileId{cell, 0, 0, 0}};
+                while (! stk.empty()) {
+                    TileId t = stk.back();
+                    stk.pop_back();
+                    double w = kCellWidth / double(1 << t.level);
+                    double d = std::hypot(
+                        cc * kCellWidth + (t.col + 0.5) * w - x,
+                        cr * kCellWidth + (t.row + 0.5) * w - z);
+                    if ((t.level + 1 < kDepth) && (d < 1.5 * w)) {
+                        for (int k = 0;  k < 4;  k++) {
+                            stk.push_back (TileId{
+                                cell, t.level + 1, 2 * t.row + (k >> 1), 2 * t.col + (k & 1)});
+                        }
+                    } else if (d < kViewDist) {
+                        TileTexture *txt = cache->make (trees[cell], t.level, t.row, t.col);
+                        ids[txt] = t;
+                        want.insert (txt);
+                    }
+                }
+            }
+        }
+        for (auto txt : active) {
+            if (want.count(txt) == 0) {
+                txt->release ();
+            }
+        }
+        for (auto txt : want) {
+            if (! txt->isActive()) {
+                txt->activate ();
+                nActivations++;
+            }
+        }
+        active = std::move(want);
+
+      // the budget can only be exceeded by the active textures
+        size_t resident = cache->residentBytes();
+        maxResident = std::max(maxResident, resident);
+        nErrors += check (resident <= std::max(budget, active.size() * kTextureBytes),
+            frame, "resident textures exceed the budget");
+
+      // the ready textures that we can see must not share a layer
+        if (pool) {
+            std::set<std::pair<VkImageView, uint32_t>> layers;
+            for (auto txt : active) {
+                if (txt->isReady()) {
+                    VkDescriptorImageInfo info;
+                    txt->getDescriptorInfo (info);
+                    bool fresh = txt->isPooled()
+                        && layers.insert(std::make_pair(info.imageView, txt->layer())).second;
+                    nErrors += check (fresh, frame, "pool: array layer is shared");
+                }
+            }
+        }
+
+        prevResident = resident;
+        prevActive = cache->numActive();
+        prevLoading = 0;
+        for (auto &it : ids) {
+            auto st = it.first->state();
+            if ((st == TileTexture::State::Decoding) || (st == TileTexture::State::Decoded)
+            || (st == TileTexture::State::Uploading)) {
+                prevLoading++;
+            }
+        }
+    }
+
+  // with the camera stopped, the uploads must make progress until all of the active
+  // textures are ready (or have failed)
+    if (stream) {
+        bool done = false;
+        for (int i = 0;  (i < kDrainFrames) && ! done;  i++, frame++) {
+            cache->newFrame ();
+            sum.add (cache->frameStats());
+            done = true;
+            for (auto txt : active) {
+                auto st = txt->state();
+                if ((st != TileTexture::State::Ready) && (st != TileTexture::State::Failed)) {
+                    done = false;
+                }
+            }
+        }
+        nErrors += check (done, frame, "streaming: the uploads stalled");
+    }
+
+  // fold the last frame into the stats and check the totals
+    uint64_t nEvictions = cache->numEvictions();
+    cache->newFrame ();
+    sum.add (cache->frameStats());
+    TextureCacheStats const &tot = cache->totalStats();
+    nErrors += check (
+        (tot.hits == sum.hits) && (tot.misses == sum.misses) && (tot.pending == sum.pending)
+        && (tot.evictions == sum.evictions) && (tot.uploads == sum.uploads)
+        && (tot.uploadBytes == sum.uploadBytes),
+        frame, "stats: the frame stats do not add up to the totals");
+    nErrors += check (tot.activations() == nActivations, frame, "stats: activation count");
+    nErrors += check (tot.evictions == nEvictions, frame, "stats: eviction count");
+
+    std::cout << frame << " frames, " << nActivations << " activations ("
+        << tot.hits << " hits, " << tot.misses << " misses, " << tot.pending << " pending), "
+        << tot.evictions << " evictions, " << tot.uploads << " uploads\n";
+    std::cout << "  max resident " << double(maxResident) / double(1 << 20) << " MB (budget "
+        << double(budget) / double(1 << 20) << " MB)\n";
+
+  // once the textures are released, a zero budget evicts all of them
+    for (auto txt : active) {
+        txt->release ();
+    }
+    for (uint64_t i = 0;  i <= TextureCache::kRetireFrames;  i++) {
+        cache->newFrame ();
+    }
+    cache->setBudget (1);
+    nErrors += check (cache->residentBytes() == 0, frame, "released textures were not evicted");
+
+    delete cache;
+    for (auto tree : trees) {
+        delete tree;
+    }
+
+    return nErrors;
+}
+
+int main (int argc, char *argv[])
+{
+    size_t budget = size_t(8) << 20;
+    size_t frameBytes = size_t(64) << 10;
+    size_t stagingBytes = TextureCache::kDefaultStagingBytes;
+    bool pool = false, stream = false, fail = false, mixed = false;
+    int nCells = 8;
+
+    int argi = 1;
+    while ((argi < argc) && (argv[argi][0] == '-')) {
+        if (strcmp(argv[argi], "-h") == 0) {
+            usage (EXIT_SUCCESS);
+        } else if ((strcmp(argv[argi], "-budget") == 0) && (argi + 1 < argc)) {
+            budget = size_t(atoi(argv[++argi])) << 20;
+        } else if ((strcmp(argv[argi], "-frame-kb") == 0) && (argi + 1 < argc)) {
+            frameBytes = size_t(atoi(argv[++argi])) << 10;
+        } else if ((strcmp(argv[argi], "-staging-kb") == 0) && (argi + 1 < argc)) {
+            stagingBytes = size_t(atoi(argv[++argi])) << 10;
+        } else if (strcmp(argv[argi], "-pool") == 0) {
+            pool = true;
+        } else if (strcmp(argv[argi], "-stream") == 0) {
+            stream = true;
+        } else if (strcmp(argv[argi], "-fail") == 0) {
+            fail = true;
+        } else if (strcmp(argv[argi], "-mixed") == 0) {
+            mixed = true;
+        } else {
+            usage (EXIT_FAILURE);
+        }
+        argi++;
+    }
+    if (argi + 1 < argc) {
+        usage (EXIT_FAILURE);
+    } else if (argi < argc) {
+        nCells = atoi(argv[argi]);
+    }
+    if ((nCells < 1) || (budget == 0) || (frameBytes == 0) || (stagingBytes == 0)) {
+        usage (EXIT_FAILURE);
+    }
+
+    std::vector<const char *> args;
+    CheckApp app(args);
+    int nErrors = app.fly (nCells, budget, pool, stream, frameBytes, stagingBytes, fail, mixed);
+    if (nErrors > 0) {
+        std::cout << "  " << nErrors << " checks failed\n";
+    }
+
+    return (nErrors == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
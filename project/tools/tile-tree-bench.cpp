@@ -0,0 +1,168 @@
+/*! \file tile-tree-bench.cpp
+ *
+ * \author John Reppy
+ *
+ * A microbenchmark that compares frontier selection over a cell's Tile objects with
+ * frontier selection over the cell's TileTree.
+ *
+ * usage: tile-tree-bench [-mmap] <map-dir> [<iterations>]
+ */
+
+/* CMSC23700 Final Project sample code (Autumn 2022)
+ *
+ * COPYRIGHT (c) 2022 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#include "map.hpp"
+#include "map-cell.hpp"
+#include "tile-tree.hpp"
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+static void usage (int sts)
+{
+    std::cerr << "usage: tile-tree-bench [-mmap] <map-dir> [<iterations>]\n";
+    exit (sts);
+}
+
+// frontier selection using the Tile objects; this is the same algorithm as
+// TileTree::selectFrontier
+static void tileFrontier (
+    Cell *cell, glm::dvec3 const &eye, float errorFactor, float tolerance,
+    std::vector<uint32_t> &frontier)
+{
+    Tile *stk[3 * Cell::kMaxLODs + 1];
+    int sp = 0;
+    stk[sp++] = &cell->tile(0);
+    while (sp > 0) {
+        Tile *tile = stk[--sp];
+        if (tile->numChildren() > 0) {
+            float dist = static_cast<float>(tile->bBox().distanceToPt(eye));
+            if (errorFactor * tile->maxError() > tolerance * dist) {
+                for (int i = 3;  i >= 0;  i--) {
+                    stk[sp++] = tile->child(i);
+                }
+                continue;
+            }
+        }
+        frontier.push_back (tile->id());
+    }
+}
+
+// the viewpoints for the benchmark: a grid of points above the cell
+static std::vector<glm::dvec3> viewpoints (Map const &map, Cell *cell)
+{
+    std::vector<glm::dvec3> pts;
+    glm::dvec3 nw = map.nwCellCorner(cell->row(), cell->col());
+    double w = double(map.hScale()) * double(map.cellWidth());
+    double y = cell->tile(0).bBox()._max.y + 10.0;
+    for (int i = 0;  i < 4;  i++) {
+        for (int j = 0;  j < 4;  j++) {
+            pts.push_back (nw + glm::dvec3((j + 0.5) * w / 4.0, y, (i + 0.5) * w / 4.0));
+        }
+    }
+    return pts;
+}
+
+// time a frontier-selection function over the viewpoints
+template <typename F>
+static double timeIt (int nIters, std::vector<glm::dvec3> const &pts, size_t &nSelected, F fn)
+{
+    std::vector<uint32_t> frontier;
+    frontier.reserve (1 << 16);
+    nSelected = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    for (int it = 0;  it < nIters;  it++) {
+        for (auto const &pt : pts) {
+            frontier.clear();
+            fn (pt, frontier);
+            nSelected += frontier.size();
+        }
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::micro>(t1 - t0).count()
+        / double(nIters * pts.size());
+}
+
+static void run (
+    const char *name, Map const &map, Cell *cell, int nIters, float errorFactor, float tolerance)
+{
+    std::vector<glm::dvec3> pts = viewpoints(map, cell);
+    TileTree const *tree = cell->tileTree();
+
+  // check that the two traversals agree
+    size_t nDiffs = 0;
+    for (auto const &pt : pts) {
+        std::vector<uint32_t> f1, f2;
+        tileFrontier (cell, pt, errorFactor, tolerance, f1);
+        tree->selectFrontier (pt, errorFactor, tolerance, f2);
+        if (f1 != f2) {
+            nDiffs++;
+        }
+    }
+
+    size_t n1, n2;
+    double t1 = timeIt (nIters, pts, n1,
+        [&](glm::dvec3 const &pt, std::vector<uint32_t> &f) {
+            tileFrontier (cell, pt, errorFactor, tolerance, f);
+        });
+    double t2 = timeIt (nIters, pts, n2,
+        [&](glm::dvec3 const &pt, std::vector<uint32_t> &f) {
+            tree->selectFrontier (pt, errorFactor, tolerance, f);
+        });
+
+    std::cout << name << ": " << n1 / (nIters * pts.size()) << " tiles selected; "
+        << "Tile " << t1 << " us, TileTree " << t2 << " us (speedup "
+        << t1 / t2 << ")";
+    if (nDiffs > 0) {
+        std::cout << "; " << nDiffs << " of " << pts.size() << " frontiers differ";
+    }
+    std::cout << "\n";
+
+}
+
+int main (int argc, char *argv[])
+{
+    bool useMMap = false;
+    int i = 1;
+    for (;  (i < argc) && (argv[i][0] == '-');  i++) {
+        if (strcmp(argv[i], "-mmap") == 0) {
+            useMMap = true;
+        } else if (strcmp(argv[i], "-h") == 0) {
+            usage (EXIT_SUCCESS);
+        } else {
+            usage (EXIT_FAILURE);
+        }
+    }
+    if ((i == argc) || (argc - i > 2)) {
+        usage (EXIT_FAILURE);
+    }
+    std::string dir = argv[i];
+    int nIters = (i + 1 < argc) ? atoi(argv[i+1]) : 20;
+    if (nIters < 1) {
+        usage (EXIT_FAILURE);
+    }
+
+    Map map(nullptr);
+    map.useMMap (useMMap);
+    if (! map.load (dir, false)) {
+        return EXIT_FAILURE;
+    }
+    Cell *cell = map.cell(0, 0);
+
+    std::cout << "cell " << dir << ": " << cell->depth() << " LODs, "
+        << qtree::fullSize(cell->depth()) << " tiles, "
+        << sizeof(Tile) << " bytes/Tile\n";
+
+  // full-tree traversal: a zero tolerance refines every node
+    run ("full tree", map, cell, nIters, 1.0f, 0.0f);
+
+  // a typical view: 1280 pixels wide with a 60 degree field of view and a
+  // one-pixel error tolerance
+    float errorFactor = 1280.0f / (2.0f * tanf(glm::radians(30.0f)));
+    run ("frontier", map, cell, nIters, errorFactor, 1.0f);
+
+    return EXIT_SUCCESS;
+}
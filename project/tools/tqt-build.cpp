@@ -0,0 +1,611 @@
+/*! \file tqt-build.cpp
+ *
+ * \author John Reppy
+ *
+ * A tool for building a texture quadtree from a large color or normal-map image.
+ * The finest level of the tree has (tileSize << (depth-1)) pixels on a side; the
+ * source image is resampled to that size and each coarser level is computed from the
+ * next finer one with a 2x2 box filter.  All of the filtering is done on linear
+ * values (i.e., colors are converted from sRGB) using SSE2 when it is available.
+ *
+ * The source is a PNG file, which is read one row at a time, and the levels of the
+ * tree are built one strip of tiles at a time, so the memory used is proportional to
+ * the width of the image (not its area).  Each strip of tiles is encoded in parallel
+ * by a pool of worker threads.  The output is a version 1 tree (PNG tiles) or, with
+ * the "-qoi" option, a version 2 tree with QOI tiles.
+ *
+ * usage: tqt-build [options] <src-png> <depth> <tile-size> <dst-tqt>
+ */
+
+/* CMSC23700 Final Project sample code (Autumn 2022)
+ *
+ * COPYRIGHT (c) 2022 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#include "cs237.hpp"
+#include "tqt.hpp"
+#include "worker-pool.hpp"
+#include "png.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+static void usage (int sts)
+{
+    std::cerr << "usage: tqt-build [options] <src-png> <depth> <tile-size> <dst-tqt>\n";
+    std::cerr << "options:\n";
+    std::cerr << "  -data     the image is a normal map instead of sRGB colors\n";
+    std::cerr << "  -qoi      encode the tiles with the QOI codec instead of PNG\n";
+    std::cerr << "  -lanczos  resample the source with a Lanczos-3 filter (default box)\n";
+    std::cerr << "  -j <n>    use <n> encoding threads (default: the number of cores)\n";
+    exit (sts);
+}
+
+//! the maximum number of bytes of tile data that are waiting to be encoded
+static constexpr size_t kMaxPendingBytes = size_t(256) << 20;
+
+/***** Pixel conversions *****/
+
+// For color images, pixels are converted to linear values for filtering.  For normal
+// maps, the components are mapped to [-1..1] and the filtered vectors are renormalized
+// when they are converted back to bytes.  Alpha is always linear.
+
+//! conversion from sRGB-encoded bytes to linear values
+static float gToLinear[256];
+//! gThreshold[i] is the smallest linear value that is encoded as i+1, so the
+//! encoding of a linear value is the number of thresholds that it is >= to.
+static float gThreshold[255];
+//! the encoding of the start of each of kNumBins equal-sized bins of linear values,
+//! which is used as the starting point for searching the thresholds
+static constexpr int kNumBins = 4096;
+static uint8_t gBinStart[kNumBins];
+
+static void initSRGB ()
+{
+    auto toLinear = [](double c) {
+        return (c <= 0.04045) ? c / 12.92 : std::pow((c + 0.055) / 1.055, 2.4);
+    };
+    for (int i = 0;  i < 256;  i++) {
+        gToLinear[i] = float(toLinear(double(i) / 255.0));
+    }
+    for (int i = 0;  i < 255;  i++) {
+        gThreshold[i] = float(toLinear((double(i) + 0.5) / 255.0));
+    }
+    int v = 0;
+    for (int i = 0;  i < kNumBins;  i++) {
+        float c = float(i) / float(kNumBins);
+        while ((v < 255) && (c >= gThreshold[v])) {
+            v++;
+        }
+        gBinStart[i] = v;
+    }
+}
+
+inline uint8_t toByte (float v)
+{
+    return static_cast<uint8_t>(std::clamp(std::lround(v * 255.0f), 0L, 255L));
+}
+
+inline uint8_t fromLinear (float c)
+{
+  // the bins are narrower than the gaps between the thresholds, so this loop only
+  // takes a step or two; the result is the same as rounding the sRGB encoding of c,
+  // but is much faster than computing it
+    int bin = std::clamp(int(c * float(kNumBins)), 0, kNumBins - 1);
+    int v = gBinStart[bin];
+    while ((v < 255) && (c >= gThreshold[v])) {
+        v++;
+    }
+    return static_cast<uint8_t>(v);
+}
+
+// convert a row of RGBA8 pixels to linear RGBA floats
+static void decodeRow (const uint8_t *src, uint32_t wid, bool normals, float *dst)
+{
+    for (uint32_t i = 0;  i < 4 * wid;  i += 4) {
+        for (int c = 0;  c < 3;  c++) {
+            dst[i+c] = normals
+                ? float(src[i+c]) * (2.0f / 255.0f) - 1.0f
+                : gToLinear[src[i+c]];
+        }
+        dst[i+3] = float(src[i+3]) * (1.0f / 255.0f);
+    }
+}
+
+// convert a row of linear RGBA floats to RGBA8 pixels
+static void encodeRow (const float *src, uint32_t wid, bool normals, uint8_t *dst)
+{
+    for (uint32_t i = 0;  i < 4 * wid;  i += 4) {
+        if (normals) {
+            float x = src[i], y = src[i+1], z = src[i+2];
+            float len = std::sqrt(x*x + y*y + z*z);
+            if (len < 1.0e-6f) {
+                x = y = 0.0f;
+                z = len = 1.0f;
+            }
+            float s = 0.5f / len;
+            dst[i] = toByte (x * s + 0.5f);
+            dst[i+1] = toByte (y * s + 0.5f);
+            dst[i+2] = toByte (z * s + 0.5f);
+        } else {
+            dst[i] = fromLinear (src[i]);
+            dst[i+1] = fromLinear (src[i+1]);
+            dst[i+2] = fromLinear (src[i+2]);
+        }
+        dst[i+3] = toByte (src[i+3]);
+    }
+}
+
+/***** Filtering *****/
+
+// In the following functions, a pixel is four consecutive floats, which is one SSE
+// register.
+
+// dst[i] += w * src[i] for n pixels
+static void accumulate (float *dst, const float *src, float w, size_t n)
+{
+#if defined(__SSE2__)
+    __m128 vw = _mm_set1_ps(w);
+    for (size_t i = 0;  i < 4 * n;  i += 4) {
+        _mm_storeu_ps (dst + i,
+            _mm_add_ps(_mm_loadu_ps(dst + i), _mm_mul_ps(vw, _mm_loadu_ps(src + i))));
+    }
+#else
+    for (size_t i = 0;  i < 4 * n;  i++) {
+        dst[i] += w * src[i];
+    }
+#endif
+}
+
+// the average of each 2x2 block of pixels from two rows of wid pixels (wid is even)
+static void box2x2 (const float *a, const float *b, uint32_t wid, float *dst)
+{
+#if defined(__SSE2__)
+    __m128 quarter = _mm_set1_ps(0.25f);
+    for (uint32_t x = 0;  x < wid;  x += 2, a += 8, b += 8, dst += 4) {
+        __m128 s = _mm_add_ps(
+            _mm_add_ps(_mm_loadu_ps(a), _mm_loadu_ps(a + 4)),
+            _mm_add_ps(_mm_loadu_ps(b), _mm_loadu_ps(b + 4)));
+        _mm_storeu_ps (dst, _mm_mul_ps(s, quarter));
+    }
+#else
+    for (uint32_t x = 0;  x < wid;  x += 2, a += 8, b += 8, dst += 4) {
+        for (int c = 0;  c < 4;  c++) {
+            dst[c] = 0.25f * (a[c] + a[c+4] + b[c] + b[c+4]);
+        }
+    }
+#endif
+}
+
+//! the weights for resampling a row (or column) of srcSize pixels to dstSize pixels.
+//! Output pixel i is the weighted sum of the count[i] input pixels starting at
+//! first[i]; the weights of each output pixel sum to one.
+struct Resampler {
+    std::vector<uint32_t> first;
+    std::vector<uint32_t> count;
+    std::vector<uint32_t> wOffset;      //!< offset of the output pixel's weights
+    std::vector<float> weights;
+
+    Resampler (uint32_t srcSize, uint32_t dstSize, bool lanczos);
+
+    //! resample a row of pixels
+    void apply (const float *src, float *dst) const
+    {
+        for (size_t i = 0;  i < this->first.size();  i++) {
+            const float *w = &this->weights[this->wOffset[i]];
+            const float *p = src + 4 * size_t(this->first[i]);
+#if defined(__SSE2__)
+            __m128 acc = _mm_setzero_ps();
+            for (uint32_t k = 0;  k < this->count[i];  k++, p += 4) {
+                acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(w[k]), _mm_loadu_ps(p)));
+            }
+            _mm_storeu_ps (dst + 4 * i, acc);
+#else
+            float acc[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+            for (uint32_t k = 0;  k < this->count[i];  k++, p += 4) {
+                for (int c = 0;  c < 4;  c++) {
+                    acc[c] += w[k] * p[c];
+                }
+            }
+            std::memcpy (dst + 4 * i, acc, sizeof(acc));
+#endif
+        }
+    }
+};
+
+// the Lanczos-3 kernel
+static double lanczos3 (double t)
+{
+    t = std::abs(t);
+    if (t < 1.0e-8) {
+        return 1.0;
+    } else if (t >= 3.0) {
+        return 0.0;
+    }
+    double pt = M_PI * t;
+    return 3.0 * std::sin(pt) * std::sin(pt / 3.0) / (pt * pt);
+}
+
+// The filters are scaled by the ratio of the sizes when minifying.  The box filter
+// weights a source pixel by how much of it is covered by the output pixel, so the
+// identity resampling and downsampling by an integer factor are exact.  Samples
+// outside the image are dropped and the remaining weights are renormalized.
+Resampler::Resampler (uint32_t srcSize, uint32_t dstSize, bool lanczos)
+    : first(dstSize), count(dstSize), wOffset(dstSize)
+{
+    double scale = double(srcSize) / double(dstSize);
+    double fScale = std::max(scale, 1.0);
+    double radius = lanczos ? 3.0 * fScale : 0.5 * fScale;
+    for (uint32_t i = 0;  i < dstSize;  i++) {
+        double center = (double(i) + 0.5) * scale;
+        int lo = std::max(0, int(std::floor(center - radius)));
+        int hi = std::min(int(srcSize) - 1, int(std::ceil(center + radius)) - 1);
+        std::vector<double> w;
+        double sum = 0.0;
+        for (int j = lo;  j <= hi;  j++) {
+            double wj;
+            if (lanczos) {
+                wj = lanczos3 ((double(j) + 0.5 - center) / fScale);
+            } else {
+                wj = std::min(double(j + 1), center + radius)
+                    - std::max(double(j), center - radius);
+            }
+            w.push_back (wj);
+            sum += wj;
+        }
+      // trim (nearly) zero weights from the ends
+        int a = 0, b = int(w.size());
+        while ((a < b - 1) && (std::abs(w[a]) < 1.0e-9)) a++;
+        while ((b - 1 > a) && (std::abs(w[b-1]) < 1.0e-9)) b--;
+        this->first[i] = lo + a;
+        this->count[i] = b - a;
+        this->wOffset[i] = this->weights.size();
+        for (int k = a;  k < b;  k++) {
+            this->weights.push_back (float(w[k] / sum));
+        }
+    }
+}
+
+/***** PNG input *****/
+
+//! Reads the rows of a PNG file one at a time as RGBA8 pixels
+class PNGReader {
+  public:
+    explicit PNGReader (std::string const &file);
+    ~PNGReader ();
+
+    bool isValid () const { return (this->_png != nullptr); }
+    uint32_t width () const { return this->_wid; }
+    uint32_t height () const { return this->_ht; }
+
+    //! read the next row into a buffer of 4*width() bytes
+    bool readRow (uint8_t *row);
+
+  private:
+    FILE *_inF;
+    png_structp _png;
+    png_infop _info;
+    uint32_t _wid;
+    uint32_t _ht;
+};
+
+PNGReader::PNGReader (std::string const &file)
+    : _inF(nullptr), _png(nullptr), _info(nullptr), _wid(0), _ht(0)
+{
+    this->_inF = std::fopen (file.c_str(), "rb");
+    if (this->_inF == nullptr) {
+        std::cerr << "tqt-build: unable to open \"" << file << "\"\n";
+        return;
+    }
+    png_byte sig[8];
+    if ((std::fread (sig, 1, 8, this->_inF) != 8) || png_sig_cmp(sig, 0, 8)) {
+        std::cerr << "tqt-build: \"" << file << "\" is not a PNG file\n";
+        return;
+    }
+
+    png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, 0, 0, 0);
+    png_infop info = (png == nullptr) ? nullptr : png_create_info_struct(png);
+    if (info == nullptr) {
+        png_destroy_read_struct (&png, nullptr, nullptr);
+        return;
+    }
+    if (setjmp (png_jmpbuf(png))) {
+        std::cerr << "tqt-build: error reading \"" << file << "\"\n";
+        png_destroy_read_struct (&png, &info, nullptr);
+        return;
+    }
+    png_init_io (png, this->_inF);
+    png_set_sig_bytes (png, 8);
+    png_read_info (png, info);
+
+    if (png_get_interlace_type(png, info) != PNG_INTERLACE_NONE) {
+      // interlaced images cannot be read one row at a time
+        std::cerr << "tqt-build: interlaced PNG files are not supported\n";
+        png_destroy_read_struct (&png, &info, nullptr);
+        return;
+    }
+
+  // convert all pixels to RGBA8
+    png_set_expand (png);
+    png_set_strip_16 (png);
+    png_set_gray_to_rgb (png);
+    png_set_add_alpha (png, 0xff, PNG_FILLER_AFTER);
+    png_read_update_info (png, info);
+
+    this->_wid = png_get_image_width(png, info);
+    this->_ht = png_get_image_height(png, info);
+    this->_png = png;
+    this->_info = info;
+}
+
+PNGReader::~PNGReader ()
+{
+    if (this->_png != nullptr) {
+        png_destroy_read_struct (&this->_png, &this->_info, nullptr);
+    }
+    if (this->_inF != nullptr) {
+        std::fclose (this->_inF);
+    }
+}
+
+bool PNGReader::readRow (uint8_t *row)
+{
+    if (setjmp (png_jmpbuf(this->_png))) {
+        return false;
+    }
+    png_read_row (this->_png, row, nullptr);
+    return true;
+}
+
+/***** Building the tree *****/
+
+//! Builds the levels of the tree from the rows of the finest level, which are added
+//! from north to south.  Each level holds one strip of tiles; when a strip is full,
+//! its tiles are handed to the worker pool to be encoded.
+class Builder {
+  public:
+    Builder (tqt::Writer &writer, WorkerPool &pool, bool normals);
+
+    //! add the next row of the given level (as linear values)
+    void addRow (uint32_t level, const float *row);
+
+    //! wait for the encoding to finish; returns false if there were any errors
+    bool finish ();
+
+    //! the number of tiles that have been encoded
+    size_t nTiles () const { return this->_nTiles.load(); }
+
+  private:
+    struct Level {
+        uint32_t wid;                   //!< the width of the level in pixels
+        std::vector<float> pending;     //!< an even row waiting for the next row
+        bool hasPending;                //!< is there a pending row?
+        std::vector<float> half;        //!< the next coarser row
+        std::vector<uint8_t> strip;     //!< the RGBA8 pixels of the current strip
+        uint32_t nRows;                 //!< the number of rows in the strip
+        uint32_t tileRow;               //!< the tile row of the strip
+    };
+
+    tqt::Writer &_writer;
+    WorkerPool &_pool;
+    bool _normals;
+    uint32_t _tileSize;
+    std::vector<Level> _levels;
+    std::atomic<size_t> _pendingBytes;  //!< tile data waiting to be encoded
+    std::atomic<size_t> _nTiles;        //!< the number of tiles encoded
+    std::atomic<bool> _failed;          //!< set if a tile could not be added
+
+    void _flushStrip (uint32_t level);
+};
+
+Builder::Builder (tqt::Writer &writer, WorkerPool &pool, bool normals)
+    : _writer(writer), _pool(pool), _normals(normals), _tileSize(writer.tileSize()),
+      _levels(writer.depth()), _pendingBytes(0), _nTiles(0), _failed(false)
+{
+    for (uint32_t lvl = 0;  lvl < writer.depth();  lvl++) {
+        Level &l = this->_levels[lvl];
+        l.wid = this->_tileSize << lvl;
+        l.pending.resize (4 * size_t(l.wid));
+        l.hasPending = false;
+        l.half.resize (2 * size_t(l.wid));
+        l.strip.resize (4 * size_t(l.wid) * this->_tileSize);
+        l.nRows = 0;
+        l.tileRow = 0;
+    }
+}
+
+void Builder::addRow (uint32_t level, const float *row)
+{
+    Level &l = this->_levels[level];
+
+    encodeRow (row, l.wid, this->_normals, &l.strip[4 * size_t(l.wid) * l.nRows]);
+    if (++l.nRows == this->_tileSize) {
+        this->_flushStrip (level);
+    }
+
+    if (level > 0) {
+        if (! l.hasPending) {
+            std::memcpy (l.pending.data(), row, l.pending.size() * sizeof(float));
+            l.hasPending = true;
+        } else {
+            box2x2 (l.pending.data(), row, l.wid, l.half.data());
+            l.hasPending = false;
+            this->addRow (level - 1, l.half.data());
+        }
+    }
+}
+
+void Builder::_flushStrip (uint32_t level)
+{
+    Level &l = this->_levels[level];
+    size_t rowBytes = 4 * size_t(l.wid);
+    size_t tileRowBytes = 4 * size_t(this->_tileSize);
+    size_t tileBytes = tileRowBytes * this->_tileSize;
+
+  // limit the amount of memory used by tiles that are waiting to be encoded
+    if (this->_pendingBytes.load() > kMaxPendingBytes) {
+        this->_pool.wait ();
+    }
+
+    uint32_t nCols = l.wid / this->_tileSize;
+    for (uint32_t col = 0;  col < nCols;  col++) {
+        std::shared_ptr<std::vector<uint8_t>> tile =
+            std::make_shared<std::vector<uint8_t>>(tileBytes);
+        for (uint32_t r = 0;  r < this->_tileSize;  r++) {
+            std::memcpy (
+                tile->data() + r * tileRowBytes,
+                l.strip.data() + r * rowBytes + col * tileRowBytes,
+                tileRowBytes);
+        }
+        this->_pendingBytes += tileBytes;
+        int row = l.tileRow;
+        this->_pool.submit ([this, level, row, col, tile, tileBytes]() {
+            if (! this->_writer.addImage (level, row, col, tile->data())) {
+                this->_failed = true;
+            }
+            this->_pendingBytes -= tileBytes;
+            this->_nTiles++;
+        });
+    }
+
+    l.nRows = 0;
+    l.tileRow++;
+}
+
+bool Builder::finish ()
+{
+    this->_pool.wait ();
+    return ! this->_failed.load();
+}
+
+int main (int argc, char *argv[])
+{
+    bool normals = false;
+    bool useQOI = false;
+    bool lanczos = false;
+    unsigned int nThreads = std::max(1u, std::thread::hardware_concurrency());
+    int argi = 1;
+    if ((argc > 1) && (strcmp(argv[1], "-h") == 0)) {
+        usage (EXIT_SUCCESS);
+    }
+    for (;  (argi < argc) && (argv[argi][0] == '-');  argi++) {
+        if (strcmp(argv[argi], "-data") == 0) {
+            normals = true;
+        } else if (strcmp(argv[argi], "-qoi") == 0) {
+            useQOI = true;
+        } else if (strcmp(argv[argi], "-lanczos") == 0) {
+            lanczos = true;
+        } else if ((strcmp(argv[argi], "-j") == 0) && (argi + 1 < argc)) {
+            int n = atoi(argv[++argi]);
+            if (n < 1) {
+                usage (EXIT_FAILURE);
+            }
+            nThreads = n;
+        } else {
+            usage (EXIT_FAILURE);
+        }
+    }
+    if (argc - argi != 4) {
+        usage (EXIT_FAILURE);
+    }
+    std::string srcFile = argv[argi];
+    int depth = atoi(argv[argi+1]);
+    int tileSize = atoi(argv[argi+2]);
+    std::string dstFile = argv[argi+3];
+    if ((depth < 1) || (depth > 16) || (tileSize < 1) || ((tileSize & (tileSize - 1)) != 0)) {
+        std::cerr << "tqt-build: the depth must be in 1..16 and the tile size must be "
+            << "a power of 2\n";
+        return EXIT_FAILURE;
+    }
+    uint32_t size = uint32_t(tileSize) << (depth - 1);
+
+    PNGReader src(srcFile);
+    if (! src.isValid()) {
+        return EXIT_FAILURE;
+    }
+    initSRGB ();
+
+    tqt::Writer writer(
+        dstFile, depth, tileSize,
+        useQOI ? tqt::Format::QOI : tqt::Format::PNG,
+        ! normals);
+    if (! writer.isValid()) {
+        return EXIT_FAILURE;
+    }
+    WorkerPool pool(nThreads);
+    Builder builder(writer, pool, normals);
+
+    auto t0 = std::chrono::steady_clock::now();
+
+  // resample the source to the finest level.  We resample each source row
+  // horizontally as it is read and keep a window of the rows that are needed
+  // for the vertical filter of the current output row.
+    Resampler hFilter(src.width(), size, lanczos);
+    Resampler vFilter(src.height(), size, lanczos);
+    std::vector<uint8_t> srcRow(4 * size_t(src.width()));
+    std::vector<float> linRow(4 * size_t(src.width()));
+    std::deque<std::vector<float>> window;
+    uint32_t windowFirst = 0;           // the source row of window.front()
+    uint32_t nRead = 0;                 // the number of source rows read so far
+    std::vector<float> outRow(4 * size_t(size));
+    for (uint32_t y = 0;  y < size;  y++) {
+        uint32_t lo = vFilter.first[y];
+        uint32_t hi = lo + vFilter.count[y];
+        while (nRead < hi) {
+            if (! src.readRow (srcRow.data())) {
+                std::cerr << "tqt-build: error reading \"" << srcFile << "\"\n";
+                builder.finish ();
+                return EXIT_FAILURE;
+            }
+            decodeRow (srcRow.data(), src.width(), normals, linRow.data());
+            window.emplace_back (4 * size_t(size));
+            hFilter.apply (linRow.data(), window.back().data());
+            nRead++;
+        }
+        while (windowFirst < lo) {
+            window.pop_front ();
+            windowFirst++;
+        }
+        std::fill (outRow.begin(), outRow.end(), 0.0f);
+        const float *w = &vFilter.weights[vFilter.wOffset[y]];
+        for (uint32_t k = 0;  k < vFilter.count[y];  k++) {
+            accumulate (outRow.data(), window[lo + k - windowFirst].data(), w[k], size);
+        }
+        builder.addRow (depth - 1, outRow.data());
+    }
+
+    if (! builder.finish() || ! writer.finish()) {
+        std::cerr << "tqt-build: error writing \"" << dstFile << "\"\n";
+        return EXIT_FAILURE;
+    }
+    auto t1 = std::chrono::steady_clock::now();
+
+  // check that the result can be loaded
+    tqt::TextureQTree tree(dstFile, false, ! normals);
+    if (! tree.isValid() || (tree.depth() != depth) || (tree.tileSize() != tileSize)) {
+        std::cerr << "tqt-build: unable to read back \"" << dstFile << "\"\n";
+        return EXIT_FAILURE;
+    }
+
+    double secs = std::chrono::duration<double>(t1 - t0).count();
+    std::cout << srcFile << " (" << src.width() << "x" << src.height() << ") -> "
+        << dstFile << ": depth " << depth << ", " << builder.nTiles() << " tiles of "
+        << tileSize << "x" << tileSize << ", " << (useQOI ? "QOI" : "PNG") << ", "
+        << (lanczos ? "Lanczos-3" : "box") << " filter\n";
+    std::cout << "  " << secs << " seconds with " << pool.numThreads() << " threads ("
+        << double(size) * double(size) * 4.0e-6 / secs << " MB/s of finest level)\n";
+
+    return EXIT_SUCCESS;
+}
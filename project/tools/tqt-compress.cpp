@@ -0,0 +1,347 @@
+/*! \file tqt-compress.cpp
+ *
+ * \author John Reppy
+ *
+ * A tool for converting version 1 texture quadtrees (PNG tiles) to version 2.  By
+ * default, the tiles are block compressed with complete mipmap chains: color trees
+ * are encoded as BC1, or as BC3 if any of their pixels are not opaque; normal-map
+ * trees are encoded as BC5, which only stores the X and Y components, so shaders that
+ * sample them must reconstruct Z as sqrt(1 - x^2 - y^2).  With the "-qoi" option,
+ * the tiles are encoded with the lossless QOI codec instead, which is much faster to
+ * decode than PNG.  After writing the output, the tool decodes both trees and reports
+ * the error, the sizes, and the decode throughput.
+ *
+ * usage: tqt-compress [-data] [-qoi] <src-tqt> <dst-tqt>
+ */
+
+/* CMSC23700 Final Project sample code (Autumn 2022)
+ *
+ * COPYRIGHT (c) 2022 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#include "cs237.hpp"
+#include "tqt.hpp"
+#include "qoi.hpp"
+#include "bc-encode.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <sys/stat.h>
+
+static void usage (int sts)
+{
+    std::cerr << "usage: tqt-compress [-data] [-qoi] <src-tqt> <dst-tqt>\n";
+    std::cerr << "options:\n";
+    std::cerr << "  -data     the tiles are normal vectors (BC5) instead of sRGB colors\n";
+    std::cerr << "  -qoi      use the lossless QOI codec instead of block compression\n";
+    exit (sts);
+}
+
+static size_t fileSize (std::string const &file)
+{
+    struct stat st;
+    if (stat(file.c_str(), &st) < 0) {
+        return 0;
+    }
+    return static_cast<size_t>(st.st_size);
+}
+
+using ImagePtr = std::unique_ptr<cs237::Image2D>;
+
+/***** Mipmap generation *****/
+
+// conversion between sRGB-encoded and linear values
+static float gToLinear[256];
+
+static void initSRGB ()
+{
+    for (int i = 0;  i < 256;  i++) {
+        float c = float(i) / 255.0f;
+        gToLinear[i] = (c <= 0.04045f) ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+    }
+}
+
+inline uint8_t toByte (float v)
+{
+    return static_cast<uint8_t>(std::clamp(std::lround(v * 255.0f), 0L, 255L));
+}
+
+inline uint8_t fromLinear (float c)
+{
+    c = (c <= 0.0031308f) ? 12.92f * c : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+    return toByte (c);
+}
+
+// compute the next mipmap level of a square RGBA8 image using a 2x2 box filter.  For
+// color images, the filtering is done on linear values; for normal maps, the average
+// vector is renormalized.
+static std::vector<uint8_t> downsample (
+    std::vector<uint8_t> const &src, uint32_t wid, bool normals)
+{
+    uint32_t nWid = std::max(1u, wid / 2);
+    std::vector<uint8_t> dst(4 * size_t(nWid) * nWid);
+    for (uint32_t y = 0;  y < nWid;  y++) {
+        for (uint32_t x = 0;  x < nWid;  x++) {
+            float sum[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+            for (uint32_t k = 0;  k < 4;  k++) {
+                uint32_t sx = std::min(2*x + (k & 1), wid - 1);
+                uint32_t sy = std::min(2*y + (k >> 1), wid - 1);
+                const uint8_t *p = &src[4 * (size_t(sy) * wid + sx)];
+                for (int i = 0;  i < 3;  i++) {
+                    sum[i] += normals
+                        ? float(p[i]) * (2.0f / 255.0f) - 1.0f
+                        : gToLinear[p[i]];
+                }
+                sum[3] += float(p[3]) / 255.0f;
+            }
+            uint8_t *q = &dst[4 * (size_t(y) * nWid + x)];
+            if (normals) {
+                float len = std::sqrt(sum[0]*sum[0] + sum[1]*sum[1] + sum[2]*sum[2]);
+                if (len < 1.0e-6f) {
+                    sum[0] = sum[1] = 0.0f;
+                    sum[2] = len = 1.0f;
+                }
+                for (int i = 0;  i < 3;  i++) {
+                    q[i] = toByte (0.5f * (sum[i] / len + 1.0f));
+                }
+            } else {
+                for (int i = 0;  i < 3;  i++) {
+                    q[i] = fromLinear (0.25f * sum[i]);
+                }
+            }
+            q[3] = toByte (0.25f * sum[3]);
+        }
+    }
+    return dst;
+}
+
+/***** Conversion *****/
+
+// the number of bytes in a compressed tile with all of its mipmap levels
+static size_t tileBytes (tqt::Format fmt, uint32_t tileSize, uint32_t nLevels)
+{
+    size_t blkBytes = (fmt == tqt::Format::BC1) ? 8 : 16;
+    size_t nb = 0;
+    for (uint32_t lvl = 0;  lvl < nLevels;  lvl++) {
+        uint32_t wid = std::max(1u, tileSize >> lvl);
+        nb += size_t((wid + 3) / 4) * size_t((wid + 3) / 4) * blkBytes;
+    }
+    return nb;
+}
+
+// the PSNR in dB for a sum of squared errors over n samples
+static double psnr (double sse, size_t n)
+{
+    if (sse == 0.0) {
+        return std::numeric_limits<double>::infinity();
+    }
+    double mse = sse / double(n);
+    return 10.0 * std::log10((255.0 * 255.0) / mse);
+}
+
+int main (int argc, char *argv[])
+{
+    bool normals = false;
+    bool useQOI = false;
+    int argi = 1;
+    if ((argc > 1) && (strcmp(argv[1], "-h") == 0)) {
+        usage (EXIT_SUCCESS);
+    }
+    for (;  (argi < argc) && (argv[argi][0] == '-');  argi++) {
+        if (strcmp(argv[argi], "-data") == 0) {
+            normals = true;
+        } else if (strcmp(argv[argi], "-qoi") == 0) {
+            useQOI = true;
+        } else {
+            usage (EXIT_FAILURE);
+        }
+    }
+    if (argc - argi != 2) {
+        usage (EXIT_FAILURE);
+    }
+    std::string srcFile = argv[argi];
+    std::string dstFile = argv[argi+1];
+
+  // we load the tiles without flipping, since the compressed tiles are stored in the
+  // same orientation as the PNG images
+    tqt::TextureQTree src(srcFile, false, ! normals);
+    if (! src.isValid()) {
+        return EXIT_FAILURE;
+    }
+    if (src.format() != tqt::Format::PNG) {
+        std::cerr << "tqt-compress: \"" << srcFile << "\" is already converted\n";
+        return EXIT_FAILURE;
+    }
+    initSRGB ();
+
+    uint32_t depth = src.depth();
+    uint32_t tileSize = src.tileSize();
+    uint32_t nLevels = 1;
+    while (! useQOI && ((tileSize >> nLevels) > 0)) {
+        nLevels++;
+    }
+    if (tileSize < 4) {
+        std::cerr << "tqt-compress: tile size " << tileSize << " is too small\n";
+        return EXIT_FAILURE;
+    }
+
+  // load a tile of the source as RGBA8 data; exits on error
+    auto loadTile = [&](int level, int row, int col) -> ImagePtr {
+        ImagePtr img(src.loadImage (level, row, col));
+        if ((img == nullptr) || (img->type() != cs237::ChannelTy::U8)) {
+            std::cerr << "tqt-compress: unable to load tile (" << level << ", "
+                << row << ", " << col << ") of \"" << srcFile << "\"\n";
+            exit (EXIT_FAILURE);
+        }
+        return img;
+    };
+
+  // pick the format; for color trees, we need to check if there is any transparency
+    tqt::Format fmt = useQOI ? tqt::Format::QOI : tqt::Format::BC5;
+    if (! useQOI && ! normals) {
+        fmt = tqt::Format::BC1;
+        for (uint32_t level = 0;  (level < depth) && (fmt == tqt::Format::BC1);  level++) {
+            for (int row = 0;  row < (1 << level);  row++) {
+                for (int col = 0;  col < (1 << level);  col++) {
+                    ImagePtr img = loadTile (level, row, col);
+                    const uint8_t *p = static_cast<const uint8_t *>(img->data());
+                    for (size_t i = 3;  i < img->nBytes();  i += 4) {
+                        if (p[i] != 255) {
+                            fmt = tqt::Format::BC3;
+                            break;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+  // the header and TOC; the tiles are stored in the same order as the TOC.  Since
+  // QOI tiles vary in size, we write the TOC after the tiles have been written.
+    size_t nTiles = ((size_t(1) << (2 * depth)) - 1) / 3;
+    size_t cTileBytes = useQOI ? 0 : tileBytes (fmt, tileSize, nLevels);
+    tqt::FileHdrV2 hdr;
+    hdr.hdr.magic = tqt::kMagic;
+    hdr.hdr.version = tqt::kVersionBC;
+    hdr.hdr.depth = depth;
+    hdr.hdr.tileSize = tileSize;
+    hdr.format = static_cast<uint32_t>(fmt);
+    hdr.nLevels = nLevels;
+    std::vector<uint64_t> toc(nTiles);
+    uint64_t offset = sizeof(hdr) + nTiles * sizeof(uint64_t);
+
+  // write to a temporary file and then rename it
+    std::string tmpFile = dstFile + ".tmp";
+    std::ofstream outS(tmpFile, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (outS.fail()) {
+        std::cerr << "tqt-compress: unable to open \"" << tmpFile << "\"\n";
+        return EXIT_FAILURE;
+    }
+    outS.write (reinterpret_cast<const char *>(&hdr), sizeof(hdr));
+    outS.write (reinterpret_cast<const char *>(toc.data()), nTiles * sizeof(uint64_t));
+
+    std::vector<uint8_t> tile(cTileBytes);
+    size_t tileIdx = 0;
+    for (uint32_t level = 0;  level < depth;  level++) {
+        for (int row = 0;  row < (1 << level);  row++) {
+            for (int col = 0;  col < (1 << level);  col++) {
+                ImagePtr img = loadTile (level, row, col);
+                const uint8_t *p = static_cast<const uint8_t *>(img->data());
+                if (useQOI) {
+                    tile = qoi::encode (p, tileSize, tileSize, ! normals);
+                } else {
+                    std::vector<uint8_t> pixels(p, p + img->nBytes());
+                    uint8_t *blocks = tile.data();
+                    uint32_t wid = tileSize;
+                    for (uint32_t lvl = 0;  lvl < nLevels;  lvl++) {
+                        if (lvl > 0) {
+                            pixels = downsample (pixels, wid, normals);
+                            wid = std::max(1u, wid / 2);
+                        }
+                        bcenc::encodeImage (fmt, wid, wid, pixels.data(), blocks);
+                        blocks += tileBytes (fmt, wid, 1);
+                    }
+                }
+                outS.write (reinterpret_cast<const char *>(tile.data()), tile.size());
+                toc[tileIdx++] = offset;
+                offset += tile.size();
+            }
+        }
+    }
+    outS.seekp (sizeof(hdr));
+    outS.write (reinterpret_cast<const char *>(toc.data()), nTiles * sizeof(uint64_t));
+    outS.close();
+    if (outS.fail() || (std::rename(tmpFile.c_str(), dstFile.c_str()) != 0)) {
+        std::cerr << "tqt-compress: error writing \"" << dstFile << "\"\n";
+        std::remove (tmpFile.c_str());
+        return EXIT_FAILURE;
+    }
+
+  // check the result by decoding the base level of every tile and comparing it
+  // with the source; we also time the decoding of both trees
+    tqt::TextureQTree dst(dstFile, false, ! normals);
+    if (! dst.isValid() || (dst.format() != fmt)) {
+        std::cerr << "tqt-compress: unable to read back \"" << dstFile << "\"\n";
+        return EXIT_FAILURE;
+    }
+    double sse = 0.0;
+    size_t nSamples = 0;
+    double srcSecs = 0.0, dstSecs = 0.0;
+    for (uint32_t level = 0;  level < depth;  level++) {
+        for (int row = 0;  row < (1 << level);  row++) {
+            for (int col = 0;  col < (1 << level);  col++) {
+                auto t0 = std::chrono::steady_clock::now();
+                ImagePtr a = loadTile (level, row, col);
+                auto t1 = std::chrono::steady_clock::now();
+                ImagePtr b(dst.loadImage (level, row, col));
+                auto t2 = std::chrono::steady_clock::now();
+                srcSecs += std::chrono::duration<double>(t1 - t0).count();
+                dstSecs += std::chrono::duration<double>(t2 - t1).count();
+                if ((b == nullptr) || (b->nBytes() != a->nBytes())) {
+                    std::cerr << "tqt-compress: unable to decode tile (" << level << ", "
+                        << row << ", " << col << ") of \"" << dstFile << "\"\n";
+                    return EXIT_FAILURE;
+                }
+                const uint8_t *pa = static_cast<const uint8_t *>(a->data());
+                const uint8_t *pb = static_cast<const uint8_t *>(b->data());
+                int nChans = ((fmt == tqt::Format::BC3) || useQOI) ? 4 : 3;
+                for (size_t i = 0;  i < a->nBytes();  i += 4) {
+                    for (int c = 0;  c < nChans;  c++) {
+                        double d = double(pa[i+c]) - double(pb[i+c]);
+                        sse += d * d;
+                    }
+                    nSamples += nChans;
+                }
+            }
+        }
+    }
+
+    const char *fmtName = (fmt == tqt::Format::BC1) ? "BC1"
+        : (fmt == tqt::Format::BC3) ? "BC3"
+        : (fmt == tqt::Format::BC5) ? "BC5" : "QOI";
+    std::cout << srcFile << " -> " << dstFile << ": " << nTiles << " tiles, " << fmtName
+        << ", PSNR " << psnr(sse, nSamples) << " dB\n";
+    std::cout << "  file " << fileSize(srcFile) << " -> " << fileSize(dstFile) << " bytes";
+    if (! useQOI) {
+        size_t rgbaBytes = 4 * size_t(tileSize) * tileSize * 4 / 3;
+        std::cout << "; GPU memory per tile " << rgbaBytes << " -> " << cTileBytes
+            << " bytes (RGBA8 with mipmaps vs. compressed)";
+    }
+    double mbytes = double(nTiles) * 4.0 * double(tileSize) * double(tileSize) * 1.0e-6;
+    std::cout << "\n  decode (RGBA8 output): PNG " << mbytes / srcSecs << " MB/s, "
+        << fmtName << " " << mbytes / dstSecs << " MB/s (speedup " << srcSecs / dstSecs
+        << ")\n";
+
+  // the QOI codec is lossless
+    if (useQOI && (sse != 0.0)) {
+        std::cerr << "tqt-compress: QOI tiles do not match the source\n";
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,138 @@
+/*! \file tqt-thread-check.cpp
+ *
+ * \author John Reppy
+ *
+ * A check that `tqt::TextureQTree::loadImage` can be called from multiple threads at
+ * once.  It decodes every tile of a texture quadtree serially and then from a pool
+ * of threads that share the tree, and compares the results.  It also reports the
+ * decode throughput of both.
+ *
+ * usage: tqt-thread-check [-data] <tqt-file> [<n-threads>]
+ */
+
+/* CMSC23700 Final Project sample code (Autumn 2022)
+ *
+ * COPYRIGHT (c) 2022 John Reppy (http://cs.uchicago.edu/~jhr)
+ * All rights reserved.
+ */
+
+#include "cs237.hpp"
+#include "tqt.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+static void usage (int sts)
+{
+    std::cerr << "usage: tqt-thread-check [-data] <tqt-file> [<n-threads>]\n";
+    std::cerr << "options:\n";
+    std::cerr << "  -data     the tiles are data (e.g., normals) instead of sRGB colors\n";
+    exit (sts);
+}
+
+//! the location of a tile in the quadtree
+struct TileId {
+    int level, row, col;
+};
+
+using ImagePtr = std::unique_ptr<cs237::Image2D>;
+
+// are two decoded tiles the same?
+static bool sameImage (ImagePtr const &a, ImagePtr const &b)
+{
+    if ((a == nullptr) || (b == nullptr)) {
+        return (a == nullptr) && (b == nullptr);
+    }
+    return (a->width() == b->width()) && (a->height() == b->height())
+        && (a->channels() == b->channels()) && (a->nBytes() == b->nBytes())
+        && (std::memcmp(a->data(), b->data(), a->nBytes()) == 0);
+}
+
+int main (int argc, char *argv[])
+{
+    bool sRGB = true;
+    int argi = 1;
+    if ((argc > 1) && (strcmp(argv[1], "-h") == 0)) {
+        usage (EXIT_SUCCESS);
+    }
+    if ((argc > 1) && (strcmp(argv[1], "-data") == 0)) {
+        sRGB = false;
+        argi++;
+    }
+    if ((argc - argi < 1) || (argc - argi > 2)) {
+        usage (EXIT_FAILURE);
+    }
+    std::string file = argv[argi];
+    int nThreads = (argc - argi == 2)
+        ? atoi(argv[argi+1])
+        : static_cast<int>(std::max(2u, std::thread::hardware_concurrency()));
+    if (nThreads < 1) {
+        usage (EXIT_FAILURE);
+    }
+
+    tqt::TextureQTree tree(file, true, sRGB);
+    if (! tree.isValid()) {
+        return EXIT_FAILURE;
+    }
+
+    std::vector<TileId> ids;
+    for (int level = 0;  level < tree.depth();  level++) {
+        for (int row = 0;  row < (1 << level);  row++) {
+            for (int col = 0;  col < (1 << level);  col++) {
+                ids.push_back (TileId{level, row, col});
+            }
+        }
+    }
+    size_t nTiles = ids.size();
+
+  // serial decode
+    std::vector<ImagePtr> serial(nTiles);
+    auto t0 = std::chrono::steady_clock::now();
+    for (size_t i = 0;  i < nTiles;  i++) {
+        serial[i].reset (tree.loadImage (ids[i].level, ids[i].row, ids[i].col));
+    }
+    auto t1 = std::chrono::steady_clock::now();
+
+  // parallel decode; the threads take tiles from a shared counter, so neighboring
+  // tiles (which are neighbors in the file) are decoded at the same time
+    std::vector<ImagePtr> parallel(nTiles);
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> threads;
+    auto t2 = std::chrono::steady_clock::now();
+    for (int t = 0;  t < nThreads;  t++) {
+        threads.emplace_back ([&]() {
+            size_t i;
+            while ((i = next.fetch_add(1)) < nTiles) {
+                parallel[i].reset (tree.loadImage (ids[i].level, ids[i].row, ids[i].col));
+            }
+        });
+    }
+    for (auto &th : threads) {
+        th.join();
+    }
+    auto t3 = std::chrono::steady_clock::now();
+
+    size_t nMissing = 0, nMismatch = 0;
+    for (size_t i = 0;  i < nTiles;  i++) {
+        if (serial[i] == nullptr) {
+            nMissing++;
+        }
+        if (! sameImage (serial[i], parallel[i])) {
+            nMismatch++;
+        }
+    }
+
+    double serialMS = std::chrono::duration<double, std::milli>(t1 - t0).count();
+    double parallelMS = std::chrono::duration<double, std::milli>(t3 - t2).count();
+    std::cout << file << ": " << nTiles << " tiles; serial " << serialMS << " ms, "
+        << nThreads << " threads " << parallelMS << " ms (speedup "
+        << serialMS / parallelMS << ")\n";
+    std::cout << "  " << nMissing << " tiles failed to decode; " << nMismatch
+        << " tiles differ from the serial decode\n";
+
+    return ((nMissing == 0) && (nMismatch == 0)) ? EXIT_SUCCESS : EXIT_FAILURE;
+}